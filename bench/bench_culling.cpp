@@ -0,0 +1,96 @@
+/*
+ * Frustum culling throughput of the scalar, SSE and AVX paths of
+ * FrustumCuller, against testing an array of BoundingBoxes one at a time.
+ * CPU only, no window is opened.
+ *   ./bench_culling [numObjects]
+ */
+#include <random>
+#include <vector>
+#include <cstdlib>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "gfx/utils/frustum_culler.h"
+
+#include "bench_utils.h"
+
+using namespace glm;
+using namespace gfx;
+
+static const size_t NUM_RUNS = 200;
+static const size_t WARMUP_RUNS = 10;
+
+static void report(const bench::Stats& stats, size_t numObjects, size_t numVisible) {
+	stats.print();
+	fprintf(stdout, "  %zu culled, %zu visible, %.2f us per 100k objects\n",
+			numObjects - numVisible, numVisible, stats.meanMs() * 1000.0 * 100000.0 / numObjects);
+}
+
+int main(int argc, char** argv) {
+	const size_t numObjects = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+
+	// Objects scattered around a camera looking down -z, about a sixth
+	// of them end up inside the frustum
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> pos(-200.0f, 200.0f);
+	std::uniform_real_distribution<float> size(0.1f, 2.0f);
+
+	std::vector<BoundingBox> boxes;
+	FrustumCuller culler;
+	culler.reserve(numObjects);
+	for(size_t i = 0; i < numObjects; i++) {
+		const vec3 c(pos(rng), pos(rng), pos(rng));
+		const vec3 e(size(rng));
+		boxes.push_back(BoundingBox(c - e, c + e));
+		culler.add(boxes.back());
+	}
+
+	const mat4 proj = perspective(radians(90.0f), 1.0f, 0.5f, 250.0f);
+	const mat4 view = lookAt(vec3(0.0f), vec3(0.0f, 0.0f, -1.0f), vec3(0.0f, 1.0f, 0.0f));
+	const Frustum frustum = Frustum::fromMatrix(proj * view);
+
+	fprintf(stdout, "%zu objects\n", numObjects);
+
+	std::vector<uint32_t> visible;
+	visible.reserve(numObjects);
+
+	bench::Stats aosStats("BoundingBox array, one at a time");
+	size_t numVisible = 0;
+	for(size_t run = 0; run < NUM_RUNS + WARMUP_RUNS; run++) {
+		bench::Timer timer;
+		visible.clear();
+		for(size_t i = 0; i < boxes.size(); i++) {
+			if(frustum.intersects(boxes[i])) {
+				visible.push_back(static_cast<uint32_t>(i));
+			}
+		}
+		if(run >= WARMUP_RUNS) {
+			aosStats.add(timer.elapsedMs());
+		}
+		numVisible = visible.size();
+	}
+	report(aosStats, numObjects, numVisible);
+
+	const struct { FrustumCuller::SimdLevel level; const char* name; } levels[] = {
+		{ FrustumCuller::SimdLevel::SCALAR, "FrustumCuller scalar" },
+		{ FrustumCuller::SimdLevel::SSE, "FrustumCuller SSE (4 wide)" },
+		{ FrustumCuller::SimdLevel::AVX, "FrustumCuller AVX (8 wide)" },
+	};
+	for(const auto& l : levels) {
+		if(!FrustumCuller::isSupported(l.level)) {
+			fprintf(stdout, "%s not supported\n", l.name);
+			continue;
+		}
+
+		bench::Stats stats(l.name);
+		for(size_t run = 0; run < NUM_RUNS + WARMUP_RUNS; run++) {
+			bench::Timer timer;
+			numVisible = culler.cull(frustum, visible, l.level);
+			if(run >= WARMUP_RUNS) {
+				stats.add(timer.elapsedMs());
+			}
+		}
+		report(stats, numObjects, numVisible);
+	}
+}
@@ -0,0 +1,171 @@
+/*
+ * CPU submission cost of drawing many small objects one draw() at a time
+ * versus a single multi-draw indirect DrawBatch.
+ * Can run headless on a software rasterizer, e.g.
+ *   SDL_VIDEODRIVER=offscreen LIBGL_ALWAYS_SOFTWARE=1 ./bench_indirect [numObjects]
+ */
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "etc/sdl_gl_window.h"
+#include "gfx/graphicscontext.h"
+#include "gfx/utils/3dshapes.h"
+#include "gfx/utils/vertex.h"
+
+#include "bench_utils.h"
+
+using namespace glm;
+using namespace gfx;
+
+static const char* BATCH_VERT_SHADER =
+		"#extension GL_ARB_shader_draw_parameters : require\n"
+		"#extension GL_ARB_shader_storage_buffer_object : require\n"
+		"#extension GL_ARB_shading_language_420pack : require\n"
+		"layout(std430, binding = 3) buffer PerDrawData { mat4 modelview[]; };\n"
+		"uniform mat4 std_Projection;\n"
+		"in vec4 in_position;\n"
+		"void main() {\n"
+		"  gl_Position = std_Projection * modelview[gl_DrawIDARB] * in_position;\n"
+		"}\n";
+
+static const char* FRAG_SHADER =
+		"out vec4 fragcolor;\n"
+		"void main() {\n"
+		"  fragcolor = vec4(1.0);\n"
+		"}\n";
+
+static const char* VERT_SHADER =
+		"uniform mat4 std_Modelview;\n"
+		"uniform mat4 std_Projection;\n"
+		"in vec4 in_position;\n"
+		"void main() {\n"
+		"  gl_Position = std_Projection * std_Modelview * in_position;\n"
+		"}\n";
+
+struct IndirectBench : public SDLGLWindow {
+	static const size_t NUM_FRAMES = 100;
+	static const size_t WARMUP_FRAMES = 5;
+
+	typedef Vertex4P Vertex;
+
+	struct DrawData {
+		mat4 modelview;
+	};
+
+	size_t numObjects;
+
+	GraphicsContext* ctx = nullptr;
+	ShaderProgramHandle program, batchProgram;
+
+	std::vector<GBufHandle<Vertex>> objects;
+	GArenaHandle<Vertex> arena;
+	std::vector<ArenaGBufHandle<Vertex>> arenaObjects;
+	DrawBatchHandle<Vertex, DrawData> batch;
+	std::vector<mat4> modelviews;
+
+	bench::Stats drawCpuStats = bench::Stats("draw() per object cpu");
+	bench::Stats drawFrameStats = bench::Stats("draw() per object frame");
+	bench::Stats batchCpuStats = bench::Stats("multi-draw indirect cpu");
+	bench::Stats batchFrameStats = bench::Stats("multi-draw indirect frame");
+
+	size_t frame = 0;
+
+	IndirectBench(size_t n) : SDLGLWindow(512, 512), numObjects(n) {
+		ctx = new GraphicsContext();
+	}
+
+	void setup(SDLGLWindow& w) {
+		program = ctx->makeShaderProgramFromStrings(VERT_SHADER, FRAG_SHADER);
+		batchProgram = ctx->makeShaderProgramFromStrings(BATCH_VERT_SHADER, FRAG_SHADER);
+
+		const mat4 proj = perspective(45.0f, 1.0f, 0.5f, 1000.0f);
+		program->setUniform("std_Projection", proj);
+		batchProgram->setUniform("std_Projection", proj);
+
+		auto cube = detail::cubeData();
+		std::vector<Vertex> verts(cube.size());
+		std::vector<GLuint> inds(cube.size());
+		for(size_t i = 0; i < cube.size(); i++) {
+			verts[i].position() = std::get<0>(cube[i]) * vec4(0.1f, 0.1f, 0.1f, 1.0f);
+			inds[i] = i;
+		}
+
+		arena = ctx->makeGeometryArena<Vertex>(numObjects*verts.size(), numObjects*inds.size());
+		batch = ctx->makeDrawBatch<DrawData>(arena, numObjects);
+
+		const size_t side = static_cast<size_t>(std::ceil(std::sqrt(float(numObjects))));
+		for(size_t i = 0; i < numObjects; i++) {
+			objects.push_back(ctx->makeIndexedGeometryBuffer<Vertex>(verts.size(), inds.size(), verts.data(), inds.data()));
+			arenaObjects.push_back(arena->allocateIndexed(verts.size(), inds.size(), verts.data(), inds.data()));
+
+			const vec3 pos((i % side) * 0.25f - side * 0.125f, (i / side) * 0.25f - side * 0.125f, -side * 0.3f);
+			modelviews.push_back(translate(mat4(1.0), pos));
+		}
+	}
+
+	void draw(SDLGLWindow& w) {
+		const bool batched = frame >= NUM_FRAMES;
+		const size_t phaseFrame = batched ? frame - NUM_FRAMES : frame;
+		const bool measured = phaseFrame >= WARMUP_FRAMES;
+
+		bench::Timer frameTimer;
+		glClear(GL_COLOR_BUFFER_BIT);
+
+		bench::Timer cpuTimer;
+		if(batched) {
+			ctx->setShaderProgram(batchProgram);
+			for(size_t i = 0; i < numObjects; i++) {
+				batch->add(arenaObjects[i], DrawData{modelviews[i]});
+			}
+			ctx->drawBatch(batch);
+			batch->advance();
+		} else {
+			ctx->setShaderProgram(program);
+			for(size_t i = 0; i < numObjects; i++) {
+				program->setUniform("std_Modelview", modelviews[i]);
+				ctx->setGeometryBuffer(objects[i]);
+				ctx->draw();
+			}
+		}
+		const double cpuMs = cpuTimer.elapsedMs();
+
+		glFinish();
+		if(measured) {
+			(batched ? batchCpuStats : drawCpuStats).add(cpuMs);
+			(batched ? batchFrameStats : drawFrameStats).add(frameTimer.elapsedMs());
+		}
+
+		frame += 1;
+		if(frame == 2 * NUM_FRAMES) {
+			close();
+		}
+	}
+
+	void teardown(SDLGLWindow& w) {
+		fprintf(stdout, "%zu objects\n", numObjects);
+		drawCpuStats.print();
+		drawFrameStats.print();
+		fprintf(stdout, "  %.0f draws/sec submitted\n", numObjects / (drawCpuStats.meanMs() / 1000.0));
+		batchCpuStats.print();
+		batchFrameStats.print();
+		fprintf(stdout, "  %.0f draws/sec submitted\n", numObjects / (batchCpuStats.meanMs() / 1000.0));
+
+		objects.clear();
+		arenaObjects.clear();
+		batch.reset();
+		arena.reset();
+		program.reset();
+		batchProgram.reset();
+		delete ctx;
+	}
+};
+
+int main(int argc, char** argv) {
+	const size_t numObjects = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000;
+	IndirectBench b(numObjects);
+	b.mainLoop();
+}
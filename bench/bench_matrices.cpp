@@ -0,0 +1,92 @@
+/*
+ * Batched modelview, modelview projection and normal matrices against
+ * per object glm calls, at every SIMD level the CPU supports, into a packed
+ * array and into 256 byte aligned slots as in a uniform buffer.
+ * CPU only, no window is opened.
+ *   ./bench_matrices [numObjects]
+ */
+#include <random>
+#include <vector>
+#include <cstdlib>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "gfx/utils/matrix_batch.h"
+
+#include "bench_utils.h"
+
+using namespace glm;
+using namespace gfx;
+
+static const size_t NUM_RUNS = 50;
+static const size_t WARMUP_RUNS = 3;
+
+// A common GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+static const size_t ALIGNED_STRIDE = 256;
+
+static const char* simdLevelName(SimdLevel level) {
+	switch(level) {
+	case SimdLevel::SSE:
+		return "SSE";
+	case SimdLevel::AVX:
+		return "AVX";
+	default:
+		return "scalar";
+	}
+}
+
+int main(int argc, char** argv) {
+	const size_t numObjects = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> pos(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> angle(-3.0f, 3.0f);
+	std::vector<mat4> models(numObjects);
+	for(mat4& m : models) {
+		m = rotate(translate(mat4(1.0f), vec3(pos(rng), pos(rng), pos(rng))), angle(rng), vec3(0.0f, 1.0f, 0.0f));
+	}
+	const mat4 view = lookAt(vec3(0.0f, 50.0f, 200.0f), vec3(0.0f), vec3(0.0f, 1.0f, 0.0f));
+	const mat4 proj = perspective(radians(60.0f), 1.0f, 0.1f, 1000.0f);
+
+	std::vector<ObjectMatrices> packed(numObjects);
+	std::vector<char> aligned(numObjects * ALIGNED_STRIDE);
+
+	fprintf(stdout, "%zu objects\n", numObjects);
+
+	bench::Stats glmStats("glm, per object");
+	for(size_t run = 0; run < NUM_RUNS + WARMUP_RUNS; run++) {
+		bench::Timer timer;
+		for(size_t i = 0; i < numObjects; i++) {
+			const mat4 mv = view * models[i];
+			packed[i].modelview = mv;
+			packed[i].modelviewProjection = proj * view * models[i];
+			packed[i].normal = mat4(transpose(inverse(mat3(mv))));
+		}
+		if(run >= WARMUP_RUNS) {
+			glmStats.add(timer.elapsedMs());
+		}
+	}
+	glmStats.print();
+	fprintf(stdout, "  %.1f ns per object\n", glmStats.meanMs() * 1e6 / numObjects);
+
+	for(SimdLevel level : { SimdLevel::SCALAR, SimdLevel::SSE, SimdLevel::AVX }) {
+		if(!isSimdLevelSupported(level)) {
+			continue;
+		}
+
+		for(size_t stride : { sizeof(ObjectMatrices), ALIGNED_STRIDE }) {
+			void* dst = stride == ALIGNED_STRIDE ? static_cast<void*>(aligned.data()) : packed.data();
+			bench::Stats stats(std::string("batch, ") + simdLevelName(level) + ", stride " + std::to_string(stride));
+			for(size_t run = 0; run < NUM_RUNS + WARMUP_RUNS; run++) {
+				bench::Timer timer;
+				computeObjectMatrices(view, proj, models.data(), nullptr, numObjects, dst, stride, level);
+				if(run >= WARMUP_RUNS) {
+					stats.add(timer.elapsedMs());
+				}
+			}
+			stats.print();
+			fprintf(stdout, "  %.1f ns per object\n", stats.meanMs() * 1e6 / numObjects);
+		}
+	}
+}
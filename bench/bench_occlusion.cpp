@@ -0,0 +1,114 @@
+/*
+ * Software occlusion culling: time to rasterize the occluders of a maze of
+ * walls and build the depth pyramid, on one thread and on a ThreadPool, and
+ * time to test the objects which survive frustum culling against it.
+ * CPU only, no window is opened.
+ *   ./bench_occlusion [numObjects] [numThreads]
+ */
+#include <random>
+#include <vector>
+#include <cstdlib>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "gfx/utils/frustum_culler.h"
+#include "gfx/utils/occlusion_culler.h"
+#include "gfx/utils/thread_pool.h"
+
+#include "bench_utils.h"
+
+using namespace glm;
+using namespace gfx;
+
+static const size_t NUM_RUNS = 100;
+static const size_t WARMUP_RUNS = 5;
+
+// Walls on a grid, like the rooms of an indoor level
+static void addWalls(OcclusionCuller& culler, std::mt19937& rng) {
+	std::uniform_int_distribution<int> coin(0, 2);
+	const std::vector<uint32_t> indices = { 0, 1, 2, 0, 2, 3 };
+	for(int i = -10; i <= 10; i++) {
+		for(int j = -10; j <= 10; j++) {
+			const float x = 20.0f * i, z = 20.0f * j;
+			if(coin(rng) == 0) {
+				culler.addOccluder({ vec3(x, 0.0f, z), vec3(x + 20.0f, 0.0f, z),
+						vec3(x + 20.0f, 8.0f, z), vec3(x, 8.0f, z) }, indices);
+			}
+			if(coin(rng) == 0) {
+				culler.addOccluder({ vec3(x, 0.0f, z), vec3(x, 0.0f, z + 20.0f),
+						vec3(x, 8.0f, z + 20.0f), vec3(x, 8.0f, z) }, indices);
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	const size_t numObjects = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+	const size_t numThreads = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 0;
+
+	std::mt19937 rng(1);
+	OcclusionCuller occlusion(256, 128);
+	addWalls(occlusion, rng);
+
+	std::uniform_real_distribution<float> pos(-200.0f, 200.0f);
+	std::uniform_real_distribution<float> height(0.5f, 6.0f);
+	std::uniform_real_distribution<float> size(0.2f, 1.5f);
+	std::vector<BoundingBox> boxes;
+	FrustumCuller frustumCuller;
+	for(size_t i = 0; i < numObjects; i++) {
+		const vec3 c(pos(rng), height(rng), pos(rng));
+		boxes.push_back(BoundingBox(c - vec3(size(rng)), c + vec3(size(rng))));
+		frustumCuller.add(boxes.back());
+	}
+
+	const mat4 proj = perspective(radians(75.0f), 16.0f / 9.0f, 0.1f, 400.0f);
+	const mat4 view = lookAt(vec3(3.0f, 2.0f, 3.0f), vec3(60.0f, 2.0f, -40.0f), vec3(0.0f, 1.0f, 0.0f));
+	const mat4 viewProj = proj * view;
+
+	std::vector<uint32_t> candidates, visible;
+	frustumCuller.cull(Frustum::fromMatrix(viewProj), candidates);
+
+	ThreadPool pool(numThreads);
+	fprintf(stdout, "%zu objects, %zu in the frustum, %zu occluders, %zu threads\n",
+			numObjects, candidates.size(), occlusion.numOccluders(), pool.numThreads());
+
+	bench::Stats serialRender("render, 1 thread");
+	bench::Stats parallelRender("render, pool");
+	bench::Stats serialCull("cull, 1 thread");
+	bench::Stats parallelCull("cull, pool");
+	for(size_t run = 0; run < NUM_RUNS + WARMUP_RUNS; run++) {
+		const bool record = run >= WARMUP_RUNS;
+		bench::Timer timer;
+		occlusion.render(viewProj);
+		if(record) {
+			serialRender.add(timer.elapsedMs());
+		}
+
+		timer.reset();
+		occlusion.render(viewProj, &pool);
+		if(record) {
+			parallelRender.add(timer.elapsedMs());
+		}
+
+		timer.reset();
+		occlusion.cull(boxes, candidates, visible);
+		if(record) {
+			serialCull.add(timer.elapsedMs());
+		}
+
+		timer.reset();
+		occlusion.cull(boxes, candidates, visible, &pool);
+		if(record) {
+			parallelCull.add(timer.elapsedMs());
+		}
+	}
+
+	serialRender.print();
+	parallelRender.print();
+	fprintf(stdout, "  %zu triangles, %zu binned\n", occlusion.stats().numTriangles, occlusion.stats().numBinned);
+	serialCull.print();
+	parallelCull.print();
+	fprintf(stdout, "  %zu of %zu frustum culling survivors occluded\n",
+			candidates.size() - visible.size(), candidates.size());
+}
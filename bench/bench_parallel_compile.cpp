@@ -0,0 +1,119 @@
+/*
+ * Loading many programs: building them one after another, submitting them
+ * all with beginShaderProgramFromStrings() then waiting, and submitting
+ * them then doing other startup work while polling. Every program differs
+ * by a constant so the driver can't share compiles between them. Disable
+ * the driver's own shader cache, e.g.
+ *   MESA_SHADER_CACHE_DISABLE=true ./bench_parallel_compile [numPrograms]
+ */
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+
+#include "etc/sdl_gl_window.h"
+#include "gfx/graphicscontext.h"
+
+#include "bench_utils.h"
+
+using namespace gfx;
+
+static std::string vertexShader(size_t variant) {
+	return "uniform mat4 mvp;\n"
+			"in vec4 in_position;\n"
+			"out vec4 v_color;\n"
+			"void main() {\n"
+			"  vec4 c = vec4(0.0);\n"
+			"  for(int i = 0; i < 16; i++) {\n"
+			"    c += sin(in_position * float(i + " + std::to_string(variant) + "));\n"
+			"  }\n"
+			"  v_color = c;\n"
+			"  gl_Position = mvp * in_position;\n"
+			"}\n";
+}
+
+static std::string fragmentShader(size_t variant) {
+	return "in vec4 v_color;\n"
+			"out vec4 fragcolor;\n"
+			"void main() {\n"
+			"  fragcolor = pow(abs(v_color), vec4(" + std::to_string(1.0 + variant * 0.001) + "));\n"
+			"}\n";
+}
+
+struct ParallelCompileBench : public SDLGLWindow {
+	// Stand in for the rest of startup, e.g. loading assets
+	static constexpr double OTHER_WORK_MS = 100.0;
+
+	size_t numPrograms;
+
+	GraphicsContext* ctx = nullptr;
+
+	ParallelCompileBench(size_t n) : SDLGLWindow(64, 64), numPrograms(n) {
+		ctx = new GraphicsContext();
+	}
+
+	static void otherWork(double ms) {
+		bench::Timer timer;
+		volatile double x = 0.0;
+		while(timer.elapsedMs() < ms) {
+			x = x + std::sqrt(x + 1.0);
+		}
+	}
+
+	double buildSerial(size_t first) {
+		std::vector<ShaderProgramHandle> programs;
+		bench::Timer timer;
+		for(size_t i = first; i < first + numPrograms; i++) {
+			programs.push_back(ctx->makeShaderProgramFromStrings(vertexShader(i), fragmentShader(i)));
+		}
+		otherWork(OTHER_WORK_MS);
+		return timer.elapsedMs();
+	}
+
+	double buildBatched(size_t first, bool poll) {
+		std::vector<ShaderProgramHandle> programs;
+		bench::Timer timer;
+		for(size_t i = first; i < first + numPrograms; i++) {
+			programs.push_back(ctx->beginShaderProgramFromStrings(vertexShader(i), fragmentShader(i)));
+		}
+		if(poll) {
+			// Other work in slices, finishing programs as they complete
+			for(size_t slice = 0; slice < 10; slice++) {
+				otherWork(OTHER_WORK_MS / 10);
+				ctx->pollShaderPrograms();
+			}
+			ctx->finishShaderPrograms();
+		} else {
+			ctx->finishShaderPrograms();
+			otherWork(OTHER_WORK_MS);
+		}
+		return timer.elapsedMs();
+	}
+
+	void setup(SDLGLWindow& w) {
+		const bool parallel = GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+
+		// Fresh variants for every run so no run reuses another's compiles
+		const double serialMs = buildSerial(0);
+		const double batchedMs = buildBatched(numPrograms, false);
+		const double overlappedMs = buildBatched(2 * numPrograms, true);
+
+		fprintf(stdout, "%zu programs plus %.0f ms of other work, parallel shader compile %s\n",
+				numPrograms, OTHER_WORK_MS, parallel ? "supported" : "not supported");
+		fprintf(stdout, "%-40s %9.2f ms\n", "serial build", serialMs);
+		fprintf(stdout, "%-40s %9.2f ms\n", "batched, then other work", batchedMs);
+		fprintf(stdout, "%-40s %9.2f ms\n", "batched, overlapped with other work", overlappedMs);
+		fprintf(stdout, "  speedup %.2fx\n", serialMs / overlappedMs);
+		close();
+	}
+
+	void teardown(SDLGLWindow& w) {
+		delete ctx;
+	}
+};
+
+int main(int argc, char** argv) {
+	const size_t numPrograms = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200;
+	ParallelCompileBench b(numPrograms);
+	b.mainLoop();
+}
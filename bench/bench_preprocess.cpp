@@ -0,0 +1,116 @@
+/*
+ * Preprocessing many shaders sharing an include tree: re-reading and
+ * re-parsing every include for each shader, as building programs one by
+ * one used to, against one ShaderPreprocessor reusing its parsed files.
+ * The tree is generated in a temporary directory. CPU only.
+ *   ./bench_preprocess [numShaders]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "gfx/utils/shader_preprocessor.h"
+
+#include "bench_utils.h"
+
+using namespace utils;
+
+static const size_t NUM_RUNS = 10;
+
+// Shared includes: a definitions file, then libraries all including it
+static const size_t NUM_LIBRARIES = 8;
+static const size_t LIBRARY_FUNCTIONS = 40;
+
+struct IncludeTree {
+	std::string dir;
+	std::vector<std::string> files;
+	std::vector<std::string> shaders;
+
+	IncludeTree(size_t numShaders) {
+		char name[] = "/tmp/bench_preprocess.XXXXXX";
+		if(mkdtemp(name) == nullptr) {
+			perror("mkdtemp");
+			exit(1);
+		}
+		dir = name;
+
+		std::string defs;
+		for(size_t i = 0; i < 64; i++) {
+			defs += "uniform vec4 std_Param" + std::to_string(i) + ";\n";
+		}
+		write("stddefs.glsl", defs);
+
+		for(size_t lib = 0; lib < NUM_LIBRARIES; lib++) {
+			std::string text = "#pragma include \"stddefs.glsl\"\n";
+			if(lib > 0) {
+				text += "#pragma include \"lib" + std::to_string(lib - 1) + ".glsl\"\n";
+			}
+			for(size_t f = 0; f < LIBRARY_FUNCTIONS; f++) {
+				text += "vec4 lib" + std::to_string(lib) + "_f" + std::to_string(f) + "(vec4 x) {\n"
+						"  return x * std_Param" + std::to_string(f) + " + vec4(" + std::to_string(f) + ".0);\n"
+						"}\n";
+			}
+			write("lib" + std::to_string(lib) + ".glsl", text);
+		}
+
+		for(size_t i = 0; i < numShaders; i++) {
+			const std::string text = "#version 330 core\n"
+					"#pragma include \"stddefs.glsl\"\n"
+					"#pragma include \"lib" + std::to_string(i % NUM_LIBRARIES) + ".glsl\"\n"
+					"out vec4 fragcolor;\n"
+					"void main() {\n"
+					"  fragcolor = lib0_f" + std::to_string(i % LIBRARY_FUNCTIONS) + "(vec4(1.0));\n"
+					"}\n";
+			shaders.push_back(write("shader" + std::to_string(i) + ".glsl", text));
+		}
+	}
+
+	~IncludeTree() {
+		for(const std::string& f : files) {
+			unlink(f.c_str());
+		}
+		rmdir(dir.c_str());
+	}
+
+	std::string write(const std::string& name, const std::string& text) {
+		const std::string filename = dir + "/" + name;
+		std::ofstream(filename.c_str(), std::ios::out | std::ios::trunc) << text;
+		files.push_back(filename);
+		return filename;
+	}
+};
+
+int main(int argc, char** argv) {
+	const size_t numShaders = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 500;
+	IncludeTree tree(numShaders);
+
+	size_t outputBytes = 0;
+	bench::Stats uncachedStats("parse every include per shader");
+	bench::Stats cachedStats("shared preprocessor");
+	for(size_t run = 0; run < NUM_RUNS; run++) {
+		ShaderPreprocessor pp;
+		bench::Timer timer;
+		for(const std::string& shader : tree.shaders) {
+			pp.clear();
+			outputBytes = pp.preprocessFile(shader).source.size();
+		}
+		uncachedStats.add(timer.elapsedMs());
+
+		timer.reset();
+		ShaderPreprocessor shared;
+		for(const std::string& shader : tree.shaders) {
+			outputBytes = shared.preprocessFile(shader).source.size();
+		}
+		cachedStats.add(timer.elapsedMs());
+	}
+
+	fprintf(stdout, "%zu shaders, %zu shared includes, ~%zu bytes per preprocessed shader\n",
+			numShaders, NUM_LIBRARIES + 1, outputBytes);
+	uncachedStats.print();
+	cachedStats.print();
+	fprintf(stdout, "  speedup %.2fx\n", uncachedStats.meanMs() / cachedStats.meanMs());
+}
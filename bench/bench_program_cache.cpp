@@ -0,0 +1,114 @@
+/*
+ * Startup cost of building the repo's shader programs: compiling every
+ * program from source, a cold binary cache (compile, then store each
+ * binary) and a warm one (load every program with glProgramBinary).
+ * Disable the driver's own shader cache to measure compiles honestly, e.g.
+ *   MESA_SHADER_CACHE_DISABLE=true ./bench_program_cache [cacheDir]
+ */
+#include <dirent.h>
+#include <unistd.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "etc/sdl_gl_window.h"
+#include "gfx/graphicscontext.h"
+
+#include "bench_utils.h"
+
+using namespace gfx;
+
+static const std::vector<std::pair<std::string, std::string>> PROGRAMS = {
+	{ "phong_vertex.glsl", "phong_frag.glsl" },
+	{ "phong_vertex.glsl", "physical_frag.glsl" },
+	{ "phong_per_draw_vert.glsl", "physical_frag.glsl" },
+	{ "phong_instanced_vert.glsl", "phong_frag.glsl" },
+	{ "solid_color_vert.glsl", "solid_color_frag.glsl" },
+	{ "draw_lights_vert.glsl", "draw_lights_frag.glsl" },
+	{ "cubemap_vert.glsl", "cubemap_frag.glsl" },
+};
+
+struct ProgramCacheBench : public SDLGLWindow {
+	static const size_t NUM_ROUNDS = 5;
+
+	std::string cacheDir;
+
+	GraphicsContext* ctx = nullptr;
+
+	bench::Stats sourceStats = bench::Stats("compile from source");
+	bench::Stats coldStats = bench::Stats("cold cache (compile + store)");
+	bench::Stats warmStats = bench::Stats("warm cache (load binaries)");
+
+	ProgramCacheBench(const std::string& dir) : SDLGLWindow(64, 64), cacheDir(dir) {
+		ctx = new GraphicsContext();
+	}
+
+	void clearCache() {
+		DIR* dir = opendir(cacheDir.c_str());
+		if(dir == nullptr) {
+			return;
+		}
+		while(dirent* entry = readdir(dir)) {
+			const std::string name = entry->d_name;
+			if(name.size() > 4 && name.compare(name.size() - 4, 4, ".bin") == 0) {
+				unlink((cacheDir + "/" + name).c_str());
+			}
+		}
+		closedir(dir);
+	}
+
+	double buildAll() {
+		std::vector<ShaderProgramHandle> programs;
+		bench::Timer timer;
+		for(const auto& p : PROGRAMS) {
+			programs.push_back(ctx->makeShaderProgramFromFiles("gfx/shaders/" + p.first, "gfx/shaders/" + p.second));
+		}
+		glFinish();
+		return timer.elapsedMs();
+	}
+
+	void setup(SDLGLWindow& w) {
+		ctx->addShaderProgramIncludeDir("gfx/shaders/glsl330");
+
+		// Fresh cache objects every time so no state carries over but the files
+		size_t hits = 0, rejected = 0;
+		bool supported = false;
+		for(size_t i = 0; i < NUM_ROUNDS; i++) {
+			sourceStats.add(buildAll());
+
+			clearCache();
+			ctx->enableProgramBinaryCache(cacheDir);
+			coldStats.add(buildAll());
+
+			ctx->enableProgramBinaryCache(cacheDir);
+			warmStats.add(buildAll());
+			supported = ctx->programBinaryCache()->isSupported();
+			hits += ctx->programBinaryCache()->stats().hits;
+			rejected += ctx->programBinaryCache()->stats().rejected;
+
+			ctx->disableProgramBinaryCache();
+		}
+
+		fprintf(stdout, "%zu programs, binary cache %s\n", PROGRAMS.size(),
+				supported ? "supported" : "not supported by the driver");
+		sourceStats.print();
+		coldStats.print();
+		warmStats.print();
+		fprintf(stdout, "  %zu of %zu warm loads hit, %zu rejected, speedup %.2fx\n", hits,
+				NUM_ROUNDS * PROGRAMS.size(), rejected, sourceStats.meanMs() / warmStats.meanMs());
+		close();
+	}
+
+	void draw(SDLGLWindow& w) {
+	}
+
+	void teardown(SDLGLWindow& w) {
+		delete ctx;
+	}
+};
+
+int main(int argc, char** argv) {
+	ProgramCacheBench b(argc > 1 ? argv[1] : "program_cache_bench");
+	b.mainLoop();
+}
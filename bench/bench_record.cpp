@@ -0,0 +1,176 @@
+/*
+ * Scaling of draw recording across threads: each thread records a slice of
+ * the draws into its own CommandBuffer, which are then executed in order on
+ * the GL thread. Recording time is measured separately from execution.
+ * Can run headless on a software rasterizer, e.g.
+ *   SDL_VIDEODRIVER=offscreen LIBGL_ALWAYS_SOFTWARE=1 ./bench_record [numDraws] [maxThreads]
+ */
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "etc/sdl_gl_window.h"
+#include "gfx/graphicscontext.h"
+#include "gfx/utils/3dshapes.h"
+#include "gfx/utils/thread_pool.h"
+#include "gfx/utils/vertex.h"
+
+#include "bench_utils.h"
+
+using namespace glm;
+using namespace gfx;
+
+static const char* VERT_SHADER =
+		"uniform mat4 std_Modelview;\n"
+		"uniform mat4 std_Projection;\n"
+		"in vec4 in_position;\n"
+		"void main() {\n"
+		"  gl_Position = std_Projection * std_Modelview * in_position;\n"
+		"}\n";
+
+static const char* FRAG_SHADER =
+		"uniform vec4 color;\n"
+		"out vec4 fragcolor;\n"
+		"void main() {\n"
+		"  fragcolor = color;\n"
+		"}\n";
+
+struct RecordBench : public SDLGLWindow {
+	static const size_t NUM_FRAMES = 50;
+	static const size_t WARMUP_FRAMES = 5;
+	static const size_t NUM_GEOMETRIES = 16;
+
+	typedef Vertex4P Vertex;
+
+	size_t numDraws;
+	size_t maxThreads;
+
+	GraphicsContext* ctx = nullptr;
+	ShaderProgramHandle program;
+	GLint modelviewLoc = -1, colorLoc = -1;
+
+	std::vector<GBufHandle<Vertex>> geometries;
+	std::vector<vec3> positions;
+
+	std::vector<std::unique_ptr<ThreadPool>> pools;
+	std::vector<CommandBufferHandle> buffers;
+
+	std::vector<bench::Stats> recordStats;
+	std::vector<bench::Stats> executeStats;
+
+	size_t frame = 0;
+
+	RecordBench(size_t n, size_t threads) : SDLGLWindow(512, 512), numDraws(n), maxThreads(threads) {
+		ctx = new GraphicsContext();
+	}
+
+	void setup(SDLGLWindow& w) {
+		program = ctx->makeShaderProgramFromStrings(VERT_SHADER, FRAG_SHADER);
+		program->setUniform("std_Projection", perspective(45.0f, 1.0f, 0.5f, 1000.0f));
+		modelviewLoc = program->uniformLocation("std_Modelview");
+		colorLoc = program->uniformLocation("color");
+
+		auto cube = detail::cubeData();
+		std::vector<Vertex> verts(cube.size());
+		for(size_t g = 0; g < NUM_GEOMETRIES; g++) {
+			const float scale = 0.05f + 0.005f * g;
+			for(size_t i = 0; i < cube.size(); i++) {
+				verts[i].position() = std::get<0>(cube[i]) * vec4(scale, scale, scale, 1.0f);
+			}
+			geometries.push_back(ctx->makeGeometryBuffer<Vertex>(verts.size(), verts.data()));
+		}
+
+		const size_t side = static_cast<size_t>(std::ceil(std::sqrt(float(numDraws))));
+		for(size_t i = 0; i < numDraws; i++) {
+			positions.push_back(vec3((i % side) * 0.25f - side * 0.125f, (i / side) * 0.25f - side * 0.125f, -side * 0.3f));
+		}
+
+		for(size_t t = 1; t <= maxThreads; t++) {
+			pools.emplace_back(new ThreadPool(t));
+			recordStats.emplace_back("record " + std::to_string(t) + " thread(s)");
+			executeStats.emplace_back("execute " + std::to_string(t) + " buffer(s)");
+			buffers.push_back(ctx->makeCommandBuffer(4 * numDraws / t, 80 * numDraws / t));
+		}
+	}
+
+	void record(CommandBuffer& buffer, size_t begin, size_t end) {
+		buffer.setShaderProgram(program);
+		for(size_t i = begin; i < end; i++) {
+			const float angle = 0.001f * (frame + i);
+			const mat4 modelview = rotate(translate(mat4(1.0), positions[i]), angle, vec3(0.0, 1.0, 0.0));
+			const vec4 color(float(i % 7) / 7.0f, float(i % 5) / 5.0f, float(i % 3) / 3.0f, 1.0f);
+
+			buffer.setGeometryBuffer(geometries[i % NUM_GEOMETRIES]);
+			buffer.setUniform(modelviewLoc, modelview);
+			buffer.setUniform(colorLoc, color);
+			buffer.draw();
+		}
+	}
+
+	void draw(SDLGLWindow& w) {
+		const size_t numThreads = frame / NUM_FRAMES + 1;
+		const bool measured = frame % NUM_FRAMES >= WARMUP_FRAMES;
+
+		ThreadPool& pool = *pools[numThreads - 1];
+		std::vector<CommandBufferHandle> threadBuffers(buffers.begin(), buffers.begin() + numThreads);
+		for(const CommandBufferHandle& buffer : threadBuffers) {
+			buffer->clear();
+		}
+
+		bench::Timer recordTimer;
+		const size_t chunkSize = (numDraws + numThreads - 1) / numThreads;
+		pool.parallelFor(numThreads, [&](size_t t) {
+			const size_t begin = std::min(numDraws, t * chunkSize);
+			const size_t end = std::min(numDraws, begin + chunkSize);
+			record(*threadBuffers[t], begin, end);
+		});
+		const double recordMs = recordTimer.elapsedMs();
+
+		glClear(GL_COLOR_BUFFER_BIT);
+		bench::Timer executeTimer;
+		ctx->execute(threadBuffers);
+		const double executeMs = executeTimer.elapsedMs();
+		glFinish();
+
+		if(measured) {
+			recordStats[numThreads - 1].add(recordMs);
+			executeStats[numThreads - 1].add(executeMs);
+		}
+
+		frame += 1;
+		if(frame == maxThreads * NUM_FRAMES) {
+			close();
+		}
+	}
+
+	void teardown(SDLGLWindow& w) {
+		fprintf(stdout, "%zu draws\n", numDraws);
+		for(size_t t = 0; t < maxThreads; t++) {
+			recordStats[t].print();
+			fprintf(stdout, "  speedup %.2fx\n", recordStats[0].meanMs() / recordStats[t].meanMs());
+		}
+		for(const bench::Stats& stats : executeStats) {
+			stats.print();
+		}
+
+		buffers.clear();
+		geometries.clear();
+		program.reset();
+		delete ctx;
+	}
+};
+
+int main(int argc, char** argv) {
+	const size_t numDraws = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 50000;
+	const size_t maxThreads = argc > 2 ? std::strtoul(argv[2], nullptr, 10) :
+			std::max(1u, std::thread::hardware_concurrency());
+	RecordBench b(numDraws, maxThreads);
+	b.mainLoop();
+}
@@ -0,0 +1,77 @@
+/*
+ * The CPU work of getting every shader in gfx/shaders ready to compile at
+ * startup: reading and preprocessing the files with a new
+ * ShaderPreprocessor, then hashing the sources for the binary cache key,
+ * against copying the shaders embedded in the library and combining their
+ * precomputed hashes. This is not the whole cold start: compiling and
+ * linking in the driver, or loading cached binaries, costs the same either
+ * way and isn't measured. The files stay in the page cache after the first
+ * run, so a cold disk makes the first cost larger. CPU only, run it from
+ * the source root.
+ *   ./bench_startup [numRuns]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+#include "gfx/utils/embedded_shaders.h"
+#include "gfx/utils/program_binary_cache.h"
+#include "gfx/utils/shader_preprocessor.h"
+
+#include "bench_utils.h"
+
+using namespace utils;
+
+int main(int argc, char** argv) {
+	const size_t numRuns = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 50;
+
+	// The defines of gfx_test's lit program
+	const ShaderDefines defines = { { "PHYSICAL_BRDF", "1" }, { "NUM_LIGHTS", "10" } };
+	const std::string defineText = ShaderPreprocessor::defineDirectives(defines);
+
+	size_t sourceBytes = 0;
+	uint64_t keys = 0;
+	bench::Stats filesStats("read and preprocess files");
+	bench::Stats embeddedStats("embedded shaders");
+	for(size_t run = 0; run < numRuns; run++) {
+		bench::Timer timer;
+		ShaderPreprocessor pp;
+		std::istringstream dirs(EMBEDDED_SHADER_INCLUDE_DIRS);
+		for(std::string dir; std::getline(dirs, dir);) {
+			pp.addIncludeDir(dir);
+		}
+		sourceBytes = 0;
+		for(size_t i = 0; i < NUM_EMBEDDED_SHADERS; i++) {
+			const std::string source = pp.preprocessFile(EMBEDDED_SHADERS[i].path, defines).source;
+			keys += ProgramBinaryCache::hash(source.data(), source.size());
+			sourceBytes += source.size();
+		}
+		filesStats.add(timer.elapsedMs());
+
+		timer.reset();
+		std::unordered_map<std::string, const EmbeddedShader*> embedded;
+		for(size_t i = 0; i < NUM_EMBEDDED_SHADERS; i++) {
+			embedded.emplace(EMBEDDED_SHADERS[i].path, &EMBEDDED_SHADERS[i]);
+		}
+		for(size_t i = 0; i < NUM_EMBEDDED_SHADERS; i++) {
+			const EmbeddedShader& shader = *embedded.find(EMBEDDED_SHADERS[i].path)->second;
+			const size_t split = static_cast<const char*>(memchr(shader.source, '\n', shader.length)) - shader.source + 1;
+			std::string source;
+			source.reserve(shader.length + defineText.size());
+			source.append(shader.source, split).append(defineText).append(shader.source + split, shader.length - split);
+			keys += ProgramBinaryCache::hash(defineText.data(), defineText.size(), shader.hash);
+		}
+		embeddedStats.add(timer.elapsedMs());
+	}
+
+	fprintf(stdout, "%zu shaders, %zu bytes of preprocessed source (key checksum %llx)\n",
+			NUM_EMBEDDED_SHADERS, sourceBytes, static_cast<unsigned long long>(keys));
+	fprintf(stdout, "CPU preparation of the sources only, GL compile and link time not included\n");
+	filesStats.print();
+	embeddedStats.print();
+	fprintf(stdout, "  speedup %.2fx\n", filesStats.meanMs() / embeddedStats.meanMs());
+}
@@ -0,0 +1,131 @@
+/*
+ * Compares rewriting a dynamic vertex buffer every frame through
+ * glNamedBufferSubData against writing into a persistently mapped
+ * StreamingGeometryBuffer.
+ */
+#include <vector>
+#include <cmath>
+#include <cstring>
+
+#include <glm/glm.hpp>
+
+#include "etc/sdl_gl_window.h"
+#include "gfx/graphicscontext.h"
+#include "gfx/utils/vertex.h"
+
+#include "bench_utils.h"
+
+using namespace glm;
+using namespace gfx;
+
+struct StreamingBench : public SDLGLWindow {
+	static const size_t NUM_VERTS = 1 << 18;
+	static const size_t NUM_FRAMES = 200;
+	static const size_t WARMUP_FRAMES = 10;
+
+	typedef Vertex4P Vertex;
+
+	GraphicsContext* ctx = nullptr;
+	ShaderProgramHandle program;
+
+	GBufHandle<Vertex> subDataGeometry;
+	StreamingGBufHandle<Vertex> streamingGeometry;
+	std::vector<Vertex> cpuVerts;
+
+	bench::Stats subDataStats = bench::Stats("glNamedBufferSubData cpu");
+	bench::Stats streamingStats = bench::Stats("persistent ring cpu");
+	bench::Stats subDataFrameStats = bench::Stats("glNamedBufferSubData frame");
+	bench::Stats streamingFrameStats = bench::Stats("persistent ring frame");
+
+	bench::Timer frameTimer;
+	size_t frame = 0;
+
+	StreamingBench() : SDLGLWindow(512, 512) {
+		ctx = new GraphicsContext();
+	}
+
+	static void writeVertices(Vertex* verts, size_t frame) {
+		const float t = frame * 0.01f;
+		const size_t side = static_cast<size_t>(std::sqrt(NUM_VERTS));
+		for(size_t i = 0; i < NUM_VERTS; i++) {
+			const float x = (i % side) / float(side) * 2.0f - 1.0f;
+			const float y = (i / side) / float(side) * 2.0f - 1.0f;
+			verts[i].position() = vec4(x, y + 0.01f * std::sin(t + x * 10.0f), 0.0f, 1.0f);
+		}
+	}
+
+	void setup(SDLGLWindow& w) {
+		ctx->addShaderProgramIncludeDir("gfx/shaders/glsl330");
+		program = ctx->makeShaderProgramFromFiles("gfx/shaders/solid_color_vert.glsl",
+				"gfx/shaders/solid_color_frag.glsl");
+		program->setUniform("std_Modelview", mat4(1.0));
+		program->setUniform("std_Projection", mat4(1.0));
+		program->setUniform("color", vec4(1.0));
+
+		subDataGeometry = ctx->makeGeometryBuffer<Vertex>(NUM_VERTS);
+		subDataGeometry->setPrimiveType(POINTS);
+		streamingGeometry = ctx->makeStreamingGeometryBuffer<Vertex>(NUM_VERTS);
+		streamingGeometry->setPrimiveType(POINTS);
+		cpuVerts.resize(NUM_VERTS);
+
+		ctx->setShaderProgram(program);
+	}
+
+	void draw(SDLGLWindow& w) {
+		const bool streaming = frame >= NUM_FRAMES;
+		const size_t phaseFrame = streaming ? frame - NUM_FRAMES : frame;
+		const bool measured = phaseFrame >= WARMUP_FRAMES;
+
+		if(measured) {
+			(streaming ? streamingFrameStats : subDataFrameStats).add(frameTimer.elapsedMs());
+		}
+		frameTimer.reset();
+
+		glClear(GL_COLOR_BUFFER_BIT);
+
+		bench::Timer timer;
+		if(streaming) {
+			writeVertices(streamingGeometry->vertexData(), frame);
+			streamingGeometry->commit(NUM_VERTS);
+			ctx->setGeometryBuffer(streamingGeometry);
+			ctx->draw();
+			streamingGeometry->advance();
+		} else {
+			writeVertices(cpuVerts.data(), frame);
+			subDataGeometry->setVertexSubData(cpuVerts.data(), 0, NUM_VERTS);
+			ctx->setGeometryBuffer(subDataGeometry);
+			ctx->draw();
+		}
+		if(measured) {
+			(streaming ? streamingStats : subDataStats).add(timer.elapsedMs());
+		}
+
+		frame += 1;
+		if(frame == 2 * NUM_FRAMES) {
+			close();
+		}
+	}
+
+	void teardown(SDLGLWindow& w) {
+		const double mb = NUM_VERTS * sizeof(Vertex) / (1024.0 * 1024.0);
+
+		fprintf(stdout, "%zu vertices (%.2f MB) rewritten per frame\n", size_t(NUM_VERTS), mb);
+		subDataStats.print();
+		subDataFrameStats.print();
+		fprintf(stdout, "  throughput %.1f MB/s\n", mb / (subDataStats.meanMs() / 1000.0));
+		streamingStats.print();
+		streamingFrameStats.print();
+		fprintf(stdout, "  throughput %.1f MB/s, %zu stalls\n",
+				mb / (streamingStats.meanMs() / 1000.0), streamingGeometry->numStalls());
+
+		subDataGeometry.reset();
+		streamingGeometry.reset();
+		program.reset();
+		delete ctx;
+	}
+};
+
+int main(int argc, char** argv) {
+	StreamingBench b;
+	b.mainLoop();
+}
@@ -0,0 +1,99 @@
+/*
+ * TransformHierarchy update cost with a small fraction of nodes moving per
+ * frame, against recomputing every world matrix, and the cost of the batch
+ * modelview, modelview projection and normal matrix pass. CPU only, no window is opened.
+ *   ./bench_transforms [numNodes] [dirtyPercent]
+ */
+#include <random>
+#include <vector>
+#include <cstdlib>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "gfx/utils/transform_hierarchy.h"
+
+#include "bench_utils.h"
+
+using namespace glm;
+using namespace gfx;
+
+static const size_t NUM_RUNS = 50;
+static const size_t WARMUP_RUNS = 3;
+
+// Nodes drawn per frame by the batch pass
+static const size_t NUM_DRAWN = 10000;
+
+int main(int argc, char** argv) {
+	const size_t numNodes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+	const double dirtyPercent = argc > 2 ? std::atof(argv[2]) : 1.0;
+	const size_t numDirty = static_cast<size_t>(numNodes * dirtyPercent / 100.0);
+
+	// A forest of shallow trees, every node's parent is one of the nodes
+	// added shortly before it
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> pos(-10.0f, 10.0f);
+	std::uniform_real_distribution<float> angle(-3.0f, 3.0f);
+	TransformHierarchy transforms;
+	transforms.reserve(numNodes);
+	for(size_t i = 0; i < numNodes; i++) {
+		const uint32_t parent = i % 100 == 0 ? TransformHierarchy::INVALID_INDEX :
+				static_cast<uint32_t>(i - 1 - rng() % std::min<size_t>(i % 100, 8));
+		transforms.add(parent, vec3(pos(rng), pos(rng), pos(rng)), angleAxis(angle(rng), vec3(0.0f, 1.0f, 0.0f)));
+	}
+	transforms.update();
+
+	fprintf(stdout, "%zu nodes, %zu dirtied per frame\n", numNodes, numDirty);
+
+	bench::Stats dirtyStats("update, dirty nodes only");
+	size_t numUpdated = 0;
+	for(size_t run = 0; run < NUM_RUNS + WARMUP_RUNS; run++) {
+		for(size_t i = 0; i < numDirty; i++) {
+			const uint32_t node = static_cast<uint32_t>(rng() % numNodes);
+			transforms.setTranslation(node, vec3(pos(rng), pos(rng), pos(rng)));
+		}
+
+		bench::Timer timer;
+		numUpdated = transforms.update();
+		if(run >= WARMUP_RUNS) {
+			dirtyStats.add(timer.elapsedMs());
+		}
+	}
+	dirtyStats.print();
+	fprintf(stdout, "  %zu world matrices recomputed\n", numUpdated);
+
+	bench::Stats fullStats("update, every node");
+	for(size_t run = 0; run < NUM_RUNS + WARMUP_RUNS; run++) {
+		for(uint32_t i = 0; i < numNodes; i += 100) {
+			transforms.setTranslation(i, transforms.translation(i));
+		}
+
+		bench::Timer timer;
+		numUpdated = transforms.update();
+		if(run >= WARMUP_RUNS) {
+			fullStats.add(timer.elapsedMs());
+		}
+	}
+	fullStats.print();
+	fprintf(stdout, "  %zu world matrices recomputed\n", numUpdated);
+
+	std::vector<uint32_t> drawn;
+	for(size_t i = 0; i < NUM_DRAWN && i < numNodes; i++) {
+		drawn.push_back(static_cast<uint32_t>(rng() % numNodes));
+	}
+	std::vector<ObjectMatrices> matrices(drawn.size());
+	const mat4 view = lookAt(vec3(0.0f, 5.0f, 20.0f), vec3(0.0f), vec3(0.0f, 1.0f, 0.0f));
+	const mat4 proj = perspective(radians(60.0f), 1.0f, 0.1f, 100.0f);
+
+	bench::Stats viewStats("modelview, mvp and normal matrices");
+	for(size_t run = 0; run < NUM_RUNS + WARMUP_RUNS; run++) {
+		bench::Timer timer;
+		transforms.computeViewMatrices(view, proj, drawn.data(), drawn.size(), matrices.data());
+		if(run >= WARMUP_RUNS) {
+			viewStats.add(timer.elapsedMs());
+		}
+	}
+	viewStats.print();
+	fprintf(stdout, "  %zu nodes, %.1f ns per node\n", drawn.size(), viewStats.meanMs() * 1e6 / drawn.size());
+}
@@ -0,0 +1,209 @@
+/*
+ * Compares two ways of feeding per draw matrices to the same draws: three
+ * ShaderProgram::setUniform() calls per draw (glProgramUniformMatrix4fv),
+ * against writing every draw's block into a UniformRing once per frame and
+ * binding a range of it per draw with glBindBufferRange. The setUniform
+ * path also sets a per frame value before every draw, which the program's
+ * copy of the last value turns into one GL call per frame.
+ * Can run headless on a software rasterizer, e.g.
+ *   SDL_VIDEODRIVER=offscreen LIBGL_ALWAYS_SOFTWARE=1 ./bench_uniforms [numDraws]
+ */
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "etc/sdl_gl_window.h"
+#include "gfx/graphicscontext.h"
+#include "gfx/utils/3dshapes.h"
+#include "gfx/utils/matrix_batch.h"
+#include "gfx/utils/vertex.h"
+
+#include "bench_utils.h"
+
+using namespace glm;
+using namespace gfx;
+
+static const char* UNIFORM_VERT_SHADER =
+		"uniform mat4 std_Modelview;\n"
+		"uniform mat4 std_ModelviewProjection;\n"
+		"uniform mat4 std_Normal;\n"
+		"uniform float u_exposure;\n"
+		"in vec4 in_position;\n"
+		"out float v_shade;\n"
+		"void main() {\n"
+		"  v_shade = u_exposure * normalize(mat3(std_Normal) * vec3(0.0, 0.0, 1.0)).z * (std_Modelview * in_position).w;\n"
+		"  gl_Position = std_ModelviewProjection * in_position;\n"
+		"}\n";
+
+static const char* BLOCK_VERT_SHADER =
+		"layout(std140) uniform PerDrawMatrixBlock {\n"
+		"  mat4 std_DrawModelview;\n"
+		"  mat4 std_DrawModelviewProjection;\n"
+		"  mat4 std_DrawNormal;\n"
+		"};\n"
+		"in vec4 in_position;\n"
+		"out float v_shade;\n"
+		"void main() {\n"
+		"  v_shade = normalize(mat3(std_DrawNormal) * vec3(0.0, 0.0, 1.0)).z * (std_DrawModelview * in_position).w;\n"
+		"  gl_Position = std_DrawModelviewProjection * in_position;\n"
+		"}\n";
+
+static const char* FRAG_SHADER =
+		"in float v_shade;\n"
+		"out vec4 fragcolor;\n"
+		"void main() {\n"
+		"  fragcolor = vec4(vec3(v_shade), 1.0);\n"
+		"}\n";
+
+struct UniformsBench : public SDLGLWindow {
+	static const size_t NUM_FRAMES = 200;
+	static const size_t WARMUP_FRAMES = 10;
+
+	typedef Vertex4P Vertex;
+
+	size_t numDraws;
+
+	GraphicsContext* ctx = nullptr;
+	ShaderProgramHandle uniformProgram;
+	ShaderProgramHandle blockProgram;
+	UniformHandle<mat4> modelviewUniform, mvpUniform, normalUniform;
+	UniformHandle<float> exposureUniform;
+
+	GBufHandle<Vertex> cube;
+	UniformRingHandle ring;
+	std::vector<UniformRange> ranges;
+
+	mat4 view, projection;
+	std::vector<mat4> models;
+	std::vector<ObjectMatrices> matrices;
+
+	bench::Stats uniformStats = bench::Stats("setUniform cpu");
+	bench::Stats ringStats = bench::Stats("uniform ring cpu");
+	bench::Stats uniformFrameStats = bench::Stats("setUniform frame");
+	bench::Stats ringFrameStats = bench::Stats("uniform ring frame");
+
+	bench::Timer frameTimer;
+	size_t frame = 0;
+
+	UniformsBench(size_t n) : SDLGLWindow(512, 512), numDraws(n) {
+		ctx = new GraphicsContext();
+	}
+
+	void setup(SDLGLWindow& w) {
+		uniformProgram = ctx->makeShaderProgramFromStrings(UNIFORM_VERT_SHADER, FRAG_SHADER);
+		// New values every draw, comparing against the last ones would only cost
+		modelviewUniform = uniformProgram->uniformHandle<mat4>("std_Modelview", UniformScope::PER_OBJECT);
+		mvpUniform = uniformProgram->uniformHandle<mat4>("std_ModelviewProjection", UniformScope::PER_OBJECT);
+		normalUniform = uniformProgram->uniformHandle<mat4>("std_Normal", UniformScope::PER_OBJECT);
+		exposureUniform = uniformProgram->uniformHandle<float>("u_exposure");
+
+		blockProgram = ctx->makeShaderProgramFromStrings(BLOCK_VERT_SHADER, FRAG_SHADER);
+		blockProgram->setUniformBlockBinding("PerDrawMatrixBlock", PER_DRAW_MATRIX_BLOCK_BINDING);
+
+		auto cubeData = detail::cubeData();
+		std::vector<Vertex> verts(cubeData.size());
+		for(size_t i = 0; i < cubeData.size(); i++) {
+			verts[i].position() = std::get<0>(cubeData[i]) * vec4(0.05f, 0.05f, 0.05f, 1.0f);
+		}
+		cube = ctx->makeGeometryBuffer<Vertex>(verts.size(), verts.data());
+
+		ring = ctx->makeUniformRing(numDraws * 256);
+		ranges.resize(numDraws);
+		matrices.resize(numDraws);
+
+		view = lookAt(vec3(0.0, 0.0, 10.0), vec3(0.0), vec3(0.0, 1.0, 0.0));
+		projection = perspective(45.0f, 1.0f, 0.5f, 1000.0f);
+		const size_t side = static_cast<size_t>(std::ceil(std::sqrt(float(numDraws))));
+		for(size_t i = 0; i < numDraws; i++) {
+			models.push_back(translate(mat4(1.0), vec3((i % side) * 0.25f - side * 0.125f,
+					(i / side) * 0.25f - side * 0.125f, -side * 0.3f)));
+		}
+	}
+
+	void drawWithUniforms() {
+		computeObjectMatrices(view, projection, models.data(), nullptr, numDraws, matrices.data());
+
+		ctx->setShaderProgram(uniformProgram);
+		ctx->setGeometryBuffer(cube);
+		const float exposure = 1.0f + (frame % 2) * 0.01f;
+		for(size_t i = 0; i < numDraws; i++) {
+			uniformProgram->setUniform(exposureUniform, exposure);
+			uniformProgram->setUniform(modelviewUniform, matrices[i].modelview);
+			uniformProgram->setUniform(mvpUniform, matrices[i].modelviewProjection);
+			uniformProgram->setUniform(normalUniform, matrices[i].normal);
+			ctx->draw();
+		}
+	}
+
+	void drawWithRing() {
+		void* dst = ring->allocate(sizeof(ObjectMatrices), numDraws, ranges.data());
+		computeObjectMatrices(view, projection, models.data(), nullptr, numDraws, dst,
+				ring->stride(sizeof(ObjectMatrices)));
+
+		ctx->setShaderProgram(blockProgram);
+		ctx->setGeometryBuffer(cube);
+		for(size_t i = 0; i < numDraws; i++) {
+			ctx->bindUniformRange(ranges[i]);
+			ctx->draw();
+		}
+		ring->advance();
+	}
+
+	void draw(SDLGLWindow& w) {
+		const bool useRing = frame >= NUM_FRAMES;
+		const size_t phaseFrame = useRing ? frame - NUM_FRAMES : frame;
+		const bool measured = phaseFrame >= WARMUP_FRAMES;
+
+		if(measured) {
+			(useRing ? ringFrameStats : uniformFrameStats).add(frameTimer.elapsedMs());
+		}
+		frameTimer.reset();
+
+		ctx->beginFrame();
+		glClear(GL_COLOR_BUFFER_BIT);
+
+		bench::Timer timer;
+		if(useRing) {
+			drawWithRing();
+		} else {
+			drawWithUniforms();
+		}
+		if(measured) {
+			(useRing ? ringStats : uniformStats).add(timer.elapsedMs());
+		}
+
+		frame += 1;
+		if(frame == 2 * NUM_FRAMES) {
+			close();
+		}
+	}
+
+	void teardown(SDLGLWindow& w) {
+		fprintf(stdout, "%zu draws, 3 mat4 per draw, uniform offset alignment %zu\n", numDraws, ring->alignment());
+		uniformStats.print();
+		uniformFrameStats.print();
+		fprintf(stdout, "  %.1f ns per draw, %zu uniform sets issued, %zu elided\n",
+				uniformStats.meanMs() * 1e6 / numDraws, uniformProgram->uniformStats().issued,
+				uniformProgram->uniformStats().elided);
+		ringStats.print();
+		ringFrameStats.print();
+		fprintf(stdout, "  %.1f ns per draw, speedup %.2fx\n", ringStats.meanMs() * 1e6 / numDraws,
+				uniformStats.meanMs() / ringStats.meanMs());
+
+		cube.reset();
+		ring.reset();
+		uniformProgram.reset();
+		blockProgram.reset();
+		delete ctx;
+	}
+};
+
+int main(int argc, char** argv) {
+	const size_t numDraws = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000;
+	UniformsBench b(numDraws);
+	b.mainLoop();
+}
@@ -0,0 +1,67 @@
+#include <chrono>
+#include <string>
+#include <cstdio>
+
+#ifndef BENCH_UTILS_H_
+#define BENCH_UTILS_H_
+
+namespace bench {
+
+/*
+ * Wall clock stopwatch reporting elapsed milliseconds
+ */
+class Timer {
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point m_start = Clock::now();
+
+public:
+	void reset() {
+		m_start = Clock::now();
+	}
+
+	double elapsedMs() const {
+		return std::chrono::duration<double, std::milli>(Clock::now() - m_start).count();
+	}
+};
+
+/*
+ * Accumulates per-iteration timings and prints a one line summary
+ */
+class Stats {
+	std::string m_name;
+	double m_totalMs = 0.0;
+	double m_minMs = 1e30;
+	double m_maxMs = 0.0;
+	size_t m_count = 0;
+
+public:
+	explicit Stats(const std::string& name) : m_name(name) {}
+
+	void add(double ms) {
+		m_totalMs += ms;
+		m_minMs = ms < m_minMs ? ms : m_minMs;
+		m_maxMs = ms > m_maxMs ? ms : m_maxMs;
+		m_count += 1;
+	}
+
+	size_t count() const {
+		return m_count;
+	}
+
+	double totalMs() const {
+		return m_totalMs;
+	}
+
+	double meanMs() const {
+		return m_count > 0 ? m_totalMs / m_count : 0.0;
+	}
+
+	void print() const {
+		fprintf(stdout, "%-40s mean %9.4f ms  min %9.4f ms  max %9.4f ms  (%zu runs)\n",
+				m_name.c_str(), meanMs(), m_count > 0 ? m_minMs : 0.0, m_maxMs, m_count);
+	}
+};
+
+}
+
+#endif /* BENCH_UTILS_H_ */
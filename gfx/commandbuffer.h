@@ -0,0 +1,211 @@
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/assert.hpp>
+
+#include "geometrybuffer.h"
+#include "drawlist.h"
+#include "shader.h"
+#include "utils/gl_traits.h"
+
+#ifndef RENDERER_COMMAND_BUFFER_H_
+#define RENDERER_COMMAND_BUFFER_H_
+
+namespace gfx {
+
+class GraphicsContext;
+
+namespace detail {
+
+/*
+ * Sets count uniforms of GL type glType at location in the current program
+ * from tightly packed data
+ */
+inline void setUniformFromData(GLenum glType, GLint location, GLsizei count, const void* data) {
+	const GLfloat* f = static_cast<const GLfloat*>(data);
+	const GLint* i = static_cast<const GLint*>(data);
+	const GLuint* u = static_cast<const GLuint*>(data);
+
+	switch(glType) {
+	case GL_FLOAT: glUniform1fv(location, count, f); break;
+	case GL_FLOAT_VEC2: glUniform2fv(location, count, f); break;
+	case GL_FLOAT_VEC3: glUniform3fv(location, count, f); break;
+	case GL_FLOAT_VEC4: glUniform4fv(location, count, f); break;
+	case GL_INT: glUniform1iv(location, count, i); break;
+	case GL_INT_VEC2: glUniform2iv(location, count, i); break;
+	case GL_INT_VEC3: glUniform3iv(location, count, i); break;
+	case GL_INT_VEC4: glUniform4iv(location, count, i); break;
+	case GL_UNSIGNED_INT: glUniform1uiv(location, count, u); break;
+	case GL_UNSIGNED_INT_VEC2: glUniform2uiv(location, count, u); break;
+	case GL_UNSIGNED_INT_VEC3: glUniform3uiv(location, count, u); break;
+	case GL_UNSIGNED_INT_VEC4: glUniform4uiv(location, count, u); break;
+	case GL_FLOAT_MAT2: glUniformMatrix2fv(location, count, GL_FALSE, f); break;
+	case GL_FLOAT_MAT3: glUniformMatrix3fv(location, count, GL_FALSE, f); break;
+	case GL_FLOAT_MAT4: glUniformMatrix4fv(location, count, GL_FALSE, f); break;
+	case GL_FLOAT_MAT2x3: glUniformMatrix2x3fv(location, count, GL_FALSE, f); break;
+	case GL_FLOAT_MAT3x2: glUniformMatrix3x2fv(location, count, GL_FALSE, f); break;
+	case GL_FLOAT_MAT2x4: glUniformMatrix2x4fv(location, count, GL_FALSE, f); break;
+	case GL_FLOAT_MAT4x2: glUniformMatrix4x2fv(location, count, GL_FALSE, f); break;
+	case GL_FLOAT_MAT3x4: glUniformMatrix3x4fv(location, count, GL_FALSE, f); break;
+	case GL_FLOAT_MAT4x3: glUniformMatrix4x3fv(location, count, GL_FALSE, f); break;
+	default: BOOST_ASSERT_MSG(false, "Error: unsupported uniform type"); break;
+	}
+}
+
+}
+
+/*
+ * A deferred list of draw commands which can be recorded on any thread.
+ *
+ * Recording makes no GL calls: commands are compact PODs which refer to
+ * programs and geometry through a per buffer table, and uniform values are
+ * copied into a payload array. GraphicsContext::execute() replays them on
+ * the GL thread. Since recording can't query GL, uniform locations must be
+ * looked up beforehand with ShaderProgram::uniformLocation().
+ *
+ * A buffer must only be recorded by one thread at a time. Make one per
+ * worker on the GL thread and clear() it every frame to reuse its storage.
+ */
+class CommandBuffer {
+	friend class GraphicsContext;
+
+	enum CommandType : uint8_t { SET_PROGRAM, SET_GEOMETRY, SET_UNIFORM, BIND_UNIFORM_RANGE, DRAW };
+
+	struct Command {
+		CommandType type;
+		GLenum glType;
+		GLint location;
+		GLsizei count;
+
+		// Index into the program, geometry or uniform range table, or the
+		// offset of the uniform value in the payload
+		uint32_t arg;
+	};
+
+	std::vector<Command> m_commands;
+	std::vector<uint8_t> m_payload;
+
+	std::vector<ShaderProgramHandle> m_programs;
+	std::vector<std::shared_ptr<detail::Geometry>> m_geometries;
+	std::vector<UniformRange> m_uniformRanges;
+
+	// Handles are only copied into the tables the first time they are used.
+	// This keeps threads recording the same objects from all hammering the
+	// same reference counts.
+	std::unordered_map<const void*, uint32_t> m_programIndices;
+	std::unordered_map<const void*, uint32_t> m_geometryIndices;
+
+	const void* m_lastProgram = nullptr;
+	const void* m_lastGeometry = nullptr;
+
+	template <class T, class Handle>
+	static uint32_t tableIndex(std::unordered_map<const void*, uint32_t>& indices,
+			std::vector<T>& table, const Handle& hdl) {
+		auto it = indices.find(hdl.get());
+		if(it == indices.end()) {
+			it = indices.emplace(hdl.get(), static_cast<uint32_t>(table.size())).first;
+			table.push_back(hdl);
+		}
+		return it->second;
+	}
+
+	CommandBuffer(size_t reserveCommands, size_t reservePayload) {
+		m_commands.reserve(reserveCommands);
+		m_payload.reserve(reservePayload);
+	}
+
+public:
+	CommandBuffer(const CommandBuffer&) = delete;
+	CommandBuffer& operator=(const CommandBuffer&) = delete;
+
+	size_t size() const {
+		return m_commands.size();
+	}
+
+	size_t payloadSize() const {
+		return m_payload.size();
+	}
+
+	/*
+	 * Drops all commands and references, keeping the allocated storage
+	 */
+	void clear() {
+		m_commands.clear();
+		m_payload.clear();
+		m_programs.clear();
+		m_geometries.clear();
+		m_uniformRanges.clear();
+		m_programIndices.clear();
+		m_geometryIndices.clear();
+		m_lastProgram = nullptr;
+		m_lastGeometry = nullptr;
+	}
+
+	void setShaderProgram(const ShaderProgramHandle& hdl) {
+		if(hdl.get() == m_lastProgram) {
+			return;
+		}
+		m_lastProgram = hdl.get();
+		m_commands.push_back({ SET_PROGRAM, 0, 0, 0, tableIndex(m_programIndices, m_programs, hdl) });
+	}
+
+	template <class Geom>
+	void setGeometryBuffer(const std::shared_ptr<Geom>& hdl) {
+		static_assert(std::is_base_of<detail::Geometry, Geom>::value,
+				"Error: setGeometryBuffer requires a handle to a geometry buffer");
+		if(hdl.get() == m_lastGeometry) {
+			return;
+		}
+		m_lastGeometry = hdl.get();
+		m_commands.push_back({ SET_GEOMETRY, 0, 0, 0, tableIndex(m_geometryIndices, m_geometries, hdl) });
+	}
+
+	/*
+	 * Sets count consecutive uniforms starting at location in the program
+	 * which is current when the command executes, set by setShaderProgram()
+	 * or by the context
+	 */
+	template <class T>
+	void setUniform(GLint location, const T* values, size_t count) {
+		static_assert(utils::is_glsl_type<T>(), "Error: invalid type for CommandBuffer::setUniform");
+		static_assert(std::is_trivially_copyable<T>::value, "Error: uniform values must be trivially copyable");
+
+		const uint32_t offset = static_cast<uint32_t>(m_payload.size());
+		const size_t bytes = count * sizeof(T);
+		m_payload.resize(m_payload.size() + bytes);
+		std::memcpy(m_payload.data() + offset, values, bytes);
+
+		m_commands.push_back({ SET_UNIFORM, utils::gl_type_id<T>(), location, static_cast<GLsizei>(count), offset });
+	}
+
+	template <class T>
+	void setUniform(GLint location, const T& value) {
+		setUniform(location, &value, 1);
+	}
+
+	/*
+	 * Binds a range of a uniform buffer at PER_DRAW_MATRIX_BLOCK_BINDING
+	 */
+	void bindUniformRange(const UniformRange& range) {
+		m_commands.push_back({ BIND_UNIFORM_RANGE, 0, 0, 0, static_cast<uint32_t>(m_uniformRanges.size()) });
+		m_uniformRanges.push_back(range);
+	}
+
+	void draw() {
+		BOOST_ASSERT_MSG(m_lastProgram != nullptr && m_lastGeometry != nullptr,
+				"Error: CommandBuffer::draw() needs a program and a geometry buffer set first");
+		m_commands.push_back({ DRAW, 0, 0, 0, 0 });
+	}
+};
+
+typedef std::shared_ptr<CommandBuffer> CommandBufferHandle;
+
+}
+
+#endif /* RENDERER_COMMAND_BUFFER_H_ */
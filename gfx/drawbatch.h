@@ -0,0 +1,129 @@
+#include <GL/glew.h>
+
+#include <memory>
+#include <boost/assert.hpp>
+
+#include "geometryarena.h"
+#include "stdbindings.h"
+#include "utils/persistent_ring.h"
+
+#ifndef RENDERER_DRAW_BATCH_H_
+#define RENDERER_DRAW_BATCH_H_
+
+namespace gfx {
+
+class GraphicsContext;
+
+/*
+ * Layout of one command in a GL_DRAW_INDIRECT_BUFFER for glMultiDrawElementsIndirect
+ */
+struct DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+/*
+ * A batch of draws of indexed geometry allocated from a single GeometryArena,
+ * submitted with one glMultiDrawElementsIndirect call.
+ *
+ * Each draw carries a DrawData element which is uploaded to a shader storage
+ * buffer bound at PER_DRAW_DATA_BUFFER_BINDING. Shaders index it with
+ * gl_DrawIDARB (GL_ARB_shader_draw_parameters); every command's baseInstance
+ * is also set to its draw index. DrawData must match the std430 layout of
+ * the array element declared in the shader.
+ *
+ * Commands and draw data are written straight into persistently mapped
+ * memory. Per frame usage:
+ *   add() each draw, GraphicsContext::drawBatch(), advance()
+ */
+template <class Vertex, class DrawData>
+class DrawBatch {
+	friend class GraphicsContext;
+
+	GArenaHandle<Vertex> m_arena;
+	PrimitiveType m_primType;
+
+	size_t m_maxDraws = 0;
+	size_t m_numDraws = 0;
+
+	detail::PersistentRing m_commandRing;
+	detail::PersistentRing m_drawDataRing;
+
+	static size_t storageBufferAlignment() {
+		GLint alignment = 1;
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		return static_cast<size_t>(alignment);
+	}
+
+	DrawBatch(const GArenaHandle<Vertex>& arena, size_t maxDraws, PrimitiveType pType, size_t numRegions) :
+			m_arena(arena), m_primType(pType), m_maxDraws(maxDraws),
+			m_commandRing(maxDraws*sizeof(DrawElementsIndirectCommand), numRegions),
+			m_drawDataRing(maxDraws*sizeof(DrawData), numRegions, storageBufferAlignment()) {
+	}
+
+	DrawElementsIndirectCommand* commands() {
+		return static_cast<DrawElementsIndirectCommand*>(m_commandRing.regionData());
+	}
+
+	DrawData* drawData() {
+		return static_cast<DrawData*>(m_drawDataRing.regionData());
+	}
+
+public:
+	DrawBatch(const DrawBatch&) = delete;
+	DrawBatch& operator=(const DrawBatch&) = delete;
+
+	size_t size() const {
+		return m_numDraws;
+	}
+
+	size_t capacity() const {
+		return m_maxDraws;
+	}
+
+	PrimitiveType primitiveType() const {
+		return m_primType;
+	}
+
+	/*
+	 * Queue a draw of geom with its per-draw data. Returns the draw index.
+	 */
+	size_t add(const ArenaGBufHandle<Vertex>& geom, const DrawData& data) {
+		BOOST_ASSERT_MSG(m_numDraws < m_maxDraws, "Error adding more draws than the batch can hold");
+		BOOST_ASSERT_MSG(geom->isIndexed(), "Error draw batches only support indexed geometry");
+		BOOST_ASSERT_MSG(geom->m_arena == m_arena, "Error geometry was not allocated from the batch's arena");
+
+		const size_t drawIndex = m_numDraws++;
+
+		DrawElementsIndirectCommand& cmd = commands()[drawIndex];
+		cmd.count = geom->numIndices();
+		cmd.instanceCount = 1;
+		cmd.firstIndex = geom->firstIndex();
+		cmd.baseVertex = geom->baseVertex();
+		cmd.baseInstance = drawIndex;
+
+		drawData()[drawIndex] = data;
+
+		return drawIndex;
+	}
+
+	/*
+	 * Call once every drawBatch() reading this frame's commands has been
+	 * issued. Empties the batch for the next frame.
+	 */
+	void advance() {
+		m_commandRing.advance();
+		m_drawDataRing.advance();
+		m_numDraws = 0;
+	}
+};
+
+template <class Vertex, class DrawData>
+using DrawBatchHandle = std::shared_ptr<DrawBatch<Vertex, DrawData>>;
+
+}
+
+#endif /* RENDERER_DRAW_BATCH_H_ */
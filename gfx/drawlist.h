@@ -0,0 +1,165 @@
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "geometrybuffer.h"
+#include "shader.h"
+#include "utils/radix_sort.h"
+#include "utils/thread_pool.h"
+
+#ifndef RENDERER_DRAW_LIST_H_
+#define RENDERER_DRAW_LIST_H_
+
+namespace gfx {
+
+class GraphicsContext;
+
+/*
+ * A range of a uniform buffer bound at PER_DRAW_MATRIX_BLOCK_BINDING for one
+ * draw. A zero size means the draw binds nothing.
+ */
+struct UniformRange {
+	GLuint buffer = 0;
+	GLintptr offset = 0;
+	GLsizeiptr size = 0;
+
+	UniformRange() = default;
+	UniformRange(GLuint buf, GLintptr off, GLsizeiptr sz) : buffer(buf), offset(off), size(sz) {}
+};
+
+/*
+ * A queue of draws which is sorted before being replayed by
+ * GraphicsContext::submit().
+ *
+ * Every draw gets a 64 bit sort key. Opaque draws sort before translucent
+ * ones and are grouped by program, then vertex array, then uniform buffer,
+ * then front to back. Translucent draws are sorted back to front first, so
+ * blending stays correct, and grouped by state only among equal depths:
+ *
+ *   opaque:      0 | program:13 | vao:13 | buffer:13 | depth:24
+ *   translucent: 1 | ~depth:24  | program:13 | vao:13 | buffer:13
+ *
+ * Programs, VAOs and buffers are renumbered in order of first use, so GL
+ * names of any size fit in their fields. A list using more than 8192 of any
+ * of them still draws correctly, but may switch state more often.
+ *
+ * Per frame usage:
+ *   clear(), add() each draw, sort(), GraphicsContext::submit()
+ */
+class DrawList {
+	friend class GraphicsContext;
+
+	static const unsigned ID_BITS = 13;
+	static const unsigned DEPTH_BITS = 24;
+	static const uint64_t ID_MASK = (uint64_t(1) << ID_BITS) - 1;
+
+	struct Packet {
+		ShaderProgramHandle program;
+		std::shared_ptr<detail::Geometry> geometry;
+		UniformRange uniforms;
+	};
+
+	struct SortEntry {
+		uint64_t key;
+		uint32_t packet;
+	};
+
+	std::vector<Packet> m_packets;
+	std::vector<SortEntry> m_entries;
+	std::vector<SortEntry> m_scratch;
+
+	std::unordered_map<GLuint, uint64_t> m_programIds;
+	std::unordered_map<GLuint, uint64_t> m_vaoIds;
+	std::unordered_map<GLuint, uint64_t> m_bufferIds;
+
+	static uint64_t sortId(std::unordered_map<GLuint, uint64_t>& ids, GLuint name) {
+		auto it = ids.find(name);
+		if(it == ids.end()) {
+			it = ids.emplace(name, ids.size() & ID_MASK).first;
+		}
+		return it->second;
+	}
+
+	/*
+	 * The bits of a non negative float compare in the same order as the
+	 * float itself. Dropping the sign bit and the low mantissa bits leaves a
+	 * 24 bit value with the same ordering, whatever the depth range.
+	 */
+	static uint64_t quantizeDepth(float depth) {
+		if(!(depth > 0.0f)) {
+			return 0;
+		}
+		uint32_t bits;
+		std::memcpy(&bits, &depth, sizeof(bits));
+		return bits >> (32 - 1 - DEPTH_BITS);
+	}
+
+	explicit DrawList(size_t reserve) {
+		m_packets.reserve(reserve);
+		m_entries.reserve(reserve);
+	}
+
+public:
+	DrawList(const DrawList&) = delete;
+	DrawList& operator=(const DrawList&) = delete;
+
+	size_t size() const {
+		return m_packets.size();
+	}
+
+	void clear() {
+		m_packets.clear();
+		m_entries.clear();
+		m_programIds.clear();
+		m_vaoIds.clear();
+		m_bufferIds.clear();
+	}
+
+	/*
+	 * Queues a draw of geom with program. depth is the distance from the
+	 * camera, e.g. the view space depth of the object's center.
+	 */
+	template <class Geom>
+	void add(const ShaderProgramHandle& program, const std::shared_ptr<Geom>& geom,
+			const UniformRange& uniforms, float depth, bool translucent = false) {
+		static_assert(std::is_base_of<detail::Geometry, Geom>::value,
+				"Error: DrawList::add requires a handle to a geometry buffer");
+
+		const uint64_t programId = sortId(m_programIds, program->m_programId);
+		const uint64_t vaoId = sortId(m_vaoIds, geom->m_vaoId);
+		const uint64_t bufferId = sortId(m_bufferIds, uniforms.buffer);
+		const uint64_t depthBits = quantizeDepth(depth);
+
+		uint64_t key;
+		if(translucent) {
+			const uint64_t invDepth = ~depthBits & ((uint64_t(1) << DEPTH_BITS) - 1);
+			key = (uint64_t(1) << 63) | (invDepth << (3*ID_BITS)) |
+					(programId << (2*ID_BITS)) | (vaoId << ID_BITS) | bufferId;
+		} else {
+			key = (programId << (2*ID_BITS + DEPTH_BITS)) | (vaoId << (ID_BITS + DEPTH_BITS)) |
+					(bufferId << DEPTH_BITS) | depthBits;
+		}
+
+		m_entries.push_back({ key, static_cast<uint32_t>(m_packets.size()) });
+		m_packets.push_back({ program, std::static_pointer_cast<detail::Geometry>(geom), uniforms });
+	}
+
+	/*
+	 * Sorts the queued draws by key. Without a sort, submit() replays them in
+	 * the order they were added.
+	 */
+	void sort(ThreadPool* pool = nullptr) {
+		radixSort(m_entries, m_scratch, [](const SortEntry& e) { return e.key; }, pool);
+	}
+};
+
+typedef std::shared_ptr<DrawList> DrawListHandle;
+
+}
+
+#endif /* RENDERER_DRAW_LIST_H_ */
@@ -0,0 +1,281 @@
+#include <GL/glew.h>
+
+#include <map>
+#include <iterator>
+#include <memory>
+#include <boost/assert.hpp>
+
+#include "geometrybuffer.h"
+
+#ifndef RENDERER_GEOMETRY_ARENA_H_
+#define RENDERER_GEOMETRY_ARENA_H_
+
+namespace gfx {
+
+class GraphicsContext;
+
+namespace detail {
+
+/*
+ * First fit allocator handing out [offset, offset + size) ranges of a fixed
+ * capacity. Adjacent free ranges are merged when a range is released.
+ */
+class RangeAllocator {
+	// Maps the offset of each free range to its size
+	std::map<size_t, size_t> m_freeRanges;
+	size_t m_capacity = 0;
+	size_t m_numFree = 0;
+
+public:
+	static const size_t INVALID_OFFSET = static_cast<size_t>(-1);
+
+	explicit RangeAllocator(size_t capacity) :
+			m_capacity(capacity), m_numFree(capacity) {
+		if(capacity > 0) {
+			m_freeRanges[0] = capacity;
+		}
+	}
+
+	size_t capacity() const {
+		return m_capacity;
+	}
+
+	size_t numFree() const {
+		return m_numFree;
+	}
+
+	/*
+	 * Returns the offset of the allocated range or INVALID_OFFSET if no free
+	 * range is large enough
+	 */
+	size_t allocate(size_t size) {
+		if(size == 0) {
+			return 0;
+		}
+
+		for(auto it = m_freeRanges.begin(); it != m_freeRanges.end(); it++) {
+			if(it->second >= size) {
+				const size_t offset = it->first;
+				const size_t remaining = it->second - size;
+				m_freeRanges.erase(it);
+				if(remaining > 0) {
+					m_freeRanges[offset + size] = remaining;
+				}
+				m_numFree -= size;
+				return offset;
+			}
+		}
+
+		return INVALID_OFFSET;
+	}
+
+	void release(size_t offset, size_t size) {
+		if(size == 0) {
+			return;
+		}
+		BOOST_ASSERT_MSG(offset + size <= m_capacity, "Error releasing range outside of allocator");
+
+		m_numFree += size;
+
+		auto next = m_freeRanges.lower_bound(offset);
+
+		// Merge with the following free range
+		if(next != m_freeRanges.end() && next->first == offset + size) {
+			size += next->second;
+			next = m_freeRanges.erase(next);
+		}
+
+		// Merge with the preceding free range
+		if(next != m_freeRanges.begin()) {
+			auto prev = std::prev(next);
+			if(prev->first + prev->second == offset) {
+				prev->second += size;
+				return;
+			}
+		}
+
+		m_freeRanges[offset] = size;
+	}
+};
+
+}
+
+template <class Vertex>
+class GeometryArena;
+
+template <class Vertex, class DrawData>
+class DrawBatch;
+
+template <class Vertex>
+class GpuCuller;
+
+/*
+ * Geometry sub-allocated from a GeometryArena.
+ * Shares its vertex array object and buffers with every other allocation
+ * from the same arena and gives its ranges back when destroyed.
+ */
+template <class Vertex>
+class ArenaGeometry: public detail::Geometry {
+	friend class GraphicsContext;
+	friend class GeometryArena<Vertex>;
+
+	template <class V, class DrawData>
+	friend class DrawBatch;
+
+	template <class V>
+	friend class GpuCuller;
+
+	std::shared_ptr<GeometryArena<Vertex>> m_arena;
+
+	ArenaGeometry(const std::shared_ptr<GeometryArena<Vertex>>& arena, PrimitiveType pType) : m_arena(arena) {
+		m_primType = pType;
+		m_vboId = arena->m_vboId;
+		m_vaoId = arena->m_vaoId;
+		m_numAttribLocations = arena->m_numAttribLocations;
+		m_vertexFormat = &detail::vertexFormat<Vertex>();
+	}
+
+public:
+	virtual ~ArenaGeometry() {
+		m_arena->m_vertRanges.release(m_baseVertex, m_numVerts);
+		if(isIndexed()) {
+			m_arena->m_indRanges.release(m_firstIndex, m_numInds);
+		}
+	}
+
+	void setVertexSubData(const Vertex* data, size_t vertexOffset, size_t numVertices) {
+		BOOST_ASSERT_MSG(vertexOffset + numVertices <= m_numVerts, "Error writing past the end of arena geometry");
+		glNamedBufferSubData(m_vboId, (m_baseVertex + vertexOffset)*sizeof(Vertex), numVertices*sizeof(Vertex), data);
+	}
+
+	void setIndexSubData(const GLuint* data, size_t indexOffset, size_t numIndices) {
+		BOOST_ASSERT_MSG(isIndexed(), "Error attempting to set index data of non indexed geometry buffer");
+		BOOST_ASSERT_MSG(indexOffset + numIndices <= m_numInds, "Error writing past the end of arena geometry");
+		glNamedBufferSubData(m_iboId, (m_firstIndex + indexOffset)*sizeof(GLuint), numIndices*sizeof(GLuint), data);
+	}
+};
+
+template <class Vertex>
+using ArenaGBufHandle = std::shared_ptr<ArenaGeometry<Vertex>>;
+
+/*
+ * One large vertex buffer and index buffer pair with a single vertex array
+ * object from which many small geometries are allocated. Allocations are
+ * drawn with a base vertex and first index, so consecutive draws of geometry
+ * from the same arena do not need to rebind the vertex array.
+ * Indices passed to allocateIndexed are relative to the allocation's first
+ * vertex.
+ */
+template <class Vertex>
+class GeometryArena: public std::enable_shared_from_this<GeometryArena<Vertex>> {
+	friend class GraphicsContext;
+	friend class ArenaGeometry<Vertex>;
+
+	GLuint m_vboId = 0, m_iboId = 0, m_vaoId = 0;
+	GLuint m_numAttribLocations = 0;
+
+	detail::RangeAllocator m_vertRanges;
+	detail::RangeAllocator m_indRanges;
+
+	GeometryArena(size_t maxVerts, size_t maxInds) :
+			m_vertRanges(maxVerts), m_indRanges(maxInds) {
+		detail::VertexArrayBindingGuard vaoGuard;
+
+		glCreateBuffers(1, &m_vboId);
+		glNamedBufferStorage(m_vboId, maxVerts*sizeof(Vertex), nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+		glBindBuffer(GL_ARRAY_BUFFER, m_vboId);
+
+		m_vaoId = detail::generateVAO<Vertex>();
+		m_numAttribLocations = detail::NumAttribLocations<typename Vertex::ListType>::value;
+
+		if(maxInds > 0) {
+			glCreateBuffers(1, &m_iboId);
+			glNamedBufferStorage(m_iboId, maxInds*sizeof(GLuint), nullptr, GL_DYNAMIC_STORAGE_BIT);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_iboId);
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+public:
+	GeometryArena(const GeometryArena&) = delete;
+	GeometryArena& operator=(const GeometryArena&) = delete;
+
+	virtual ~GeometryArena() {
+		glDeleteVertexArrays(1, &m_vaoId);
+		glDeleteBuffers(1, &m_vboId);
+		if(m_iboId != 0) {
+			glDeleteBuffers(1, &m_iboId);
+		}
+	}
+
+	size_t maxVertices() const {
+		return m_vertRanges.capacity();
+	}
+
+	size_t maxIndices() const {
+		return m_indRanges.capacity();
+	}
+
+	size_t freeVertices() const {
+		return m_vertRanges.numFree();
+	}
+
+	size_t freeIndices() const {
+		return m_indRanges.numFree();
+	}
+
+	/*
+	 * Allocate non indexed geometry. Returns an empty handle if the arena is full.
+	 */
+	ArenaGBufHandle<Vertex> allocate(size_t numVerts, const Vertex* verts, PrimitiveType pType = TRIANGLES) {
+		const size_t baseVertex = m_vertRanges.allocate(numVerts);
+		if(baseVertex == detail::RangeAllocator::INVALID_OFFSET) {
+			return ArenaGBufHandle<Vertex>();
+		}
+
+		ArenaGBufHandle<Vertex> ret(new ArenaGeometry<Vertex>(this->shared_from_this(), pType));
+		ret->m_baseVertex = baseVertex;
+		ret->m_numVerts = numVerts;
+		if(verts != nullptr) {
+			ret->setVertexSubData(verts, 0, numVerts);
+			ret->computeBounds(verts, numVerts);
+		}
+		return ret;
+	}
+
+	/*
+	 * Allocate indexed geometry. Returns an empty handle if the arena is full.
+	 */
+	ArenaGBufHandle<Vertex> allocateIndexed(size_t numVerts, size_t numInds, const Vertex* verts, const GLuint* inds,
+			PrimitiveType pType = TRIANGLES) {
+		BOOST_ASSERT_MSG(m_iboId != 0, "Error allocating indexed geometry from an arena without an index buffer");
+
+		const size_t firstIndex = m_indRanges.allocate(numInds);
+		if(firstIndex == detail::RangeAllocator::INVALID_OFFSET) {
+			return ArenaGBufHandle<Vertex>();
+		}
+
+		ArenaGBufHandle<Vertex> ret = allocate(numVerts, verts, pType);
+		if(!ret) {
+			m_indRanges.release(firstIndex, numInds);
+			return ret;
+		}
+
+		ret->m_iboId = m_iboId;
+		ret->m_firstIndex = firstIndex;
+		ret->m_numInds = numInds;
+		if(inds != nullptr) {
+			ret->setIndexSubData(inds, 0, numInds);
+		}
+		return ret;
+	}
+};
+
+template <class Vertex>
+using GArenaHandle = std::shared_ptr<GeometryArena<Vertex>>;
+
+}
+
+#endif /* RENDERER_GEOMETRY_ARENA_H_ */
@@ -1,10 +1,13 @@
 #include <GL/glew.h>
 
 #include <memory>
+#include <vector>
 #include <boost/assert.hpp>
 
 #include "utils/tuple.h"
 #include "utils/gl_traits.h"
+#include "utils/persistent_ring.h"
+#include "utils/bounds.h"
 
 #ifndef RENDERER_GEOMETRY_H_
 #define RENDERER_GEOMETRY_H_
@@ -14,6 +17,7 @@ namespace gfx {
 enum PrimitiveType { TRIANGLES = GL_TRIANGLES, LINES = GL_LINES, POINTS = GL_POINTS };
 
 class GraphicsContext;
+class DrawList;
 
 namespace detail {
 
@@ -58,34 +62,146 @@ struct NamedVertexConsCell<I, T, NameT> {
 };
 
 /*
- * Setup vertex attribute pointers for a cons-list of types
+ * Setup the vertex attribute pointer(s) for a single attribute of type T.
+ * Matrices take one attribute location per column.
  */
-template <size_t I, class ConsCell>
-struct EnableAttribArrayAOS;
+template <class T>
+struct VertexAttrib {
+	static const GLuint NUM_LOCATIONS = 1;
+
+	inline static void enable(GLuint location, size_t stride, size_t offset, GLuint divisor) {
+		glEnableVertexAttribArray(location);
+		glVertexAttribPointer(location, utils::dim<T>(), utils::gl_value_type_id<T>(), GL_FALSE, stride, (void*)offset);
+		glVertexAttribDivisor(location, divisor);
+	}
+};
 
-template <size_t I>
-struct EnableAttribArrayAOS<I, EmptyListType> {
-	inline static void enable(size_t stride) {
-		return;
+template <class ColumnType, GLuint NumColumns>
+struct MatrixVertexAttrib {
+	static const GLuint NUM_LOCATIONS = NumColumns;
+
+	inline static void enable(GLuint location, size_t stride, size_t offset, GLuint divisor) {
+		for(GLuint i = 0; i < NumColumns; i++) {
+			VertexAttrib<ColumnType>::enable(location + i, stride, offset + i*sizeof(ColumnType), divisor);
+		}
 	}
 };
 
-template <size_t I, class ConsCell>
+template <> struct VertexAttrib<glm::mat2> : MatrixVertexAttrib<glm::vec2, 2> {};
+template <> struct VertexAttrib<glm::mat3> : MatrixVertexAttrib<glm::vec3, 3> {};
+template <> struct VertexAttrib<glm::mat4> : MatrixVertexAttrib<glm::vec4, 4> {};
+template <> struct VertexAttrib<glm::mat2x3> : MatrixVertexAttrib<glm::vec3, 2> {};
+template <> struct VertexAttrib<glm::mat3x2> : MatrixVertexAttrib<glm::vec2, 3> {};
+template <> struct VertexAttrib<glm::mat2x4> : MatrixVertexAttrib<glm::vec4, 2> {};
+template <> struct VertexAttrib<glm::mat4x2> : MatrixVertexAttrib<glm::vec2, 4> {};
+template <> struct VertexAttrib<glm::mat3x4> : MatrixVertexAttrib<glm::vec4, 3> {};
+template <> struct VertexAttrib<glm::mat4x3> : MatrixVertexAttrib<glm::vec3, 4> {};
+
+/*
+ * Number of attribute locations used by a cons-list of types
+ */
+template <class ConsCell>
+struct NumAttribLocations {
+	static const GLuint value =
+			VertexAttrib<typename ConsCell::HeadType>::NUM_LOCATIONS +
+			NumAttribLocations<typename ConsCell::TailType>::value;
+};
+
+template <>
+struct NumAttribLocations<EmptyListType> {
+	static const GLuint value = 0;
+};
+
+/*
+ * Setup vertex attribute pointers for a cons-list of types, starting at
+ * attribute location `location`. Offsets are taken relative to the start of
+ * RootList so any tuple layout is handled, and baseOffset is added to all of
+ * them. A non zero divisor makes the attributes advance per instance.
+ */
+template <class ConsCell, size_t Element = 0, class RootList = ConsCell>
 struct EnableAttribArrayAOS {
-	inline static void enable(size_t stride) {
+	inline static void enable(GLuint location, size_t stride, size_t baseOffset = 0, GLuint divisor = 0) {
 		typedef typename ConsCell::HeadType HT;
 		typedef typename ConsCell::TailType TT;
-		typedef ListElement<0, ConsCell> LE;
+		typedef ListElement<Element, RootList> LE;
+
+		VertexAttrib<HT>::enable(location, stride, baseOffset + LE::offset(), divisor);
 
-		glEnableVertexAttribArray(I);
-		glVertexAttribPointer(I, utils::dim<HT>(), utils::gl_value_type_id<HT>(), GL_FALSE, stride, (void*)LE::offset());
+		EnableAttribArrayAOS<TT, Element+1, RootList>::enable(
+				location + VertexAttrib<HT>::NUM_LOCATIONS, stride, baseOffset, divisor);
+	}
+};
 
-		EnableAttribArrayAOS<I+1, TT>::enable(stride);
+template <size_t Element, class RootList>
+struct EnableAttribArrayAOS<EmptyListType, Element, RootList> {
+	inline static void enable(GLuint location, size_t stride, size_t baseOffset = 0, GLuint divisor = 0) {
+		return;
 	}
 };
 
 
 
+/*
+ * Restores the vertex array binding active at construction when going out of
+ * scope. Used when creating VAOs so building geometry does not disturb the
+ * VAO bound by the GraphicsContext.
+ */
+class VertexArrayBindingGuard {
+	GLint m_prevVao = 0;
+
+public:
+	VertexArrayBindingGuard() {
+		glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &m_prevVao);
+	}
+
+	VertexArrayBindingGuard(const VertexArrayBindingGuard&) = delete;
+	VertexArrayBindingGuard& operator=(const VertexArrayBindingGuard&) = delete;
+
+	~VertexArrayBindingGuard() {
+		glBindVertexArray(m_prevVao);
+	}
+};
+
+/*
+ * One vertex attribute as set up by EnableAttribArrayAOS: its first
+ * location, GL type and the number of locations it takes
+ */
+struct VertexAttribFormat {
+	GLuint location;
+	GLenum type;
+	GLuint numLocations;
+};
+
+typedef std::vector<VertexAttribFormat> VertexFormat;
+
+template <class ConsCell>
+struct AppendVertexFormat {
+	static void append(VertexFormat& format, GLuint location) {
+		typedef typename ConsCell::HeadType HT;
+		format.push_back(VertexAttribFormat { location, utils::gl_type_id<HT>(), VertexAttrib<HT>::NUM_LOCATIONS });
+		AppendVertexFormat<typename ConsCell::TailType>::append(format, location + VertexAttrib<HT>::NUM_LOCATIONS);
+	}
+};
+
+template <>
+struct AppendVertexFormat<EmptyListType> {
+	static void append(VertexFormat&, GLuint) {}
+};
+
+/*
+ * The attributes generateVAO<Vertex>() sets up. There is one instance per
+ * vertex type, so formats can be compared by address.
+ */
+template <class Vertex>
+inline const VertexFormat& vertexFormat() {
+	static const VertexFormat format = [] {
+		VertexFormat ret;
+		AppendVertexFormat<typename Vertex::ListType>::append(ret, 0);
+		return ret;
+	}();
+	return format;
+}
+
 /*
  * Generate a VAO for an array of vertices of type Vertex
  * Vertex must be have the trait IsTypeTuple
@@ -99,18 +215,47 @@ inline static GLuint generateVAO() {
 	glGenVertexArrays(1, &vao);
 	glBindVertexArray(vao);
 	const size_t sizeofVertex = sizeof(Vertex);
-	EnableAttribArrayAOS<0, typename Vertex::ListType>::enable(sizeofVertex);
+	EnableAttribArrayAOS<typename Vertex::ListType>::enable(0, sizeofVertex);
 	return vao;
 }
 
 class Geometry {
 protected:
-	friend class GraphicsContext;
+	friend class gfx::GraphicsContext;
+	friend class gfx::DrawList;
 
 	PrimitiveType m_primType = PrimitiveType::TRIANGLES;
 	size_t m_numVerts = 0, m_numInds = 0;
 	GLuint m_vboId = 0, m_iboId = 0, m_vaoId = 0;
 
+	// Location of the geometry within its vertex and index buffers
+	GLint m_baseVertex = 0;
+	size_t m_firstIndex = 0;
+
+	// Number of attribute locations used by the vertex type. Per instance
+	// attributes are placed after them.
+	GLuint m_numAttribLocations = 0;
+	const VertexFormat* m_vertexFormat = nullptr;
+
+	// Object space bounds of the vertex positions. Only known when the
+	// geometry was created or fully replaced from CPU side vertex data.
+	bool m_hasBounds = false;
+	BoundingBox m_bounds;
+	BoundingSphere m_boundingSphere;
+
+	template <class Vertex>
+	void initVertexArray() {
+		m_vaoId = generateVAO<Vertex>();
+		m_numAttribLocations = NumAttribLocations<typename Vertex::ListType>::value;
+		m_vertexFormat = &detail::vertexFormat<Vertex>();
+	}
+
+	template <class Vertex>
+	void computeBounds(const Vertex* verts, size_t numVerts) {
+		m_hasBounds = verts != nullptr &&
+				VertexBounds<Vertex>::compute(verts, numVerts, m_bounds, m_boundingSphere);
+	}
+
 public:
 	PrimitiveType primitiveType() const {
 		return m_primType;
@@ -124,10 +269,48 @@ public:
 		return m_numInds;
 	}
 
+	GLuint numAttribLocations() const {
+		return m_numAttribLocations;
+	}
+
+	const VertexFormat& vertexFormat() const {
+		return *m_vertexFormat;
+	}
+
+	GLint baseVertex() const {
+		return m_baseVertex;
+	}
+
+	size_t firstIndex() const {
+		return m_firstIndex;
+	}
+
 	bool isIndexed() const {
 		return m_iboId != 0;
 	}
 
+	bool hasBounds() const {
+		return m_hasBounds;
+	}
+
+	const BoundingBox& bounds() const {
+		return m_bounds;
+	}
+
+	const BoundingSphere& boundingSphere() const {
+		return m_boundingSphere;
+	}
+
+	/*
+	 * Sets the bounds of geometry whose vertices were not given on the CPU,
+	 * or were only partially updated. The sphere encloses the box.
+	 */
+	void setBounds(const BoundingBox& box) {
+		m_hasBounds = true;
+		m_bounds = box;
+		m_boundingSphere = BoundingSphere(box.center(), glm::length(box.extents()));
+	}
+
 	void setPrimiveType(const PrimitiveType& primType) {
 		m_primType = primType;
 	}
@@ -146,25 +329,27 @@ class GeometryBuffer: public detail::Geometry {
 	friend class GraphicsContext;
 
 	GeometryBuffer(bool isIndexed, PrimitiveType pType = TRIANGLES) {
+		detail::VertexArrayBindingGuard vaoGuard;
+
 		m_primType = pType;
 
-		glGenBuffers(1, &m_iboId);
+		glGenBuffers(1, &m_vboId);
 
 		glBindBuffer(GL_ARRAY_BUFFER, m_vboId);
 
-		m_vaoId = detail::generateVAO<Vertex>();
+		initVertexArray<Vertex>();
 
 		if(isIndexed) {
-			glGenBuffers(1, &m_vboId);
+			glGenBuffers(1, &m_iboId);
 			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_iboId);
 		}
 
-		glBindVertexArray(0);
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 	}
 
 	GeometryBuffer(size_t numVerts, PrimitiveType pType = TRIANGLES) {
+		detail::VertexArrayBindingGuard vaoGuard;
+
 		m_primType = pType;
 		m_numVerts = numVerts;
 
@@ -173,13 +358,14 @@ class GeometryBuffer: public detail::Geometry {
 		glBindBuffer(GL_ARRAY_BUFFER, m_vboId);
 		glBufferData(GL_ARRAY_BUFFER, numVerts*sizeof(Vertex), nullptr, GL_STATIC_DRAW);
 
-		m_vaoId = detail::generateVAO<Vertex>();
+		initVertexArray<Vertex>();
 
-		glBindVertexArray(0);
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
 	}
 
 	GeometryBuffer(size_t numVerts, const Vertex* verts, PrimitiveType pType = TRIANGLES) {
+		detail::VertexArrayBindingGuard vaoGuard;
+
 		m_primType = pType;
 		m_numVerts = numVerts;
 
@@ -188,13 +374,15 @@ class GeometryBuffer: public detail::Geometry {
 		glBindBuffer(GL_ARRAY_BUFFER, m_vboId);
 		glBufferData(GL_ARRAY_BUFFER, numVerts*sizeof(Vertex), verts, GL_STATIC_DRAW);
 
-		m_vaoId = detail::generateVAO<Vertex>();
+		initVertexArray<Vertex>();
+		computeBounds(verts, numVerts);
 
-		glBindVertexArray(0);
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
 	}
 
 	GeometryBuffer(size_t numVerts, size_t numInds, PrimitiveType pType = TRIANGLES) {
+		detail::VertexArrayBindingGuard vaoGuard;
+
 		m_primType = pType;
 		m_numVerts = numVerts;
 		m_numInds = numInds;
@@ -205,17 +393,17 @@ class GeometryBuffer: public detail::Geometry {
 		glBindBuffer(GL_ARRAY_BUFFER, m_vboId);
 		glBufferData(GL_ARRAY_BUFFER, numVerts*sizeof(Vertex), nullptr, GL_STATIC_DRAW);
 
-		m_vaoId = detail::generateVAO<Vertex>();
+		initVertexArray<Vertex>();
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_iboId);
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, numInds*sizeof(GLuint), nullptr, GL_STATIC_DRAW);
 
-		glBindVertexArray(0);
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 	}
 
 	GeometryBuffer(size_t numVerts, size_t numInds, const Vertex* verts, const GLuint* inds, PrimitiveType pType=TRIANGLES) {
+		detail::VertexArrayBindingGuard vaoGuard;
+
 		m_primType = pType;
 		m_numVerts = numVerts;
 		m_numInds = numInds;
@@ -226,14 +414,13 @@ class GeometryBuffer: public detail::Geometry {
 		glBindBuffer(GL_ARRAY_BUFFER, m_vboId);
 		glBufferData(GL_ARRAY_BUFFER, numVerts*sizeof(Vertex), verts, GL_STATIC_DRAW);
 
-		m_vaoId = detail::generateVAO<Vertex>();
+		initVertexArray<Vertex>();
+		computeBounds(verts, numVerts);
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_iboId);
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, numInds*sizeof(GLuint), inds, GL_STATIC_DRAW);
 
-		glBindVertexArray(0);
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 	}
 
 public:
@@ -248,6 +435,7 @@ public:
 	void setVertexData(Vertex* data, size_t numVertices) {
 		m_numVerts = numVertices;
 		glNamedBufferData(m_vboId, m_numVerts*sizeof(Vertex), data, GL_STATIC_DRAW);
+		computeBounds(data, numVertices);
 	}
 
 	void setIndexData(GLuint* data, size_t numIndices) {
@@ -267,9 +455,111 @@ public:
 };
 
 
+/*
+ * Geometry which is rewritten every frame.
+ * Vertex and index data live in persistently mapped buffers split into one
+ * region per frame in flight, so the CPU writes straight into GPU visible
+ * memory without reallocating or synchronizing with pending draws.
+ *
+ * Per frame usage:
+ *   fill vertexData() (and indexData()), commit(), draw, advance()
+ */
+template <class Vertex>
+class StreamingGeometryBuffer: public detail::Geometry {
+	friend class GraphicsContext;
+
+	size_t m_maxVerts = 0, m_maxInds = 0;
+
+	detail::PersistentRing m_vertRing;
+	std::unique_ptr<detail::PersistentRing> m_indRing;
+
+	StreamingGeometryBuffer(size_t maxVerts, size_t maxInds, size_t numRegions, PrimitiveType pType = TRIANGLES) :
+			m_maxVerts(maxVerts), m_maxInds(maxInds), m_vertRing(maxVerts*sizeof(Vertex), numRegions) {
+		detail::VertexArrayBindingGuard vaoGuard;
+
+		m_primType = pType;
+		m_vboId = m_vertRing.bufferId();
+
+		glBindBuffer(GL_ARRAY_BUFFER, m_vboId);
+
+		initVertexArray<Vertex>();
+
+		if(maxInds > 0) {
+			m_indRing.reset(new detail::PersistentRing(maxInds*sizeof(GLuint), numRegions));
+			m_iboId = m_indRing->bufferId();
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_iboId);
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+public:
+	virtual ~StreamingGeometryBuffer() {
+		glDeleteVertexArrays(1, &m_vaoId);
+	}
+
+	size_t maxVertices() const {
+		return m_maxVerts;
+	}
+
+	size_t maxIndices() const {
+		return m_maxInds;
+	}
+
+	/*
+	 * Mapped memory for this frame's vertices. Holds maxVertices() elements.
+	 */
+	Vertex* vertexData() {
+		return static_cast<Vertex*>(m_vertRing.regionData());
+	}
+
+	/*
+	 * Mapped memory for this frame's indices. Holds maxIndices() elements.
+	 * Indices are relative to the first vertex of vertexData().
+	 */
+	GLuint* indexData() {
+		BOOST_ASSERT_MSG(m_indRing, "Error attempting to get index data of non indexed geometry buffer");
+		return static_cast<GLuint*>(m_indRing->regionData());
+	}
+
+	/*
+	 * Set the amount of data written this frame. Must be called before drawing.
+	 */
+	void commit(size_t numVertices, size_t numIndices = 0) {
+		BOOST_ASSERT_MSG(numVertices <= m_maxVerts, "Error streaming more vertices than the buffer can hold");
+		BOOST_ASSERT_MSG(numIndices <= m_maxInds, "Error streaming more indices than the buffer can hold");
+		m_numVerts = numVertices;
+		m_numInds = numIndices;
+		m_baseVertex = m_vertRing.regionIndex() * m_maxVerts;
+		m_firstIndex = m_indRing ? m_indRing->regionIndex() * m_maxInds : 0;
+	}
+
+	/*
+	 * Call once all draws reading this frame's data have been issued.
+	 * Blocks only if the GPU is still reading the next region.
+	 */
+	void advance() {
+		m_vertRing.advance();
+		if(m_indRing) {
+			m_indRing->advance();
+		}
+	}
+
+	/*
+	 * Number of times advance() had to wait for the GPU
+	 */
+	size_t numStalls() const {
+		return m_vertRing.numStalls() + (m_indRing ? m_indRing->numStalls() : 0);
+	}
+};
+
+
 template <class Vertex>
 using GBufHandle = std::shared_ptr<GeometryBuffer<Vertex>>;
 
+template <class Vertex>
+using StreamingGBufHandle = std::shared_ptr<StreamingGeometryBuffer<Vertex>>;
+
 }
 
 #endif /* RENDERER_GEOMETRY_H_ */
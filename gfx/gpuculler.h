@@ -0,0 +1,190 @@
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <boost/assert.hpp>
+#include <glm/glm.hpp>
+
+#include "geometryarena.h"
+#include "shader.h"
+#include "stdbindings.h"
+
+#ifndef RENDERER_GPU_CULLER_H_
+#define RENDERER_GPU_CULLER_H_
+
+namespace gfx {
+
+class GraphicsContext;
+
+namespace detail {
+
+/*
+ * One object as seen by the culling compute shader, std430 layout.
+ * Keep in sync with shaders/cull_frustum_comp.glsl
+ */
+struct CullObject {
+	glm::mat4 model;
+
+	// Object space box, boundsMin.w is 0 for objects which are never culled
+	glm::vec4 boundsMin;
+	glm::vec4 boundsMax;
+
+	// count, firstIndex, baseVertex, unused
+	GLuint draw[4];
+};
+
+static_assert(sizeof(CullObject) == 112, "Error: CullObject does not match its std430 layout");
+
+}
+
+/*
+ * Frustum culling on the GPU for indexed geometry allocated from one
+ * GeometryArena.
+ *
+ * Every object's model matrix, object space bounds and draw arguments live
+ * in a shader storage buffer. GraphicsContext::cullOnGpu() runs a compute
+ * shader (shaders/cull_frustum_comp.glsl) which tests each object against
+ * the frustum and appends a draw command for the survivors to an indirect
+ * buffer, then GraphicsContext::drawCulled() draws them with the draw count
+ * taken from the GPU (GL_ARB_indirect_parameters). Nothing is read back.
+ * Without GL_ARB_indirect_parameters, commands are written in place with an
+ * instance count of 0 for culled objects instead.
+ *
+ * The object buffer is bound at PER_DRAW_DATA_BUFFER_BINDING while drawing
+ * and every command's baseInstance is its object's index, so vertex shaders
+ * fetch their model matrix with objects[gl_BaseInstanceARB].model.
+ *
+ * Only objects added or moved since the last cull are uploaded, so static
+ * scenes cost no per object CPU work per frame.
+ */
+template <class Vertex>
+class GpuCuller {
+	friend class GraphicsContext;
+
+	GArenaHandle<Vertex> m_arena;
+	ShaderProgramHandle m_cullProgram;
+	PrimitiveType m_primType;
+	size_t m_maxObjects;
+	bool m_compact;
+
+	GLuint m_objectBuffer = 0;
+	GLuint m_commandBuffer = 0;
+	GLuint m_drawCountBuffer = 0;
+
+	std::vector<detail::CullObject> m_objects;
+	std::vector<ArenaGBufHandle<Vertex>> m_geometries;
+
+	// Range of m_objects which changed since the last upload
+	size_t m_dirtyBegin = 0;
+	size_t m_dirtyEnd = 0;
+
+	GpuCuller(const GArenaHandle<Vertex>& arena, const ShaderProgramHandle& cullProgram,
+			size_t maxObjects, PrimitiveType pType) :
+				m_arena(arena), m_cullProgram(cullProgram), m_primType(pType), m_maxObjects(maxObjects),
+				m_compact(GLEW_ARB_indirect_parameters) {
+		m_objects.reserve(maxObjects);
+		m_geometries.reserve(maxObjects);
+
+		const GLuint zero = 0;
+		glCreateBuffers(1, &m_objectBuffer);
+		glNamedBufferStorage(m_objectBuffer, maxObjects*sizeof(detail::CullObject), nullptr, GL_DYNAMIC_STORAGE_BIT);
+		glCreateBuffers(1, &m_commandBuffer);
+		glNamedBufferStorage(m_commandBuffer, maxObjects*sizeof(DrawElementsIndirectCommand), nullptr, 0);
+		glCreateBuffers(1, &m_drawCountBuffer);
+		glNamedBufferStorage(m_drawCountBuffer, sizeof(GLuint), &zero, GL_DYNAMIC_STORAGE_BIT);
+	}
+
+	void markDirty(size_t object) {
+		if(m_dirtyBegin == m_dirtyEnd) {
+			m_dirtyBegin = object;
+			m_dirtyEnd = object + 1;
+		} else {
+			m_dirtyBegin = std::min(m_dirtyBegin, object);
+			m_dirtyEnd = std::max(m_dirtyEnd, object + 1);
+		}
+	}
+
+	void upload() {
+		if(m_dirtyBegin == m_dirtyEnd) {
+			return;
+		}
+		glNamedBufferSubData(m_objectBuffer, m_dirtyBegin*sizeof(detail::CullObject),
+				(m_dirtyEnd - m_dirtyBegin)*sizeof(detail::CullObject), &m_objects[m_dirtyBegin]);
+		m_dirtyBegin = m_dirtyEnd = 0;
+	}
+
+public:
+	GpuCuller(const GpuCuller&) = delete;
+	GpuCuller& operator=(const GpuCuller&) = delete;
+
+	~GpuCuller() {
+		glDeleteBuffers(1, &m_objectBuffer);
+		glDeleteBuffers(1, &m_commandBuffer);
+		glDeleteBuffers(1, &m_drawCountBuffer);
+	}
+
+	size_t size() const {
+		return m_objects.size();
+	}
+
+	size_t capacity() const {
+		return m_maxObjects;
+	}
+
+	/*
+	 * True if the surviving draws are compacted and counted on the GPU
+	 */
+	bool compacts() const {
+		return m_compact;
+	}
+
+	/*
+	 * Adds an object drawing geom with a model matrix and returns its index.
+	 * Geometry without bounds is never culled.
+	 */
+	uint32_t add(const ArenaGBufHandle<Vertex>& geom, const glm::mat4& model) {
+		BOOST_ASSERT_MSG(m_objects.size() < m_maxObjects, "Error: GpuCuller is full");
+		BOOST_ASSERT_MSG(geom->m_arena == m_arena, "Error: GpuCuller geometry must come from the culler's arena");
+		BOOST_ASSERT_MSG(geom->isIndexed(), "Error: GpuCuller only draws indexed geometry");
+
+		detail::CullObject obj;
+		obj.model = model;
+		if(geom->hasBounds()) {
+			obj.boundsMin = glm::vec4(geom->bounds().min, 1.0f);
+			obj.boundsMax = glm::vec4(geom->bounds().max, 1.0f);
+		} else {
+			obj.boundsMin = glm::vec4(0.0f);
+			obj.boundsMax = glm::vec4(0.0f);
+		}
+		obj.draw[0] = static_cast<GLuint>(geom->numIndices());
+		obj.draw[1] = static_cast<GLuint>(geom->firstIndex());
+		obj.draw[2] = static_cast<GLuint>(geom->baseVertex());
+		obj.draw[3] = 0;
+
+		const uint32_t index = static_cast<uint32_t>(m_objects.size());
+		m_objects.push_back(obj);
+		m_geometries.push_back(geom);
+		markDirty(index);
+		return index;
+	}
+
+	void setTransform(uint32_t object, const glm::mat4& model) {
+		BOOST_ASSERT_MSG(object < m_objects.size(), "Error: GpuCuller object index out of range");
+		m_objects[object].model = model;
+		markDirty(object);
+	}
+
+	const glm::mat4& transform(uint32_t object) const {
+		return m_objects[object].model;
+	}
+};
+
+template <class Vertex>
+using GpuCullerHandle = std::shared_ptr<GpuCuller<Vertex>>;
+
+}
+
+#endif /* RENDERER_GPU_CULLER_H_ */
@@ -3,49 +3,472 @@
 
 namespace gfx {
 
-utils::GLProgramBuilder GraphicsContext::programBuilder;
+static utils::GLProgramBuilder makeProgramBuilder() {
+	utils::GLProgramBuilder ret;
+	ret.setEmbeddedShaders(utils::EMBEDDED_SHADERS, utils::NUM_EMBEDDED_SHADERS, utils::EMBEDDED_SHADER_INCLUDE_DIRS);
+	return ret;
+}
+
+utils::GLProgramBuilder GraphicsContext::programBuilder = makeProgramBuilder();
 
 ShaderProgramHandle GraphicsContext::makeShaderProgramFromFiles(const std::string& vert, const std::string& frag) const {
+	return makeFileProgram(programBuilder.beginFromFiles(vert, frag));
+}
+
+ShaderProgramHandle GraphicsContext::makeShaderProgramFromStrings(const std::string& vert, const std::string& frag) const {
 	std::shared_ptr<ShaderProgram> ret = std::shared_ptr<ShaderProgram>(new ShaderProgram());
-	ret->m_programId = programBuilder.buildFromFiles(vert, frag);
+	ret->setProgramId(programBuilder.buildFromStrings(vert, frag));
 	return ret;
 }
 
-ShaderProgramHandle GraphicsContext::makeShaderProgramFromStrings(const std::string& vert, const std::string& frag) const {
+ShaderProgramHandle GraphicsContext::makeComputeProgramFromFile(const std::string& shader) const {
+	return makeFileProgram(programBuilder.beginComputeProgramFromFile(shader));
+}
+
+ShaderProgramHandle GraphicsContext::makeComputeProgramFromString(const std::string& shader) const {
+	std::shared_ptr<ShaderProgram> ret = std::shared_ptr<ShaderProgram>(new ShaderProgram());
+	ret->setProgramId(programBuilder.buildComputeProgramFromString(shader));
+	return ret;
+}
+
+ShaderProgramHandle GraphicsContext::makeFileProgram(utils::PendingProgram&& pending) const {
 	std::shared_ptr<ShaderProgram> ret = std::shared_ptr<ShaderProgram>(new ShaderProgram());
-	ret->m_programId = programBuilder.buildFromFiles(vert, frag);
+	ret->setProgramId(programBuilder.finishLink(pending));
+	ret->m_files = std::move(pending.files);
+	watchShaderProgram(ret);
+	return ret;
+}
+
+ShaderProgramHandle GraphicsContext::addPendingProgram(utils::PendingProgram&& pending) {
+	std::shared_ptr<ShaderProgram> ret = std::shared_ptr<ShaderProgram>(new ShaderProgram());
+	ret->m_files = std::move(pending.files);
+	ret->m_pending.reset(new utils::PendingProgram(std::move(pending)));
+	m_pendingPrograms.push_back(ret);
+	if(!ret->m_files.stages.empty()) {
+		watchShaderProgram(ret);
+	}
+	return ret;
+}
+
+void GraphicsContext::watchShaderProgram(const ShaderProgramHandle& program) const {
+	m_filePrograms.push_back(program);
+	if(m_shaderWatcher) {
+		for(const std::string& file : program->m_files.dependencies) {
+			m_shaderWatcher->watch(file);
+		}
+	}
+}
+
+ShaderProgramHandle GraphicsContext::beginShaderProgramFromFiles(const std::string& vert, const std::string& frag) {
+	programBuilder.enableParallelCompile();
+	return addPendingProgram(programBuilder.beginFromFiles(vert, frag));
+}
+
+ShaderProgramHandle GraphicsContext::beginShaderProgramFromStrings(const std::string& vert, const std::string& frag) {
+	programBuilder.enableParallelCompile();
+	return addPendingProgram(programBuilder.beginFromStrings(vert, frag));
+}
+
+std::vector<ShaderProgramHandle> GraphicsContext::beginShaderProgramsFromFiles(
+		const std::vector<std::pair<std::string, std::string>>& files) {
+	std::vector<ShaderProgramHandle> ret;
+	ret.reserve(files.size());
+	for(const auto& f : files) {
+		ret.push_back(beginShaderProgramFromFiles(f.first, f.second));
+	}
 	return ret;
 }
 
+ShaderProgramHandle GraphicsContext::beginComputeProgramFromFile(const std::string& shader) {
+	programBuilder.enableParallelCompile();
+	return addPendingProgram(programBuilder.beginComputeProgramFromFile(shader));
+}
+
+void GraphicsContext::finishShaderProgram(ShaderProgram& program) {
+	program.setProgramId(programBuilder.finishLink(*program.m_pending));
+	program.m_pending.reset();
+}
+
+size_t GraphicsContext::pollShaderPrograms() {
+	auto finished = std::remove_if(m_pendingPrograms.begin(), m_pendingPrograms.end(),
+			[this](const ShaderProgramHandle& program) {
+		// Programs which have been used are already finished
+		if(!program->isReady()) {
+			if(!programBuilder.isComplete(*program->m_pending)) {
+				return false;
+			}
+			finishShaderProgram(*program);
+		}
+		return true;
+	});
+	m_pendingPrograms.erase(finished, m_pendingPrograms.end());
+	return m_pendingPrograms.size();
+}
+
+void GraphicsContext::finishShaderPrograms() {
+	for(const ShaderProgramHandle& program : m_pendingPrograms) {
+		if(!program->isReady()) {
+			finishShaderProgram(*program);
+		}
+	}
+	m_pendingPrograms.clear();
+}
+
+OcclusionQueriesHandle GraphicsContext::makeOcclusionQueries(size_t numObjects, size_t numFrames) const {
+	static const std::string proxyVert =
+			"#version 330\n"
+			"layout(location = 0) in vec3 in_position;\n"
+			"uniform mat4 u_viewProj;\n"
+			"uniform vec3 u_boxMin;\n"
+			"uniform vec3 u_boxMax;\n"
+			"void main() {\n"
+			"	gl_Position = u_viewProj * vec4(mix(u_boxMin, u_boxMax, in_position), 1.0);\n"
+			"}\n";
+	static const std::string proxyFrag =
+			"#version 330\n"
+			"out vec4 out_color;\n"
+			"void main() {\n"
+			"	out_color = vec4(1.0);\n"
+			"}\n";
+
+	return std::shared_ptr<OcclusionQueries>(
+			new OcclusionQueries(numObjects, numFrames, makeShaderProgramFromStrings(proxyVert, proxyFrag)));
+}
+
+void GraphicsContext::beginOcclusionQueries(const OcclusionQueriesHandle& queries, const glm::mat4& viewProj) {
+	queries->advance();
+	queries->m_viewProj = viewProj;
+
+	useProgram(queries->m_proxyProgram);
+	glProgramUniformMatrix4fv(queries->m_proxyProgram->m_programId, queries->m_viewProjLocation, 1, GL_FALSE,
+			glm::value_ptr(viewProj));
+	bindVertexArray(queries->m_vaoId, queries);
+
+	// The camera may be inside a proxy's back faces
+	m_restoreFaceCulling = isCapabilityEnabled(CULL_FACE_CAP, GL_CULL_FACE);
+	m_restoreDepthTest = !isCapabilityEnabled(DEPTH_TEST_CAP, GL_DEPTH_TEST);
+	disableFaceCulling();
+	enableDepthBuffer();
+
+	// Depth prepasses and transparent passes draw with writes off
+	if(!m_state.colorMaskKnown) {
+		glGetBooleanv(GL_COLOR_WRITEMASK, m_state.colorMask.data());
+		m_state.colorMaskKnown = true;
+	}
+	if(!m_state.depthMaskKnown) {
+		glGetBooleanv(GL_DEPTH_WRITEMASK, &m_state.depthMask);
+		m_state.depthMaskKnown = true;
+	}
+	m_restoreColorMask = m_state.colorMask;
+	m_restoreDepthMask = m_state.depthMask;
+	setColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	setDepthMask(GL_FALSE);
+}
+
+bool GraphicsContext::queryOcclusion(const OcclusionQueriesHandle& queries, size_t object, const BoundingBox& box) {
+	BOOST_ASSERT_MSG(object < queries->m_numObjects, "Error: occlusion query object out of range");
+
+	for(int i = 0; i < 8; i++) {
+		const glm::vec4 corner((i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y,
+				(i & 4) ? box.max.z : box.min.z, 1.0f);
+		const glm::vec4 clip = queries->m_viewProj * corner;
+		if(clip.z < -clip.w) {
+			return false;
+		}
+	}
+
+	OcclusionQueries::Slot& slot = queries->slot(queries->m_frame, object);
+	glBeginQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, slot.query);
+	glProgramUniform3fv(queries->m_proxyProgram->m_programId, queries->m_boxMinLocation, 1, glm::value_ptr(box.min));
+	glProgramUniform3fv(queries->m_proxyProgram->m_programId, queries->m_boxMaxLocation, 1, glm::value_ptr(box.max));
+	glDrawElements(GL_TRIANGLES, OcclusionQueries::NUM_PROXY_INDICES, GL_UNSIGNED_INT, nullptr);
+	glEndQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE);
+
+	slot.issued = true;
+	queries->m_stats.queriesIssued += 1;
+	return true;
+}
+
+void GraphicsContext::endOcclusionQueries() {
+	setColorMask(m_restoreColorMask[0], m_restoreColorMask[1], m_restoreColorMask[2], m_restoreColorMask[3]);
+	setDepthMask(m_restoreDepthMask);
+	if(m_restoreFaceCulling) {
+		enableFaceCulling();
+	}
+	if(m_restoreDepthTest) {
+		disableDepthBuffer();
+	}
+}
+
+void GraphicsContext::beginConditionalDraw(const OcclusionQueriesHandle& queries, size_t object) {
+	BOOST_ASSERT_MSG(!m_inConditionalDraw, "Error: conditional draws cannot be nested");
+	OcclusionQueries::Slot& slot = queries->slot(queries->m_frame, object);
+	if(slot.issued) {
+		glBeginConditionalRender(slot.query, GL_QUERY_NO_WAIT);
+		slot.conditional = true;
+		m_inConditionalDraw = true;
+	}
+}
+
+void GraphicsContext::endConditionalDraw() {
+	if(m_inConditionalDraw) {
+		glEndConditionalRender();
+		m_inConditionalDraw = false;
+	}
+}
+
+void GraphicsContext::dispatchCompute(const ShaderProgramHandle& program, GLuint groupsX, GLuint groupsY, GLuint groupsZ) {
+	useProgram(program);
+	glDispatchCompute(groupsX, groupsY, groupsZ);
+}
+
 void GraphicsContext::addShaderProgramIncludeDir(const std::string& dirname) {
 	programBuilder.addIncludeDir(dirname);
 }
 
+void GraphicsContext::useEmbeddedShaders(bool use) {
+	programBuilder.setUseEmbeddedShaders(use);
+}
+
+void GraphicsContext::enableProgramBinaryCache(const std::string& dirname) {
+	programBuilder.enableBinaryCache(dirname);
+}
+
+void GraphicsContext::disableProgramBinaryCache() {
+	programBuilder.disableBinaryCache();
+}
+
+ShaderVariantsHandle GraphicsContext::makeShaderVariants(const std::string& vert, const std::string& frag,
+		const std::vector<ShaderOption>& options) const {
+	return std::shared_ptr<ShaderVariants>(new ShaderVariants(
+			{ { GL_VERTEX_SHADER, vert }, { GL_FRAGMENT_SHADER, frag } }, options));
+}
+
+ShaderProgramHandle GraphicsContext::shaderVariant(const ShaderVariantsHandle& variants, ShaderVariantKey key) {
+	const auto it = variants->m_programs.find(key);
+	if(it != variants->m_programs.end()) {
+		return it->second;
+	}
+	ShaderProgramHandle ret = makeFileProgram(programBuilder.beginFromFiles(variants->variantFiles(key)));
+	variants->addVariant(key, ret);
+	return ret;
+}
+
+void GraphicsContext::prewarmShaderVariants(const ShaderVariantsHandle& variants,
+		const std::vector<ShaderVariantKey>& keys) {
+	programBuilder.enableParallelCompile();
+	for(ShaderVariantKey key : keys) {
+		if(!variants->hasVariant(key)) {
+			variants->addVariant(key, addPendingProgram(programBuilder.beginFromFiles(variants->variantFiles(key))));
+		}
+	}
+}
+
+void GraphicsContext::enableShaderHotReload() {
+	if(m_shaderWatcher) {
+		return;
+	}
+	// Edits are made to the files, not to the copies built into the library
+	programBuilder.setUseEmbeddedShaders(false);
+	m_shaderWatcher.reset(new utils::FileWatcher());
+	for(const auto& weak : m_filePrograms) {
+		if(ShaderProgramHandle program = weak.lock()) {
+			for(const std::string& file : program->m_files.dependencies) {
+				m_shaderWatcher->watch(file);
+			}
+		}
+	}
+}
+
+void GraphicsContext::disableShaderHotReload() {
+	m_shaderWatcher.reset();
+}
+
+size_t GraphicsContext::reloadShaderPrograms() {
+	if(!m_shaderWatcher) {
+		return 0;
+	}
+	const std::vector<std::string> changed = m_shaderWatcher->takeChanged();
+	if(changed.empty()) {
+		return 0;
+	}
+	for(const std::string& file : changed) {
+		fprintf(stdout, "Shader file changed: %s\n", file.c_str());
+		programBuilder.getPreprocessor().invalidate(file);
+	}
+
+	m_filePrograms.erase(std::remove_if(m_filePrograms.begin(), m_filePrograms.end(),
+			[](const std::weak_ptr<ShaderProgram>& program) { return program.expired(); }), m_filePrograms.end());
+
+	// Submit every affected program before waiting for any, so they compile
+	// in parallel where the driver can
+	programBuilder.enableParallelCompile();
+	std::vector<std::pair<ShaderProgramHandle, utils::PendingProgram>> rebuilds;
+	for(const auto& weak : m_filePrograms) {
+		ShaderProgramHandle program = weak.lock();
+		const std::vector<std::string>& dependencies = program->m_files.dependencies;
+		const bool affected = std::find_first_of(dependencies.begin(), dependencies.end(),
+				changed.begin(), changed.end()) != dependencies.end();
+		if(!affected) {
+			continue;
+		}
+		try {
+			rebuilds.emplace_back(program, programBuilder.beginFromFiles(program->m_files));
+		} catch(const std::runtime_error& e) {
+			fprintf(stderr, "%s\nKeeping the previous program\n", e.what());
+		}
+	}
+
+	size_t numReloaded = 0;
+	for(auto& rebuild : rebuilds) {
+		ShaderProgram& program = *rebuild.first;
+		utils::PendingProgram& pending = rebuild.second;
+		const GLuint programId = programBuilder.finishLink(pending);
+		if(pending.failed) {
+			fprintf(stderr, "Keeping the previous program\n");
+			glDeleteProgram(programId);
+			continue;
+		}
+
+		if(!program.isReady()) {
+			finishShaderProgram(program);
+		}
+		// The old program is deleted by setProgramId(), don't leave it current
+		if(m_boundProgram == program.m_programId) {
+			glUseProgram(0);
+			m_boundProgram = 0;
+		}
+		program.setProgramId(programId);
+		program.m_files = std::move(pending.files);
+		for(const std::string& file : program.m_files.dependencies) {
+			m_shaderWatcher->watch(file);
+		}
+		numReloaded += 1;
+	}
+	return numReloaded;
+}
+
+void GraphicsContext::setCapability(CachedCap cap, GLenum glCap, bool enabled) {
+	if(m_state.capKnown[cap] && m_state.capEnabled[cap] == enabled) {
+		m_stateStats.elided += 1;
+		return;
+	}
+
+	if(enabled) {
+		glEnable(glCap);
+	} else {
+		glDisable(glCap);
+	}
+	m_state.capKnown[cap] = true;
+	m_state.capEnabled[cap] = enabled;
+	m_stateStats.issued += 1;
+}
+
+bool GraphicsContext::isCapabilityEnabled(CachedCap cap, GLenum glCap) {
+	if(!m_state.capKnown[cap]) {
+		m_state.capEnabled[cap] = glIsEnabled(glCap) == GL_TRUE;
+		m_state.capKnown[cap] = true;
+	}
+	return m_state.capEnabled[cap];
+}
+
 void GraphicsContext::enableAlphaBlending() {
-	glEnable(GL_BLEND);
+	setCapability(BLEND_CAP, GL_BLEND, true);
+}
+
+void GraphicsContext::disableAlphaBlending() {
+	setCapability(BLEND_CAP, GL_BLEND, false);
+}
+
+void GraphicsContext::setBlendFunc(BlendFactor src, BlendFactor dst) {
+	if(m_state.blendFuncKnown && m_state.blendSrc == GLenum(src) && m_state.blendDst == GLenum(dst)) {
+		m_stateStats.elided += 1;
+		return;
+	}
+
+	glBlendFunc(src, dst);
+	m_state.blendFuncKnown = true;
+	m_state.blendSrc = src;
+	m_state.blendDst = dst;
+	m_stateStats.issued += 1;
 }
 
 void GraphicsContext::enableFaceCulling() {
-	glEnable(GL_CULL_FACE);
+	setCapability(CULL_FACE_CAP, GL_CULL_FACE, true);
 }
 
 void GraphicsContext::disableFaceCulling() {
-	glDisable(GL_CULL_FACE);
+	setCapability(CULL_FACE_CAP, GL_CULL_FACE, false);
 }
 
 void GraphicsContext::setFaceCullMode(FaceCullMode mode) {
+	if(m_state.cullModeKnown && m_state.cullMode == GLenum(mode)) {
+		m_stateStats.elided += 1;
+		return;
+	}
+
 	glCullFace(mode);
+	m_state.cullModeKnown = true;
+	m_state.cullMode = mode;
+	m_stateStats.issued += 1;
 }
 
 void GraphicsContext::setClearColor(const glm::vec4& clearColor) {
+	if(m_state.clearColorKnown && m_state.clearColor == clearColor) {
+		m_stateStats.elided += 1;
+		return;
+	}
+
 	glClearColor(clearColor.r, clearColor.g, clearColor.b, clearColor.a);
+	m_state.clearColorKnown = true;
+	m_state.clearColor = clearColor;
+	m_stateStats.issued += 1;
 }
 
 void GraphicsContext::enableDepthBuffer() {
-	glEnable(GL_DEPTH_TEST);
+	setCapability(DEPTH_TEST_CAP, GL_DEPTH_TEST, true);
 }
 
 void GraphicsContext::disableDepthBuffer() {
-	glDisable(GL_DEPTH_TEST);
+	setCapability(DEPTH_TEST_CAP, GL_DEPTH_TEST, false);
+}
+
+void GraphicsContext::setColorMask(GLboolean r, GLboolean g, GLboolean b, GLboolean a) {
+	const std::array<GLboolean, 4> mask = { { r, g, b, a } };
+	if(m_state.colorMaskKnown && m_state.colorMask == mask) {
+		m_stateStats.elided += 1;
+		return;
+	}
+
+	glColorMask(r, g, b, a);
+	m_state.colorMaskKnown = true;
+	m_state.colorMask = mask;
+	m_stateStats.issued += 1;
+}
+
+void GraphicsContext::setDepthMask(GLboolean enabled) {
+	if(m_state.depthMaskKnown && m_state.depthMask == enabled) {
+		m_stateStats.elided += 1;
+		return;
+	}
+
+	glDepthMask(enabled);
+	m_state.depthMaskKnown = true;
+	m_state.depthMask = enabled;
+	m_stateStats.issued += 1;
+}
+
+void GraphicsContext::invalidateStateCache() {
+	m_state = StateCache();
+
+	// 0 is a valid name for both bindings, so rebind to a known state rather
+	// than trying to represent "unknown"
+	glBindVertexArray(0);
+	m_boundVao = 0;
+	m_boundVaoOwner.reset();
+
+	glUseProgram(0);
+	m_boundProgram = 0;
+	m_boundProgramOwner.reset();
 }
 }
@@ -3,6 +3,7 @@
 #include <array>
 #include <memory>
 #include <utility>
+#include <type_traits>
 #include <iostream>
 
 #include <glm/glm.hpp>
@@ -10,8 +11,21 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "utils/gl_program_builder.h"
+#include "utils/file_watcher.h"
 #include "geometrybuffer.h"
+#include "geometryarena.h"
+#include "drawbatch.h"
+#include "instancebuffer.h"
+#include "drawlist.h"
+#include "commandbuffer.h"
+#include "gpuculler.h"
+#include "occlusionqueries.h"
+#include "uniformbuffer.h"
+#include "uniformring.h"
+#include "stdbindings.h"
 #include "shader.h"
+#include "shadervariants.h"
+#include "utils/frustum.h"
 
 #ifndef RENDERER_H_
 #define RENDERER_H_
@@ -20,17 +34,246 @@ namespace gfx {
 
 enum FaceCullMode { BACK = GL_BACK, FRONT = GL_FRONT, FRONT_AND_BACK = GL_FRONT_AND_BACK };
 enum WindingMode { CW, CCW };
+enum BlendFactor {
+	ZERO = GL_ZERO, ONE = GL_ONE,
+	SRC_ALPHA = GL_SRC_ALPHA, ONE_MINUS_SRC_ALPHA = GL_ONE_MINUS_SRC_ALPHA,
+	DST_ALPHA = GL_DST_ALPHA, ONE_MINUS_DST_ALPHA = GL_ONE_MINUS_DST_ALPHA,
+	SRC_COLOR = GL_SRC_COLOR, ONE_MINUS_SRC_COLOR = GL_ONE_MINUS_SRC_COLOR,
+	DST_COLOR = GL_DST_COLOR, ONE_MINUS_DST_COLOR = GL_ONE_MINUS_DST_COLOR
+};
+
+/*
+ * Counts of state changes sent to GL and state changes skipped because the
+ * state was already set. Reset by GraphicsContext::beginFrame()
+ */
+struct StateStats {
+	size_t issued = 0;
+	size_t elided = 0;
+};
 
 class GraphicsContext {
 	std::shared_ptr<detail::Geometry> m_currentBuf;
 
+	// Holding the owner of the bound VAO keeps it alive, so m_boundVao cannot
+	// be deleted and its name reused while it is cached
+	std::shared_ptr<const void> m_boundVaoOwner;
+	GLuint m_boundVao = 0;
+
+	// Same for the current program
+	ShaderProgramHandle m_boundProgramOwner;
+	GLuint m_boundProgram = 0;
+
+	// Programs whose compiles and links are still in flight
+	std::vector<ShaderProgramHandle> m_pendingPrograms;
+
+	// Programs built from files, to rebuild when a file they depend on
+	// changes. Mutable since the factory functions making them are const.
+	mutable std::vector<std::weak_ptr<ShaderProgram>> m_filePrograms;
+	std::unique_ptr<utils::FileWatcher> m_shaderWatcher;
+
+	/*
+	 * Shadow copy of the remaining GL state set through the context. Nothing is
+	 * known until the first time a piece of state is set, so the first call
+	 * always goes through to GL
+	 */
+	enum CachedCap { DEPTH_TEST_CAP, CULL_FACE_CAP, BLEND_CAP, NUM_CACHED_CAPS };
+	struct StateCache {
+		std::array<bool, NUM_CACHED_CAPS> capKnown {};
+		std::array<bool, NUM_CACHED_CAPS> capEnabled {};
+
+		bool cullModeKnown = false;
+		GLenum cullMode = GL_BACK;
+
+		bool blendFuncKnown = false;
+		GLenum blendSrc = GL_ONE;
+		GLenum blendDst = GL_ZERO;
+
+		bool clearColorKnown = false;
+		glm::vec4 clearColor;
+
+		bool colorMaskKnown = false;
+		std::array<GLboolean, 4> colorMask {};
+
+		bool depthMaskKnown = false;
+		GLboolean depthMask = GL_TRUE;
+
+		// Range bound at PER_DRAW_MATRIX_BLOCK_BINDING. Forgotten every
+		// frame, so a ring deleted since can't leave a stale name behind
+		bool drawRangeKnown = false;
+		UniformRange drawRange;
+	} m_state;
+
+	StateStats m_stateStats;
+
+	// State to put back after drawing occlusion query proxies
+	bool m_restoreFaceCulling = false;
+	bool m_restoreDepthTest = false;
+	std::array<GLboolean, 4> m_restoreColorMask {};
+	GLboolean m_restoreDepthMask = GL_TRUE;
+
+	bool m_inConditionalDraw = false;
+
+	void bindVertexArray(GLuint vao, const std::shared_ptr<const void>& owner) {
+		if(m_boundVao != vao) {
+			glBindVertexArray(vao);
+			m_boundVao = vao;
+			m_stateStats.issued += 1;
+		} else {
+			m_stateStats.elided += 1;
+		}
+		m_boundVaoOwner = owner;
+	}
+
+	void useProgram(const ShaderProgramHandle& program) {
+		if(!program->isReady()) {
+			finishShaderProgram(*program);
+		}
+		if(m_boundProgram != program->m_programId) {
+			glUseProgram(program->m_programId);
+			m_boundProgram = program->m_programId;
+			m_stateStats.issued += 1;
+		} else {
+			m_stateStats.elided += 1;
+		}
+		m_boundProgramOwner = program;
+	}
+
+	void bindDrawUniformRange(const UniformRange& range) {
+		const UniformRange& bound = m_state.drawRange;
+		if(m_state.drawRangeKnown && range.buffer == bound.buffer &&
+				range.offset == bound.offset && range.size == bound.size) {
+			m_stateStats.elided += 1;
+			return;
+		}
+		glBindBufferRange(GL_UNIFORM_BUFFER, PER_DRAW_MATRIX_BLOCK_BINDING, range.buffer, range.offset, range.size);
+		m_state.drawRange = range;
+		m_state.drawRangeKnown = true;
+		m_stateStats.issued += 1;
+	}
+
+	/*
+	 * Whether the current program's vertex inputs match the current
+	 * geometry's vertex format. Only used in assertions, the result is
+	 * cached per program and format.
+	 */
+	bool vertexInputsMatch() const {
+		std::string error;
+		if(!m_boundProgramOwner || m_boundProgramOwner->acceptsVertexFormat(m_currentBuf->vertexFormat(), &error)) {
+			return true;
+		}
+		std::cerr << error << std::endl;
+		return false;
+	}
+
+	void setCapability(CachedCap cap, GLenum glCap, bool enabled);
+
+	/*
+	 * The cached state of cap, asking GL for it if it isn't known yet
+	 */
+	bool isCapabilityEnabled(CachedCap cap, GLenum glCap);
+
+	void finishShaderProgram(ShaderProgram& program);
+
+	ShaderProgramHandle addPendingProgram(utils::PendingProgram&& pending);
+
+	ShaderProgramHandle makeFileProgram(utils::PendingProgram&& pending) const;
+
+	void watchShaderProgram(const ShaderProgramHandle& program) const;
+
 	static utils::GLProgramBuilder programBuilder;
 
 public:
 	ShaderProgramHandle makeShaderProgramFromFiles(const std::string& vert, const std::string& frag) const;
 	ShaderProgramHandle makeShaderProgramFromStrings(const std::string& vert, const std::string& frag) const;
+	ShaderProgramHandle makeComputeProgramFromFile(const std::string& shader) const;
+	ShaderProgramHandle makeComputeProgramFromString(const std::string& shader) const;
 	void addShaderProgramIncludeDir(const std::string& dirname);
 
+	/*
+	 * Whether programs built from the files in gfx/shaders use the copies
+	 * preprocessed at build time and compiled into the library instead of
+	 * reading the files, see utils::EmbeddedShader. On by default, the
+	 * copies are used while the include directories are the ones they were
+	 * built with. enableShaderHotReload() turns it off.
+	 */
+	void useEmbeddedShaders(bool use);
+
+	/*
+	 * Submit the compiles and links of programs without waiting for the
+	 * driver, which compiles them on its own threads if it supports
+	 * GL_KHR_parallel_shader_compile. The returned programs become ready
+	 * later: pollShaderPrograms() finishes those the driver is done with,
+	 * and using a program that isn't ready waits for it.
+	 */
+	ShaderProgramHandle beginShaderProgramFromFiles(const std::string& vert, const std::string& frag);
+	ShaderProgramHandle beginShaderProgramFromStrings(const std::string& vert, const std::string& frag);
+	std::vector<ShaderProgramHandle> beginShaderProgramsFromFiles(
+			const std::vector<std::pair<std::string, std::string>>& files);
+	ShaderProgramHandle beginComputeProgramFromFile(const std::string& shader);
+
+	/*
+	 * Finishes the pending programs the driver is done with and returns how
+	 * many are left. Without GL_KHR_parallel_shader_compile the driver can't
+	 * be polled and this finishes them all.
+	 */
+	size_t pollShaderPrograms();
+
+	/*
+	 * Waits for every pending program
+	 */
+	void finishShaderPrograms();
+
+	/*
+	 * Cache linked programs in dirname and load them from there on later
+	 * runs instead of compiling them, see utils::ProgramBinaryCache
+	 */
+	void enableProgramBinaryCache(const std::string& dirname);
+
+	void disableProgramBinaryCache();
+
+	const utils::ProgramBinaryCache* programBinaryCache() const {
+		return programBuilder.getBinaryCache();
+	}
+
+	/*
+	 * A set of programs built from the same files with different values of
+	 * options, see ShaderVariants
+	 */
+	ShaderVariantsHandle makeShaderVariants(const std::string& vert, const std::string& frag,
+			const std::vector<ShaderOption>& options) const;
+
+	/*
+	 * The variant of a set with the given key, built now if it hasn't been
+	 */
+	ShaderProgramHandle shaderVariant(const ShaderVariantsHandle& variants, ShaderVariantKey key);
+
+	/*
+	 * Submits the variants of a set which haven't been built yet without
+	 * waiting for them, like beginShaderProgramFromFiles(). They are
+	 * finished by pollShaderPrograms() or when first used.
+	 */
+	void prewarmShaderVariants(const ShaderVariantsHandle& variants, const std::vector<ShaderVariantKey>& keys);
+
+	/*
+	 * Watch the files programs are built from, including the files they
+	 * include, so reloadShaderPrograms() can rebuild programs after a file
+	 * is edited. Programs built afterwards read their files rather than
+	 * embedded copies.
+	 */
+	void enableShaderHotReload();
+
+	void disableShaderHotReload();
+
+	/*
+	 * Rebuilds the programs depending on files changed since the last call
+	 * and returns how many were replaced. Call it between frames. Replaced
+	 * programs keep their handles, uniform handles, block bindings and the
+	 * values set through PER_FRAME uniform handles, other uniform values go
+	 * back to their defaults. A program which fails to compile or link keeps
+	 * running the previous version.
+	 */
+	size_t reloadShaderPrograms();
+
 	template <class Vertex>
 	GBufHandle<Vertex> makeGeometryBuffer() const {
 		return std::shared_ptr<GeometryBuffer<Vertex>>(new GeometryBuffer<Vertex>(false));
@@ -64,31 +307,342 @@ public:
 	}
 
 	template <class Vertex>
-	void setGeometryBuffer(const GBufHandle<Vertex>& hdl) {
+	StreamingGBufHandle<Vertex> makeStreamingGeometryBuffer(size_t maxVerts,
+			size_t numRegions = detail::PersistentRing::DEFAULT_NUM_REGIONS) const {
+		return std::shared_ptr<StreamingGeometryBuffer<Vertex>>(
+				new StreamingGeometryBuffer<Vertex>(maxVerts, 0, numRegions));
+	}
+
+	template <class Vertex>
+	StreamingGBufHandle<Vertex> makeIndexedStreamingGeometryBuffer(size_t maxVerts, size_t maxInds,
+			size_t numRegions = detail::PersistentRing::DEFAULT_NUM_REGIONS) const {
+		return std::shared_ptr<StreamingGeometryBuffer<Vertex>>(
+				new StreamingGeometryBuffer<Vertex>(maxVerts, maxInds, numRegions));
+	}
+
+	template <class Vertex>
+	GArenaHandle<Vertex> makeGeometryArena(size_t maxVerts, size_t maxInds = 0) const {
+		return std::shared_ptr<GeometryArena<Vertex>>(new GeometryArena<Vertex>(maxVerts, maxInds));
+	}
+
+	template <class DrawData, class Vertex>
+	DrawBatchHandle<Vertex, DrawData> makeDrawBatch(const GArenaHandle<Vertex>& arena, size_t maxDraws,
+			PrimitiveType pType = TRIANGLES,
+			size_t numRegions = detail::PersistentRing::DEFAULT_NUM_REGIONS) const {
+		return std::shared_ptr<DrawBatch<Vertex, DrawData>>(
+				new DrawBatch<Vertex, DrawData>(arena, maxDraws, pType, numRegions));
+	}
+
+	template <class Instance>
+	InstanceBufHandle<Instance> makeInstanceBuffer(size_t maxInstances,
+			size_t numRegions = detail::PersistentRing::DEFAULT_NUM_REGIONS) const {
+		return std::shared_ptr<InstanceBuffer<Instance>>(new InstanceBuffer<Instance>(maxInstances, numRegions));
+	}
+
+	/*
+	 * cullProgram must be built from shaders/cull_frustum_comp.glsl
+	 * (or a shader with the same interface)
+	 */
+	template <class Vertex>
+	GpuCullerHandle<Vertex> makeGpuCuller(const GArenaHandle<Vertex>& arena, const ShaderProgramHandle& cullProgram,
+			size_t maxObjects, PrimitiveType pType = TRIANGLES) const {
+		return std::shared_ptr<GpuCuller<Vertex>>(new GpuCuller<Vertex>(arena, cullProgram, maxObjects, pType));
+	}
+
+	/*
+	 * Queries for numObjects objects whose results are read back
+	 * numFrames - 1 frames later
+	 */
+	OcclusionQueriesHandle makeOcclusionQueries(size_t numObjects, size_t numFrames = 2) const;
+
+	/*
+	 * Block must be a Std140Tuple, see UniformBuffer
+	 */
+	template <class Block>
+	UniformBufHandle<Block> makeUniformBuffer() const {
+		return std::shared_ptr<UniformBuffer<Block>>(new UniformBuffer<Block>());
+	}
+
+	/*
+	 * A ring of bytesPerFrame bytes of per draw uniform blocks per frame
+	 */
+	UniformRingHandle makeUniformRing(size_t bytesPerFrame,
+			size_t numRegions = detail::PersistentRing::DEFAULT_NUM_REGIONS) const {
+		return std::shared_ptr<UniformRing>(new UniformRing(bytesPerFrame, numRegions));
+	}
+
+	/*
+	 * Command buffers make no GL calls, so they can be recorded on any thread,
+	 * but create them here on the GL thread
+	 */
+	CommandBufferHandle makeCommandBuffer(size_t reserveCommands = 0, size_t reservePayload = 0) const {
+		return std::shared_ptr<CommandBuffer>(new CommandBuffer(reserveCommands, reservePayload));
+	}
+
+	DrawListHandle makeDrawList(size_t reserve = 0) const {
+		return std::shared_ptr<DrawList>(new DrawList(reserve));
+	}
+
+	template <class Geom>
+	void setGeometryBuffer(const std::shared_ptr<Geom>& hdl) {
+		static_assert(std::is_base_of<detail::Geometry, Geom>::value,
+				"Error: setGeometryBuffer requires a handle to a geometry buffer");
 		m_currentBuf = std::static_pointer_cast<detail::Geometry>(hdl);
-		glBindVertexArray(hdl->m_vaoId);
+
+		// Geometry allocated from the same arena shares a VAO
+		bindVertexArray(hdl->m_vaoId, hdl);
 	}
 
+	/*
+	 * Runs a compute program. Callers issue their own glMemoryBarrier
+	 * before consuming the results.
+	 */
+	void dispatchCompute(const ShaderProgramHandle& program, GLuint groupsX, GLuint groupsY = 1, GLuint groupsZ = 1);
+
 	void setShaderProgram(const ShaderProgramHandle& hdl) {
-		glUseProgram(hdl->m_programId);
+		useProgram(hdl);
+	}
+
+	/*
+	 * Binds a whole uniform buffer to a uniform block binding point, see
+	 * StdBindingPoint and ShaderProgram::setUniformBlockBinding()
+	 */
+	template <class Block>
+	void bindUniformBuffer(const UniformBufHandle<Block>& buffer, GLuint binding) {
+		glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer->m_bufferId);
+		if(binding == PER_DRAW_MATRIX_BLOCK_BINDING) {
+			m_state.drawRangeKnown = false;
+		}
+	}
+
+	/*
+	 * Binds a range, e.g. from a UniformRing, at PER_DRAW_MATRIX_BLOCK_BINDING
+	 * for the following draws. Binding the range already bound does nothing.
+	 */
+	void bindUniformRange(const UniformRange& range) {
+		bindDrawUniformRange(range);
 	}
 
 	void draw() {
+		BOOST_ASSERT_MSG(vertexInputsMatch(), "Error: program vertex inputs do not match the geometry's vertex format");
 		if(m_currentBuf->isIndexed()) {
-			glDrawElements(m_currentBuf->primitiveType(), m_currentBuf->numIndices(), GL_UNSIGNED_INT, nullptr);
+			const size_t indexOffset = m_currentBuf->firstIndex() * sizeof(GLuint);
+			glDrawElementsBaseVertex(m_currentBuf->primitiveType(), m_currentBuf->numIndices(), GL_UNSIGNED_INT,
+					reinterpret_cast<void*>(indexOffset), m_currentBuf->baseVertex());
+		} else {
+			glDrawArrays(m_currentBuf->primitiveType(), m_currentBuf->baseVertex(), m_currentBuf->numVertices());
+		}
+	}
+
+	/*
+	 * Submit every draw queued in batch with a single glMultiDrawElementsIndirect.
+	 * Uses the currently set shader program.
+	 */
+	template <class Vertex, class DrawData>
+	void drawBatch(const DrawBatchHandle<Vertex, DrawData>& batch) {
+		if(batch->size() == 0) {
+			return;
+		}
+
+		bindVertexArray(batch->m_arena->m_vaoId, batch->m_arena);
+
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, PER_DRAW_DATA_BUFFER_BINDING,
+				batch->m_drawDataRing.bufferId(), batch->m_drawDataRing.regionOffset(),
+				batch->size()*sizeof(DrawData));
+
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, batch->m_commandRing.bufferId());
+		glMultiDrawElementsIndirect(batch->primitiveType(), GL_UNSIGNED_INT,
+				reinterpret_cast<void*>(batch->m_commandRing.regionOffset()), batch->size(), 0);
+	}
+
+	/*
+	 * Culls every object of a GpuCuller against a frustum on the GPU,
+	 * writing the indirect draw commands consumed by drawCulled()
+	 */
+	template <class Vertex>
+	void cullOnGpu(const GpuCullerHandle<Vertex>& culler, const Frustum& frustum) {
+		static const GLint PLANES_LOCATION = 0;
+		static const GLint NUM_OBJECTS_LOCATION = 6;
+		static const GLint COMPACT_LOCATION = 7;
+		static const GLuint LOCAL_SIZE = 64;
+
+		if(culler->size() == 0) {
+			return;
+		}
+		culler->upload();
+
+		const GLuint programId = culler->m_cullProgram->m_programId;
+		glProgramUniform4fv(programId, PLANES_LOCATION, Frustum::NUM_PLANES, glm::value_ptr(frustum.planes[0]));
+		glProgramUniform1ui(programId, NUM_OBJECTS_LOCATION, static_cast<GLuint>(culler->size()));
+		glProgramUniform1ui(programId, COMPACT_LOCATION, culler->m_compact ? 1 : 0);
+
+		const GLuint zero = 0;
+		glClearNamedBufferData(culler->m_drawCountBuffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_OBJECT_BUFFER_BINDING, culler->m_objectBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_COMMAND_BUFFER_BINDING, culler->m_commandBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_DRAW_COUNT_BUFFER_BINDING, culler->m_drawCountBuffer);
+
+		const GLuint numGroups = static_cast<GLuint>((culler->size() + LOCAL_SIZE - 1) / LOCAL_SIZE);
+		dispatchCompute(culler->m_cullProgram, numGroups);
+
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+	/*
+	 * Draws the objects which survived the last cullOnGpu() with the current shader program
+	 */
+	template <class Vertex>
+	void drawCulled(const GpuCullerHandle<Vertex>& culler) {
+		if(culler->size() == 0) {
+			return;
+		}
+
+		bindVertexArray(culler->m_arena->m_vaoId, culler->m_arena);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PER_DRAW_DATA_BUFFER_BINDING, culler->m_objectBuffer);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, culler->m_commandBuffer);
+
+		if(culler->m_compact) {
+			glBindBuffer(GL_PARAMETER_BUFFER_ARB, culler->m_drawCountBuffer);
+			glMultiDrawElementsIndirectCountARB(culler->m_primType, GL_UNSIGNED_INT, nullptr, 0,
+					static_cast<GLsizei>(culler->size()), 0);
+			glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
 		} else {
-			glDrawArrays(GL_TRIANGLES, 0, m_currentBuf->numVertices());
+			glMultiDrawElementsIndirect(culler->m_primType, GL_UNSIGNED_INT, nullptr,
+					static_cast<GLsizei>(culler->size()), 0);
 		}
 	}
 
+	/*
+	 * Starts a frame of occlusion queries: reads back the results which are
+	 * ready and sets up state for drawing bounding box proxies, with color
+	 * and depth writes off. No other drawing until endOcclusionQueries().
+	 */
+	void beginOcclusionQueries(const OcclusionQueriesHandle& queries, const glm::mat4& viewProj);
+
+	/*
+	 * Draws an object's world space bounding box inside its query. Boxes
+	 * crossing the near plane are not queried and their object is drawn
+	 * unconditionally; returns whether a query was issued.
+	 */
+	bool queryOcclusion(const OcclusionQueriesHandle& queries, size_t object, const BoundingBox& box);
+
+	/*
+	 * Puts back the culling, depth test and write masks in effect before
+	 * beginOcclusionQueries()
+	 */
+	void endOcclusionQueries();
+
+	/*
+	 * Draws issued until endConditionalDraw() are skipped by the GPU if the
+	 * object's proxy was hidden this frame
+	 */
+	void beginConditionalDraw(const OcclusionQueriesHandle& queries, size_t object);
+
+	void endConditionalDraw();
+
 	// TODO: Wireframe drawing
 	void drawWireFrame();
 
-	// TODO: Instanced rendering
-	void drawInstanced();
+	/*
+	 * Draw the current geometry once per committed instance.
+	 * The instance attributes are attached to the geometry's VAO starting at
+	 * the first location after its vertex attributes.
+	 */
+	template <class Instance>
+	void drawInstanced(const InstanceBufHandle<Instance>& instances) {
+		if(instances->numInstances() == 0) {
+			return;
+		}
+		BOOST_ASSERT_MSG(vertexInputsMatch(), "Error: program vertex inputs do not match the geometry's vertex format");
+
+		glBindBuffer(GL_ARRAY_BUFFER, instances->m_ring.bufferId());
+		detail::EnableAttribArrayAOS<typename Instance::ListType>::enable(
+				m_currentBuf->numAttribLocations(), sizeof(Instance), instances->m_ring.regionOffset(), 1);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		if(m_currentBuf->isIndexed()) {
+			const size_t indexOffset = m_currentBuf->firstIndex() * sizeof(GLuint);
+			glDrawElementsInstancedBaseVertex(m_currentBuf->primitiveType(), m_currentBuf->numIndices(),
+					GL_UNSIGNED_INT, reinterpret_cast<void*>(indexOffset), instances->numInstances(),
+					m_currentBuf->baseVertex());
+		} else {
+			glDrawArraysInstanced(m_currentBuf->primitiveType(), m_currentBuf->baseVertex(),
+					m_currentBuf->numVertices(), instances->numInstances());
+		}
+	}
+
+	/*
+	 * Replays a DrawList in key order, or in submission order if it was not
+	 * sorted. Program and VAO changes go through the state cache, so runs of
+	 * draws sharing them only set them once.
+	 */
+	void submit(const DrawListHandle& list) {
+		for(const DrawList::SortEntry& entry : list->m_entries) {
+			const DrawList::Packet& packet = list->m_packets[entry.packet];
+
+			useProgram(packet.program);
+			m_currentBuf = packet.geometry;
+			bindVertexArray(packet.geometry->m_vaoId, packet.geometry);
+
+			if(packet.uniforms.size > 0) {
+				bindDrawUniformRange(packet.uniforms);
+			}
+
+			draw();
+		}
+	}
+
+	/*
+	 * Runs the commands recorded in a CommandBuffer. Must not be called while
+	 * another thread is still recording into it.
+	 */
+	void execute(const CommandBufferHandle& buffer) {
+		for(const CommandBuffer::Command& cmd : buffer->m_commands) {
+			switch(cmd.type) {
+			case CommandBuffer::SET_PROGRAM: {
+				const ShaderProgramHandle& program = buffer->m_programs[cmd.arg];
+				useProgram(program);
+				break;
+			}
+			case CommandBuffer::SET_GEOMETRY: {
+				const std::shared_ptr<detail::Geometry>& geom = buffer->m_geometries[cmd.arg];
+				m_currentBuf = geom;
+				bindVertexArray(geom->m_vaoId, geom);
+				break;
+			}
+			case CommandBuffer::SET_UNIFORM:
+				BOOST_ASSERT_MSG(m_boundProgramOwner, "Error: CommandBuffer sets a uniform with no shader program bound.");
+				detail::setUniformFromData(cmd.glType, cmd.location, cmd.count, buffer->m_payload.data() + cmd.arg);
+				if(m_boundProgramOwner) {
+					m_boundProgramOwner->forgetUniformValue(cmd.location, cmd.count);
+				}
+				break;
+			case CommandBuffer::BIND_UNIFORM_RANGE:
+				bindDrawUniformRange(buffer->m_uniformRanges[cmd.arg]);
+				break;
+			case CommandBuffer::DRAW:
+				draw();
+				break;
+			}
+		}
+	}
+
+	/*
+	 * Runs several command buffers in order, e.g. one per recording thread
+	 */
+	void execute(const std::vector<CommandBufferHandle>& buffers) {
+		for(const CommandBufferHandle& buffer : buffers) {
+			execute(buffer);
+		}
+	}
 
 	void enableAlphaBlending();
 
+	void disableAlphaBlending();
+
+	void setBlendFunc(BlendFactor src, BlendFactor dst);
+
 	void enableFaceCulling();
 
 	void disableFaceCulling();
@@ -100,6 +654,32 @@ public:
 	void enableDepthBuffer();
 
 	void disableDepthBuffer();
+
+	/*
+	 * glColorMask and glDepthMask through the state cache
+	 */
+	void setColorMask(GLboolean r, GLboolean g, GLboolean b, GLboolean a);
+
+	void setDepthMask(GLboolean enabled);
+
+	/*
+	 * Starts a new frame of state statistics. stateStats() returns the counts
+	 * accumulated since the last call
+	 */
+	void beginFrame() {
+		m_stateStats = StateStats();
+		m_state.drawRangeKnown = false;
+	}
+
+	const StateStats& stateStats() const {
+		return m_stateStats;
+	}
+
+	/*
+	 * Forgets all shadowed state. Call this after changing GL state without
+	 * going through the context, e.g. from third party code
+	 */
+	void invalidateStateCache();
 };
 
 }
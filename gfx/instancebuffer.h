@@ -0,0 +1,82 @@
+#include <GL/glew.h>
+
+#include <memory>
+#include <boost/assert.hpp>
+
+#include "utils/tuple.h"
+#include "utils/persistent_ring.h"
+
+#ifndef RENDERER_INSTANCE_BUFFER_H_
+#define RENDERER_INSTANCE_BUFFER_H_
+
+namespace gfx {
+
+class GraphicsContext;
+
+/*
+ * Per instance attributes for GraphicsContext::drawInstanced.
+ * Instance is a gfx::Tuple whose elements become vertex attributes with a
+ * divisor of 1, located right after the attributes of the drawn geometry's
+ * vertex type. E.g. Tuple<mat4, vec4> for a transform and color takes
+ * locations N..N+3 and N+4 when drawn with a Vertex using N locations.
+ *
+ * Instances are streamed into persistently mapped memory. Per frame usage:
+ *   fill instanceData(), commit(), drawInstanced(), advance()
+ */
+template <class Instance>
+class InstanceBuffer {
+	friend class GraphicsContext;
+
+	static_assert(IsGfxTuple<Instance>::value,
+			"Error Instance type is not a TupleN or TypeList.");
+
+	size_t m_maxInstances = 0;
+	size_t m_numInstances = 0;
+
+	detail::PersistentRing m_ring;
+
+	InstanceBuffer(size_t maxInstances, size_t numRegions) :
+			m_maxInstances(maxInstances), m_ring(maxInstances*sizeof(Instance), numRegions) {
+	}
+
+public:
+	InstanceBuffer(const InstanceBuffer&) = delete;
+	InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+	size_t maxInstances() const {
+		return m_maxInstances;
+	}
+
+	size_t numInstances() const {
+		return m_numInstances;
+	}
+
+	/*
+	 * Mapped memory for this frame's instances. Holds maxInstances() elements.
+	 */
+	Instance* instanceData() {
+		return static_cast<Instance*>(m_ring.regionData());
+	}
+
+	/*
+	 * Set the number of instances written this frame
+	 */
+	void commit(size_t numInstances) {
+		BOOST_ASSERT_MSG(numInstances <= m_maxInstances, "Error streaming more instances than the buffer can hold");
+		m_numInstances = numInstances;
+	}
+
+	/*
+	 * Call once all draws reading this frame's instances have been issued
+	 */
+	void advance() {
+		m_ring.advance();
+	}
+};
+
+template <class Instance>
+using InstanceBufHandle = std::shared_ptr<InstanceBuffer<Instance>>;
+
+}
+
+#endif /* RENDERER_INSTANCE_BUFFER_H_ */
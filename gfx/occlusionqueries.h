@@ -0,0 +1,210 @@
+#include <GL/glew.h>
+
+#include <memory>
+#include <vector>
+
+#include <boost/assert.hpp>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "utils/bounds.h"
+
+#ifndef RENDERER_OCCLUSION_QUERIES_H_
+#define RENDERER_OCCLUSION_QUERIES_H_
+
+namespace gfx {
+
+class GraphicsContext;
+
+/*
+ * Counters for one frame of occlusion queries
+ */
+struct OcclusionQueryStats {
+	// Bounding box proxies drawn under a query
+	size_t queriesIssued = 0;
+
+	// Results read back from earlier frames, and results not ready yet
+	// (those objects keep their previous visibility)
+	size_t resultsRead = 0;
+	size_t resultsPending = 0;
+
+	// Conditional draws from earlier frames whose query found no samples,
+	// so the GPU skipped them
+	size_t drawsSkipped = 0;
+};
+
+/*
+ * Hardware occlusion queries for a fixed set of objects.
+ *
+ * Every frame each object's world space bounding box is drawn, without
+ * writing color or depth, inside a GL_ANY_SAMPLES_PASSED_CONSERVATIVE query.
+ * The object itself is then drawn between GraphicsContext::beginConditionalDraw()
+ * and endConditionalDraw(), so the GPU skips it if the box was hidden.
+ * Proxies are depth tested against whatever is already in the depth buffer,
+ * so draw the large occluders (or a depth prepass) first. Draw every proxy
+ * before the objects so the results are usually ready by the time the
+ * conditional draws reach them; GL_QUERY_NO_WAIT is used and the CPU never
+ * waits on the GPU.
+ *
+ * The results are also read back on the CPU a few frames late, when they
+ * are available without a stall. wasVisible() exposes them so callers can
+ * skip CPU work for expensive objects which are known to be hidden.
+ *
+ * Per frame usage:
+ *   beginOcclusionQueries(), queryOcclusion() for every object, endOcclusionQueries(),
+ *   then draw every object inside beginConditionalDraw() / endConditionalDraw()
+ */
+class OcclusionQueries {
+	friend class GraphicsContext;
+
+	struct Slot {
+		GLuint query = 0;
+		bool issued = false;
+
+		// A conditional draw depended on the query
+		bool conditional = false;
+	};
+
+	// m_slots[frame * m_numObjects + object]
+	std::vector<Slot> m_slots;
+	size_t m_numObjects;
+	size_t m_numFrames;
+	size_t m_frame = 0;
+
+	// Last known result for each object
+	std::vector<bool> m_visible;
+
+	OcclusionQueryStats m_stats;
+
+	glm::mat4 m_viewProj;
+
+	// Unit cube proxy, scaled to each box in the vertex shader
+	GLuint m_vaoId = 0, m_vboId = 0, m_iboId = 0;
+	ShaderProgramHandle m_proxyProgram;
+	GLint m_boxMinLocation = -1, m_boxMaxLocation = -1, m_viewProjLocation = -1;
+
+	static const size_t NUM_PROXY_INDICES = 36;
+
+	OcclusionQueries(size_t numObjects, size_t numFrames, const ShaderProgramHandle& proxyProgram) :
+			m_numObjects(numObjects), m_numFrames(numFrames), m_visible(numObjects, true),
+			m_proxyProgram(proxyProgram) {
+		BOOST_ASSERT_MSG(numFrames >= 2, "Error: occlusion query results need at least one frame of latency");
+
+		m_slots.resize(numObjects * numFrames);
+		std::vector<GLuint> ids(m_slots.size());
+		if(!ids.empty()) {
+			glCreateQueries(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, static_cast<GLsizei>(ids.size()), ids.data());
+		}
+		for(size_t i = 0; i < ids.size(); i++) {
+			m_slots[i].query = ids[i];
+		}
+
+		m_boxMinLocation = m_proxyProgram->uniformLocation("u_boxMin");
+		m_boxMaxLocation = m_proxyProgram->uniformLocation("u_boxMax");
+		m_viewProjLocation = m_proxyProgram->uniformLocation("u_viewProj");
+
+		static const GLfloat corners[] = {
+			0.0f, 0.0f, 0.0f,  1.0f, 0.0f, 0.0f,  1.0f, 1.0f, 0.0f,  0.0f, 1.0f, 0.0f,
+			0.0f, 0.0f, 1.0f,  1.0f, 0.0f, 1.0f,  1.0f, 1.0f, 1.0f,  0.0f, 1.0f, 1.0f,
+		};
+		static const GLuint indices[NUM_PROXY_INDICES] = {
+			0, 2, 1,  0, 3, 2,  4, 5, 6,  4, 6, 7,
+			0, 1, 5,  0, 5, 4,  3, 6, 2,  3, 7, 6,
+			0, 4, 7,  0, 7, 3,  1, 2, 6,  1, 6, 5,
+		};
+
+		glCreateBuffers(1, &m_vboId);
+		glNamedBufferStorage(m_vboId, sizeof(corners), corners, 0);
+		glCreateBuffers(1, &m_iboId);
+		glNamedBufferStorage(m_iboId, sizeof(indices), indices, 0);
+
+		glCreateVertexArrays(1, &m_vaoId);
+		glVertexArrayVertexBuffer(m_vaoId, 0, m_vboId, 0, 3 * sizeof(GLfloat));
+		glVertexArrayElementBuffer(m_vaoId, m_iboId);
+		glEnableVertexArrayAttrib(m_vaoId, 0);
+		glVertexArrayAttribFormat(m_vaoId, 0, 3, GL_FLOAT, GL_FALSE, 0);
+		glVertexArrayAttribBinding(m_vaoId, 0, 0);
+	}
+
+	Slot& slot(size_t frame, size_t object) {
+		return m_slots[frame * m_numObjects + object];
+	}
+
+	/*
+	 * Moves on to the next frame's queries, reading the results they held
+	 * from numFrames - 1 frames ago
+	 */
+	void advance() {
+		m_frame = (m_frame + 1) % m_numFrames;
+		m_stats = OcclusionQueryStats();
+
+		for(size_t i = 0; i < m_numObjects; i++) {
+			Slot& s = slot(m_frame, i);
+			if(!s.issued) {
+				continue;
+			}
+			const bool conditional = s.conditional;
+			s.issued = false;
+			s.conditional = false;
+
+			GLuint available = GL_FALSE;
+			glGetQueryObjectuiv(s.query, GL_QUERY_RESULT_AVAILABLE, &available);
+			if(!available) {
+				m_stats.resultsPending += 1;
+				continue;
+			}
+
+			GLuint anyPassed = GL_TRUE;
+			glGetQueryObjectuiv(s.query, GL_QUERY_RESULT, &anyPassed);
+			m_visible[i] = anyPassed != GL_FALSE;
+			m_stats.resultsRead += 1;
+			m_stats.drawsSkipped += conditional && !m_visible[i] ? 1 : 0;
+		}
+	}
+
+public:
+	OcclusionQueries(const OcclusionQueries&) = delete;
+	OcclusionQueries& operator=(const OcclusionQueries&) = delete;
+
+	~OcclusionQueries() {
+		std::vector<GLuint> ids;
+		for(const Slot& s : m_slots) {
+			ids.push_back(s.query);
+		}
+		glDeleteQueries(static_cast<GLsizei>(ids.size()), ids.data());
+		glDeleteVertexArrays(1, &m_vaoId);
+		glDeleteBuffers(1, &m_vboId);
+		glDeleteBuffers(1, &m_iboId);
+	}
+
+	size_t numObjects() const {
+		return m_numObjects;
+	}
+
+	/*
+	 * Frames between issuing a query and reading its result back
+	 */
+	size_t latency() const {
+		return m_numFrames - 1;
+	}
+
+	/*
+	 * The last result read back for an object, true until there is one
+	 */
+	bool wasVisible(size_t object) const {
+		return m_visible[object];
+	}
+
+	/*
+	 * Counters since the last beginOcclusionQueries()
+	 */
+	const OcclusionQueryStats& stats() const {
+		return m_stats;
+	}
+};
+
+typedef std::shared_ptr<OcclusionQueries> OcclusionQueriesHandle;
+
+}
+
+#endif /* RENDERER_OCCLUSION_QUERIES_H_ */
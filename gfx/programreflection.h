@@ -0,0 +1,312 @@
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "geometrybuffer.h"
+
+#ifndef RENDERER_PROGRAM_REFLECTION_H_
+#define RENDERER_PROGRAM_REFLECTION_H_
+
+namespace gfx {
+
+/*
+ * A uniform or buffer variable. Uniforms in the default block have a
+ * location and a blockIndex of -1, block members have an offset and array
+ * and matrix strides within their block instead.
+ */
+struct ProgramVariable {
+	std::string name;
+	GLenum type;
+	GLint arraySize;
+	GLint location;
+	GLint blockIndex;
+	GLint offset;
+	GLint arrayStride;
+	GLint matrixStride;
+};
+
+/*
+ * A uniform or shader storage block. members are indices into
+ * ProgramReflection::uniforms() or bufferVariables() respectively.
+ */
+struct ProgramBlock {
+	std::string name;
+	GLint binding;
+	GLint dataSize;
+	std::vector<size_t> members;
+};
+
+/*
+ * An active vertex shader input. Built-in inputs are not recorded.
+ */
+struct ProgramInput {
+	std::string name;
+	GLenum type;
+	GLint arraySize;
+	GLint location;
+};
+
+namespace detail {
+
+/*
+ * Number of consecutive attribute locations taken by an input of a GLSL type
+ */
+inline GLuint numAttribLocations(GLenum type) {
+	switch(type) {
+	case GL_FLOAT_MAT2: case GL_FLOAT_MAT2x3: case GL_FLOAT_MAT2x4:
+		return 2;
+	case GL_FLOAT_MAT3: case GL_FLOAT_MAT3x2: case GL_FLOAT_MAT3x4:
+		return 3;
+	case GL_FLOAT_MAT4: case GL_FLOAT_MAT4x2: case GL_FLOAT_MAT4x3:
+		return 4;
+	default:
+		return 1;
+	}
+}
+
+/*
+ * Whether a GLSL type is made of floats. generateVAO() sets every
+ * attribute up with glVertexAttribPointer, which always feeds floats.
+ */
+inline bool isFloatType(GLenum type) {
+	switch(type) {
+	case GL_FLOAT: case GL_FLOAT_VEC2: case GL_FLOAT_VEC3: case GL_FLOAT_VEC4:
+	case GL_FLOAT_MAT2: case GL_FLOAT_MAT3: case GL_FLOAT_MAT4:
+	case GL_FLOAT_MAT2x3: case GL_FLOAT_MAT2x4: case GL_FLOAT_MAT3x2:
+	case GL_FLOAT_MAT3x4: case GL_FLOAT_MAT4x2: case GL_FLOAT_MAT4x3:
+		return true;
+	default:
+		return false;
+	}
+}
+
+}
+
+/*
+ * Everything a linked program exposes through the program interface
+ * queries: uniforms, uniform blocks with their members' offsets, shader
+ * storage blocks and vertex inputs. Built once after link, so looking
+ * anything up afterwards doesn't go to the driver.
+ */
+class ProgramReflection {
+	std::vector<ProgramVariable> m_uniforms;
+	std::vector<ProgramBlock> m_uniformBlocks;
+	std::vector<ProgramVariable> m_bufferVariables;
+	std::vector<ProgramBlock> m_storageBlocks;
+	std::vector<ProgramInput> m_inputs;
+
+	// Locations of default block uniforms by name. Array elements are
+	// recorded under both "name[i]" and, for element 0, "name".
+	std::unordered_map<std::string, GLint> m_locations;
+
+	static GLint numResources(GLuint program, GLenum interface) {
+		GLint ret = 0;
+		glGetProgramInterfaceiv(program, interface, GL_ACTIVE_RESOURCES, &ret);
+		return ret;
+	}
+
+	static std::string resourceName(GLuint program, GLenum interface, GLuint index, GLint nameLength) {
+		std::vector<GLchar> buf(std::max(nameLength, 1));
+		GLsizei length = 0;
+		glGetProgramResourceName(program, interface, index, static_cast<GLsizei>(buf.size()), &length, buf.data());
+		return std::string(buf.data(), length);
+	}
+
+	static std::vector<ProgramVariable> reflectVariables(GLuint program, GLenum interface) {
+		// GL_LOCATION is only valid for uniforms, it must stay last
+		static const GLenum props[] = {
+			GL_NAME_LENGTH, GL_TYPE, GL_ARRAY_SIZE, GL_BLOCK_INDEX,
+			GL_OFFSET, GL_ARRAY_STRIDE, GL_MATRIX_STRIDE, GL_LOCATION
+		};
+		const GLsizei numProps = interface == GL_UNIFORM ? 8 : 7;
+
+		std::vector<ProgramVariable> ret;
+		const GLint n = numResources(program, interface);
+		for(GLint i = 0; i < n; i++) {
+			GLint values[8] = { 0, 0, 0, -1, -1, 0, 0, -1 };
+			glGetProgramResourceiv(program, interface, static_cast<GLuint>(i), numProps, props, numProps, nullptr, values);
+			ret.push_back(ProgramVariable { resourceName(program, interface, static_cast<GLuint>(i), values[0]),
+					static_cast<GLenum>(values[1]), values[2], values[7], values[3], values[4], values[5], values[6] });
+		}
+		return ret;
+	}
+
+	static std::vector<ProgramBlock> reflectBlocks(GLuint program, GLenum interface,
+			const std::vector<ProgramVariable>& variables) {
+		static const GLenum props[] = { GL_NAME_LENGTH, GL_BUFFER_BINDING, GL_BUFFER_DATA_SIZE };
+
+		std::vector<ProgramBlock> ret;
+		const GLint n = numResources(program, interface);
+		for(GLint i = 0; i < n; i++) {
+			GLint values[3] = { 0, 0, 0 };
+			glGetProgramResourceiv(program, interface, static_cast<GLuint>(i), 3, props, 3, nullptr, values);
+			ret.push_back(ProgramBlock { resourceName(program, interface, static_cast<GLuint>(i), values[0]),
+					values[1], values[2], std::vector<size_t>() });
+		}
+
+		for(size_t i = 0; i < variables.size(); i++) {
+			const GLint block = variables[i].blockIndex;
+			if(block >= 0 && block < n) {
+				ret[block].members.push_back(i);
+			}
+		}
+		return ret;
+	}
+
+	void reflectInputs(GLuint program) {
+		static const GLenum props[] = { GL_NAME_LENGTH, GL_TYPE, GL_ARRAY_SIZE, GL_LOCATION };
+
+		const GLint n = numResources(program, GL_PROGRAM_INPUT);
+		for(GLint i = 0; i < n; i++) {
+			GLint values[4] = { 0, 0, 0, -1 };
+			glGetProgramResourceiv(program, GL_PROGRAM_INPUT, static_cast<GLuint>(i), 4, props, 4, nullptr, values);
+			if(values[3] == -1) {
+				continue;
+			}
+			m_inputs.push_back(ProgramInput { resourceName(program, GL_PROGRAM_INPUT, static_cast<GLuint>(i), values[0]),
+					static_cast<GLenum>(values[1]), values[2], values[3] });
+		}
+
+		std::sort(m_inputs.begin(), m_inputs.end(), [](const ProgramInput& a, const ProgramInput& b) {
+			return a.location < b.location;
+		});
+	}
+
+	void recordLocations(GLuint program) {
+		for(const ProgramVariable& u : m_uniforms) {
+			if(u.location == -1) {
+				continue;
+			}
+			m_locations[u.name] = u.location;
+
+			// Arrays are reported once, as name[0]
+			if(u.name.size() > 3 && u.name.compare(u.name.size() - 3, 3, "[0]") == 0) {
+				const std::string base = u.name.substr(0, u.name.size() - 3);
+				m_locations[base] = u.location;
+				for(GLint j = 1; j < u.arraySize; j++) {
+					const std::string element = base + "[" + std::to_string(j) + "]";
+					m_locations[element] = glGetProgramResourceLocation(program, GL_UNIFORM, element.c_str());
+				}
+			}
+		}
+	}
+
+public:
+	ProgramReflection() = default;
+
+	explicit ProgramReflection(GLuint program) {
+		m_uniforms = reflectVariables(program, GL_UNIFORM);
+		m_uniformBlocks = reflectBlocks(program, GL_UNIFORM_BLOCK, m_uniforms);
+		m_bufferVariables = reflectVariables(program, GL_BUFFER_VARIABLE);
+		m_storageBlocks = reflectBlocks(program, GL_SHADER_STORAGE_BLOCK, m_bufferVariables);
+		reflectInputs(program);
+		recordLocations(program);
+	}
+
+	/*
+	 * Every active uniform, in the default block or in a uniform block
+	 */
+	const std::vector<ProgramVariable>& uniforms() const {
+		return m_uniforms;
+	}
+
+	const std::vector<ProgramBlock>& uniformBlocks() const {
+		return m_uniformBlocks;
+	}
+
+	const std::vector<ProgramVariable>& bufferVariables() const {
+		return m_bufferVariables;
+	}
+
+	const std::vector<ProgramBlock>& storageBlocks() const {
+		return m_storageBlocks;
+	}
+
+	/*
+	 * Vertex inputs, sorted by location
+	 */
+	const std::vector<ProgramInput>& inputs() const {
+		return m_inputs;
+	}
+
+	/*
+	 * Location of a default block uniform, -1 if there is no such active uniform
+	 */
+	GLint uniformLocation(const std::string& name) const {
+		const auto it = m_locations.find(name);
+		return it == m_locations.end() ? -1 : it->second;
+	}
+
+	/*
+	 * Index of a uniform block for glUniformBlockBinding, -1 if there is no
+	 * such active block
+	 */
+	GLint uniformBlockIndex(const std::string& name) const {
+		for(size_t i = 0; i < m_uniformBlocks.size(); i++) {
+			if(m_uniformBlocks[i].name == name) {
+				return static_cast<GLint>(i);
+			}
+		}
+		return -1;
+	}
+
+	const ProgramBlock* uniformBlock(const std::string& name) const {
+		const GLint index = uniformBlockIndex(name);
+		return index == -1 ? nullptr : &m_uniformBlocks[index];
+	}
+
+	const ProgramBlock* storageBlock(const std::string& name) const {
+		for(const ProgramBlock& b : m_storageBlocks) {
+			if(b.name == name) {
+				return &b;
+			}
+		}
+		return nullptr;
+	}
+
+	/*
+	 * Checks the vertex inputs against the attributes a VAO of the given
+	 * format provides: each input must start at the first location of an
+	 * attribute, take as many locations and be made of floats. Inputs past
+	 * the format's last location are assumed to be per instance attributes
+	 * and are not checked. On a mismatch error, if given, says why.
+	 */
+	bool matchesVertexFormat(const detail::VertexFormat& format, std::string* error = nullptr) const {
+		const GLuint end = format.empty() ? 0 : format.back().location + format.back().numLocations;
+		for(const ProgramInput& input : m_inputs) {
+			const GLuint location = static_cast<GLuint>(input.location);
+			if(location >= end) {
+				continue;
+			}
+
+			std::string mismatch;
+			const auto attrib = std::find_if(format.begin(), format.end(), [&](const detail::VertexAttribFormat& a) {
+				return a.location == location;
+			});
+			const GLuint numLocations = detail::numAttribLocations(input.type) * static_cast<GLuint>(input.arraySize);
+			if(attrib == format.end()) {
+				mismatch = "starts in the middle of a vertex attribute";
+			} else if(!detail::isFloatType(input.type)) {
+				mismatch = "is not a float type but vertex attributes are converted to floats";
+			} else if(numLocations != attrib->numLocations) {
+				mismatch = "takes " + std::to_string(numLocations) + " locations but the vertex attribute takes " +
+						std::to_string(attrib->numLocations);
+			}
+
+			if(!mismatch.empty()) {
+				if(error) {
+					*error = "Error: vertex input " + input.name + " at location " + std::to_string(location) + " " + mismatch;
+				}
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+}
+
+#endif /* RENDERER_PROGRAM_REFLECTION_H_ */
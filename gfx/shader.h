@@ -1,9 +1,16 @@
+#include <algorithm>
+#include <cstring>
 #include <memory>
 #include <string>
 #include <sstream>
+#include <unordered_map>
+#include <vector>
 
 #include <boost/assert.hpp>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
 
+#include "programreflection.h"
 #include "utils/gl_program_builder.h"
 #include "utils/gl_traits.h"
 
@@ -16,256 +23,471 @@
 namespace gfx {
 
 class GraphicsContext;
+class DrawList;
+class ShaderProgram;
 
-class ShaderProgram {
-	friend class GraphicsContext;
-
-	GLuint m_programId = 0;
+namespace detail {
 
-	// TODO: handle double types
-	template <class T>
-	void getUniformForType(GLint loc, T* buf);
-
-	ShaderProgram() = default;
+/*
+ * glProgramUniform* for each GLSL type, num values from a tightly packed array
+ */
+inline void programUniform(GLuint program, GLint loc, const GLfloat* value, GLsizei num, GLboolean) {
+	glProgramUniform1fv(program, loc, num, value);
+}
 
-public:
-	virtual ~ShaderProgram() {
-		glDeleteProgram(m_programId);
-	}
+inline void programUniform(GLuint program, GLint loc, const glm::vec2* value, GLsizei num, GLboolean) {
+	glProgramUniform2fv(program, loc, num, glm::value_ptr(*value));
+}
 
-	bool hasUniform(const std::string& name) {
-		return glGetUniformLocation(m_programId, name.c_str()) != -1;
-	}
+inline void programUniform(GLuint program, GLint loc, const glm::vec3* value, GLsizei num, GLboolean) {
+	glProgramUniform3fv(program, loc, num, glm::value_ptr(*value));
+}
 
-	template <class T>
-	void setUniform(const std::string& name, const T& value, size_t num, bool transpose) {
-		static_assert(utils::is_glsl_type<T>(), "Error: invalid type for Shader::setUniform");
-	}
+inline void programUniform(GLuint program, GLint loc, const glm::vec4* value, GLsizei num, GLboolean) {
+	glProgramUniform4fv(program, loc, num, glm::value_ptr(*value));
+}
 
-	template <class T>
-	void setUniform(const std::string& name, const T& value, bool transpose) {
-		static_assert(utils::is_glsl_type<T>(), "Error: invalid type for Shader::setUniform");
-		setUniform<T>(name, value, 1, transpose);
-	}
+inline void programUniform(GLuint program, GLint loc, const GLint* value, GLsizei num, GLboolean) {
+	glProgramUniform1iv(program, loc, num, value);
+}
 
-	template <class T>
-	void setUniform(const std::string& name, const T& value) {
-		static_assert(utils::is_glsl_type<T>(), "Error: invalid type for Shader::setUniform");
-		setUniform<T>(name, value, 1, false);
-	}
+inline void programUniform(GLuint program, GLint loc, const glm::ivec2* value, GLsizei num, GLboolean) {
+	glProgramUniform2iv(program, loc, num, glm::value_ptr(*value));
+}
 
-	template <class T>
-	T getUniform(const std::string& name) {
-		static_assert(utils::is_glsl_type<T>(), "Error: invalid type for Shader::getUniform");
-		T ret;
-		const GLint loc = glGetUniformLocation(m_programId, name.c_str());
-		getUniformForType<typename utils::container_type<T>::type>(loc, glm::value_ptr(ret));
+inline void programUniform(GLuint program, GLint loc, const glm::ivec3* value, GLsizei num, GLboolean) {
+	glProgramUniform3iv(program, loc, num, glm::value_ptr(*value));
+}
 
-		return ret;
-	}
+inline void programUniform(GLuint program, GLint loc, const glm::ivec4* value, GLsizei num, GLboolean) {
+	glProgramUniform4iv(program, loc, num, glm::value_ptr(*value));
+}
 
-	// TODO: Program introspection functions
-	//       https://www.opengl.org/wiki/Program_Introspection
-	size_t numUniforms() const {
-		return 0;
-	}
+inline void programUniform(GLuint program, GLint loc, const GLuint* value, GLsizei num, GLboolean) {
+	glProgramUniform1uiv(program, loc, num, value);
+}
 
-	size_t numAttributes() const {
-		return 0;
-	}
-};
+inline void programUniform(GLuint program, GLint loc, const glm::uvec2* value, GLsizei num, GLboolean) {
+	glProgramUniform2uiv(program, loc, num, glm::value_ptr(*value));
+}
 
-typedef std::shared_ptr<ShaderProgram> ShaderProgramHandle;
+inline void programUniform(GLuint program, GLint loc, const glm::uvec3* value, GLsizei num, GLboolean) {
+	glProgramUniform3uiv(program, loc, num, glm::value_ptr(*value));
+}
 
-template <>
-void ShaderProgram::getUniformForType<GLfloat>(GLint loc, GLfloat* buf) {
-	glGetUniformfv(m_programId, loc, buf);
+inline void programUniform(GLuint program, GLint loc, const glm::uvec4* value, GLsizei num, GLboolean) {
+	glProgramUniform4uiv(program, loc, num, glm::value_ptr(*value));
 }
 
-template <>
-void ShaderProgram::getUniformForType<GLint>(GLint loc, GLint* buf) {
-	glGetUniformiv(m_programId, loc, buf);
+inline void programUniform(GLuint program, GLint loc, const glm::mat2* value, GLsizei num, GLboolean transpose) {
+	glProgramUniformMatrix2fv(program, loc, num, transpose, glm::value_ptr(*value));
 }
 
-template <>
-void ShaderProgram::getUniformForType<GLuint>(GLint loc, GLuint* buf) {
-	glGetUniformuiv(m_programId, loc, buf);
+inline void programUniform(GLuint program, GLint loc, const glm::mat3* value, GLsizei num, GLboolean transpose) {
+	glProgramUniformMatrix3fv(program, loc, num, transpose, glm::value_ptr(*value));
 }
 
-template <>
-GLfloat ShaderProgram::getUniform<GLfloat>(const std::string& name) {
-	GLfloat ret;
-	GLint loc = glGetUniformLocation(m_programId, name.c_str());
-	getUniformForType<GLfloat>(loc, &ret);
-	return ret;
+inline void programUniform(GLuint program, GLint loc, const glm::mat4* value, GLsizei num, GLboolean transpose) {
+	glProgramUniformMatrix4fv(program, loc, num, transpose, glm::value_ptr(*value));
 }
 
-template <>
-GLint ShaderProgram::getUniform<GLint>(const std::string& name) {
-	GLint ret;
-	GLint loc = glGetUniformLocation(m_programId, name.c_str());
-	getUniformForType<GLint>(loc, &ret);
-	return ret;
+inline void programUniform(GLuint program, GLint loc, const glm::mat2x3* value, GLsizei num, GLboolean transpose) {
+	glProgramUniformMatrix2x3fv(program, loc, num, transpose, glm::value_ptr(*value));
 }
 
-template <>
-GLuint ShaderProgram::getUniform<GLuint>(const std::string& name) {
-	GLuint ret;
-	GLint loc = glGetUniformLocation(m_programId, name.c_str());
-	getUniformForType<GLuint>(loc, &ret);
-	return ret;
+inline void programUniform(GLuint program, GLint loc, const glm::mat3x2* value, GLsizei num, GLboolean transpose) {
+	glProgramUniformMatrix3x2fv(program, loc, num, transpose, glm::value_ptr(*value));
 }
 
-template <>
-void ShaderProgram::setUniform<GLfloat>(const std::string& name, const GLfloat& value, size_t num, bool) {
-	GLint loc = glGetUniformLocation(m_programId, name.c_str());
-	BOOST_ASSERT_MSG(loc != -1, __SHADER_SS_MSG("Error: " << name << " is not a uniform for program."));
-	glProgramUniform1fv(m_programId, loc, num, &value);
+inline void programUniform(GLuint program, GLint loc, const glm::mat2x4* value, GLsizei num, GLboolean transpose) {
+	glProgramUniformMatrix2x4fv(program, loc, num, transpose, glm::value_ptr(*value));
 }
 
-template <>
-void ShaderProgram::setUniform<glm::vec2>(const std::string& name, const glm::vec2& value, size_t num, bool) {
-	GLint loc = glGetUniformLocation(m_programId, name.c_str());
-	BOOST_ASSERT_MSG(loc != -1, __SHADER_SS_MSG("Error: " << name << " is not a uniform for program."));
-	glProgramUniform2fv(m_programId, loc, num, glm::value_ptr(value));
+inline void programUniform(GLuint program, GLint loc, const glm::mat4x2* value, GLsizei num, GLboolean transpose) {
+	glProgramUniformMatrix4x2fv(program, loc, num, transpose, glm::value_ptr(*value));
 }
 
-template <>
-void ShaderProgram::setUniform<glm::vec3>(const std::string& name, const glm::vec3& value, size_t num, bool) {
-	GLint loc = glGetUniformLocation(m_programId, name.c_str());
-	BOOST_ASSERT_MSG(loc != -1, __SHADER_SS_MSG("Error: " << name << " is not a uniform for program."));
-	glProgramUniform3fv(m_programId, loc, num, glm::value_ptr(value));
+inline void programUniform(GLuint program, GLint loc, const glm::mat3x4* value, GLsizei num, GLboolean transpose) {
+	glProgramUniformMatrix3x4fv(program, loc, num, transpose, glm::value_ptr(*value));
 }
 
-template <>
-void ShaderProgram::setUniform<glm::vec4>(const std::string& name, const glm::vec4& value, size_t num, bool) {
-	GLint loc = glGetUniformLocation(m_programId, name.c_str());
-	BOOST_ASSERT_MSG(loc != -1, __SHADER_SS_MSG("Error: " << name << " is not a uniform for program."));
-	glProgramUniform4fv(m_programId, loc, num, glm::value_ptr(value));
+inline void programUniform(GLuint program, GLint loc, const glm::mat4x3* value, GLsizei num, GLboolean transpose) {
+	glProgramUniformMatrix4x3fv(program, loc, num, transpose, glm::value_ptr(*value));
 }
 
-template <>
-void ShaderProgram::setUniform<GLint>(const std::string& name, const GLint& value, size_t num, bool) {
-	GLint loc = glGetUniformLocation(m_programId, name.c_str());
-	BOOST_ASSERT_MSG(loc != -1, __SHADER_SS_MSG("Error: " << name << " is not a uniform for program."));
-	glProgramUniform1iv(m_programId, loc, num, &value);
+inline void getProgramUniform(GLuint program, GLint loc, GLfloat* buf) {
+	glGetUniformfv(program, loc, buf);
 }
 
-template <>
-void ShaderProgram::setUniform<glm::ivec2>(const std::string& name, const glm::ivec2& value, size_t num, bool) {
-	GLint loc = glGetUniformLocation(m_programId, name.c_str());
-	BOOST_ASSERT_MSG(loc != -1, __SHADER_SS_MSG("Error: " << name << " is not a uniform for program."));
-	glProgramUniform2iv(m_programId, loc, num, glm::value_ptr(value));
+inline void getProgramUniform(GLuint program, GLint loc, GLint* buf) {
+	glGetUniformiv(program, loc, buf);
 }
 
-template <>
-void ShaderProgram::setUniform<glm::ivec3>(const std::string& name, const glm::ivec3& value, size_t num, bool) {
-	GLint loc = glGetUniformLocation(m_programId, name.c_str());
-	BOOST_ASSERT_MSG(loc != -1, __SHADER_SS_MSG("Error: " << name << " is not a uniform for program."));
-	glProgramUniform3iv(m_programId, loc, num, glm::value_ptr(value));
+inline void getProgramUniform(GLuint program, GLint loc, GLuint* buf) {
+	glGetUniformuiv(program, loc, buf);
 }
 
-template <>
-void ShaderProgram::setUniform<glm::ivec4>(const std::string& name, const glm::ivec4& value, size_t num, bool) {
-	GLint loc = glGetUniformLocation(m_programId, name.c_str());
-	BOOST_ASSERT_MSG(loc != -1, __SHADER_SS_MSG("Error: " << name << " is not a uniform for program."));
-	glProgramUniform4iv(m_programId, loc, num, glm::value_ptr(value));
+/*
+ * programUniform() for size bytes of tightly packed T
+ */
+template <class T>
+inline void programUniformBytes(GLuint program, GLint loc, const void* value, size_t size, GLboolean transpose) {
+	programUniform(program, loc, static_cast<const T*>(value), static_cast<GLsizei>(size / sizeof(T)), transpose);
 }
 
+template <class T>
+inline typename utils::container_type<T>::type* valuePtr(T& value) {
+	return glm::value_ptr(value);
+}
 
 template <>
-void ShaderProgram::setUniform<GLuint>(const std::string& name, const GLuint& value, size_t num, bool) {
-	GLint loc = glGetUniformLocation(m_programId, name.c_str());
-	BOOST_ASSERT_MSG(loc != -1, __SHADER_SS_MSG("Error: " << name << " is not a uniform for program."));
-	glProgramUniform1uiv(m_programId, loc, num, &value);
+inline GLfloat* valuePtr<GLfloat>(GLfloat& value) {
+	return &value;
 }
 
 template <>
-void ShaderProgram::setUniform<glm::uvec2>(const std::string& name, const glm::uvec2& value, size_t num, bool) {
-	GLint loc = glGetUniformLocation(m_programId, name.c_str());
-	BOOST_ASSERT_MSG(loc != -1, __SHADER_SS_MSG("Error: " << name << " is not a uniform for program."));
-	glProgramUniform2uiv(m_programId, loc, num, glm::value_ptr(value));
+inline GLint* valuePtr<GLint>(GLint& value) {
+	return &value;
 }
 
 template <>
-void ShaderProgram::setUniform<glm::uvec3>(const std::string& name, const glm::uvec3& value, size_t num, bool) {
-	GLint loc = glGetUniformLocation(m_programId, name.c_str());
-	BOOST_ASSERT_MSG(loc != -1, __SHADER_SS_MSG("Error: " << name << " is not a uniform for program."));
-	glProgramUniform3uiv(m_programId, loc, num, glm::value_ptr(value));
+inline GLuint* valuePtr<GLuint>(GLuint& value) {
+	return &value;
 }
 
-template <>
-void ShaderProgram::setUniform<glm::uvec4>(const std::string& name, const glm::uvec4& value, size_t num, bool) {
-	GLint loc = glGetUniformLocation(m_programId, name.c_str());
-	BOOST_ASSERT_MSG(loc != -1, __SHADER_SS_MSG("Error: " << name << " is not a uniform for program."));
-	glProgramUniform4uiv(m_programId, loc, num, glm::value_ptr(value));
 }
 
+/*
+ * How often the value of a uniform changes. Programs keep a copy of the last
+ * value set through a PER_FRAME handle and skip setting the same value again,
+ * so a per frame uniform can be set before every draw and only the first set
+ * reaches GL. PER_OBJECT uniforms change on nearly every draw and are always
+ * set, without the copy and comparison.
+ */
+enum class UniformScope { PER_FRAME, PER_OBJECT };
+
+/*
+ * Uniform values set through handles: sent to GL, and skipped because the
+ * program already had the value. See ShaderProgram::uniformStats()
+ */
+struct UniformStats {
+	size_t issued = 0;
+	size_t elided = 0;
+};
 
+/*
+ * A uniform of one ShaderProgram, looked up by name once with
+ * ShaderProgram::uniformHandle(). Setting a uniform through a handle is a
+ * single glProgramUniform* call, with no string building or lookup.
+ *
+ * Handles refer to a slot in their program rather than to a location, so
+ * they stay valid when the program is relinked. A handle to a uniform the
+ * program doesn't have (e.g. one the compiler optimized out) is inactive
+ * and setting it does nothing.
+ */
+template <class T>
+class UniformHandle {
+	friend class ShaderProgram;
+
+	const ShaderProgram* m_program = nullptr;
+	size_t m_slot = 0;
 
-template <>
-void ShaderProgram::setUniform<glm::mat2>(const std::string& name, const glm::mat2& value, size_t num, bool transpose) {
-	GLint loc = glGetUniformLocation(m_programId, name.c_str());
-	BOOST_ASSERT_MSG(loc != -1, __SHADER_SS_MSG("Error: " << name << " is not a uniform for program."));
-	glProgramUniformMatrix2fv(m_programId, loc, num, transpose, glm::value_ptr(value));
-}
+public:
+	UniformHandle() = default;
 
-template <>
-void ShaderProgram::setUniform<glm::mat3>(const std::string& name, const glm::mat3& value, size_t num, bool transpose) {
-	GLint loc = glGetUniformLocation(m_programId, name.c_str());
-	BOOST_ASSERT_MSG(loc != -1, __SHADER_SS_MSG("Error: " << name << " is not a uniform for program."));
-	glProgramUniformMatrix3fv(m_programId, loc, num, transpose, glm::value_ptr(value));
-}
+	bool isNull() const {
+		return m_program == nullptr;
+	}
+};
 
-template <>
-void ShaderProgram::setUniform<glm::mat4>(const std::string& name, const glm::mat4& value, size_t num, bool transpose) {
-	GLint loc = glGetUniformLocation(m_programId, name.c_str());
-	BOOST_ASSERT_MSG(loc != -1, __SHADER_SS_MSG("Error: " << name << " is not a uniform for program."));
-	glProgramUniformMatrix4fv(m_programId, loc, num, transpose, glm::value_ptr(value));
-}
+class ShaderProgram {
+	friend class GraphicsContext;
+	friend class DrawList;
 
-template <>
-void ShaderProgram::setUniform<glm::mat2x3>(const std::string& name, const glm::mat2x3& value, size_t num, bool transpose) {
-	GLint loc = glGetUniformLocation(m_programId, name.c_str());
-	BOOST_ASSERT_MSG(loc != -1, __SHADER_SS_MSG("Error: " << name << " is not a uniform for program."));
-	glProgramUniformMatrix2x3fv(m_programId, loc, num, transpose, glm::value_ptr(value));
-}
+	GLuint m_programId = 0;
 
-template <>
-void ShaderProgram::setUniform<glm::mat3x2>(const std::string& name, const glm::mat3x2& value, size_t num, bool transpose) {
-	GLint loc = glGetUniformLocation(m_programId, name.c_str());
-	BOOST_ASSERT_MSG(loc != -1, __SHADER_SS_MSG("Error: " << name << " is not a uniform for program."));
-	glProgramUniformMatrix3x2fv(m_programId, loc, num, transpose, glm::value_ptr(value));
-}
+	// Uniforms, blocks and vertex inputs, reflected once after link
+	ProgramReflection m_reflection;
+
+	// Vertex formats already checked against the inputs
+	mutable std::vector<const detail::VertexFormat*> m_acceptedFormats;
+
+	// Names of the uniforms handles were made for and their locations in
+	// the current program, indexed by handle slot, and the slots by name
+	std::vector<std::string> m_handleNames;
+	std::vector<GLint> m_handleLocations;
+	std::vector<UniformScope> m_handleScopes;
+	std::unordered_map<std::string, size_t> m_handleSlots;
+
+	// Last value set through each PER_FRAME handle slot, set again on the
+	// new program when the program is replaced. upload is null until a
+	// value has been set, or once any of the count locations it covers is
+	// written some other way.
+	struct UniformShadow {
+		std::vector<char> value;
+		GLsizei count = 0;
+		GLboolean transpose = GL_FALSE;
+		void (*upload)(GLuint, GLint, const void*, size_t, GLboolean) = nullptr;
+	};
+	std::vector<UniformShadow> m_handleShadows;
+
+	UniformStats m_uniformStats;
+
+	// Uniform block bindings, set again when the program is replaced
+	std::vector<std::pair<std::string, GLuint>> m_blockBindings;
+
+	// Set while the program is still compiling, see
+	// GraphicsContext::beginShaderProgramFromFiles(). m_programId is 0 until
+	// the program is ready.
+	std::unique_ptr<utils::PendingProgram> m_pending;
+
+	// Files the program was built from, empty for programs built from
+	// strings. See GraphicsContext::enableShaderHotReload()
+	utils::ProgramFiles m_files;
 
-template <>
-void ShaderProgram::setUniform<glm::mat2x4>(const std::string& name, const glm::mat2x4& value, size_t num, bool transpose) {
-	GLint loc = glGetUniformLocation(m_programId, name.c_str());
-	BOOST_ASSERT_MSG(loc != -1, __SHADER_SS_MSG("Error: " << name << " is not a uniform for program."));
-	glProgramUniformMatrix2x4fv(m_programId, loc, num, transpose, glm::value_ptr(value));
-}
+	ShaderProgram() = default;
 
-template <>
-void ShaderProgram::setUniform<glm::mat4x2>(const std::string& name, const glm::mat4x2& value, size_t num, bool transpose) {
-	GLint loc = glGetUniformLocation(m_programId, name.c_str());
-	BOOST_ASSERT_MSG(loc != -1, __SHADER_SS_MSG("Error: " << name << " is not a uniform for program."));
-	glProgramUniformMatrix4x2fv(m_programId, loc, num, transpose, glm::value_ptr(value));
-}
+	/*
+	 * Takes ownership of a linked program, replacing the current one, and
+	 * rebuilds the reflection and handle locations from it
+	 */
+	void setProgramId(GLuint programId) {
+		if(m_programId != programId) {
+			glDeleteProgram(m_programId);
+		}
+		m_programId = programId;
+		m_reflection = ProgramReflection(m_programId);
+		m_acceptedFormats.clear();
+
+		for(size_t i = 0; i < m_handleNames.size(); i++) {
+			m_handleLocations[i] = uniformLocation(m_handleNames[i]);
+		}
+		// Values set before the link may overlap, the copies kept are those
+		// of the values written last
+		for(size_t i = 0; i < m_handleNames.size(); i++) {
+			UniformShadow& shadow = m_handleShadows[i];
+			const GLint loc = m_handleLocations[i];
+			if(shadow.upload && loc != -1) {
+				const auto upload = shadow.upload;
+				upload(m_programId, loc, shadow.value.data(), shadow.value.size(), shadow.transpose);
+				forgetUniformValue(loc, shadow.count);
+				shadow.upload = upload;
+			}
+		}
+		for(const auto& binding : m_blockBindings) {
+			applyUniformBlockBinding(binding.first, binding.second);
+		}
+	}
 
-template <>
-void ShaderProgram::setUniform<glm::mat3x4>(const std::string& name, const glm::mat3x4& value, size_t num, bool transpose) {
-	GLint loc = glGetUniformLocation(m_programId, name.c_str());
-	BOOST_ASSERT_MSG(loc != -1, __SHADER_SS_MSG("Error: " << name << " is not a uniform for program."));
-	glProgramUniformMatrix3x4fv(m_programId, loc, num, transpose, glm::value_ptr(value));
-}
+	/*
+	 * Forgets the values of every slot covering any of the count locations
+	 * from location. Names can share locations, "u" and "u[0]", and an
+	 * array set writes the elements after the first, so any write can make
+	 * another slot's copy stale. Called for uniforms set without going
+	 * through a handle too, e.g. by a CommandBuffer.
+	 */
+	void forgetUniformValue(GLint location, GLsizei count = 1) {
+		for(size_t i = 0; i < m_handleLocations.size(); i++) {
+			UniformShadow& shadow = m_handleShadows[i];
+			const GLint loc = m_handleLocations[i];
+			if(shadow.upload && loc != -1 && loc < location + count && location < loc + shadow.count) {
+				shadow.upload = nullptr;
+			}
+		}
+	}
 
-template <>
-void ShaderProgram::setUniform<glm::mat4x3>(const std::string& name, const glm::mat4x3& value, size_t num, bool transpose) {
-	GLint loc = glGetUniformLocation(m_programId, name.c_str());
-	BOOST_ASSERT_MSG(loc != -1, __SHADER_SS_MSG("Error: " << name << " is not a uniform for program."));
-	glProgramUniformMatrix4x3fv(m_programId, loc, num, transpose, glm::value_ptr(value));
-}
+	void applyUniformBlockBinding(const std::string& name, GLuint binding) {
+		const GLint index = m_reflection.uniformBlockIndex(name);
+		if(index != -1) {
+			glUniformBlockBinding(m_programId, static_cast<GLuint>(index), binding);
+		}
+	}
+
+public:
+	virtual ~ShaderProgram() {
+		if(m_pending) {
+			for(const auto& shader : m_pending->shaders) {
+				glDeleteShader(shader.second);
+			}
+			glDeleteProgram(m_pending->program);
+		}
+		glDeleteProgram(m_programId);
+	}
+
+	/*
+	 * Whether the program has been compiled and linked. Uniform handles and
+	 * block bindings can be made before then and are resolved once it is.
+	 * Uniforms set through PER_FRAME handles before then are set once it
+	 * is, other uniforms can't be set or read.
+	 */
+	bool isReady() const {
+		return !m_pending;
+	}
+
+	bool hasUniform(const std::string& name) const {
+		return m_reflection.uniformLocation(name) != -1;
+	}
+
+	template <class T>
+	bool hasUniform(const UniformHandle<T>& handle) const {
+		BOOST_ASSERT_MSG(handle.m_program == this, "Error: UniformHandle belongs to another program.");
+		return m_handleLocations[handle.m_slot] != -1;
+	}
+
+	/*
+	 * Location of a uniform for use with CommandBuffer::setUniform, -1 if the
+	 * program has no active uniform with that name
+	 */
+	GLint uniformLocation(const std::string& name) const {
+		return m_reflection.uniformLocation(name);
+	}
+
+	/*
+	 * Looks a uniform up for repeated use with setUniform(UniformHandle...).
+	 * Asking for the same name twice returns the same slot, with the scope
+	 * it was first made with.
+	 */
+	template <class T>
+	UniformHandle<T> uniformHandle(const std::string& name, UniformScope scope = UniformScope::PER_FRAME) {
+		static_assert(utils::is_glsl_type<T>(), "Error: invalid type for Shader::uniformHandle");
+		UniformHandle<T> ret;
+		ret.m_program = this;
+
+		const auto inserted = m_handleSlots.emplace(name, m_handleNames.size());
+		ret.m_slot = inserted.first->second;
+		if(inserted.second) {
+			m_handleNames.push_back(name);
+			m_handleLocations.push_back(uniformLocation(name));
+			m_handleScopes.push_back(scope);
+			m_handleShadows.emplace_back();
+		}
+		return ret;
+	}
+
+	template <class T>
+	void setUniform(const UniformHandle<T>& handle, const T& value, size_t num = 1, bool transpose = false) {
+		BOOST_ASSERT_MSG(handle.m_program == this, "Error: UniformHandle belongs to another program.");
+		const GLint loc = m_handleLocations[handle.m_slot];
+		if(m_handleScopes[handle.m_slot] == UniformScope::PER_OBJECT) {
+			if(loc != -1) {
+				detail::programUniform(m_programId, loc, &value, static_cast<GLsizei>(num), transpose);
+				forgetUniformValue(loc, static_cast<GLsizei>(num));
+				m_uniformStats.issued += 1;
+			}
+			return;
+		}
+
+		UniformShadow& shadow = m_handleShadows[handle.m_slot];
+		const char* bytes = reinterpret_cast<const char*>(&value);
+		const size_t size = sizeof(T) * num;
+		if(shadow.upload == &detail::programUniformBytes<T> && shadow.transpose == transpose &&
+				shadow.value.size() == size && std::memcmp(shadow.value.data(), bytes, size) == 0) {
+			m_uniformStats.elided += 1;
+			return;
+		}
+		// Not linked yet or not active, the value is set if that changes
+		if(loc != -1) {
+			detail::programUniform(m_programId, loc, &value, static_cast<GLsizei>(num), transpose);
+			forgetUniformValue(loc, static_cast<GLsizei>(num));
+			m_uniformStats.issued += 1;
+		}
+		shadow.value.assign(bytes, bytes + size);
+		shadow.count = static_cast<GLsizei>(num);
+		shadow.transpose = transpose;
+		shadow.upload = &detail::programUniformBytes<T>;
+	}
+
+	/*
+	 * Goes through a PER_FRAME handle for the name, made on first use
+	 */
+	template <class T>
+	void setUniform(const std::string& name, const T& value, size_t num, bool transpose) {
+		static_assert(utils::is_glsl_type<T>(), "Error: invalid type for Shader::setUniform");
+		const UniformHandle<T> handle = uniformHandle<T>(name);
+		BOOST_ASSERT_MSG(m_handleLocations[handle.m_slot] != -1, __SHADER_SS_MSG("Error: " << name << " is not a uniform for program."));
+		setUniform(handle, value, num, transpose);
+	}
 
+	template <class T>
+	void setUniform(const std::string& name, const T& value, bool transpose) {
+		static_assert(utils::is_glsl_type<T>(), "Error: invalid type for Shader::setUniform");
+		setUniform<T>(name, value, 1, transpose);
+	}
+
+	template <class T>
+	void setUniform(const std::string& name, const T& value) {
+		static_assert(utils::is_glsl_type<T>(), "Error: invalid type for Shader::setUniform");
+		setUniform<T>(name, value, 1, false);
+	}
+
+	// TODO: handle double types
+	template <class T>
+	T getUniform(const std::string& name) {
+		static_assert(utils::is_glsl_type<T>(), "Error: invalid type for Shader::getUniform");
+		T ret;
+		detail::getProgramUniform(m_programId, uniformLocation(name), detail::valuePtr(ret));
+		return ret;
+	}
+
+	/*
+	 * Sets the binding point of a uniform block, for shaders which can't
+	 * declare it. Does nothing if the program has no such active block.
+	 */
+	void setUniformBlockBinding(const std::string& name, GLuint binding) {
+		for(auto& b : m_blockBindings) {
+			if(b.first == name) {
+				b.second = binding;
+				applyUniformBlockBinding(name, binding);
+				return;
+			}
+		}
+		m_blockBindings.emplace_back(name, binding);
+		applyUniformBlockBinding(name, binding);
+	}
+
+	const UniformStats& uniformStats() const {
+		return m_uniformStats;
+	}
+
+	void resetUniformStats() {
+		m_uniformStats = UniformStats();
+	}
+
+	const ProgramReflection& reflection() const {
+		return m_reflection;
+	}
+
+	size_t numUniforms() const {
+		return m_reflection.uniforms().size();
+	}
+
+	size_t numAttributes() const {
+		return m_reflection.inputs().size();
+	}
+
+	/*
+	 * Whether the vertex inputs can be fed from a VAO with the given format,
+	 * see ProgramReflection::matchesVertexFormat(). Formats which match are
+	 * remembered, so checking one again is a short search.
+	 */
+	bool acceptsVertexFormat(const detail::VertexFormat& format, std::string* error = nullptr) const {
+		if(std::find(m_acceptedFormats.begin(), m_acceptedFormats.end(), &format) != m_acceptedFormats.end()) {
+			return true;
+		}
+		if(!m_reflection.matchesVertexFormat(format, error)) {
+			return false;
+		}
+		m_acceptedFormats.push_back(&format);
+		return true;
+	}
+
+	template <class Vertex>
+	bool acceptsVertex(std::string* error = nullptr) const {
+		return acceptsVertexFormat(detail::vertexFormat<Vertex>(), error);
+	}
+};
+
+typedef std::shared_ptr<ShaderProgram> ShaderProgramHandle;
 
 }
 #undef __SHADER_SS_MSG
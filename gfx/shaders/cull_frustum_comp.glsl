@@ -0,0 +1,92 @@
+#version 430
+
+// Frustum culling for gfx::GpuCuller, see GraphicsContext::cullOnGpu.
+// Binding points match gfx::StdBindingPoint and CullObject matches
+// gfx::detail::CullObject.
+#define CULL_OBJECT_BUFFER_BINDING_POINT 4
+#define CULL_COMMAND_BUFFER_BINDING_POINT 5
+#define CULL_DRAW_COUNT_BUFFER_BINDING_POINT 6
+
+struct CullObject {
+	mat4 model;
+	// Object space box, bounds_min.w is 0 for objects which are never culled
+	vec4 bounds_min;
+	vec4 bounds_max;
+	// count, firstIndex, baseVertex, unused
+	uvec4 draw;
+};
+
+struct DrawCommand {
+	uint count;
+	uint instance_count;
+	uint first_index;
+	int base_vertex;
+	uint base_instance;
+};
+
+layout(std430, binding=CULL_OBJECT_BUFFER_BINDING_POINT) readonly buffer CullObjectBuffer {
+	CullObject objects[];
+};
+
+layout(std430, binding=CULL_COMMAND_BUFFER_BINDING_POINT) writeonly buffer CullCommandBuffer {
+	DrawCommand commands[];
+};
+
+layout(std430, binding=CULL_DRAW_COUNT_BUFFER_BINDING_POINT) buffer CullDrawCountBuffer {
+	uint draw_count;
+};
+
+// Planes in the same order and form as gfx::Frustum
+layout(location = 0) uniform vec4 u_planes[6];
+layout(location = 6) uniform uint u_num_objects;
+// Nonzero to append visible draws, otherwise every object keeps its slot
+layout(location = 7) uniform uint u_compact;
+
+layout(local_size_x = 64) in;
+
+bool is_visible(CullObject obj) {
+	if(obj.bounds_min.w == 0.0) {
+		return true;
+	}
+
+	// World space box enclosing the transformed object box (Arvo)
+	vec3 center = 0.5 * (obj.bounds_min.xyz + obj.bounds_max.xyz);
+	vec3 extents = 0.5 * (obj.bounds_max.xyz - obj.bounds_min.xyz);
+	vec3 world_center = (obj.model * vec4(center, 1.0)).xyz;
+	vec3 world_extents = abs(mat3(obj.model)) * extents;
+
+	for(int i = 0; i < 6; i++) {
+		vec3 n = u_planes[i].xyz;
+		float r = dot(world_extents, abs(n));
+		if(dot(n, world_center) + u_planes[i].w < -r) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void main() {
+	uint id = gl_GlobalInvocationID.x;
+	if(id >= u_num_objects) {
+		return;
+	}
+
+	CullObject obj = objects[id];
+	bool visible = is_visible(obj);
+
+	DrawCommand cmd;
+	cmd.count = obj.draw.x;
+	cmd.instance_count = visible ? 1u : 0u;
+	cmd.first_index = obj.draw.y;
+	cmd.base_vertex = int(obj.draw.z);
+	// Lets vertex shaders find their object with gl_BaseInstanceARB
+	cmd.base_instance = id;
+
+	if(u_compact != 0u) {
+		if(visible) {
+			commands[atomicAdd(draw_count, 1u)] = cmd;
+		}
+	} else {
+		commands[id] = cmd;
+	}
+}
@@ -1,8 +1,8 @@
 #pragma include "stddefs.glsl"
 
-in vec4 in_position;
-in vec3 in_normal;
-in vec2 in_texcoord;
+layout(location = 0) in vec4 in_position;
+layout(location = 1) in vec3 in_normal;
+layout(location = 2) in vec2 in_texcoord;
 
 void main() {
 	gl_Position =  std_Projection * std_Modelview * in_position;
@@ -1,6 +1,6 @@
 #pragma include "stddefs.glsl"
 
-in vec4 in_position;
+layout(location = 0) in vec4 in_position;
 
 smooth out float interp_factor;
 
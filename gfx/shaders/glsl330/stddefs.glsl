@@ -5,6 +5,14 @@ struct Light {
     float enabled;
 };
 
+// Size of std_Lights. Programs built with a lower NUM_LIGHTS only light
+// with the first NUM_LIGHTS lights, looping over them with a constant
+// bound the compiler can unroll
+#define STD_MAX_LIGHTS 10
+#ifndef NUM_LIGHTS
+#define NUM_LIGHTS STD_MAX_LIGHTS
+#endif
+
 struct Material {
     vec4 diffuse;
     vec4 specular;
@@ -16,5 +24,18 @@ uniform mat4 std_Modelview;
 uniform mat4 std_Normal;
 uniform mat4 std_View;
 uniform mat4 std_Projection;
-uniform vec4 std_GlobalAmbient;
-uniform Light std_Lights[10];
+// GLSL 330 can't declare binding points, programs bind this block with
+// ShaderProgram::setUniformBlockBinding() to PER_FRAME_LIGHT_BLOCK_BINDING
+layout(std140) uniform PerFrameLightingBlock {
+    vec4 std_GlobalAmbient;
+    Light std_Lights[STD_MAX_LIGHTS];
+};
+
+// Per draw matrices laid out like gfx::ObjectMatrices, bound with
+// GraphicsContext::bindUniformRange() at PER_DRAW_MATRIX_BLOCK_BINDING.
+// Programs bind the block with ShaderProgram::setUniformBlockBinding().
+layout(std140) uniform PerDrawMatrixBlock {
+    mat4 std_DrawModelview;
+    mat4 std_DrawModelviewProjection;
+    mat4 std_DrawNormal;
+};
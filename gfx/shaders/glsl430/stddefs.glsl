@@ -6,6 +6,14 @@ struct Light {
 	float enabled;
 };
 
+// Size of std_Lights. Programs built with a lower NUM_LIGHTS only light
+// with the first NUM_LIGHTS lights, looping over them with a constant
+// bound the compiler can unroll
+#define STD_MAX_LIGHTS 10
+#ifndef NUM_LIGHTS
+#define NUM_LIGHTS STD_MAX_LIGHTS
+#endif
+
 struct Material {
 	vec4 diffuse;
 	vec4 specular;
@@ -16,6 +24,10 @@ struct Material {
 #define PER_FRAME_LIGHT_BLOCK 2
 #define PER_DRAW_MATRIX_BLOCK_BINDING_POINT 3
 
+// Shader storage buffer holding one element per draw of a DrawBatch,
+// indexed by gl_DrawIDARB
+#define PER_DRAW_DATA_BUFFER_BINDING_POINT 3
+
 layout(std140, binding=PER_FRAME_MATRIX_BLOCK_BINDING_POINT) uniform PerFrameMatrixBlock {
 	mat4 std_Modelview;
 	mat4 std_Normal;
@@ -25,5 +37,12 @@ layout(std140, binding=PER_FRAME_MATRIX_BLOCK_BINDING_POINT) uniform PerFrameMat
 
 layout(std140, binding=PER_FRAME_LIGHT_BLOCK) uniform PerFrameLightingBlock {
 	vec4 std_GlobalAmbient;
-	Light std_Lights[10];
+	Light std_Lights[STD_MAX_LIGHTS];
+};
+
+// Per draw matrices laid out like gfx::ObjectMatrices
+layout(std140, binding=PER_DRAW_MATRIX_BLOCK_BINDING_POINT) uniform PerDrawMatrixBlock {
+	mat4 std_DrawModelview;
+	mat4 std_DrawModelviewProjection;
+	mat4 std_DrawNormal;
 };
\ No newline at end of file
@@ -0,0 +1,21 @@
+#pragma include "stddefs.glsl"
+
+layout(location = 0) in vec4 in_position;
+layout(location = 1) in vec3 in_normal;
+layout(location = 2) in vec2 in_texcoord;
+
+// Per instance model matrix, see GraphicsContext::drawInstanced
+layout(location = 3) in mat4 in_model;
+
+smooth out vec4 v_position;
+smooth out vec3 v_normal;
+smooth out vec2 v_texcoord;
+
+void main() {
+	mat4 modelview = std_View * in_model;
+	v_position = modelview * in_position;
+	// Assumes instances are uniformly scaled
+	v_normal = mat3(modelview) * in_normal;
+	v_texcoord = in_texcoord;
+	gl_Position =  std_Projection * v_position;
+}
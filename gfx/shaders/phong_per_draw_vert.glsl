@@ -0,0 +1,18 @@
+#pragma include "stddefs.glsl"
+
+layout(location = 0) in vec4 in_position;
+layout(location = 1) in vec3 in_normal;
+layout(location = 2) in vec2 in_texcoord;
+
+smooth out vec4 v_position;
+smooth out vec3 v_normal;
+smooth out vec2 v_texcoord;
+
+// Same as phong_vertex.glsl with the matrices of each draw read from
+// PerDrawMatrixBlock, see gfx::UniformRing
+void main() {
+	v_position = std_DrawModelview * in_position;
+	v_normal = mat3(std_DrawNormal) * in_normal;
+	v_texcoord = in_texcoord;
+	gl_Position = std_DrawModelviewProjection * in_position;
+}
@@ -1,6 +1,6 @@
 #pragma include "stddefs.glsl"
 
-in vec4 position;
+layout(location = 0) in vec4 position;
 
 void main() {
   gl_Position = std_Projection * std_Modelview * position;
@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <boost/assert.hpp>
+
+#include "shader.h"
+
+#ifndef SHADER_VARIANTS_H_
+#define SHADER_VARIANTS_H_
+
+namespace gfx {
+
+/*
+ * Names one variant of a ShaderVariants, the value of every option packed
+ * into a bitmask
+ */
+typedef uint32_t ShaderVariantKey;
+
+/*
+ * A define ShaderVariants builds programs with. bits is the width of its
+ * value in a ShaderVariantKey: 1 for a toggle, defined as 0 or 1, and
+ * enough bits for the largest value of an integer option like NUM_LIGHTS.
+ * Keys which don't mention the option get defaultValue, e.g. the number
+ * of lights a shader would otherwise fall back on.
+ */
+struct ShaderOption {
+	std::string name;
+	unsigned bits;
+	unsigned defaultValue = 0;
+};
+
+/*
+ * Programs built from the same shader files with different values of a
+ * few options, instead of a copy of the files for every combination. A
+ * variant is compiled the first time GraphicsContext::shaderVariant() asks
+ * for it, or ahead of time by GraphicsContext::prewarmShaderVariants(), and
+ * kept for the lifetime of the set.
+ *
+ * Every option is defined in every variant, so shaders test toggles with
+ * #if rather than #ifdef. Integer options make good loop bounds: the
+ * compiler sees a constant and can unroll the loop.
+ */
+class ShaderVariants {
+	friend class GraphicsContext;
+
+	utils::ProgramFiles m_files;
+	std::vector<ShaderOption> m_options;
+	std::vector<unsigned> m_shifts;
+
+	std::unordered_map<ShaderVariantKey, ShaderProgramHandle> m_programs;
+
+	// Set on every variant, including those built later
+	std::vector<std::pair<std::string, GLuint>> m_blockBindings;
+
+	ShaderVariants(const std::vector<std::pair<GLenum, std::string>>& stages,
+			const std::vector<ShaderOption>& options) : m_options(options) {
+		m_files.stages = stages;
+
+		unsigned shift = 0;
+		for(const ShaderOption& option : m_options) {
+			BOOST_ASSERT_MSG(option.bits > 0, "Error: shader option without bits.");
+			m_shifts.push_back(shift);
+			shift += option.bits;
+		}
+		BOOST_ASSERT_MSG(shift <= 8 * sizeof(ShaderVariantKey), "Error: too many shader option bits for a key.");
+	}
+
+	/*
+	 * The files of the variant, with a define for every option
+	 */
+	utils::ProgramFiles variantFiles(ShaderVariantKey key) const {
+		utils::ProgramFiles ret = m_files;
+		for(size_t i = 0; i < m_options.size(); i++) {
+			ret.defines.emplace_back(m_options[i].name, std::to_string(value(key, i)));
+		}
+		return ret;
+	}
+
+	void addVariant(ShaderVariantKey key, const ShaderProgramHandle& program) {
+		for(const auto& binding : m_blockBindings) {
+			program->setUniformBlockBinding(binding.first, binding.second);
+		}
+		m_programs.emplace(key, program);
+	}
+
+public:
+	size_t numOptions() const {
+		return m_options.size();
+	}
+
+	const ShaderOption& option(size_t i) const {
+		return m_options[i];
+	}
+
+	size_t optionIndex(const std::string& name) const {
+		for(size_t i = 0; i < m_options.size(); i++) {
+			if(m_options[i].name == name) {
+				return i;
+			}
+		}
+		BOOST_ASSERT_MSG(false, "Error: no such shader option.");
+		return m_options.size();
+	}
+
+	unsigned value(ShaderVariantKey key, size_t option) const {
+		const ShaderVariantKey mask = (ShaderVariantKey(2) << (m_options[option].bits - 1)) - 1;
+		return (key >> m_shifts[option]) & mask;
+	}
+
+	/*
+	 * key with option set to value
+	 */
+	ShaderVariantKey withValue(ShaderVariantKey key, size_t option, unsigned value) const {
+		const ShaderVariantKey mask = (ShaderVariantKey(2) << (m_options[option].bits - 1)) - 1;
+		BOOST_ASSERT_MSG(value <= mask, "Error: value too wide for its shader option.");
+		return (key & ~(mask << m_shifts[option])) | (ShaderVariantKey(value) << m_shifts[option]);
+	}
+
+	/*
+	 * Key of the variant with every option at its default value
+	 */
+	ShaderVariantKey defaultKey() const {
+		ShaderVariantKey ret = 0;
+		for(size_t i = 0; i < m_options.size(); i++) {
+			ret = withValue(ret, i, m_options[i].defaultValue);
+		}
+		return ret;
+	}
+
+	/*
+	 * Key of the variant with the given option values, options left out
+	 * get their default value. Look keys up once rather than every frame.
+	 */
+	ShaderVariantKey key(const std::vector<std::pair<std::string, unsigned>>& values) const {
+		ShaderVariantKey ret = defaultKey();
+		for(const auto& v : values) {
+			ret = withValue(ret, optionIndex(v.first), v.second);
+		}
+		return ret;
+	}
+
+	bool hasVariant(ShaderVariantKey key) const {
+		return m_programs.count(key) != 0;
+	}
+
+	/*
+	 * Number of variants built so far
+	 */
+	size_t numVariants() const {
+		return m_programs.size();
+	}
+
+	/*
+	 * ShaderProgram::setUniformBlockBinding() on every variant
+	 */
+	void setUniformBlockBinding(const std::string& name, GLuint binding) {
+		auto it = std::find_if(m_blockBindings.begin(), m_blockBindings.end(),
+				[&name](const std::pair<std::string, GLuint>& b) { return b.first == name; });
+		if(it == m_blockBindings.end()) {
+			m_blockBindings.emplace_back(name, binding);
+		} else {
+			it->second = binding;
+		}
+		for(auto& program : m_programs) {
+			program.second->setUniformBlockBinding(name, binding);
+		}
+	}
+};
+
+typedef std::shared_ptr<ShaderVariants> ShaderVariantsHandle;
+
+}
+
+#endif /* SHADER_VARIANTS_H_ */
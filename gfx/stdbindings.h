@@ -0,0 +1,30 @@
+#ifndef RENDERER_STD_BINDINGS_H_
+#define RENDERER_STD_BINDINGS_H_
+
+namespace gfx {
+
+/*
+ * Buffer binding points shared with the GLSL standard definitions.
+ * Keep in sync with shaders/glsl430/stddefs.glsl. GLSL 330 can't declare
+ * bindings, programs using shaders/glsl330/stddefs.glsl set them with
+ * ShaderProgram::setUniformBlockBinding()
+ */
+enum StdBindingPoint {
+	// Uniform block binding points
+	PER_FRAME_MATRIX_BLOCK_BINDING = 1,
+	PER_FRAME_LIGHT_BLOCK_BINDING = 2,
+	PER_DRAW_MATRIX_BLOCK_BINDING = 3,
+	MATERIAL_BLOCK_BINDING = 4,
+
+	// Shader storage buffer binding points
+	PER_DRAW_DATA_BUFFER_BINDING = 3,
+
+	// Shader storage buffer binding points used by shaders/cull_frustum_comp.glsl
+	CULL_OBJECT_BUFFER_BINDING = 4,
+	CULL_COMMAND_BUFFER_BINDING = 5,
+	CULL_DRAW_COUNT_BUFFER_BINDING = 6
+};
+
+}
+
+#endif /* RENDERER_STD_BINDINGS_H_ */
@@ -0,0 +1,77 @@
+#include <GL/glew.h>
+
+#include <memory>
+
+#include "utils/block_tuple.h"
+
+#ifndef RENDERER_UNIFORM_BUFFER_H_
+#define RENDERER_UNIFORM_BUFFER_H_
+
+namespace gfx {
+
+class GraphicsContext;
+
+/*
+ * A uniform buffer holding one uniform block, with a CPU side copy of it.
+ * Block is a Std140Tuple (or a type derived from one) with the block's
+ * member types in order, e.g. for
+ *   layout(std140) uniform Lighting { vec4 ambient; Light lights[10]; };
+ * with struct Light { vec4 position; vec4 color; float attenuation; }:
+ *   Std140Tuple<vec4, std::array<Std140Tuple<vec4, vec4, float>, 10>>
+ *
+ * Fill data() and upload() the whole block with one glNamedBufferSubData,
+ * then bind it with GraphicsContext::bindUniformBuffer().
+ */
+template <class Block>
+class UniformBuffer {
+	friend class GraphicsContext;
+
+	static_assert(IsStd140Block<Block>::value, "Error: uniform blocks must be std140 block tuples");
+
+	GLuint m_bufferId = 0;
+	Block m_data;
+
+	UniformBuffer() : m_data() {
+		glCreateBuffers(1, &m_bufferId);
+		glNamedBufferStorage(m_bufferId, sizeof(Block), &m_data, GL_DYNAMIC_STORAGE_BIT);
+	}
+
+public:
+	UniformBuffer(const UniformBuffer&) = delete;
+	UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+	~UniformBuffer() {
+		glDeleteBuffers(1, &m_bufferId);
+	}
+
+	GLuint bufferId() const {
+		return m_bufferId;
+	}
+
+	Block& data() {
+		return m_data;
+	}
+
+	const Block& data() const {
+		return m_data;
+	}
+
+	/*
+	 * Copies data() to the buffer
+	 */
+	void upload() {
+		glNamedBufferSubData(m_bufferId, 0, sizeof(Block), &m_data);
+	}
+
+	void upload(const Block& data) {
+		m_data = data;
+		upload();
+	}
+};
+
+template <class Block>
+using UniformBufHandle = std::shared_ptr<UniformBuffer<Block>>;
+
+}
+
+#endif /* RENDERER_UNIFORM_BUFFER_H_ */
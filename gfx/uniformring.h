@@ -0,0 +1,118 @@
+#include <GL/glew.h>
+
+#include <cstring>
+#include <memory>
+#include <boost/assert.hpp>
+
+#include "drawlist.h"
+#include "utils/persistent_ring.h"
+
+#ifndef RENDERER_UNIFORM_RING_H_
+#define RENDERER_UNIFORM_RING_H_
+
+namespace gfx {
+
+class GraphicsContext;
+
+/*
+ * Frame scoped uniform memory for per draw blocks. Each draw's block is
+ * written straight into persistently mapped memory at an offset aligned to
+ * GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, and the returned UniformRange is bound
+ * with glBindBufferRange when the draw is issued, through
+ * GraphicsContext::bindUniformRange(), a DrawList or a CommandBuffer.
+ *
+ * Per frame usage:
+ *   push() or allocate() each draw's block, issue the draws, advance()
+ */
+class UniformRing {
+	friend class GraphicsContext;
+
+	size_t m_alignment = 1;
+	size_t m_used = 0;
+
+	detail::PersistentRing m_ring;
+
+	static size_t uniformBufferAlignment() {
+		GLint alignment = 1;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		return static_cast<size_t>(alignment);
+	}
+
+	UniformRing(size_t bytesPerFrame, size_t numRegions) :
+			m_alignment(uniformBufferAlignment()), m_ring(bytesPerFrame, numRegions, m_alignment) {
+	}
+
+public:
+	UniformRing(const UniformRing&) = delete;
+	UniformRing& operator=(const UniformRing&) = delete;
+
+	size_t alignment() const {
+		return m_alignment;
+	}
+
+	/*
+	 * Bytes available per frame
+	 */
+	size_t capacity() const {
+		return m_ring.regionSize();
+	}
+
+	size_t bytesUsed() const {
+		return m_used;
+	}
+
+	GLuint bufferId() const {
+		return m_ring.bufferId();
+	}
+
+	/*
+	 * Distance between consecutive blocks of size bytes written by allocate()
+	 */
+	size_t stride(size_t size) const {
+		return (size + m_alignment - 1) / m_alignment * m_alignment;
+	}
+
+	/*
+	 * Reserves count blocks of size bytes, stride(size) bytes apart, and
+	 * writes their ranges to ranges. Returns the mapped memory of the first
+	 * block for the caller to fill, e.g. with computeObjectMatrices().
+	 */
+	void* allocate(size_t size, size_t count, UniformRange* ranges) {
+		const size_t blockStride = stride(size);
+		const size_t offset = stride(m_used);
+		BOOST_ASSERT_MSG(offset + blockStride * count <= capacity(),
+				"Error writing more uniform blocks than the ring holds per frame");
+
+		const size_t bufferOffset = m_ring.regionOffset() + offset;
+		for(size_t i = 0; i < count; i++) {
+			ranges[i] = UniformRange(m_ring.bufferId(), bufferOffset + i * blockStride, size);
+		}
+		m_used = offset + blockStride * count;
+		return static_cast<uint8_t*>(m_ring.regionData()) + offset;
+	}
+
+	/*
+	 * Copies one block into the ring and returns its range
+	 */
+	template <class Block>
+	UniformRange push(const Block& block) {
+		UniformRange range;
+		std::memcpy(allocate(sizeof(Block), 1, &range), &block, sizeof(Block));
+		return range;
+	}
+
+	/*
+	 * Call once every draw reading this frame's blocks has been issued.
+	 * Empties the ring for the next frame.
+	 */
+	void advance() {
+		m_ring.advance();
+		m_used = 0;
+	}
+};
+
+typedef std::shared_ptr<UniformRing> UniformRingHandle;
+
+}
+
+#endif /* RENDERER_UNIFORM_RING_H_ */
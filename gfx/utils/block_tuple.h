@@ -0,0 +1,278 @@
+#include <array>
+#include <cstddef>
+#include <type_traits>
+
+#include <glm/glm.hpp>
+
+#include "tuple.h"
+
+#ifndef GFX_UTILS_BLOCK_TUPLE_H_
+#define GFX_UTILS_BLOCK_TUPLE_H_
+
+namespace gfx {
+namespace detail {
+
+constexpr size_t roundUp(size_t n, size_t r) {
+	return (n + r - 1) / r * r;
+}
+
+/*
+ * Layout rules of GLSL interface blocks. Under std430 every member is
+ * aligned to its base alignment, std140 also rounds the alignment of
+ * arrays and structs up to that of a vec4.
+ */
+struct Std140Layout {
+	static constexpr size_t arrayAlign(size_t align) {
+		return roundUp(align, 16);
+	}
+
+	static constexpr size_t structAlign(size_t align) {
+		return roundUp(align, 16);
+	}
+};
+
+struct Std430Layout {
+	static constexpr size_t arrayAlign(size_t align) {
+		return align;
+	}
+
+	static constexpr size_t structAlign(size_t align) {
+		return align;
+	}
+};
+
+template <class Rules, size_t StructAlign, size_t Padding, size_t Offset, class... Elements>
+struct PaddedConsCell;
+
+/*
+ * Alignment of a block tuple's list type, for block tuples nested in
+ * blocks with the same rules
+ */
+template <class Rules, class ListType>
+struct BlockStructAlign {
+	static constexpr bool VALID = false;
+	static constexpr size_t value = 1;
+};
+
+template <class Rules, size_t StructAlign, size_t Padding, size_t Offset, class... Elements>
+struct BlockStructAlign<Rules, PaddedConsCell<Rules, StructAlign, Padding, Offset, Elements...>> {
+	static constexpr bool VALID = true;
+	static constexpr size_t value = StructAlign;
+};
+
+/*
+ * Base alignment of a block member of type T under Rules. Members can be
+ * float, int and unsigned int scalars, glm vectors and matrices of them,
+ * std::arrays, and block tuples (or types derived from them) with the same
+ * rules. glm types and std::arrays are tightly packed, so matrix columns and
+ * array elements must be a multiple of their alignment in size: e.g. mat3
+ * or std::array<float, N> are not valid std140 members, mat3x4 and
+ * std::array<vec4, N> are.
+ */
+template <class Rules, class T, class Enable = void>
+struct BlockAlign {
+	static constexpr bool VALID = false;
+	static constexpr size_t value = 1;
+};
+
+template <class Rules, class T>
+struct BlockAlign<Rules, T, typename std::enable_if<std::is_class<typename T::ListType>::value>::type> :
+		BlockStructAlign<Rules, typename T::ListType> {};
+
+#define __BT_BASIC_ALIGN(type, align) \
+		template <class Rules> \
+		struct BlockAlign<Rules, type> { \
+			static constexpr bool VALID = true; \
+			static constexpr size_t value = align; \
+		};
+
+__BT_BASIC_ALIGN(float, 4)
+__BT_BASIC_ALIGN(int, 4)
+__BT_BASIC_ALIGN(unsigned int, 4)
+__BT_BASIC_ALIGN(glm::vec2, 8)
+__BT_BASIC_ALIGN(glm::vec3, 16)
+__BT_BASIC_ALIGN(glm::vec4, 16)
+__BT_BASIC_ALIGN(glm::ivec2, 8)
+__BT_BASIC_ALIGN(glm::ivec3, 16)
+__BT_BASIC_ALIGN(glm::ivec4, 16)
+__BT_BASIC_ALIGN(glm::uvec2, 8)
+__BT_BASIC_ALIGN(glm::uvec3, 16)
+__BT_BASIC_ALIGN(glm::uvec4, 16)
+
+#undef __BT_BASIC_ALIGN
+
+/*
+ * Matrices are laid out as arrays of their column vectors
+ */
+template <class Rules, class Column>
+struct MatrixBlockAlign {
+	static constexpr size_t value = Rules::arrayAlign(BlockAlign<Rules, Column>::value);
+	static constexpr bool VALID = sizeof(Column) % value == 0;
+};
+
+#define __BT_MATRIX_ALIGN(type, column) \
+		template <class Rules> \
+		struct BlockAlign<Rules, type> : MatrixBlockAlign<Rules, column> {};
+
+__BT_MATRIX_ALIGN(glm::mat2, glm::vec2)
+__BT_MATRIX_ALIGN(glm::mat3, glm::vec3)
+__BT_MATRIX_ALIGN(glm::mat4, glm::vec4)
+__BT_MATRIX_ALIGN(glm::mat2x3, glm::vec3)
+__BT_MATRIX_ALIGN(glm::mat3x2, glm::vec2)
+__BT_MATRIX_ALIGN(glm::mat2x4, glm::vec4)
+__BT_MATRIX_ALIGN(glm::mat4x2, glm::vec2)
+__BT_MATRIX_ALIGN(glm::mat3x4, glm::vec4)
+__BT_MATRIX_ALIGN(glm::mat4x3, glm::vec3)
+
+#undef __BT_MATRIX_ALIGN
+
+template <class Rules, class T, size_t N>
+struct BlockAlign<Rules, std::array<T, N>> {
+	static constexpr size_t value = Rules::arrayAlign(BlockAlign<Rules, T>::value);
+	static constexpr bool VALID = BlockAlign<Rules, T>::VALID && sizeof(T) % value == 0;
+};
+
+template <class Rules, class... Elements>
+struct MaxBlockAlign;
+
+template <class Rules>
+struct MaxBlockAlign<Rules> {
+	static constexpr size_t value = 1;
+};
+
+template <class Rules, class T, class... Rest>
+struct MaxBlockAlign<Rules, T, Rest...> {
+	static constexpr size_t value = BlockAlign<Rules, T>::value > MaxBlockAlign<Rules, Rest...>::value ?
+			BlockAlign<Rules, T>::value : MaxBlockAlign<Rules, Rest...>::value;
+};
+
+/*
+ * Padding after the element at Offset, up to the next element's alignment
+ * or, after the last element, to the end of the struct
+ */
+template <class Rules, size_t StructAlign, size_t Offset, class... Elements>
+struct BlockPadding;
+
+template <class Rules, size_t StructAlign, size_t Offset, class T>
+struct BlockPadding<Rules, StructAlign, Offset, T> {
+	static constexpr size_t value = roundUp(Offset + sizeof(T), StructAlign) - (Offset + sizeof(T));
+};
+
+template <class Rules, size_t StructAlign, size_t Offset, class T, class Next, class... Rest>
+struct BlockPadding<Rules, StructAlign, Offset, T, Next, Rest...> {
+	static constexpr size_t value = roundUp(Offset + sizeof(T), BlockAlign<Rules, Next>::value) - (Offset + sizeof(T));
+};
+
+template <class Rules, size_t StructAlign, size_t Offset, class... Elements>
+using BlockConsCell = PaddedConsCell<Rules, StructAlign,
+		BlockPadding<Rules, StructAlign, Offset, Elements...>::value, Offset, Elements...>;
+
+/*
+ * A cons cell for a list of values laid out by GLSL block rules. Offset is
+ * the head's offset from the start of the list. Explicit padding after the
+ * head puts the tail at the next element's aligned offset, so the
+ * layout doesn't depend on the alignment the compiler gives the glm types.
+ */
+#define __BT_CELL_CHECKS \
+		static_assert(BlockAlign<Rules, T>::VALID, \
+				"Error: type can't be a GLSL block member, see gfx::detail::BlockAlign"); \
+		static_assert(Offset % BlockAlign<Rules, T>::value == 0, \
+				"Error: misaligned GLSL block member");
+
+template <class Rules, size_t StructAlign, size_t Padding, size_t Offset, class T, class... Rest>
+struct PaddedConsCell<Rules, StructAlign, Padding, Offset, T, Rest...> {
+	__BT_CELL_CHECKS
+
+	T head;
+	unsigned char padding[Padding];
+	BlockConsCell<Rules, StructAlign, Offset + sizeof(T) + Padding, Rest...> tail;
+
+	typedef T HeadType;
+	typedef BlockConsCell<Rules, StructAlign, Offset + sizeof(T) + Padding, Rest...> TailType;
+};
+
+template <class Rules, size_t StructAlign, size_t Offset, class T, class... Rest>
+struct PaddedConsCell<Rules, StructAlign, 0, Offset, T, Rest...> {
+	__BT_CELL_CHECKS
+
+	T head;
+	BlockConsCell<Rules, StructAlign, Offset + sizeof(T), Rest...> tail;
+
+	typedef T HeadType;
+	typedef BlockConsCell<Rules, StructAlign, Offset + sizeof(T), Rest...> TailType;
+};
+
+template <class Rules, size_t StructAlign, size_t Padding, size_t Offset, class T>
+struct PaddedConsCell<Rules, StructAlign, Padding, Offset, T> {
+	__BT_CELL_CHECKS
+
+	T head;
+	unsigned char padding[Padding];
+
+	typedef T HeadType;
+	typedef EmptyListType TailType;
+};
+
+template <class Rules, size_t StructAlign, size_t Offset, class T>
+struct PaddedConsCell<Rules, StructAlign, 0, Offset, T> {
+	__BT_CELL_CHECKS
+
+	T head;
+
+	typedef T HeadType;
+	typedef EmptyListType TailType;
+};
+
+#undef __BT_CELL_CHECKS
+
+template <size_t I, class... Elements>
+using Std140ConsCell = BlockConsCell<Std140Layout,
+		Std140Layout::structAlign(MaxBlockAlign<Std140Layout, Elements...>::value), 0, Elements...>;
+
+template <size_t I, class... Elements>
+using Std430ConsCell = BlockConsCell<Std430Layout,
+		Std430Layout::structAlign(MaxBlockAlign<Std430Layout, Elements...>::value), 0, Elements...>;
+
+}
+
+
+/*
+ * Tuples laid out like a GLSL struct or interface block declared with
+ * layout(std140) or layout(std430) and the same member types in the same
+ * order. sizeof() includes the struct's trailing padding, so arrays of
+ * them match GLSL arrays of the struct. Block tuples can be nested, and
+ * types which can't be laid out with the rules fail to compile.
+ */
+template <class... Types>
+using Std140Tuple = detail::Tuple<detail::Std140ConsCell, Types...>;
+
+template <class... Types>
+using Std430Tuple = detail::Tuple<detail::Std430ConsCell, Types...>;
+
+template <class... Types>
+struct IsGfxTuple<Std140Tuple<Types...>> {
+	static constexpr const bool value = true;
+};
+
+template <class... Types>
+struct IsGfxTuple<Std430Tuple<Types...>> {
+	static constexpr const bool value = true;
+};
+
+/*
+ * Whether T (a block tuple or a type derived from one) is laid out with
+ * std140 rules, as uniform blocks require
+ */
+template <class T, class Enable = void>
+struct IsStd140Block {
+	static constexpr const bool value = false;
+};
+
+template <class T>
+struct IsStd140Block<T, typename std::enable_if<std::is_class<typename T::ListType>::value>::type> {
+	static constexpr const bool value = detail::BlockStructAlign<detail::Std140Layout, typename T::ListType>::VALID;
+};
+
+}
+
+#endif /* GFX_UTILS_BLOCK_TUPLE_H_ */
@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#include <glm/glm.hpp>
+
+#ifndef GFX_UTILS_BOUNDS_H_
+#define GFX_UTILS_BOUNDS_H_
+
+namespace gfx {
+
+/*
+ * Axis aligned bounding box. A default constructed box is empty: it contains
+ * nothing and growing it by a point gives a box around that point.
+ */
+struct BoundingBox {
+	glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+	glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+	BoundingBox() = default;
+	BoundingBox(const glm::vec3& mn, const glm::vec3& mx) : min(mn), max(mx) {}
+
+	bool empty() const {
+		return min.x > max.x || min.y > max.y || min.z > max.z;
+	}
+
+	glm::vec3 center() const {
+		return (min + max) * 0.5f;
+	}
+
+	glm::vec3 extents() const {
+		return (max - min) * 0.5f;
+	}
+
+	float surfaceArea() const {
+		if(empty()) {
+			return 0.0f;
+		}
+		const glm::vec3 d = max - min;
+		return 2.0f * (d.x*d.y + d.y*d.z + d.z*d.x);
+	}
+
+	bool overlaps(const BoundingBox& b) const {
+		return min.x <= b.max.x && max.x >= b.min.x &&
+				min.y <= b.max.y && max.y >= b.min.y &&
+				min.z <= b.max.z && max.z >= b.min.z;
+	}
+
+	/*
+	 * Squared distance from p to the closest point of the box, 0 inside it
+	 */
+	float distanceSquared(const glm::vec3& p) const {
+		const glm::vec3 d = glm::max(glm::max(min - p, p - max), glm::vec3(0.0f));
+		return glm::dot(d, d);
+	}
+
+	void grow(const glm::vec3& p) {
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+	}
+
+	void grow(const BoundingBox& b) {
+		min = glm::min(min, b.min);
+		max = glm::max(max, b.max);
+	}
+
+	/*
+	 * The box around this box after transforming it by m
+	 */
+	BoundingBox transformed(const glm::mat4& m) const {
+		const glm::vec3 c = glm::vec3(m * glm::vec4(center(), 1.0f));
+		const glm::vec3 e = extents();
+		const glm::vec3 te(
+				std::abs(m[0][0])*e.x + std::abs(m[1][0])*e.y + std::abs(m[2][0])*e.z,
+				std::abs(m[0][1])*e.x + std::abs(m[1][1])*e.y + std::abs(m[2][1])*e.z,
+				std::abs(m[0][2])*e.x + std::abs(m[1][2])*e.y + std::abs(m[2][2])*e.z);
+		return BoundingBox(c - te, c + te);
+	}
+};
+
+struct BoundingSphere {
+	glm::vec3 center = glm::vec3(0.0f);
+	float radius = 0.0f;
+
+	BoundingSphere() = default;
+	BoundingSphere(const glm::vec3& c, float r) : center(c), radius(r) {}
+};
+
+namespace detail {
+
+template <class T>
+inline glm::vec3 boundsPosition(const T& p) {
+	return glm::vec3(p.x, p.y, p.z);
+}
+
+}
+
+/*
+ * Bounds of the positions of an array of vertices. The position is taken to
+ * be the first element of the vertex and must be a vec3 or vec4.
+ */
+template <class Vertex>
+BoundingBox computeBoundingBox(const Vertex* verts, size_t numVerts) {
+	BoundingBox ret;
+	for(size_t i = 0; i < numVerts; i++) {
+		ret.grow(detail::boundsPosition(verts[i].template get<0>()));
+	}
+	return ret;
+}
+
+/*
+ * A sphere centered on the bounding box of the vertices. Not the tightest
+ * sphere, but never larger than the box's circumsphere.
+ */
+template <class Vertex>
+BoundingSphere computeBoundingSphere(const Vertex* verts, size_t numVerts, const BoundingBox& box) {
+	const glm::vec3 center = box.center();
+	float radius2 = 0.0f;
+	for(size_t i = 0; i < numVerts; i++) {
+		const glm::vec3 d = detail::boundsPosition(verts[i].template get<0>()) - center;
+		radius2 = std::max(radius2, glm::dot(d, d));
+	}
+	return BoundingSphere(center, std::sqrt(radius2));
+}
+
+namespace detail {
+
+/*
+ * Computes vertex bounds when the first element of the vertex is a vec3 or
+ * vec4 position. compute() returns false for any other vertex layout.
+ */
+template <class Vertex, class Position =
+		typename std::decay<decltype(std::declval<const Vertex&>().template get<0>())>::type>
+struct VertexBounds {
+	static bool compute(const Vertex*, size_t, BoundingBox&, BoundingSphere&) {
+		return false;
+	}
+};
+
+template <class Vertex>
+struct VertexBounds<Vertex, glm::vec3> {
+	static bool compute(const Vertex* verts, size_t numVerts, BoundingBox& box, BoundingSphere& sphere) {
+		box = computeBoundingBox(verts, numVerts);
+		sphere = computeBoundingSphere(verts, numVerts, box);
+		return !box.empty();
+	}
+};
+
+template <class Vertex>
+struct VertexBounds<Vertex, glm::vec4> : VertexBounds<Vertex, glm::vec3> {};
+
+}
+
+}
+
+#endif /* GFX_UTILS_BOUNDS_H_ */
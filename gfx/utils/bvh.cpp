@@ -0,0 +1,472 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+
+#include <boost/assert.hpp>
+
+namespace gfx {
+
+const uint32_t Bvh::INVALID_INDEX;
+const uint32_t Bvh::NUM_BINS;
+const uint32_t Bvh::MIN_LEAF_SIZE;
+const uint32_t Bvh::MAX_LEAF_SIZE;
+
+namespace {
+
+// Cost of visiting an inner node relative to testing one object
+const float TRAVERSAL_COST = 1.0f;
+
+// Below this many objects a subtree is not worth handing to another thread
+const uint32_t MIN_PARALLEL_BUILD_SIZE = 4096;
+
+enum FrustumTest { OUTSIDE, INTERSECTING, INSIDE };
+
+FrustumTest classify(const Frustum& frustum, const BoundingBox& b) {
+	const glm::vec3 c = b.center();
+	const glm::vec3 e = b.extents();
+	FrustumTest ret = INSIDE;
+	for(const glm::vec4& p : frustum.planes) {
+		const float d = p.x*c.x + p.y*c.y + p.z*c.z + p.w;
+		const float r = std::abs(p.x)*e.x + std::abs(p.y)*e.y + std::abs(p.z)*e.z;
+		if(d + r < 0.0f) {
+			return OUTSIDE;
+		}
+		if(d - r < 0.0f) {
+			ret = INTERSECTING;
+		}
+	}
+	return ret;
+}
+
+}
+
+BoundingBox Bvh::buildBounds(uint32_t begin, uint32_t end, BoundingBox& centroidBounds) const {
+	BoundingBox ret;
+	centroidBounds = BoundingBox();
+	for(uint32_t i = begin; i < end; i++) {
+		ret.grow(m_buildItems[i].box);
+		centroidBounds.grow(m_buildItems[i].centroid);
+	}
+	return ret;
+}
+
+BoundingBox Bvh::rangeBounds(uint32_t begin, uint32_t end) const {
+	BoundingBox ret;
+	for(uint32_t i = begin; i < end; i++) {
+		ret.grow(m_objectBounds[m_objectOrder[i]]);
+	}
+	return ret;
+}
+
+bool Bvh::split(uint32_t begin, uint32_t end, const BoundingBox& box, const BoundingBox& centroidBox, uint32_t& mid) {
+	const uint32_t count = end - begin;
+	if(count <= MIN_LEAF_SIZE) {
+		return false;
+	}
+
+	// Small nodes have few split candidates and don't need as many bins
+	const uint32_t numBins = std::min<uint32_t>(NUM_BINS, count);
+
+	glm::vec3 scale;
+	for(int axis = 0; axis < 3; axis++) {
+		const float extent = centroidBox.max[axis] - centroidBox.min[axis];
+		scale[axis] = extent > 0.0f ? numBins / extent : 0.0f;
+	}
+	auto binIndex = [&](const BuildItem& item, int axis) {
+		return std::min(numBins - 1, uint32_t((item.centroid[axis] - centroidBox.min[axis]) * scale[axis]));
+	};
+
+	// Bin along all three axes in one pass over the objects
+	BoundingBox binBoxes[3][NUM_BINS];
+	uint32_t binCounts[3][NUM_BINS] = {};
+	for(uint32_t i = begin; i < end; i++) {
+		const BuildItem& item = m_buildItems[i];
+		for(int axis = 0; axis < 3; axis++) {
+			const uint32_t bin = binIndex(item, axis);
+			binCounts[axis][bin] += 1;
+			binBoxes[axis][bin].grow(item.box);
+		}
+	}
+
+	float bestCost = std::numeric_limits<float>::max();
+	int bestAxis = -1;
+	uint32_t bestBin = 0;
+
+	for(int axis = 0; axis < 3; axis++) {
+		if(scale[axis] == 0.0f) {
+			continue;
+		}
+
+		// Sweep from the left, then from the right evaluating the cost of
+		// splitting before each bin
+		float leftArea[NUM_BINS - 1];
+		uint32_t leftCount[NUM_BINS - 1];
+		BoundingBox acc;
+		uint32_t n = 0;
+		for(uint32_t b = 0; b < numBins - 1; b++) {
+			acc.grow(binBoxes[axis][b]);
+			n += binCounts[axis][b];
+			leftArea[b] = acc.surfaceArea();
+			leftCount[b] = n;
+		}
+
+		acc = BoundingBox();
+		n = 0;
+		for(uint32_t b = numBins - 1; b > 0; b--) {
+			acc.grow(binBoxes[axis][b]);
+			n += binCounts[axis][b];
+			if(leftCount[b - 1] == 0 || n == 0) {
+				continue;
+			}
+			const float cost = leftCount[b - 1] * leftArea[b - 1] + n * acc.surfaceArea();
+			if(cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = b;
+			}
+		}
+	}
+
+	if(bestAxis < 0) {
+		// All centroids coincide, so binning can't separate anything
+		if(count <= MAX_LEAF_SIZE) {
+			return false;
+		}
+		mid = begin + count / 2;
+		return true;
+	}
+
+	const float area = box.surfaceArea();
+	if(count <= MAX_LEAF_SIZE && TRAVERSAL_COST * area + bestCost >= count * area) {
+		return false;
+	}
+
+	BuildItem* first = m_buildItems.data() + begin;
+	BuildItem* last = m_buildItems.data() + end;
+	mid = begin + static_cast<uint32_t>(std::partition(first, last, [&](const BuildItem& item) {
+		return binIndex(item, bestAxis) < bestBin;
+	}) - first);
+	return true;
+}
+
+void Bvh::buildSubtree(std::vector<Node>& nodes, uint32_t node, uint32_t begin, uint32_t end) {
+	std::vector<BuildTask> stack;
+	stack.push_back({ node, begin, end });
+
+	while(!stack.empty()) {
+		const BuildTask task = stack.back();
+		stack.pop_back();
+
+		BoundingBox centroidBox;
+		const BoundingBox box = buildBounds(task.begin, task.end, centroidBox);
+		nodes[task.node].box = box;
+
+		uint32_t mid;
+		if(!split(task.begin, task.end, box, centroidBox, mid)) {
+			nodes[task.node].first = task.begin;
+			nodes[task.node].count = task.end - task.begin;
+			continue;
+		}
+
+		const uint32_t left = static_cast<uint32_t>(nodes.size());
+		nodes.resize(left + 2);
+		nodes[task.node].first = left;
+		nodes[task.node].count = 0;
+		stack.push_back({ left, task.begin, mid });
+		stack.push_back({ left + 1, mid, task.end });
+	}
+}
+
+void Bvh::build(const std::vector<BoundingBox>& objectBounds, ThreadPool* pool) {
+	const uint32_t n = static_cast<uint32_t>(objectBounds.size());
+
+	m_objectBounds = objectBounds;
+	m_objectOrder.resize(n);
+	m_objectLeaves.assign(n, INVALID_INDEX);
+
+	// Objects are sorted into leaf order along with copies of their bounds,
+	// so the build streams through memory instead of gathering by index
+	m_buildItems.resize(n);
+	for(uint32_t i = 0; i < n; i++) {
+		m_buildItems[i].box = m_objectBounds[i];
+		m_buildItems[i].centroid = m_objectBounds[i].center();
+		m_buildItems[i].object = i;
+	}
+
+	m_nodes.clear();
+	m_dirtyNodes.clear();
+	m_numRefitNodes = 0;
+	if(n == 0) {
+		m_parents.clear();
+		m_dirty.clear();
+		return;
+	}
+
+	m_nodes.reserve(2 * (n / MAX_LEAF_SIZE + 1));
+	m_nodes.push_back(Node());
+
+	// Split the top of the tree breadth first until there are enough
+	// subtrees to keep every thread busy
+	std::vector<BuildTask> tasks;
+	std::vector<BuildTask> frontier;
+	frontier.push_back({ 0, 0, n });
+	const size_t targetTasks = pool ? 4 * pool->numThreads() : 1;
+	while(!frontier.empty() && pool && pool->numThreads() > 1 && frontier.size() + tasks.size() < targetTasks) {
+		std::vector<BuildTask> next;
+		for(const BuildTask& task : frontier) {
+			if(task.end - task.begin < MIN_PARALLEL_BUILD_SIZE) {
+				tasks.push_back(task);
+				continue;
+			}
+
+			BoundingBox centroidBox;
+			const BoundingBox box = buildBounds(task.begin, task.end, centroidBox);
+			m_nodes[task.node].box = box;
+
+			uint32_t mid;
+			if(!split(task.begin, task.end, box, centroidBox, mid)) {
+				m_nodes[task.node].first = task.begin;
+				m_nodes[task.node].count = task.end - task.begin;
+				continue;
+			}
+
+			const uint32_t left = static_cast<uint32_t>(m_nodes.size());
+			m_nodes.resize(left + 2);
+			m_nodes[task.node].first = left;
+			m_nodes[task.node].count = 0;
+			next.push_back({ left, task.begin, mid });
+			next.push_back({ left + 1, mid, task.end });
+		}
+		frontier.swap(next);
+	}
+	tasks.insert(tasks.end(), frontier.begin(), frontier.end());
+
+	// Build every subtree into its own node array, rooted at index 0. Tasks
+	// cover disjoint ranges of m_objectOrder so they can run concurrently.
+	std::vector<std::vector<Node>> subtrees(tasks.size());
+	auto buildTask = [&](size_t t) {
+		subtrees[t].push_back(Node());
+		buildSubtree(subtrees[t], 0, tasks[t].begin, tasks[t].end);
+	};
+	if(pool) {
+		pool->parallelFor(tasks.size(), buildTask);
+	} else {
+		for(size_t t = 0; t < tasks.size(); t++) {
+			buildTask(t);
+		}
+	}
+
+	// Splice the subtrees in. A subtree's root replaces its task's node and
+	// the rest are appended, which keeps sibling nodes next to each other.
+	for(size_t t = 0; t < tasks.size(); t++) {
+		const std::vector<Node>& subtree = subtrees[t];
+		const uint32_t base = static_cast<uint32_t>(m_nodes.size());
+		auto relocate = [&](Node node) {
+			if(node.count == 0) {
+				node.first = base + node.first - 1;
+			}
+			return node;
+		};
+
+		m_nodes[tasks[t].node] = relocate(subtree[0]);
+		for(size_t i = 1; i < subtree.size(); i++) {
+			m_nodes.push_back(relocate(subtree[i]));
+		}
+	}
+
+	for(uint32_t i = 0; i < n; i++) {
+		m_objectOrder[i] = m_buildItems[i].object;
+	}
+	m_buildItems.clear();
+	m_buildItems.shrink_to_fit();
+
+	m_parents.assign(m_nodes.size(), INVALID_INDEX);
+	for(uint32_t i = 0; i < m_nodes.size(); i++) {
+		const Node& node = m_nodes[i];
+		if(node.count == 0) {
+			m_parents[node.first] = i;
+			m_parents[node.first + 1] = i;
+		} else {
+			for(uint32_t j = node.first; j < node.first + node.count; j++) {
+				m_objectLeaves[m_objectOrder[j]] = i;
+			}
+		}
+	}
+	m_dirty.assign(m_nodes.size(), 0);
+}
+
+void Bvh::markDirty(uint32_t node) {
+	while(node != INVALID_INDEX && !m_dirty[node]) {
+		m_dirty[node] = 1;
+		m_dirtyNodes.push_back(node);
+		node = m_parents[node];
+	}
+}
+
+void Bvh::update(uint32_t object, const BoundingBox& box) {
+	BOOST_ASSERT_MSG(object < m_objectBounds.size(), "Error: Bvh object index out of range");
+	m_objectBounds[object] = box;
+	markDirty(m_objectLeaves[object]);
+}
+
+void Bvh::refit() {
+	// Children always come after their parent, so refitting in decreasing
+	// index order updates both children before the parent
+	std::sort(m_dirtyNodes.begin(), m_dirtyNodes.end(), std::greater<uint32_t>());
+
+	for(uint32_t i : m_dirtyNodes) {
+		Node& node = m_nodes[i];
+		if(node.count == 0) {
+			node.box = m_nodes[node.first].box;
+			node.box.grow(m_nodes[node.first + 1].box);
+		} else {
+			node.box = rangeBounds(node.first, node.first + node.count);
+		}
+		m_dirty[i] = 0;
+	}
+
+	m_numRefitNodes = m_dirtyNodes.size();
+	m_dirtyNodes.clear();
+}
+
+void Bvh::queryFrustum(const Frustum& frustum, std::vector<uint32_t>& out) const {
+	if(m_nodes.empty()) {
+		return;
+	}
+
+	// Second member: the node is known to be inside the frustum
+	std::vector<std::pair<uint32_t, bool>> stack;
+	stack.push_back(std::make_pair(0u, false));
+
+	while(!stack.empty()) {
+		const uint32_t i = stack.back().first;
+		bool inside = stack.back().second;
+		stack.pop_back();
+
+		const Node& node = m_nodes[i];
+		if(!inside) {
+			const FrustumTest test = classify(frustum, node.box);
+			if(test == OUTSIDE) {
+				continue;
+			}
+			inside = test == INSIDE;
+		}
+
+		if(node.count == 0) {
+			stack.push_back(std::make_pair(node.first + 1, inside));
+			stack.push_back(std::make_pair(node.first, inside));
+			continue;
+		}
+
+		for(uint32_t j = node.first; j < node.first + node.count; j++) {
+			const uint32_t obj = m_objectOrder[j];
+			if(inside || frustum.intersects(m_objectBounds[obj])) {
+				out.push_back(obj);
+			}
+		}
+	}
+}
+
+void Bvh::queryBox(const BoundingBox& box, std::vector<uint32_t>& out) const {
+	if(m_nodes.empty()) {
+		return;
+	}
+
+	std::vector<uint32_t> stack(1, 0);
+	while(!stack.empty()) {
+		const Node& node = m_nodes[stack.back()];
+		stack.pop_back();
+
+		if(!node.box.overlaps(box)) {
+			continue;
+		}
+
+		if(node.count == 0) {
+			stack.push_back(node.first + 1);
+			stack.push_back(node.first);
+			continue;
+		}
+
+		for(uint32_t j = node.first; j < node.first + node.count; j++) {
+			const uint32_t obj = m_objectOrder[j];
+			if(m_objectBounds[obj].overlaps(box)) {
+				out.push_back(obj);
+			}
+		}
+	}
+}
+
+void Bvh::querySphere(const glm::vec3& center, float radius, std::vector<uint32_t>& out) const {
+	if(m_nodes.empty()) {
+		return;
+	}
+
+	const float radius2 = radius * radius;
+	std::vector<uint32_t> stack(1, 0);
+	while(!stack.empty()) {
+		const Node& node = m_nodes[stack.back()];
+		stack.pop_back();
+
+		if(node.box.distanceSquared(center) > radius2) {
+			continue;
+		}
+
+		if(node.count == 0) {
+			stack.push_back(node.first + 1);
+			stack.push_back(node.first);
+			continue;
+		}
+
+		for(uint32_t j = node.first; j < node.first + node.count; j++) {
+			const uint32_t obj = m_objectOrder[j];
+			if(m_objectBounds[obj].distanceSquared(center) <= radius2) {
+				out.push_back(obj);
+			}
+		}
+	}
+}
+
+uint32_t Bvh::nearest(const glm::vec3& point, float* distance) const {
+	uint32_t best = INVALID_INDEX;
+	float bestDist2 = std::numeric_limits<float>::max();
+
+	// Visit nodes closest first and stop once the closest remaining node is
+	// further away than the best object found
+	typedef std::pair<float, uint32_t> Entry;
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+	if(!m_nodes.empty()) {
+		queue.push(Entry(m_nodes[0].box.distanceSquared(point), 0));
+	}
+
+	while(!queue.empty() && queue.top().first < bestDist2) {
+		const Node& node = m_nodes[queue.top().second];
+		queue.pop();
+
+		if(node.count == 0) {
+			queue.push(Entry(m_nodes[node.first].box.distanceSquared(point), node.first));
+			queue.push(Entry(m_nodes[node.first + 1].box.distanceSquared(point), node.first + 1));
+			continue;
+		}
+
+		for(uint32_t j = node.first; j < node.first + node.count; j++) {
+			const uint32_t obj = m_objectOrder[j];
+			const float dist2 = m_objectBounds[obj].distanceSquared(point);
+			if(dist2 < bestDist2) {
+				bestDist2 = dist2;
+				best = obj;
+			}
+		}
+	}
+
+	if(distance != nullptr) {
+		*distance = best == INVALID_INDEX ? std::numeric_limits<float>::max() : std::sqrt(bestDist2);
+	}
+	return best;
+}
+
+}
@@ -0,0 +1,153 @@
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "frustum.h"
+#include "thread_pool.h"
+
+#ifndef GFX_UTILS_BVH_H_
+#define GFX_UTILS_BVH_H_
+
+namespace gfx {
+
+/*
+ * Bounding volume hierarchy over the world space bounding boxes of a set of
+ * scene objects, for hierarchical frustum culling and spatial queries.
+ * Objects are identified by their index in the array given to build().
+ *
+ * The tree is built top down with a binned surface area heuristic. When a
+ * few objects move per frame, update() their bounds and refit() instead of
+ * rebuilding: refitting only touches the nodes above the moved objects, but
+ * the tree gets worse the further objects move from where they were built,
+ * so rebuild every now and then.
+ */
+class Bvh {
+	struct Node {
+		BoundingBox box;
+
+		// Leaves: first object in m_objectOrder. Inner nodes: left child, the
+		// right child always follows it.
+		uint32_t first = 0;
+
+		// Number of objects, 0 for inner nodes
+		uint32_t count = 0;
+	};
+
+	struct BuildTask {
+		uint32_t node;
+		uint32_t begin, end;
+	};
+
+	struct BuildItem {
+		BoundingBox box;
+		glm::vec3 centroid;
+		uint32_t object;
+	};
+
+	static const uint32_t NUM_BINS = 16;
+	static const uint32_t MIN_LEAF_SIZE = 2;
+	static const uint32_t MAX_LEAF_SIZE = 8;
+
+	std::vector<Node> m_nodes;
+	std::vector<uint32_t> m_parents;
+
+	std::vector<BoundingBox> m_objectBounds;
+	std::vector<uint32_t> m_objectOrder;
+	std::vector<uint32_t> m_objectLeaves;
+
+	std::vector<uint8_t> m_dirty;
+	std::vector<uint32_t> m_dirtyNodes;
+
+	// Only used during build()
+	std::vector<BuildItem> m_buildItems;
+
+	size_t m_numRefitNodes = 0;
+
+	BoundingBox rangeBounds(uint32_t begin, uint32_t end) const;
+	BoundingBox buildBounds(uint32_t begin, uint32_t end, BoundingBox& centroidBounds) const;
+
+	/*
+	 * Splits the objects of a node in two. Returns false if the node should
+	 * stay a leaf, otherwise the objects are partitioned at mid.
+	 */
+	bool split(uint32_t begin, uint32_t end, const BoundingBox& box, const BoundingBox& centroidBox, uint32_t& mid);
+
+	void buildSubtree(std::vector<Node>& nodes, uint32_t node, uint32_t begin, uint32_t end);
+
+	void markDirty(uint32_t node);
+
+public:
+	static const uint32_t INVALID_INDEX = ~0u;
+
+	/*
+	 * Builds the tree over a new set of objects. With a pool, the top of the
+	 * tree is split up serially and the subtrees below it built in parallel.
+	 */
+	void build(const std::vector<BoundingBox>& objectBounds, ThreadPool* pool = nullptr);
+
+	size_t numObjects() const {
+		return m_objectBounds.size();
+	}
+
+	size_t numNodes() const {
+		return m_nodes.size();
+	}
+
+	/*
+	 * Bounds of the whole scene
+	 */
+	BoundingBox bounds() const {
+		return m_nodes.empty() ? BoundingBox() : m_nodes[0].box;
+	}
+
+	const BoundingBox& objectBounds(uint32_t object) const {
+		return m_objectBounds[object];
+	}
+
+	/*
+	 * Changes the bounds of an object. Queries see the change after refit().
+	 */
+	void update(uint32_t object, const BoundingBox& box);
+
+	/*
+	 * Recomputes the bounds of the nodes above objects updated since the last
+	 * refit
+	 */
+	void refit();
+
+	/*
+	 * Number of nodes recomputed by the last refit()
+	 */
+	size_t numRefitNodes() const {
+		return m_numRefitNodes;
+	}
+
+	/*
+	 * Appends the objects whose bounds intersect the frustum to out. Objects
+	 * in subtrees entirely inside the frustum are appended without testing.
+	 */
+	void queryFrustum(const Frustum& frustum, std::vector<uint32_t>& out) const;
+
+	/*
+	 * Appends the objects whose bounds overlap box to out
+	 */
+	void queryBox(const BoundingBox& box, std::vector<uint32_t>& out) const;
+
+	/*
+	 * Appends the objects whose bounds are within radius of center to out
+	 */
+	void querySphere(const glm::vec3& center, float radius, std::vector<uint32_t>& out) const;
+
+	/*
+	 * The object whose bounds are nearest to point, e.g. the camera position,
+	 * and optionally the distance to them. INVALID_INDEX if the tree is empty.
+	 */
+	uint32_t nearest(const glm::vec3& point, float* distance = nullptr) const;
+};
+
+}
+
+#endif /* GFX_UTILS_BVH_H_ */
@@ -80,6 +80,10 @@ mat4 Camera::getProjectionMatrix() const {
   return proj_mat;
 }
 
+Frustum Camera::getFrustum() const {
+  return Frustum::fromMatrix(getProjectionMatrix() * getViewMatrix());
+}
+
 vec3 Camera::getLookatVector() const {
   return orientation * lookat;
 }
@@ -1,6 +1,8 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include "frustum.h"
+
 #ifndef CAMERA_H_
 #define CAMERA_H_
 
@@ -33,6 +35,7 @@ public:
 
   glm::mat4 getViewMatrix() const;
   glm::mat4 getProjectionMatrix() const;
+  Frustum getFrustum() const;
   glm::vec3 getLookatVector() const;
   glm::vec3 getUpVector() const;
   glm::vec3 getRightVector() const;
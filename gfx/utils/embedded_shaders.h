@@ -0,0 +1,43 @@
+#include <cstddef>
+#include <cstdint>
+
+#ifndef EMBEDDED_SHADERS_H_
+#define EMBEDDED_SHADERS_H_
+
+namespace utils {
+
+/*
+ * A shader preprocessed at build time by tools/embed_shaders, with its
+ * includes expanded, as ShaderPreprocessor::preprocessFile() would return
+ * it without defines
+ */
+struct EmbeddedShader {
+	// Relative to the source root, e.g. "gfx/shaders/phong_vertex.glsl"
+	const char* path;
+
+	const char* source;
+	size_t length;
+
+	// 64 bit FNV-1a hash of source
+	uint64_t hash;
+
+	// The shader and every file it includes, each followed by a newline
+	const char* files;
+};
+
+/*
+ * The shaders compiled into the gfx library, generated by the build.
+ * Followed by an entry with a null path.
+ */
+extern const EmbeddedShader EMBEDDED_SHADERS[];
+extern const size_t NUM_EMBEDDED_SHADERS;
+
+/*
+ * The include directories the shaders were preprocessed with, each
+ * followed by a newline
+ */
+extern const char* const EMBEDDED_SHADER_INCLUDE_DIRS;
+
+}
+
+#endif /* EMBEDDED_SHADERS_H_ */
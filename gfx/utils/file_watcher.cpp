@@ -0,0 +1,122 @@
+#include "file_watcher.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace utils {
+
+namespace {
+
+const uint32_t WATCH_EVENTS = IN_CLOSE_WRITE | IN_MOVED_TO;
+
+}
+
+FileWatcher::FileWatcher() {
+	m_inotifyFd = inotify_init1(IN_CLOEXEC);
+	if(m_inotifyFd == -1) {
+		fprintf(stderr, "Error initializing inotify: %s\n", strerror(errno));
+		return;
+	}
+	if(pipe2(m_wakeFds, O_CLOEXEC) != 0) {
+		fprintf(stderr, "Error creating file watcher pipe: %s\n", strerror(errno));
+		close(m_inotifyFd);
+		m_inotifyFd = -1;
+		return;
+	}
+	m_thread = std::thread(&FileWatcher::run, this);
+}
+
+FileWatcher::~FileWatcher() {
+	if(m_thread.joinable()) {
+		const char stop = 0;
+		while(write(m_wakeFds[1], &stop, 1) == -1 && errno == EINTR) {
+		}
+		m_thread.join();
+	}
+	for(int fd : { m_inotifyFd, m_wakeFds[0], m_wakeFds[1] }) {
+		if(fd != -1) {
+			close(fd);
+		}
+	}
+}
+
+void FileWatcher::watch(const std::string& path) {
+	if(!isSupported()) {
+		return;
+	}
+
+	const size_t slash = path.find_last_of('/');
+	const std::string dir = slash == std::string::npos ? std::string() : path.substr(0, slash);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if(!m_files.insert(path).second) {
+		return;
+	}
+
+	// The same directory gives back the same descriptor however it's spelled
+	const int wd = inotify_add_watch(m_inotifyFd, dir.empty() ? "." : dir.c_str(), WATCH_EVENTS);
+	if(wd == -1) {
+		fprintf(stderr, "Error watching %s: %s\n", path.c_str(), strerror(errno));
+		return;
+	}
+	std::vector<std::string>& spellings = m_dirs[wd];
+	if(std::find(spellings.begin(), spellings.end(), dir) == spellings.end()) {
+		spellings.push_back(dir);
+	}
+}
+
+std::vector<std::string> FileWatcher::takeChanged() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::vector<std::string> ret(m_changed.begin(), m_changed.end());
+	m_changed.clear();
+	return ret;
+}
+
+void FileWatcher::run() {
+	alignas(inotify_event) char buf[4096];
+
+	pollfd fds[2] = { { m_inotifyFd, POLLIN, 0 }, { m_wakeFds[0], POLLIN, 0 } };
+	for(;;) {
+		if(poll(fds, 2, -1) == -1) {
+			if(errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "Error waiting for file changes: %s\n", strerror(errno));
+			return;
+		}
+		if(fds[1].revents != 0) {
+			return;
+		}
+
+		const ssize_t length = read(m_inotifyFd, buf, sizeof(buf));
+		if(length <= 0) {
+			continue;
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for(ssize_t i = 0; i < length; ) {
+			const inotify_event* event = reinterpret_cast<const inotify_event*>(buf + i);
+			i += sizeof(inotify_event) + event->len;
+
+			const auto dirs = m_dirs.find(event->wd);
+			if(event->len == 0 || dirs == m_dirs.end()) {
+				continue;
+			}
+			for(const std::string& dir : dirs->second) {
+				const std::string path = dir.empty() ? std::string(event->name) : dir + "/" + event->name;
+				if(m_files.count(path) != 0) {
+					m_changed.insert(path);
+				}
+			}
+		}
+	}
+}
+
+}
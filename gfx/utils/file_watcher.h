@@ -0,0 +1,62 @@
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#ifndef FILE_WATCHER_H_
+#define FILE_WATCHER_H_
+
+namespace utils {
+
+/*
+ * Watches files for changes with inotify on a background thread. The
+ * directories holding the files are watched rather than the files
+ * themselves, so editors which save by writing a new file and renaming it
+ * over the old one are seen too. Paths are reported spelled the way they
+ * were passed to watch().
+ */
+class FileWatcher {
+	int m_inotifyFd = -1;
+
+	// Written to by the destructor to wake the thread up
+	int m_wakeFds[2] = { -1, -1 };
+
+	std::thread m_thread;
+
+	std::mutex m_mutex;
+
+	// Every spelling of each watched directory, by watch descriptor
+	std::unordered_map<int, std::vector<std::string>> m_dirs;
+	std::unordered_set<std::string> m_files;
+	std::unordered_set<std::string> m_changed;
+
+	void run();
+
+public:
+	FileWatcher();
+
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	~FileWatcher();
+
+	/*
+	 * False if inotify couldn't be set up, nothing is ever reported then
+	 */
+	bool isSupported() const {
+		return m_inotifyFd != -1;
+	}
+
+	void watch(const std::string& path);
+
+	/*
+	 * Files written since the last call, each once
+	 */
+	std::vector<std::string> takeChanged();
+};
+
+}
+
+#endif /* FILE_WATCHER_H_ */
@@ -0,0 +1,77 @@
+#include <array>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+
+#ifndef GFX_UTILS_FRUSTUM_H_
+#define GFX_UTILS_FRUSTUM_H_
+
+namespace gfx {
+
+/*
+ * The six planes of a view frustum, pointing inwards. A plane (n, d) keeps
+ * the points p with dot(n, p) + d >= 0. Normals are unit length, so plane
+ * distances are in world units.
+ */
+struct Frustum {
+	enum { LEFT, RIGHT, BOTTOM, TOP, NEAR, FAR, NUM_PLANES };
+
+	std::array<glm::vec4, NUM_PLANES> planes;
+
+	/*
+	 * Extracts the planes from a GL style (clip z in [-w, w]) view projection
+	 * matrix, e.g. camera.getProjectionMatrix() * camera.getViewMatrix().
+	 * Planes come out in the space the matrix transforms from.
+	 */
+	static Frustum fromMatrix(const glm::mat4& m) {
+		const glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+		const glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+		const glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+		const glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+		Frustum ret;
+		ret.planes[LEFT] = row3 + row0;
+		ret.planes[RIGHT] = row3 - row0;
+		ret.planes[BOTTOM] = row3 + row1;
+		ret.planes[TOP] = row3 - row1;
+		ret.planes[NEAR] = row3 + row2;
+		ret.planes[FAR] = row3 - row2;
+
+		for(glm::vec4& p : ret.planes) {
+			p /= glm::length(glm::vec3(p.x, p.y, p.z));
+		}
+		return ret;
+	}
+
+	bool intersects(const BoundingSphere& s) const {
+		for(const glm::vec4& p : planes) {
+			if(glm::dot(glm::vec3(p.x, p.y, p.z), s.center) + p.w < -s.radius) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/*
+	 * Conservative: boxes near a corner of the frustum may pass without
+	 * touching it
+	 */
+	bool intersects(const BoundingBox& b) const {
+		const glm::vec3 c = b.center();
+		const glm::vec3 e = b.extents();
+		for(const glm::vec4& p : planes) {
+			const float d = p.x*c.x + p.y*c.y + p.z*c.z + p.w;
+			const float r = std::abs(p.x)*e.x + std::abs(p.y)*e.y + std::abs(p.z)*e.z;
+			if(d + r < 0.0f) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+}
+
+#endif /* GFX_UTILS_FRUSTUM_H_ */
@@ -0,0 +1,197 @@
+#include "frustum_culler.h"
+
+#include <cmath>
+#include <limits>
+
+#include <boost/assert.hpp>
+
+#ifdef GFX_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace gfx {
+
+void FrustumCuller::resizeStorage(size_t n) {
+	m_size = n;
+	const size_t padded = ((n + PADDING - 1) / PADDING) * PADDING;
+
+	// Padding boxes are centered on NaN, which fails every plane comparison
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	m_centerX.resize(padded, nan);
+	m_centerY.resize(padded, nan);
+	m_centerZ.resize(padded, nan);
+	m_extentX.resize(padded, 0.0f);
+	m_extentY.resize(padded, 0.0f);
+	m_extentZ.resize(padded, 0.0f);
+}
+
+void FrustumCuller::reserve(size_t n) {
+	const size_t padded = ((n + PADDING - 1) / PADDING) * PADDING;
+	for(std::vector<float>* v : { &m_centerX, &m_centerY, &m_centerZ, &m_extentX, &m_extentY, &m_extentZ }) {
+		v->reserve(padded);
+	}
+}
+
+uint32_t FrustumCuller::add(const BoundingBox& box) {
+	const uint32_t index = static_cast<uint32_t>(m_size);
+	resizeStorage(m_size + 1);
+	set(index, box);
+	return index;
+}
+
+void FrustumCuller::set(uint32_t index, const BoundingBox& box) {
+	BOOST_ASSERT_MSG(index < m_size, "Error: FrustumCuller index out of range");
+	const glm::vec3 c = box.center();
+	const glm::vec3 e = box.extents();
+	m_centerX[index] = c.x;
+	m_centerY[index] = c.y;
+	m_centerZ[index] = c.z;
+	m_extentX[index] = e.x;
+	m_extentY[index] = e.y;
+	m_extentZ[index] = e.z;
+}
+
+size_t FrustumCuller::cull(const Frustum& frustum, std::vector<uint32_t>& visible, SimdLevel level) const {
+	BOOST_ASSERT_MSG(isSupported(level), "Error: SIMD level not supported on this CPU");
+
+	visible.resize(m_size);
+	size_t numVisible = 0;
+	switch(level) {
+	case SimdLevel::SCALAR:
+		numVisible = cullScalar(frustum, visible.data());
+		break;
+	case SimdLevel::SSE:
+		numVisible = cullSSE(frustum, visible.data());
+		break;
+	case SimdLevel::AVX:
+		numVisible = cullAVX(frustum, visible.data());
+		break;
+	}
+	visible.resize(numVisible);
+	return numVisible;
+}
+
+size_t FrustumCuller::cullScalar(const Frustum& frustum, uint32_t* visible) const {
+	size_t numVisible = 0;
+	for(size_t i = 0; i < m_size; i++) {
+		bool inside = true;
+		for(const glm::vec4& p : frustum.planes) {
+			const float d = p.x*m_centerX[i] + p.y*m_centerY[i] + p.z*m_centerZ[i] + p.w;
+			const float r = std::abs(p.x)*m_extentX[i] + std::abs(p.y)*m_extentY[i] + std::abs(p.z)*m_extentZ[i];
+			if(d + r < 0.0f) {
+				inside = false;
+				break;
+			}
+		}
+		visible[numVisible] = static_cast<uint32_t>(i);
+		numVisible += inside;
+	}
+	return numVisible;
+}
+
+#ifdef GFX_SIMD_X86
+
+/*
+ * Both SIMD paths compute d + r for every plane and AND the d + r >= 0 masks
+ * together, then append the indices of the set lanes. Padding lanes never
+ * pass, so nothing is written past the m_size entries visible has room for.
+ */
+
+__attribute__((target("sse2")))
+size_t FrustumCuller::cullSSE(const Frustum& frustum, uint32_t* visible) const {
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 px[Frustum::NUM_PLANES], py[Frustum::NUM_PLANES], pz[Frustum::NUM_PLANES], pw[Frustum::NUM_PLANES];
+	__m128 ax[Frustum::NUM_PLANES], ay[Frustum::NUM_PLANES], az[Frustum::NUM_PLANES];
+	for(size_t p = 0; p < Frustum::NUM_PLANES; p++) {
+		px[p] = _mm_set1_ps(frustum.planes[p].x);
+		py[p] = _mm_set1_ps(frustum.planes[p].y);
+		pz[p] = _mm_set1_ps(frustum.planes[p].z);
+		pw[p] = _mm_set1_ps(frustum.planes[p].w);
+		ax[p] = _mm_and_ps(px[p], absMask);
+		ay[p] = _mm_and_ps(py[p], absMask);
+		az[p] = _mm_and_ps(pz[p], absMask);
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+	size_t numVisible = 0;
+	for(size_t i = 0; i < m_size; i += 4) {
+		const __m128 cx = _mm_loadu_ps(&m_centerX[i]);
+		const __m128 cy = _mm_loadu_ps(&m_centerY[i]);
+		const __m128 cz = _mm_loadu_ps(&m_centerZ[i]);
+		const __m128 ex = _mm_loadu_ps(&m_extentX[i]);
+		const __m128 ey = _mm_loadu_ps(&m_extentY[i]);
+		const __m128 ez = _mm_loadu_ps(&m_extentZ[i]);
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for(size_t p = 0; p < Frustum::NUM_PLANES; p++) {
+			__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px[p], cx), _mm_mul_ps(py[p], cy)),
+					_mm_add_ps(_mm_mul_ps(pz[p], cz), pw[p]));
+			__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[p], ex), _mm_mul_ps(ay[p], ey)), _mm_mul_ps(az[p], ez));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(d, r), zero));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		while(mask != 0) {
+			visible[numVisible++] = static_cast<uint32_t>(i + __builtin_ctz(mask));
+			mask &= mask - 1;
+		}
+	}
+	return numVisible;
+}
+
+__attribute__((target("avx")))
+size_t FrustumCuller::cullAVX(const Frustum& frustum, uint32_t* visible) const {
+	const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 px[Frustum::NUM_PLANES], py[Frustum::NUM_PLANES], pz[Frustum::NUM_PLANES], pw[Frustum::NUM_PLANES];
+	__m256 ax[Frustum::NUM_PLANES], ay[Frustum::NUM_PLANES], az[Frustum::NUM_PLANES];
+	for(size_t p = 0; p < Frustum::NUM_PLANES; p++) {
+		px[p] = _mm256_set1_ps(frustum.planes[p].x);
+		py[p] = _mm256_set1_ps(frustum.planes[p].y);
+		pz[p] = _mm256_set1_ps(frustum.planes[p].z);
+		pw[p] = _mm256_set1_ps(frustum.planes[p].w);
+		ax[p] = _mm256_and_ps(px[p], absMask);
+		ay[p] = _mm256_and_ps(py[p], absMask);
+		az[p] = _mm256_and_ps(pz[p], absMask);
+	}
+
+	const __m256 zero = _mm256_setzero_ps();
+	size_t numVisible = 0;
+	for(size_t i = 0; i < m_size; i += 8) {
+		const __m256 cx = _mm256_loadu_ps(&m_centerX[i]);
+		const __m256 cy = _mm256_loadu_ps(&m_centerY[i]);
+		const __m256 cz = _mm256_loadu_ps(&m_centerZ[i]);
+		const __m256 ex = _mm256_loadu_ps(&m_extentX[i]);
+		const __m256 ey = _mm256_loadu_ps(&m_extentY[i]);
+		const __m256 ez = _mm256_loadu_ps(&m_extentZ[i]);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for(size_t p = 0; p < Frustum::NUM_PLANES; p++) {
+			__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px[p], cx), _mm256_mul_ps(py[p], cy)),
+					_mm256_add_ps(_mm256_mul_ps(pz[p], cz), pw[p]));
+			__m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax[p], ex), _mm256_mul_ps(ay[p], ey)),
+					_mm256_mul_ps(az[p], ez));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(d, r), zero, _CMP_GE_OQ));
+		}
+
+		int mask = _mm256_movemask_ps(inside);
+		while(mask != 0) {
+			visible[numVisible++] = static_cast<uint32_t>(i + __builtin_ctz(mask));
+			mask &= mask - 1;
+		}
+	}
+	return numVisible;
+}
+
+#else
+
+size_t FrustumCuller::cullSSE(const Frustum& frustum, uint32_t* visible) const {
+	return cullScalar(frustum, visible);
+}
+
+size_t FrustumCuller::cullAVX(const Frustum& frustum, uint32_t* visible) const {
+	return cullScalar(frustum, visible);
+}
+
+#endif
+
+}
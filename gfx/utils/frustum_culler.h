@@ -0,0 +1,76 @@
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bounds.h"
+#include "frustum.h"
+#include "simd.h"
+
+#ifndef GFX_UTILS_FRUSTUM_CULLER_H_
+#define GFX_UTILS_FRUSTUM_CULLER_H_
+
+namespace gfx {
+
+/*
+ * Frustum culls large numbers of world space bounding boxes.
+ *
+ * Boxes are stored as separate arrays of center and extent components so
+ * the SIMD paths test 4 (SSE) or 8 (AVX) boxes per iteration against each
+ * plane. The AVX path is picked at run time when the CPU supports it, the
+ * scalar path is used on other architectures.
+ */
+class FrustumCuller {
+public:
+	typedef gfx::SimdLevel SimdLevel;
+
+private:
+	// Arrays are padded to a multiple of the widest SIMD width with boxes
+	// which are never visible, so the SIMD loops need no scalar tail
+	static const size_t PADDING = 8;
+
+	std::vector<float> m_centerX, m_centerY, m_centerZ;
+	std::vector<float> m_extentX, m_extentY, m_extentZ;
+	size_t m_size = 0;
+
+	void resizeStorage(size_t n);
+
+	size_t cullScalar(const Frustum& frustum, uint32_t* visible) const;
+	size_t cullSSE(const Frustum& frustum, uint32_t* visible) const;
+	size_t cullAVX(const Frustum& frustum, uint32_t* visible) const;
+
+public:
+	static SimdLevel bestSimdLevel() {
+		return gfx::bestSimdLevel();
+	}
+
+	static bool isSupported(SimdLevel level) {
+		return isSimdLevelSupported(level);
+	}
+
+	size_t size() const {
+		return m_size;
+	}
+
+	void clear() {
+		resizeStorage(0);
+	}
+
+	void reserve(size_t n);
+
+	/*
+	 * Adds a box and returns its index
+	 */
+	uint32_t add(const BoundingBox& box);
+
+	void set(uint32_t index, const BoundingBox& box);
+
+	/*
+	 * Writes the indices of the boxes intersecting the frustum to visible, in
+	 * increasing order, and returns how many there are
+	 */
+	size_t cull(const Frustum& frustum, std::vector<uint32_t>& visible, SimdLevel level = bestSimdLevel()) const;
+};
+
+}
+
+#endif /* GFX_UTILS_FRUSTUM_CULLER_H_ */
@@ -10,167 +10,338 @@
 #include <algorithm>
 #include <functional>
 #include <iterator>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 #include <iostream>
 
+#include "embedded_shaders.h"
+#include "program_binary_cache.h"
+#include "shader_preprocessor.h"
+
 #ifndef PROGRAM_BUILDER_H_
 #define PROGRAM_BUILDER_H_
 
 namespace utils {
 
-struct GLProgramBuilder {
-	GLuint buildComputeProgramFromString(const std::string& shader) {
-		GLuint program = glCreateProgram();
+/*
+ * The files a program is built from, kept to build it again when they change
+ */
+struct ProgramFiles {
+	std::vector<std::pair<GLenum, std::string>> stages;
+	ShaderDefines defines;
 
-		GLuint compute_shader = compile(GL_COMPUTE_SHADER, shader);
+	// The stage files and every file they include, filled in by
+	// GLProgramBuilder::beginFromFiles()
+	std::vector<std::string> dependencies;
+};
 
-		glAttachShader(program, compute_shader);
-		glLinkProgram(program);
+/*
+ * A program whose shaders have been submitted for compiling and linking
+ * but whose status hasn't been checked yet, see GLProgramBuilder::beginLink()
+ */
+struct PendingProgram {
+	GLuint program = 0;
+	std::vector<std::pair<GLenum, GLuint>> shaders;
+	uint64_t cacheKey = 0;
 
-		if (!logLinkStatus(program))
-			std::runtime_error("Failed to link shaders");
-		glDeleteShader(compute_shader);
+	// Loaded from the binary cache, already linked
+	bool cached = false;
 
-		return program;
+	// Set by GLProgramBuilder::finishLink() if a shader didn't compile or
+	// the program didn't link
+	bool failed = false;
+
+	// Empty for programs built from strings
+	ProgramFiles files;
+};
+
+struct GLProgramBuilder {
+	GLuint buildComputeProgramFromString(const std::string& shader,
+			const ShaderDefines& defines = ShaderDefines()) {
+		return link({ { GL_COMPUTE_SHADER, preprocess(shader, defines) } });
 	}
 
-	GLuint buildComputeProgramFromFile(const std::string& shader) {
-		GLuint program = glCreateProgram();
+	GLuint buildComputeProgramFromFile(const std::string& shader,
+			const ShaderDefines& defines = ShaderDefines()) {
+		return link({ { GL_COMPUTE_SHADER, readShader(GL_COMPUTE_SHADER, shader, defines) } });
+	}
 
-		GLuint compute_shader = compileFromFile(GL_COMPUTE_SHADER, shader);
+	GLuint buildFromFiles(const std::string& vert, const std::string& frag,
+			const ShaderDefines& defines = ShaderDefines()) {
+		return link({ { GL_VERTEX_SHADER, readShader(GL_VERTEX_SHADER, vert, defines) },
+				{ GL_FRAGMENT_SHADER, readShader(GL_FRAGMENT_SHADER, frag, defines) } });
+	}
 
-		glAttachShader(program, compute_shader);
-		glLinkProgram(program);
+	GLuint buildFromStrings(const std::string& vert, const std::string& frag,
+			const ShaderDefines& defines = ShaderDefines()) {
+		return link({ { GL_VERTEX_SHADER, preprocess(vert, defines) },
+				{ GL_FRAGMENT_SHADER, preprocess(frag, defines) } });
+	}
+
+	PendingProgram beginFromFiles(const std::string& vert, const std::string& frag,
+			const ShaderDefines& defines = ShaderDefines()) {
+		ProgramFiles files;
+		files.stages = { { GL_VERTEX_SHADER, vert }, { GL_FRAGMENT_SHADER, frag } };
+		files.defines = defines;
+		return beginFromFiles(files);
+	}
+
+	/*
+	 * Begins a program from the stage files in files, recording the files
+	 * it depends on in the returned program
+	 */
+	PendingProgram beginFromFiles(const ProgramFiles& files) {
+		ProgramFiles recorded;
+		recorded.stages = files.stages;
+		recorded.defines = files.defines;
+
+		ProgramBinaryCache::Sources sources;
+		ProgramBinaryCache::SourceHashes hashes;
+		const std::string defines = ShaderPreprocessor::defineDirectives(files.defines);
+		for(const auto& stage : files.stages) {
+			if(const EmbeddedShader* embedded = findEmbedded(stage.second)) {
+				sources.emplace_back(stage.first, embeddedSource(*embedded, defines));
+				hashes.emplace_back(stage.first, ProgramBinaryCache::hash(defines.data(), defines.size(), embedded->hash));
+				std::istringstream dependencies(embedded->files);
+				for(std::string file; std::getline(dependencies, file);) {
+					addDependency(recorded, std::move(file));
+				}
+				continue;
+			}
+
+			fprintf(stdout, "Reading %s: %s\n", shaderTypeAsString(stage.first).c_str(), stage.second.c_str());
+			PreprocessedShader shader = preprocessor.preprocessFile(stage.second, files.defines);
+			sources.emplace_back(stage.first, std::move(shader.source));
+			for(std::string& file : shader.files) {
+				addDependency(recorded, std::move(file));
+			}
+		}
 
-		if (!logLinkStatus(program))
-			std::runtime_error("Failed to link shaders");
-		glDeleteShader(compute_shader);
+		// Embedded shaders come with their hash, the key needs no pass over the text
+		uint64_t cacheKey = 0;
+		if(binaryCache) {
+			cacheKey = hashes.size() == sources.size() ? binaryCache->key(hashes) : binaryCache->key(sources);
+		}
+		PendingProgram ret = beginLink(sources, cacheKey);
+		ret.files = std::move(recorded);
+		return ret;
+	}
 
-		return program;
+	PendingProgram beginFromStrings(const std::string& vert, const std::string& frag,
+			const ShaderDefines& defines = ShaderDefines()) {
+		return beginLink({ { GL_VERTEX_SHADER, preprocess(vert, defines) },
+				{ GL_FRAGMENT_SHADER, preprocess(frag, defines) } });
 	}
 
-	GLuint buildFromFiles(const std::string& vert, const std::string& frag) {
-		GLuint program = glCreateProgram();
+	PendingProgram beginComputeProgramFromFile(const std::string& shader,
+			const ShaderDefines& defines = ShaderDefines()) {
+		ProgramFiles files;
+		files.stages = { { GL_COMPUTE_SHADER, shader } };
+		files.defines = defines;
+		return beginFromFiles(files);
+	}
 
-		GLuint vert_shader = compileFromFile(GL_VERTEX_SHADER, vert);
-		GLuint frag_shader = compileFromFile(GL_FRAGMENT_SHADER, frag);
+	/*
+	 * Submits the compiles and the link of a program without querying any
+	 * status, so the driver can work on it while the caller does something
+	 * else. Finish it with finishLink().
+	 */
+	PendingProgram beginLink(const ProgramBinaryCache::Sources& sources) {
+		return beginLink(sources, binaryCache ? binaryCache->key(sources) : 0);
+	}
 
-		glAttachShader(program, vert_shader);
-		glAttachShader(program, frag_shader);
-		glLinkProgram(program);
+	/*
+	 * beginLink() with the binary cache key of sources already known
+	 */
+	PendingProgram beginLink(const ProgramBinaryCache::Sources& sources, uint64_t cacheKey) {
+		PendingProgram ret;
+		if(binaryCache) {
+			ret.cacheKey = cacheKey;
+			ret.program = binaryCache->load(ret.cacheKey);
+			if(ret.program != 0) {
+				ret.cached = true;
+				return ret;
+			}
+		}
 
-		if (!logLinkStatus(program))
-			std::runtime_error("Failed to link shaders");
-		glDeleteShader(vert_shader);
-		glDeleteShader(frag_shader);
+		ret.program = glCreateProgram();
+		if(binaryCache) {
+			glProgramParameteri(ret.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		}
+		for(const auto& source : sources) {
+			const GLuint shader = submitCompile(source.first, source.second);
+			glAttachShader(ret.program, shader);
+			ret.shaders.emplace_back(source.first, shader);
+		}
+		glLinkProgram(ret.program);
+		return ret;
+	}
 
-		return program;
+	/*
+	 * Whether finishLink() would return without waiting for the driver.
+	 * Always true without GL_KHR_parallel_shader_compile.
+	 */
+	bool isComplete(const PendingProgram& pending) const {
+		if(pending.cached || !parallelCompile) {
+			return true;
+		}
+		GLint complete = GL_TRUE;
+		glGetProgramiv(pending.program, GL_COMPLETION_STATUS_KHR, &complete);
+		return complete == GL_TRUE;
 	}
 
-	GLuint buildFromStrings(const std::string& vert, const std::string& frag) {
-		GLuint program = glCreateProgram();
-		GLuint vert_shader = compile(GL_VERTEX_SHADER, vert);
-		GLuint frag_shader = compile(GL_FRAGMENT_SHADER, frag);
-		glAttachShader(program, vert_shader);
-		glAttachShader(program, frag_shader);
-		glLinkProgram(program);
+	/*
+	 * Checks and logs the compile and link status of a pending program,
+	 * waiting for the driver if needed, and returns the program
+	 */
+	GLuint finishLink(PendingProgram& pending) {
+		if(pending.cached) {
+			fprintf(stdout, "Loaded program from binary cache\n");
+			return pending.program;
+		}
+
+		for(const auto& shader : pending.shaders) {
+			logCompileStatus(shader.second, shader.first);
+		}
+		const bool linked = logLinkStatus(pending.program);
+		for(const auto& shader : pending.shaders) {
+			glDeleteShader(shader.second);
+		}
+		pending.shaders.clear();
+		pending.failed = !linked;
 
-		logLinkStatus(program);
-		glDeleteShader(vert_shader);
-		glDeleteShader(frag_shader);
-		return program;
+		if(binaryCache && linked) {
+			binaryCache->store(pending.cacheKey, pending.program);
+		}
+		return pending.program;
+	}
+
+	/*
+	 * Lets the driver compile on its own threads if it supports
+	 * GL_KHR_parallel_shader_compile (or the ARB version). Returns whether
+	 * it does, isComplete() can only poll if so.
+	 */
+	bool enableParallelCompile() {
+		if(parallelCompile) {
+			return true;
+		}
+		if(GLEW_KHR_parallel_shader_compile) {
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+			parallelCompile = true;
+		} else if(GLEW_ARB_parallel_shader_compile) {
+			glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+			parallelCompile = true;
+		}
+		return parallelCompile;
 	}
 
 	void addIncludeDir(const std::string& dir) {
-		includeDirs.push_back(dir);
+		preprocessor.addIncludeDir(dir);
 	}
 
 	const std::vector<std::string>& getIncludeDirs() {
-		return includeDirs;
+		return preprocessor.includeDirs();
+	}
+
+	/*
+	 * Caches every parsed shader file, invalidate() a file after editing it
+	 */
+	ShaderPreprocessor& getPreprocessor() {
+		return preprocessor;
+	}
+
+	/*
+	 * Load programs from binaries cached in dir when their preprocessed
+	 * sources and the driver haven't changed since they were stored, see
+	 * ProgramBinaryCache. Needs a current GL context.
+	 */
+	void enableBinaryCache(const std::string& dir) {
+		binaryCache.reset(new ProgramBinaryCache(dir));
+	}
+
+	void disableBinaryCache() {
+		binaryCache.reset();
+	}
+
+	const ProgramBinaryCache* getBinaryCache() const {
+		return binaryCache.get();
+	}
+
+	/*
+	 * Build programs from these copies of shader files, looked up by path,
+	 * instead of reading the files. Only used while the include directories
+	 * are the ones the copies were preprocessed with.
+	 */
+	void setEmbeddedShaders(const EmbeddedShader* shaders, size_t count, const std::string& includeDirs) {
+		embeddedShaders.clear();
+		for(size_t i = 0; i < count; i++) {
+			embeddedShaders.emplace(shaders[i].path, &shaders[i]);
+		}
+		embeddedIncludeDirs.clear();
+		std::istringstream dirs(includeDirs);
+		for(std::string dir; std::getline(dirs, dir);) {
+			embeddedIncludeDirs.push_back(dir);
+		}
+	}
+
+	void setUseEmbeddedShaders(bool use) {
+		useEmbeddedShaders = use;
 	}
 
 private:
-	std::vector<std::string> includeDirs;
-
-	std::string preprocess(const std::string& input) {
-		std::string res = std::string("#version 330\n");
-		std::istringstream iss(input);
-		for(std::string line; std::getline(iss, line); ) {
-			// Copy original line to alter it
-			std::string line_cpy = line;
-
-			// Clear whitespace before the line
-			line_cpy.erase(line_cpy.begin(),
-					std::find_if(line_cpy.begin(), line_cpy.end(), std::ptr_fun<int, int>(std::isgraph)));
-
-			// Check for preprocessor directives
-			if(line_cpy.size() > 0 && line_cpy[0] == '#') {
-				// Split line into tokens by whitespace
-				std::istringstream buf(line_cpy);
-				std::vector<std::string> tokens{std::istream_iterator<std::string>(buf),
-					std::istream_iterator<std::string>()};
-
-				// Handle #pragma directives
-				if(tokens[0] == "#pragma") {
-					// TODO: Multiple levels of inclusion
-					if(tokens[1] == "include") {
-						std::string filename = tokens[2].substr(1, tokens[2].size()-2);
-						std::string fn = filename;
-						struct stat buf;
-						auto iter = includeDirs.begin();
-						while(stat(fn.c_str(), &buf) != 0 && iter != includeDirs.end()) {
-							fn = *iter + std::string("/") + filename;
-							iter++;
-						}
-						if(iter == includeDirs.end() && stat(fn.c_str(), &buf) != 0) {
-							std::ostringstream err;
-							err << "Error: Could not find included file " << filename;
-							throw std::runtime_error(err.str());
-						}
-						std::string file_str = readFileToString(fn);
-						file_str = file_str.append(std::string("\n"));
-						res = res.append(file_str);
-						continue;
-					}
-				}
-				if(tokens[0] == "#version") {
-					// TODO: Handle multiple GLSL versions
-					if(tokens[1] != "330") {
-						std::ostringstream err;
-						err << "Error: Invalid version " << tokens[1] <<
-								". Compiling shader with " << "330" << " context.";
-						throw std::runtime_error(err.str());
-					} else {
-						continue;
-					}
-				}
-			}
-			line.append(std::string("\n"));
-			res = res.append(line);
+	ShaderPreprocessor preprocessor;
+	std::unique_ptr<ProgramBinaryCache> binaryCache;
+	bool parallelCompile = false;
+
+	std::unordered_map<std::string, const EmbeddedShader*> embeddedShaders;
+	std::vector<std::string> embeddedIncludeDirs;
+	bool useEmbeddedShaders = true;
+
+	const EmbeddedShader* findEmbedded(const std::string& path) const {
+		if(!useEmbeddedShaders || preprocessor.includeDirs() != embeddedIncludeDirs) {
+			return nullptr;
 		}
-		return res;
-	}
-
-	std::string readFileToString(const std::string& filename) {
-		std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
-		if (in) {
-			std::string contents;
-			in.seekg(0, std::ios::end);
-			contents.resize((unsigned int) in.tellg());
-			in.seekg(0, std::ios::beg);
-			in.read(&contents[0], contents.size());
-			in.close();
-			return (contents);
+		auto it = embeddedShaders.find(path);
+		return it == embeddedShaders.end() ? nullptr : it->second;
+	}
+
+	/*
+	 * The embedded source with defines after its #version line, as
+	 * preprocessFile() would return it
+	 */
+	static std::string embeddedSource(const EmbeddedShader& shader, const std::string& defines) {
+		const char* versionEnd = static_cast<const char*>(memchr(shader.source, '\n', shader.length));
+		const size_t split = versionEnd ? versionEnd - shader.source + 1 : 0;
+		std::string ret;
+		ret.reserve(shader.length + defines.size());
+		ret.append(shader.source, split).append(defines).append(shader.source + split, shader.length - split);
+		return ret;
+	}
+
+	static void addDependency(ProgramFiles& files, std::string file) {
+		if(std::find(files.dependencies.begin(), files.dependencies.end(), file) == files.dependencies.end()) {
+			files.dependencies.push_back(std::move(file));
 		}
-		std::ostringstream err;
-		err << "Error reading file " << filename << " with ERRNO: " << strerror(errno);
-		std::runtime_error(err.str().c_str());
-		return "";
 	}
 
-	GLuint compile(const GLenum type, const std::string& src) {
-		std::string s = preprocess(src);
+	/*
+	 * Links a program from preprocessed sources, or loads it from the
+	 * binary cache if it has been built before
+	 */
+	GLuint link(const ProgramBinaryCache::Sources& sources) {
+		PendingProgram pending = beginLink(sources);
+		return finishLink(pending);
+	}
+
+	std::string preprocess(const std::string& input, const ShaderDefines& defines) {
+		return preprocessor.preprocess(input, defines).source;
+	}
 
+	/*
+	 * Compile status is checked later, by finishLink()
+	 */
+	GLuint submitCompile(const GLenum type, const std::string& s) {
 		GLuint shader = glCreateShader(type);
 		const GLchar* source = s.c_str();
 
@@ -178,18 +349,13 @@ private:
 
 		glCompileShader(shader);
 
-		if (logCompileStatus(shader, type) != 0) {
-			std::runtime_error("Compilation failed\n");
-		}
-
 		return shader;
 	}
 
-	GLuint compileFromFile(const GLenum type, const std::string& file_path) {
+	std::string readShader(const GLenum type, const std::string& file_path, const ShaderDefines& defines) {
 		fprintf(stdout, "Reading %s: %s\n", shaderTypeAsString(type).c_str(), file_path.c_str());
 
-		std::string src = readFileToString(file_path);
-		return compile(type, src);
+		return preprocessor.preprocessFile(file_path, defines).source;
 	}
 
 	static GLint logCompileStatus(const GLuint shader_id, const GLenum type) {
@@ -0,0 +1,179 @@
+#include "matrix_batch.h"
+
+#include <boost/assert.hpp>
+
+#ifdef GFX_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace gfx {
+
+namespace {
+
+const glm::mat4& model(const glm::mat4* models, const uint32_t* indices, size_t i) {
+	return indices ? models[indices[i]] : models[i];
+}
+
+ObjectMatrices* output(void* dst, size_t stride, size_t i) {
+	return reinterpret_cast<ObjectMatrices*>(static_cast<char*>(dst) + i * stride);
+}
+
+void computeScalar(const glm::mat4& view, const glm::mat4& viewProjection,
+		const glm::mat4* models, const uint32_t* indices, size_t count, void* dst, size_t stride) {
+	for(size_t i = 0; i < count; i++) {
+		const glm::mat4& m = model(models, indices, i);
+		ObjectMatrices* out = output(dst, stride, i);
+		out->modelview = view * m;
+		out->modelviewProjection = viewProjection * m;
+
+		// The inverse transpose of [c0 c1 c2] is [c1 x c2, c2 x c0, c0 x c1] / det
+		const glm::vec3 c0(out->modelview[0]), c1(out->modelview[1]), c2(out->modelview[2]);
+		const glm::vec3 n0 = glm::cross(c1, c2);
+		const glm::vec3 n1 = glm::cross(c2, c0);
+		const glm::vec3 n2 = glm::cross(c0, c1);
+		const float invDet = 1.0f / glm::dot(c0, n0);
+		out->normal = glm::mat4(
+				glm::vec4(n0 * invDet, 0.0f),
+				glm::vec4(n1 * invDet, 0.0f),
+				glm::vec4(n2 * invDet, 0.0f),
+				glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+	}
+}
+
+#ifdef GFX_SIMD_X86
+
+/*
+ * Cross product of the xyz parts of a and b, w is 0
+ */
+__attribute__((target("sse2"), always_inline))
+inline __m128 crossSSE(__m128 a, __m128 b) {
+	const __m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+	const __m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+	const __m128 c = _mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));
+	return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+/*
+ * Writes the normal matrix of the 3x3 with columns c0, c1, c2
+ */
+__attribute__((target("sse2"), always_inline))
+inline void normalMatrixSSE(__m128 c0, __m128 c1, __m128 c2, float* out) {
+	const __m128 n0 = crossSSE(c1, c2);
+	const __m128 n1 = crossSSE(c2, c0);
+	const __m128 n2 = crossSSE(c0, c1);
+
+	// dot(c0, n0) in every lane, n0.w is 0
+	__m128 det = _mm_mul_ps(c0, n0);
+	det = _mm_add_ps(det, _mm_shuffle_ps(det, det, _MM_SHUFFLE(2, 3, 0, 1)));
+	det = _mm_add_ps(det, _mm_shuffle_ps(det, det, _MM_SHUFFLE(1, 0, 3, 2)));
+
+	_mm_storeu_ps(out, _mm_div_ps(n0, det));
+	_mm_storeu_ps(out + 4, _mm_div_ps(n1, det));
+	_mm_storeu_ps(out + 8, _mm_div_ps(n2, det));
+	_mm_storeu_ps(out + 12, _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+#define GFX_SPLAT(v, k) _mm_shuffle_ps(v, v, _MM_SHUFFLE(k, k, k, k))
+
+__attribute__((target("sse2")))
+void computeSSE(const glm::mat4& view, const glm::mat4& viewProjection,
+		const glm::mat4* models, const uint32_t* indices, size_t count, void* dst, size_t stride) {
+	const float* v = &view[0][0];
+	const float* vp = &viewProjection[0][0];
+	const __m128 v0 = _mm_loadu_ps(v), v1 = _mm_loadu_ps(v + 4), v2 = _mm_loadu_ps(v + 8), v3 = _mm_loadu_ps(v + 12);
+	const __m128 vp0 = _mm_loadu_ps(vp), vp1 = _mm_loadu_ps(vp + 4), vp2 = _mm_loadu_ps(vp + 8), vp3 = _mm_loadu_ps(vp + 12);
+
+	for(size_t i = 0; i < count; i++) {
+		const float* m = &model(models, indices, i)[0][0];
+		float* out = &output(dst, stride, i)->modelview[0][0];
+
+		// Column j of A * M is the sum of A's columns weighted by M's column j
+		__m128 mv[4];
+		for(int j = 0; j < 4; j++) {
+			const __m128 mj = _mm_loadu_ps(m + 4 * j);
+			const __m128 x = GFX_SPLAT(mj, 0), y = GFX_SPLAT(mj, 1), z = GFX_SPLAT(mj, 2), w = GFX_SPLAT(mj, 3);
+			mv[j] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v0, x), _mm_mul_ps(v1, y)),
+					_mm_add_ps(_mm_mul_ps(v2, z), _mm_mul_ps(v3, w)));
+			const __m128 mvp = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vp0, x), _mm_mul_ps(vp1, y)),
+					_mm_add_ps(_mm_mul_ps(vp2, z), _mm_mul_ps(vp3, w)));
+			_mm_storeu_ps(out + 4 * j, mv[j]);
+			_mm_storeu_ps(out + 16 + 4 * j, mvp);
+		}
+
+		normalMatrixSSE(mv[0], mv[1], mv[2], out + 32);
+	}
+}
+
+#undef GFX_SPLAT
+
+/*
+ * Like the SSE path but with two columns of each product per instruction:
+ * the low and high halves of a register hold adjacent columns
+ */
+__attribute__((target("avx")))
+void computeAVX(const glm::mat4& view, const glm::mat4& viewProjection,
+		const glm::mat4* models, const uint32_t* indices, size_t count, void* dst, size_t stride) {
+	const __m128* v = reinterpret_cast<const __m128*>(&view[0][0]);
+	const __m128* vp = reinterpret_cast<const __m128*>(&viewProjection[0][0]);
+	__m256 v0 = _mm256_broadcast_ps(v), v1 = _mm256_broadcast_ps(v + 1);
+	__m256 v2 = _mm256_broadcast_ps(v + 2), v3 = _mm256_broadcast_ps(v + 3);
+	__m256 vp0 = _mm256_broadcast_ps(vp), vp1 = _mm256_broadcast_ps(vp + 1);
+	__m256 vp2 = _mm256_broadcast_ps(vp + 2), vp3 = _mm256_broadcast_ps(vp + 3);
+
+	for(size_t i = 0; i < count; i++) {
+		const float* m = &model(models, indices, i)[0][0];
+		float* out = &output(dst, stride, i)->modelview[0][0];
+
+		const __m256 m01 = _mm256_loadu_ps(m);
+		const __m256 m23 = _mm256_loadu_ps(m + 8);
+		const __m256 x01 = _mm256_permute_ps(m01, 0x00), y01 = _mm256_permute_ps(m01, 0x55);
+		const __m256 z01 = _mm256_permute_ps(m01, 0xaa), w01 = _mm256_permute_ps(m01, 0xff);
+		const __m256 x23 = _mm256_permute_ps(m23, 0x00), y23 = _mm256_permute_ps(m23, 0x55);
+		const __m256 z23 = _mm256_permute_ps(m23, 0xaa), w23 = _mm256_permute_ps(m23, 0xff);
+
+		const __m256 mv01 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(v0, x01), _mm256_mul_ps(v1, y01)),
+				_mm256_add_ps(_mm256_mul_ps(v2, z01), _mm256_mul_ps(v3, w01)));
+		const __m256 mv23 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(v0, x23), _mm256_mul_ps(v1, y23)),
+				_mm256_add_ps(_mm256_mul_ps(v2, z23), _mm256_mul_ps(v3, w23)));
+		const __m256 mvp01 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vp0, x01), _mm256_mul_ps(vp1, y01)),
+				_mm256_add_ps(_mm256_mul_ps(vp2, z01), _mm256_mul_ps(vp3, w01)));
+		const __m256 mvp23 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vp0, x23), _mm256_mul_ps(vp1, y23)),
+				_mm256_add_ps(_mm256_mul_ps(vp2, z23), _mm256_mul_ps(vp3, w23)));
+
+		_mm256_storeu_ps(out, mv01);
+		_mm256_storeu_ps(out + 8, mv23);
+		_mm256_storeu_ps(out + 16, mvp01);
+		_mm256_storeu_ps(out + 24, mvp23);
+
+		normalMatrixSSE(_mm256_castps256_ps128(mv01), _mm256_extractf128_ps(mv01, 1),
+				_mm256_castps256_ps128(mv23), out + 32);
+	}
+}
+
+#endif
+
+}
+
+void computeObjectMatrices(const glm::mat4& view, const glm::mat4& projection,
+		const glm::mat4* models, const uint32_t* indices, size_t count,
+		void* dst, size_t stride, SimdLevel level) {
+	BOOST_ASSERT_MSG(isSimdLevelSupported(level), "Error: SIMD level not supported on this CPU");
+	BOOST_ASSERT_MSG(stride >= sizeof(ObjectMatrices), "Error: ObjectMatrices stride is too small");
+
+	const glm::mat4 viewProjection = projection * view;
+	switch(level) {
+#ifdef GFX_SIMD_X86
+	case SimdLevel::SSE:
+		computeSSE(view, viewProjection, models, indices, count, dst, stride);
+		break;
+	case SimdLevel::AVX:
+		computeAVX(view, viewProjection, models, indices, count, dst, stride);
+		break;
+#endif
+	default:
+		computeScalar(view, viewProjection, models, indices, count, dst, stride);
+		break;
+	}
+}
+
+}
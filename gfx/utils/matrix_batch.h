@@ -0,0 +1,43 @@
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "simd.h"
+
+#ifndef GFX_UTILS_MATRIX_BATCH_H_
+#define GFX_UTILS_MATRIX_BATCH_H_
+
+namespace gfx {
+
+/*
+ * Per object matrices as laid out in a std140 uniform block or std430
+ * buffer: mat4 modelview, mat4 modelviewProjection, mat4 normal
+ */
+struct ObjectMatrices {
+	glm::mat4 modelview;
+	glm::mat4 modelviewProjection;
+
+	// Inverse transpose of the modelview's upper 3x3, in a mat4
+	glm::mat4 normal;
+};
+
+static_assert(sizeof(ObjectMatrices) == 3 * 16 * sizeof(float), "Error: ObjectMatrices must be tightly packed");
+
+/*
+ * Computes the ObjectMatrices of count objects and writes them to dst, one
+ * every stride bytes, so dst can point straight into (mapped) uniform
+ * buffer memory with each object at an aligned offset. Object i uses
+ * models[indices[i]], or models[i] if indices is null.
+ *
+ * The SSE path does each 4x4 product as 16 broadcast multiply-adds, the AVX
+ * path does two columns per instruction. Normal matrices come from the
+ * cross products of the modelview's columns rather than a general inverse.
+ */
+void computeObjectMatrices(const glm::mat4& view, const glm::mat4& projection,
+		const glm::mat4* models, const uint32_t* indices, size_t count,
+		void* dst, size_t stride = sizeof(ObjectMatrices), SimdLevel level = bestSimdLevel());
+
+}
+
+#endif /* GFX_UTILS_MATRIX_BATCH_H_ */
@@ -0,0 +1,415 @@
+#include "occlusion_culler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <boost/assert.hpp>
+
+#ifdef __SSE2__
+#define GFX_OCCLUSION_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace gfx {
+
+const uint32_t OcclusionCuller::TILE_SIZE;
+const uint32_t OcclusionCuller::NUM_TILE_LEVELS;
+
+namespace {
+
+// Pyramid texels a tested box may span per side, larger boxes use a coarser level
+const uint32_t MAX_TEST_TEXELS = 4;
+
+// Candidates per work item in cull()
+const size_t CULL_CHUNK_SIZE = 1024;
+
+// Clip space vertices closer to the camera plane than this count as behind it
+const float MIN_W = 1e-5f;
+
+void forEach(ThreadPool* pool, size_t n, const std::function<void(size_t)>& fn) {
+	if(pool) {
+		pool->parallelFor(n, fn);
+	} else {
+		for(size_t i = 0; i < n; i++) {
+			fn(i);
+		}
+	}
+}
+
+/*
+ * Clips a convex polygon against the clip space half space dot(plane, v) >= 0
+ */
+size_t clipPolygon(const glm::vec4& plane, const glm::vec4* in, size_t n, glm::vec4* out) {
+	size_t numOut = 0;
+	for(size_t i = 0; i < n; i++) {
+		const glm::vec4& a = in[i];
+		const glm::vec4& b = in[(i + 1) % n];
+		const float da = glm::dot(plane, a);
+		const float db = glm::dot(plane, b);
+		if(da >= 0.0f) {
+			out[numOut++] = a;
+		}
+		if((da >= 0.0f) != (db >= 0.0f)) {
+			out[numOut++] = a + (b - a) * (da / (da - db));
+		}
+	}
+	return numOut;
+}
+
+}
+
+OcclusionCuller::OcclusionCuller(uint32_t width, uint32_t height) :
+		m_width(width), m_height(height), m_viewProj(1.0f) {
+	BOOST_ASSERT_MSG(width > 0 && height > 0, "Error: OcclusionCuller needs a non empty depth buffer");
+
+	m_numTilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	m_numTilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+	m_tileBins.resize(m_numTilesX * m_numTilesY);
+
+	uint32_t w = m_numTilesX * TILE_SIZE;
+	uint32_t h = m_numTilesY * TILE_SIZE;
+	while(true) {
+		m_levels.push_back({ w, h, std::vector<float>(w * h, 1.0f) });
+		if(w == 1 && h == 1) {
+			break;
+		}
+		w = (w + 1) / 2;
+		h = (h + 1) / 2;
+	}
+}
+
+uint32_t OcclusionCuller::addOccluder(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices,
+		const glm::mat4& model) {
+	BOOST_ASSERT_MSG(indices.size() % 3 == 0, "Error: occluders must be triangle lists");
+	for(uint32_t i : indices) {
+		BOOST_ASSERT_MSG(i < positions.size(), "Error: occluder index out of range");
+	}
+	m_occluders.push_back({ positions, indices, model });
+	m_triangles.resize(m_occluders.size());
+	return static_cast<uint32_t>(m_occluders.size() - 1);
+}
+
+void OcclusionCuller::setOccluderTransform(uint32_t occluder, const glm::mat4& model) {
+	BOOST_ASSERT_MSG(occluder < m_occluders.size(), "Error: occluder index out of range");
+	m_occluders[occluder].model = model;
+}
+
+void OcclusionCuller::clearOccluders() {
+	m_occluders.clear();
+	m_triangles.clear();
+}
+
+void OcclusionCuller::render(const glm::mat4& viewProj, ThreadPool* pool) {
+	m_viewProj = viewProj;
+
+	forEach(pool, m_occluders.size(), [this](size_t i) { setupTriangles(i); });
+
+	m_stats = Stats();
+	for(std::vector<const RasterTriangle*>& bin : m_tileBins) {
+		bin.clear();
+	}
+	for(const std::vector<RasterTriangle>& triangles : m_triangles) {
+		for(const RasterTriangle& t : triangles) {
+			const int32_t tileSize = static_cast<int32_t>(TILE_SIZE);
+			for(int32_t ty = t.minY / tileSize; ty <= t.maxY / tileSize; ty++) {
+				for(int32_t tx = t.minX / tileSize; tx <= t.maxX / tileSize; tx++) {
+					m_tileBins[ty * m_numTilesX + tx].push_back(&t);
+					m_stats.numBinned += 1;
+				}
+			}
+		}
+		m_stats.numTriangles += triangles.size();
+	}
+
+	forEach(pool, m_tileBins.size(), [this](size_t tile) { rasterizeTile(tile); });
+
+	for(size_t level = NUM_TILE_LEVELS + 1; level < m_levels.size(); level++) {
+		buildLevel(level);
+	}
+}
+
+void OcclusionCuller::setupTriangles(size_t occluder) {
+	const Occluder& occ = m_occluders[occluder];
+	std::vector<RasterTriangle>& out = m_triangles[occluder];
+	out.clear();
+
+	const glm::mat4 mvp = m_viewProj * occ.model;
+
+	// Near, left, right, bottom and top clip planes. Triangles past the far
+	// plane are kept, their depth is above the cleared 1 and never wins.
+	static const glm::vec4 planes[] = {
+		glm::vec4(0.0f, 0.0f, 1.0f, 1.0f),
+		glm::vec4(1.0f, 0.0f, 0.0f, 1.0f),
+		glm::vec4(-1.0f, 0.0f, 0.0f, 1.0f),
+		glm::vec4(0.0f, 1.0f, 0.0f, 1.0f),
+		glm::vec4(0.0f, -1.0f, 0.0f, 1.0f),
+	};
+
+	std::vector<glm::vec4> clip(occ.positions.size());
+	for(size_t i = 0; i < clip.size(); i++) {
+		clip[i] = mvp * glm::vec4(occ.positions[i], 1.0f);
+	}
+
+	for(size_t i = 0; i + 2 < occ.indices.size(); i += 3) {
+		glm::vec4 poly[2][8] = {
+			{ clip[occ.indices[i]], clip[occ.indices[i + 1]], clip[occ.indices[i + 2]] },
+			{}
+		};
+
+		// Reject triangles outside any plane and skip clipping those inside all of them
+		bool outside = false, inside = true;
+		for(const glm::vec4& p : planes) {
+			const float d0 = glm::dot(p, poly[0][0]), d1 = glm::dot(p, poly[0][1]), d2 = glm::dot(p, poly[0][2]);
+			outside = outside || (d0 < 0.0f && d1 < 0.0f && d2 < 0.0f);
+			inside = inside && d0 >= 0.0f && d1 >= 0.0f && d2 >= 0.0f;
+		}
+		if(outside) {
+			continue;
+		}
+
+		size_t n = 3, cur = 0;
+		if(!inside) {
+			for(const glm::vec4& p : planes) {
+				n = clipPolygon(p, poly[cur], n, poly[1 - cur]);
+				cur = 1 - cur;
+				if(n < 3) {
+					break;
+				}
+			}
+		}
+		for(size_t v = 2; v < n; v++) {
+			emitTriangle(poly[cur][0], poly[cur][v - 1], poly[cur][v], out);
+		}
+	}
+}
+
+void OcclusionCuller::emitTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c,
+		std::vector<RasterTriangle>& out) const {
+	if(a.w < MIN_W || b.w < MIN_W || c.w < MIN_W) {
+		return;
+	}
+
+	// Window space: pixels with (0, 0) at the bottom left, depth in [0, 1]
+	const glm::vec3 scale(0.5f * m_width, 0.5f * m_height, 0.5f);
+	glm::vec3 v[3] = {
+		(glm::vec3(a) / a.w + glm::vec3(1.0f)) * scale,
+		(glm::vec3(b) / b.w + glm::vec3(1.0f)) * scale,
+		(glm::vec3(c) / c.w + glm::vec3(1.0f)) * scale,
+	};
+
+	float area = (v[1].x - v[0].x)*(v[2].y - v[0].y) - (v[2].x - v[0].x)*(v[1].y - v[0].y);
+	if(std::abs(area) < 1e-6f) {
+		return;
+	}
+	// Both windings occlude, make the edge functions positive inside
+	if(area < 0.0f) {
+		std::swap(v[1], v[2]);
+		area = -area;
+	}
+
+	RasterTriangle t;
+	for(size_t e = 0; e < 3; e++) {
+		const glm::vec3& p = v[e];
+		const glm::vec3& q = v[(e + 1) % 3];
+		const float ea = p.y - q.y;
+		const float eb = q.x - p.x;
+		t.edges[e] = glm::vec3(ea, eb, -(ea*p.x + eb*p.y));
+	}
+
+	const float dzdx = ((v[1].z - v[0].z)*(v[2].y - v[0].y) - (v[2].z - v[0].z)*(v[1].y - v[0].y)) / area;
+	const float dzdy = ((v[1].x - v[0].x)*(v[2].z - v[0].z) - (v[2].x - v[0].x)*(v[1].z - v[0].z)) / area;
+	t.depth = glm::vec3(dzdx, dzdy, v[0].z - dzdx*v[0].x - dzdy*v[0].y);
+
+	const float minX = std::min(v[0].x, std::min(v[1].x, v[2].x));
+	const float maxX = std::max(v[0].x, std::max(v[1].x, v[2].x));
+	const float minY = std::min(v[0].y, std::min(v[1].y, v[2].y));
+	const float maxY = std::max(v[0].y, std::max(v[1].y, v[2].y));
+	t.minX = std::max(0, static_cast<int32_t>(std::floor(minX)));
+	t.minY = std::max(0, static_cast<int32_t>(std::floor(minY)));
+	t.maxX = std::min(static_cast<int32_t>(m_width) - 1, static_cast<int32_t>(std::floor(maxX)));
+	t.maxY = std::min(static_cast<int32_t>(m_height) - 1, static_cast<int32_t>(std::floor(maxY)));
+	if(t.minX > t.maxX || t.minY > t.maxY) {
+		return;
+	}
+
+	out.push_back(t);
+}
+
+void OcclusionCuller::rasterizeTile(size_t tile) {
+	const uint32_t tileX = static_cast<uint32_t>(tile % m_numTilesX);
+	const uint32_t tileY = static_cast<uint32_t>(tile / m_numTilesX);
+	const int32_t x0 = tileX * TILE_SIZE, y0 = tileY * TILE_SIZE;
+	const int32_t x1 = x0 + TILE_SIZE - 1, y1 = y0 + TILE_SIZE - 1;
+
+	Level& level = m_levels[0];
+	for(int32_t y = y0; y <= y1; y++) {
+		std::fill_n(&level.depth[y * level.width + x0], TILE_SIZE, 1.0f);
+	}
+
+	for(const RasterTriangle* t : m_tileBins[tile]) {
+		// Start on a multiple of 4 pixels, tiles are too, so a group of 4
+		// never crosses into the next tile
+		const int32_t minX = std::max(t->minX, x0) & ~3;
+		const int32_t maxX = std::min(t->maxX, x1);
+		const int32_t minY = std::max(t->minY, y0);
+		const int32_t maxY = std::min(t->maxY, y1);
+
+#ifdef GFX_OCCLUSION_SSE
+		const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 e0a = _mm_set1_ps(t->edges[0].x);
+		const __m128 e1a = _mm_set1_ps(t->edges[1].x);
+		const __m128 e2a = _mm_set1_ps(t->edges[2].x);
+		const __m128 za = _mm_set1_ps(t->depth.x);
+
+		for(int32_t y = minY; y <= maxY; y++) {
+			const float py = y + 0.5f;
+			const __m128 e0row = _mm_set1_ps(t->edges[0].y*py + t->edges[0].z);
+			const __m128 e1row = _mm_set1_ps(t->edges[1].y*py + t->edges[1].z);
+			const __m128 e2row = _mm_set1_ps(t->edges[2].y*py + t->edges[2].z);
+			const __m128 zrow = _mm_set1_ps(t->depth.y*py + t->depth.z);
+			float* row = &level.depth[y * level.width];
+
+			for(int32_t x = minX; x <= maxX; x += 4) {
+				const __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), offsets);
+				const __m128 e0 = _mm_add_ps(_mm_mul_ps(e0a, px), e0row);
+				const __m128 e1 = _mm_add_ps(_mm_mul_ps(e1a, px), e1row);
+				const __m128 e2 = _mm_add_ps(_mm_mul_ps(e2a, px), e2row);
+				const __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)),
+						_mm_cmpge_ps(e2, zero));
+				if(_mm_movemask_ps(inside) == 0) {
+					continue;
+				}
+
+				const __m128 z = _mm_add_ps(_mm_mul_ps(za, px), zrow);
+				const __m128 old = _mm_loadu_ps(row + x);
+				const __m128 nearest = _mm_min_ps(old, z);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+			}
+		}
+#else
+		for(int32_t y = minY; y <= maxY; y++) {
+			const float py = y + 0.5f;
+			float* row = &level.depth[y * level.width];
+			for(int32_t x = minX; x <= maxX; x++) {
+				const float px = x + 0.5f;
+				if(t->edges[0].x*px + t->edges[0].y*py + t->edges[0].z >= 0.0f &&
+						t->edges[1].x*px + t->edges[1].y*py + t->edges[1].z >= 0.0f &&
+						t->edges[2].x*px + t->edges[2].y*py + t->edges[2].z >= 0.0f) {
+					row[x] = std::min(row[x], t->depth.x*px + t->depth.y*py + t->depth.z);
+				}
+			}
+		}
+#endif
+	}
+
+	buildTileLevels(tileX, tileY);
+}
+
+void OcclusionCuller::buildTileLevels(uint32_t tileX, uint32_t tileY) {
+	// Level dimensions are exact halves up to NUM_TILE_LEVELS, so this
+	// tile's texels only depend on its own pixels
+	for(size_t l = 1; l <= NUM_TILE_LEVELS && l < m_levels.size(); l++) {
+		const Level& src = m_levels[l - 1];
+		Level& dst = m_levels[l];
+		const uint32_t size = TILE_SIZE >> l;
+		const uint32_t x0 = tileX * size, y0 = tileY * size;
+		for(uint32_t y = y0; y < y0 + size; y++) {
+			const float* row0 = &src.depth[(2 * y) * src.width];
+			const float* row1 = row0 + src.width;
+			for(uint32_t x = x0; x < x0 + size; x++) {
+				dst.depth[y * dst.width + x] = std::max(std::max(row0[2 * x], row0[2 * x + 1]),
+						std::max(row1[2 * x], row1[2 * x + 1]));
+			}
+		}
+	}
+}
+
+void OcclusionCuller::buildLevel(size_t level) {
+	const Level& src = m_levels[level - 1];
+	Level& dst = m_levels[level];
+	for(uint32_t y = 0; y < dst.height; y++) {
+		for(uint32_t x = 0; x < dst.width; x++) {
+			// Texels past the edge of an odd sized level count as far
+			float farthest = 1.0f;
+			if(2 * x + 1 < src.width && 2 * y + 1 < src.height) {
+				const float* row0 = &src.depth[(2 * y) * src.width];
+				const float* row1 = row0 + src.width;
+				farthest = std::max(std::max(row0[2 * x], row0[2 * x + 1]), std::max(row1[2 * x], row1[2 * x + 1]));
+			}
+			dst.depth[y * dst.width + x] = farthest;
+		}
+	}
+}
+
+bool OcclusionCuller::isVisible(const BoundingBox& box) const {
+	if(box.empty()) {
+		return false;
+	}
+
+	glm::vec3 ndcMin(1e30f), ndcMax(-1e30f);
+	for(int i = 0; i < 8; i++) {
+		const glm::vec4 corner((i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y,
+				(i & 4) ? box.max.z : box.min.z, 1.0f);
+		const glm::vec4 clip = m_viewProj * corner;
+		if(clip.w < MIN_W) {
+			return true;
+		}
+		const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		ndcMin = glm::min(ndcMin, ndc);
+		ndcMax = glm::max(ndcMax, ndc);
+	}
+
+	// Nothing to test against off screen or in front of the near plane
+	if(ndcMax.x < -1.0f || ndcMin.x > 1.0f || ndcMax.y < -1.0f || ndcMin.y > 1.0f || ndcMin.z < -1.0f) {
+		return true;
+	}
+
+	const float nearest = 0.5f * ndcMin.z + 0.5f;
+	const auto toPixel = [](float ndc, uint32_t size) {
+		const float p = std::floor((0.5f * ndc + 0.5f) * size);
+		return static_cast<uint32_t>(std::min(std::max(p, 0.0f), static_cast<float>(size - 1)));
+	};
+	uint32_t x0 = toPixel(ndcMin.x, m_width), x1 = toPixel(ndcMax.x, m_width);
+	uint32_t y0 = toPixel(ndcMin.y, m_height), y1 = toPixel(ndcMax.y, m_height);
+
+	size_t l = 0;
+	while(l + 1 < m_levels.size() && (x1 - x0 >= MAX_TEST_TEXELS || y1 - y0 >= MAX_TEST_TEXELS)) {
+		x0 >>= 1; x1 >>= 1;
+		y0 >>= 1; y1 >>= 1;
+		l += 1;
+	}
+
+	const Level& level = m_levels[l];
+	for(uint32_t y = y0; y <= y1; y++) {
+		for(uint32_t x = x0; x <= x1; x++) {
+			if(level.depth[y * level.width + x] >= nearest) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+size_t OcclusionCuller::cull(const std::vector<BoundingBox>& boxes, const std::vector<uint32_t>& candidates,
+		std::vector<uint32_t>& visible, ThreadPool* pool) const {
+	std::vector<uint8_t> flags(candidates.size());
+	const size_t numChunks = (candidates.size() + CULL_CHUNK_SIZE - 1) / CULL_CHUNK_SIZE;
+	forEach(pool, numChunks, [&](size_t chunk) {
+		const size_t end = std::min(candidates.size(), (chunk + 1) * CULL_CHUNK_SIZE);
+		for(size_t i = chunk * CULL_CHUNK_SIZE; i < end; i++) {
+			BOOST_ASSERT_MSG(candidates[i] < boxes.size(), "Error: occlusion cull candidate out of range");
+			flags[i] = isVisible(boxes[candidates[i]]);
+		}
+	});
+
+	visible.clear();
+	for(size_t i = 0; i < candidates.size(); i++) {
+		if(flags[i]) {
+			visible.push_back(candidates[i]);
+		}
+	}
+	return visible.size();
+}
+
+}
@@ -0,0 +1,152 @@
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "thread_pool.h"
+
+#ifndef GFX_UTILS_OCCLUSION_CULLER_H_
+#define GFX_UTILS_OCCLUSION_CULLER_H_
+
+namespace gfx {
+
+/*
+ * Software occlusion culling.
+ *
+ * A few large, simple occluder meshes (walls, floors, low poly stand-ins for
+ * big objects) are rasterized into a small depth buffer on the CPU. A
+ * hierarchical Z pyramid holding the farthest depth under each texel is
+ * built from it, and object bounding boxes are tested against the pyramid
+ * before their draws are submitted.
+ *
+ * The screen is split into 32x32 pixel tiles. Triangles are binned into the
+ * tiles they touch and each tile is rasterized, 4 pixels at a time with SSE,
+ * by one thread, which also builds the tile's part of the pyramid. No GL
+ * calls are made, so render() and cull() can run on a worker thread while
+ * the GL thread is still submitting the previous frame.
+ *
+ * Occluders must lie inside what they stand in for, or visible objects get
+ * culled. Depths are window space, 0 at the near plane and 1 at the far plane.
+ */
+class OcclusionCuller {
+public:
+	static const uint32_t TILE_SIZE = 32;
+
+	struct Stats {
+		// Occluder triangles after clipping
+		size_t numTriangles = 0;
+
+		// Triangle and tile pairs rasterized
+		size_t numBinned = 0;
+	};
+
+private:
+	// Pyramid levels built per tile: a tile shrinks to a single texel
+	static const uint32_t NUM_TILE_LEVELS = 5;
+
+	struct Occluder {
+		std::vector<glm::vec3> positions;
+		std::vector<uint32_t> indices;
+		glm::mat4 model;
+	};
+
+	/*
+	 * A triangle set up for rasterization: inside where all three edge
+	 * functions edge[i].x*x + edge[i].y*y + edge[i].z are >= 0, with depth
+	 * depth.x*x + depth.y*y + depth.z, over an inclusive pixel rectangle
+	 */
+	struct RasterTriangle {
+		glm::vec3 edges[3];
+		glm::vec3 depth;
+		int32_t minX, minY, maxX, maxY;
+	};
+
+	struct Level {
+		uint32_t width, height;
+		std::vector<float> depth;
+	};
+
+	uint32_t m_width, m_height;
+	uint32_t m_numTilesX, m_numTilesY;
+
+	// Level 0 is the depth buffer, padded to whole tiles
+	std::vector<Level> m_levels;
+
+	std::vector<Occluder> m_occluders;
+	std::vector<std::vector<RasterTriangle>> m_triangles;
+	std::vector<std::vector<const RasterTriangle*>> m_tileBins;
+
+	glm::mat4 m_viewProj;
+	Stats m_stats;
+
+	void setupTriangles(size_t occluder);
+	void emitTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c, std::vector<RasterTriangle>& out) const;
+	void rasterizeTile(size_t tile);
+	void buildTileLevels(uint32_t tileX, uint32_t tileY);
+	void buildLevel(size_t level);
+
+public:
+	/*
+	 * width and height of the depth buffer, a few hundred pixels wide is plenty
+	 */
+	OcclusionCuller(uint32_t width = 256, uint32_t height = 128);
+
+	uint32_t width() const {
+		return m_width;
+	}
+
+	uint32_t height() const {
+		return m_height;
+	}
+
+	size_t numOccluders() const {
+		return m_occluders.size();
+	}
+
+	/*
+	 * Adds an indexed triangle mesh and returns its index
+	 */
+	uint32_t addOccluder(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices,
+			const glm::mat4& model = glm::mat4(1.0f));
+
+	void setOccluderTransform(uint32_t occluder, const glm::mat4& model);
+
+	void clearOccluders();
+
+	/*
+	 * Rasterizes every occluder as seen through viewProj and builds the
+	 * pyramid. Not thread safe with cull() or isVisible().
+	 */
+	void render(const glm::mat4& viewProj, ThreadPool* pool = nullptr);
+
+	/*
+	 * False if a world space box is certainly hidden behind the occluders of
+	 * the last render(). Boxes crossing the near plane are always visible.
+	 */
+	bool isVisible(const BoundingBox& box) const;
+
+	/*
+	 * Writes the indices in candidates whose boxes are visible to visible,
+	 * in the same order, and returns how many there are. Candidates would
+	 * usually be the output of FrustumCuller or Bvh::queryFrustum.
+	 */
+	size_t cull(const std::vector<BoundingBox>& boxes, const std::vector<uint32_t>& candidates,
+			std::vector<uint32_t>& visible, ThreadPool* pool = nullptr) const;
+
+	/*
+	 * Depth of a pixel of the depth buffer, (0, 0) is the bottom left
+	 */
+	float depth(uint32_t x, uint32_t y) const {
+		return m_levels[0].depth[y * m_levels[0].width + x];
+	}
+
+	const Stats& stats() const {
+		return m_stats;
+	}
+};
+
+}
+
+#endif /* GFX_UTILS_OCCLUSION_CULLER_H_ */
@@ -0,0 +1,65 @@
+#include "persistent_ring.h"
+
+#include <boost/assert.hpp>
+
+namespace gfx {
+namespace detail {
+
+PersistentRing::PersistentRing(size_t regionSize, size_t numRegions, size_t alignment) :
+		m_numRegions(numRegions), m_fences(numRegions, nullptr) {
+	BOOST_ASSERT_MSG(numRegions > 0, "Error: a persistent ring needs at least one region");
+	BOOST_ASSERT_MSG(alignment > 0, "Error: invalid persistent ring alignment");
+
+	m_regionSize = ((regionSize + alignment - 1) / alignment) * alignment;
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	const GLsizeiptr size = m_regionSize * m_numRegions;
+
+	glCreateBuffers(1, &m_bufferId);
+	glNamedBufferStorage(m_bufferId, size, nullptr, flags);
+	m_mappedPtr = static_cast<uint8_t*>(glMapNamedBufferRange(m_bufferId, 0, size, flags));
+	BOOST_ASSERT_MSG(m_mappedPtr != nullptr, "Error: failed to persistently map buffer");
+}
+
+PersistentRing::~PersistentRing() {
+	for(GLsync fence : m_fences) {
+		if(fence != nullptr) {
+			glDeleteSync(fence);
+		}
+	}
+	glUnmapNamedBuffer(m_bufferId);
+	glDeleteBuffers(1, &m_bufferId);
+}
+
+void PersistentRing::waitForRegion(size_t region) {
+	GLsync fence = m_fences[region];
+	if(fence == nullptr) {
+		return;
+	}
+
+	// Fast path: the GPU is already done with this region
+	GLenum status = glClientWaitSync(fence, 0, 0);
+	if(status == GL_TIMEOUT_EXPIRED) {
+		m_numStalls += 1;
+		do {
+			status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		} while(status == GL_TIMEOUT_EXPIRED);
+	}
+	BOOST_ASSERT_MSG(status != GL_WAIT_FAILED, "Error: waiting on persistent ring fence failed");
+
+	glDeleteSync(fence);
+	m_fences[region] = nullptr;
+}
+
+void PersistentRing::advance() {
+	if(m_fences[m_region] != nullptr) {
+		glDeleteSync(m_fences[m_region]);
+	}
+	m_fences[m_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	m_region = (m_region + 1) % m_numRegions;
+	waitForRegion(m_region);
+}
+
+}
+}
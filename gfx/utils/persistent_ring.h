@@ -0,0 +1,88 @@
+#include <GL/glew.h>
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#ifndef GFX_UTILS_PERSISTENT_RING_H_
+#define GFX_UTILS_PERSISTENT_RING_H_
+
+namespace gfx {
+namespace detail {
+
+/*
+ * An immutable buffer object which stays mapped for writing for its whole
+ * lifetime. The buffer is split into equally sized regions, one per frame in
+ * flight: the CPU writes into the current region while the GPU reads from the
+ * others. advance() fences the current region and moves on to the next one,
+ * waiting only if the GPU has not finished reading it yet.
+ */
+class PersistentRing {
+	GLuint m_bufferId = 0;
+	uint8_t* m_mappedPtr = nullptr;
+
+	size_t m_regionSize = 0;
+	size_t m_numRegions = 0;
+	size_t m_region = 0;
+
+	std::vector<GLsync> m_fences;
+	size_t m_numStalls = 0;
+
+	void waitForRegion(size_t region);
+
+public:
+	static const size_t DEFAULT_NUM_REGIONS = 3;
+
+	/*
+	 * regionSize is rounded up to a multiple of alignment so every region
+	 * starts at an offset usable with glBindBufferRange
+	 */
+	PersistentRing(size_t regionSize, size_t numRegions = DEFAULT_NUM_REGIONS, size_t alignment = 1);
+
+	PersistentRing(const PersistentRing&) = delete;
+	PersistentRing& operator=(const PersistentRing&) = delete;
+
+	~PersistentRing();
+
+	GLuint bufferId() const {
+		return m_bufferId;
+	}
+
+	size_t regionSize() const {
+		return m_regionSize;
+	}
+
+	size_t numRegions() const {
+		return m_numRegions;
+	}
+
+	size_t regionIndex() const {
+		return m_region;
+	}
+
+	size_t regionOffset() const {
+		return m_region * m_regionSize;
+	}
+
+	void* regionData() {
+		return m_mappedPtr + regionOffset();
+	}
+
+	/*
+	 * Number of times advance() had to block on the GPU
+	 */
+	size_t numStalls() const {
+		return m_numStalls;
+	}
+
+	/*
+	 * Fence the current region once all previously issued commands which read
+	 * it have completed, then make the next region current.
+	 */
+	void advance();
+};
+
+}
+}
+
+#endif /* GFX_UTILS_PERSISTENT_RING_H_ */
@@ -0,0 +1,157 @@
+#include "program_binary_cache.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include <cstring>
+#include <fstream>
+
+namespace utils {
+
+namespace {
+
+// File layout: header, then binaryLength bytes of glGetProgramBinary output
+struct BinaryHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t key;
+	uint32_t format;
+	uint32_t binaryLength;
+};
+
+const char BINARY_MAGIC[4] = { 'F', 'G', 'P', 'B' };
+const uint32_t BINARY_VERSION = 1;
+
+std::string glString(GLenum name) {
+	const GLubyte* str = glGetString(name);
+	return str ? std::string(reinterpret_cast<const char*>(str)) : std::string();
+}
+
+}
+
+ProgramBinaryCache::ProgramBinaryCache(const std::string& dir) : m_dir(dir) {
+	GLint numFormats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+	m_supported = numFormats > 0;
+	m_driver = glString(GL_VENDOR) + "\n" + glString(GL_RENDERER) + "\n" + glString(GL_VERSION);
+
+	if(m_supported && mkdir(m_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "Error creating program binary cache directory %s: %s\n", m_dir.c_str(), strerror(errno));
+		m_supported = false;
+	}
+}
+
+uint64_t ProgramBinaryCache::hash(const void* data, size_t size, uint64_t h) {
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for(size_t i = 0; i < size; i++) {
+		h ^= bytes[i];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+uint64_t ProgramBinaryCache::key(const Sources& sources) const {
+	uint64_t h = hash(m_driver.data(), m_driver.size());
+	for(const auto& source : sources) {
+		// Hash the lengths too so moving text between stages changes the key
+		const uint64_t stage[2] = { source.first, source.second.size() };
+		h = hash(stage, sizeof(stage), h);
+		h = hash(source.second.data(), source.second.size(), h);
+	}
+	return h;
+}
+
+uint64_t ProgramBinaryCache::key(const SourceHashes& hashes) const {
+	uint64_t h = hash(m_driver.data(), m_driver.size());
+	for(const auto& source : hashes) {
+		const uint64_t stage[2] = { source.first, source.second };
+		h = hash(stage, sizeof(stage), h);
+	}
+	return h;
+}
+
+std::string ProgramBinaryCache::path(uint64_t key) const {
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+	return m_dir + "/" + name;
+}
+
+GLuint ProgramBinaryCache::load(uint64_t key) {
+	if(!m_supported) {
+		return 0;
+	}
+
+	std::ifstream in(path(key).c_str(), std::ios::in | std::ios::binary);
+	BinaryHeader header;
+	if(!in || !in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+			std::memcmp(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0 ||
+			header.version != BINARY_VERSION || header.key != key) {
+		m_stats.misses += 1;
+		return 0;
+	}
+
+	std::vector<char> binary(header.binaryLength);
+	if(!in.read(binary.data(), binary.size())) {
+		m_stats.misses += 1;
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+
+	GLint success = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if(success != GL_TRUE) {
+		glDeleteProgram(program);
+		m_stats.rejected += 1;
+		return 0;
+	}
+
+	m_stats.hits += 1;
+	return program;
+}
+
+void ProgramBinaryCache::store(uint64_t key, GLuint program) {
+	if(!m_supported) {
+		return;
+	}
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if(length <= 0) {
+		return;
+	}
+
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+
+	BinaryHeader header;
+	std::memcpy(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+	header.version = BINARY_VERSION;
+	header.key = key;
+	header.format = format;
+	header.binaryLength = static_cast<uint32_t>(length);
+
+	// Write then rename, so a concurrent or interrupted run never sees half a file
+	const std::string filename = path(key);
+	const std::string tmpFilename = filename + ".tmp";
+	{
+		std::ofstream out(tmpFilename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(binary.data(), length);
+		if(!out) {
+			fprintf(stderr, "Error writing program binary %s\n", tmpFilename.c_str());
+			remove(tmpFilename.c_str());
+			return;
+		}
+	}
+	if(rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+		remove(tmpFilename.c_str());
+		return;
+	}
+	m_stats.stored += 1;
+}
+
+}
@@ -0,0 +1,91 @@
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef PROGRAM_BINARY_CACHE_H_
+#define PROGRAM_BINARY_CACHE_H_
+
+namespace utils {
+
+/*
+ * Linked program binaries stored in a directory, one file per program,
+ * named after a 64 bit FNV-1a hash of the program's preprocessed shader
+ * sources and the GL vendor, renderer and version strings. A driver update
+ * or an edit to any shader or included file changes the key, so stale
+ * binaries are never loaded; a binary the driver still rejects is treated
+ * as a miss and overwritten once the program is recompiled.
+ */
+class ProgramBinaryCache {
+public:
+	typedef std::vector<std::pair<GLenum, std::string>> Sources;
+
+	// Per stage hashes of sources whose text was hashed ahead of time
+	typedef std::vector<std::pair<GLenum, uint64_t>> SourceHashes;
+
+	struct Stats {
+		size_t hits = 0;
+		size_t misses = 0;
+		size_t rejected = 0;
+		size_t stored = 0;
+	};
+
+private:
+	std::string m_dir;
+	std::string m_driver;
+	bool m_supported = false;
+	Stats m_stats;
+
+	std::string path(uint64_t key) const;
+
+public:
+	/*
+	 * Creates dir if it doesn't exist. Must be constructed with a current GL
+	 * context. Does nothing if the driver supports no binary formats.
+	 */
+	explicit ProgramBinaryCache(const std::string& dir);
+
+	static uint64_t hash(const void* data, size_t size, uint64_t h = 14695981039346656037ull);
+
+	bool isSupported() const {
+		return m_supported;
+	}
+
+	const std::string& directory() const {
+		return m_dir;
+	}
+
+	const Stats& stats() const {
+		return m_stats;
+	}
+
+	/*
+	 * Key of a program built from preprocessed sources, one per stage
+	 */
+	uint64_t key(const Sources& sources) const;
+
+	/*
+	 * Key of a program from the hashes of its sources, for sources hashed
+	 * when they were built into the binary
+	 */
+	uint64_t key(const SourceHashes& hashes) const;
+
+	/*
+	 * A linked program created from the cached binary, or 0 if there is
+	 * none or the driver rejected it
+	 */
+	GLuint load(uint64_t key);
+
+	/*
+	 * Writes program's binary. The program must have been linked with
+	 * GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.
+	 */
+	void store(uint64_t key, GLuint program);
+};
+
+}
+
+#endif /* PROGRAM_BINARY_CACHE_H_ */
@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "thread_pool.h"
+
+#ifndef GFX_UTILS_RADIX_SORT_H_
+#define GFX_UTILS_RADIX_SORT_H_
+
+namespace gfx {
+
+/*
+ * Stable LSD radix sort of elements by a 64 bit key, one byte per pass.
+ * key(element) must return a uint64_t. Passes over bytes which are equal in
+ * every key are skipped, so keys only using their upper bits cost no more
+ * than short keys.
+ *
+ * scratch is resized to data.size() and left holding garbage; keep it around
+ * between calls to avoid reallocating. With a pool, every pass is split into
+ * one chunk per thread: each chunk builds its own histogram and scatters into
+ * its own slice of every bucket, which keeps the sort stable.
+ */
+template <class T, class KeyFn>
+void radixSort(std::vector<T>& data, std::vector<T>& scratch, KeyFn key, ThreadPool* pool = nullptr) {
+	typedef std::array<size_t, 256> Histogram;
+
+	// Below this many elements per chunk, threading costs more than it saves
+	const size_t MIN_CHUNK_SIZE = 4096;
+
+	const size_t n = data.size();
+	if(n < 2) {
+		return;
+	}
+	scratch.resize(n);
+
+	size_t numChunks = pool ? pool->numThreads() : 1;
+	numChunks = std::max<size_t>(1, std::min(numChunks, n / MIN_CHUNK_SIZE));
+	const size_t chunkSize = (n + numChunks - 1) / numChunks;
+
+	auto forEachChunk = [&](const std::function<void(size_t, size_t, size_t)>& fn) {
+		auto chunkFn = [&](size_t c) {
+			const size_t begin = c * chunkSize;
+			const size_t end = std::min(n, begin + chunkSize);
+			fn(c, begin, end);
+		};
+		if(numChunks > 1) {
+			pool->parallelFor(numChunks, chunkFn);
+		} else {
+			chunkFn(0);
+		}
+	};
+
+	// Find the bytes which differ between any two keys
+	std::vector<uint64_t> chunkDiffs(numChunks, 0);
+	const uint64_t firstKey = key(data[0]);
+	forEachChunk([&](size_t c, size_t begin, size_t end) {
+		uint64_t diff = 0;
+		for(size_t i = begin; i < end; i++) {
+			diff |= key(data[i]) ^ firstKey;
+		}
+		chunkDiffs[c] = diff;
+	});
+	uint64_t diff = 0;
+	for(uint64_t d : chunkDiffs) {
+		diff |= d;
+	}
+
+	std::vector<Histogram> offsets(numChunks);
+	T* src = data.data();
+	T* dst = scratch.data();
+	bool swapped = false;
+
+	for(unsigned shift = 0; shift < 64; shift += 8) {
+		if(((diff >> shift) & 0xff) == 0) {
+			continue;
+		}
+
+		forEachChunk([&](size_t c, size_t begin, size_t end) {
+			Histogram& hist = offsets[c];
+			hist.fill(0);
+			for(size_t i = begin; i < end; i++) {
+				hist[(key(src[i]) >> shift) & 0xff] += 1;
+			}
+		});
+
+		// Turn the counts into output offsets, bucket major then chunk
+		size_t total = 0;
+		for(size_t digit = 0; digit < 256; digit++) {
+			for(size_t c = 0; c < numChunks; c++) {
+				const size_t count = offsets[c][digit];
+				offsets[c][digit] = total;
+				total += count;
+			}
+		}
+
+		forEachChunk([&](size_t c, size_t begin, size_t end) {
+			Histogram& offset = offsets[c];
+			for(size_t i = begin; i < end; i++) {
+				dst[offset[(key(src[i]) >> shift) & 0xff]++] = src[i];
+			}
+		});
+
+		std::swap(src, dst);
+		swapped = !swapped;
+	}
+
+	if(swapped) {
+		data.swap(scratch);
+	}
+}
+
+}
+
+#endif /* GFX_UTILS_RADIX_SORT_H_ */
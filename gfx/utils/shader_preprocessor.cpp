@@ -0,0 +1,288 @@
+#include "shader_preprocessor.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace utils {
+
+namespace {
+
+bool isSpace(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+size_t skipSpaces(const std::string& s, size_t i, size_t end) {
+	while(i < end && isSpace(s[i])) {
+		i++;
+	}
+	return i;
+}
+
+size_t skipWord(const std::string& s, size_t i, size_t end) {
+	while(i < end && !isSpace(s[i])) {
+		i++;
+	}
+	return i;
+}
+
+bool fileExists(const std::string& path) {
+	struct stat buf;
+	return stat(path.c_str(), &buf) == 0 && S_ISREG(buf.st_mode);
+}
+
+std::string directoryOf(const std::string& path) {
+	const size_t slash = path.find_last_of('/');
+	return slash == std::string::npos ? std::string() : path.substr(0, slash);
+}
+
+std::string readFile(const std::string& path) {
+	const int fd = open(path.c_str(), O_RDONLY);
+	if(fd == -1) {
+		throw std::runtime_error("Error reading file " + path + " with ERRNO: " + strerror(errno));
+	}
+
+	struct stat buf;
+	if(fstat(fd, &buf) != 0) {
+		const int error = errno;
+		close(fd);
+		throw std::runtime_error("Error reading file " + path + " with ERRNO: " + strerror(error));
+	}
+
+	std::string ret;
+	if(buf.st_size > 0) {
+		void* data = mmap(nullptr, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(data == MAP_FAILED) {
+			const int error = errno;
+			close(fd);
+			throw std::runtime_error("Error reading file " + path + " with ERRNO: " + strerror(error));
+		}
+		ret.assign(static_cast<const char*>(data), buf.st_size);
+		munmap(data, buf.st_size);
+	}
+	close(fd);
+	return ret;
+}
+
+}
+
+struct ShaderPreprocessor::Expansion {
+	std::string version = "330";
+	std::string body;
+	std::vector<std::string> files;
+
+	// Files already included and the chain of files being expanded
+	std::unordered_set<const ShaderSource*> included;
+	std::vector<const ShaderSource*> stack;
+};
+
+std::string ShaderPreprocessor::defineDirectives(const ShaderDefines& defines) {
+	std::string ret;
+	for(const auto& define : defines) {
+		ret.append("#define ").append(define.first).append(" ").append(define.second).append("\n");
+	}
+	return ret;
+}
+
+PreprocessedShader ShaderPreprocessor::finish(Expansion& state, const ShaderDefines& defines) {
+	PreprocessedShader ret;
+	ret.source.reserve(state.body.size() + 64);
+	ret.source.append("#version ").append(state.version).append("\n");
+	ret.source.append(defineDirectives(defines));
+	ret.source.append(state.body);
+	ret.files = std::move(state.files);
+	return ret;
+}
+
+std::shared_ptr<ShaderSource> ShaderPreprocessor::parse(const std::string& path, std::string text) {
+	std::shared_ptr<ShaderSource> ret = std::make_shared<ShaderSource>();
+	ret->path = path;
+	if(!text.empty() && text.back() != '\n') {
+		text.push_back('\n');
+	}
+	ret->text = std::move(text);
+
+	const std::string& s = ret->text;
+	size_t lineStart = 0;
+	size_t lineNumber = 1;
+	while(lineStart < s.size()) {
+		const size_t lineEnd = s.find('\n', lineStart);
+		const size_t next = lineEnd + 1;
+
+		ShaderSource::Chunk directive { ShaderSource::TEXT, 0, 0, 0, std::string() };
+		size_t i = skipSpaces(s, lineStart, lineEnd);
+		if(i < lineEnd && s[i] == '#') {
+			i = skipSpaces(s, i + 1, lineEnd);
+			const size_t nameEnd = skipWord(s, i, lineEnd);
+			const std::string name = s.substr(i, nameEnd - i);
+
+			if(name == "version") {
+				size_t argBegin = skipSpaces(s, nameEnd, lineEnd);
+				size_t argEnd = lineEnd;
+				while(argEnd > argBegin && isSpace(s[argEnd - 1])) {
+					argEnd--;
+				}
+				if(argBegin == argEnd) {
+					throw std::runtime_error("Error: #version directive without a version in " + path);
+				}
+
+				// Normalize the whitespace between the version and the profile
+				std::string version;
+				while(argBegin < argEnd) {
+					const size_t wordEnd = skipWord(s, argBegin, argEnd);
+					version.append(version.empty() ? "" : " ").append(s, argBegin, wordEnd - argBegin);
+					argBegin = skipSpaces(s, wordEnd, argEnd);
+				}
+				directive.type = ShaderSource::VERSION;
+				directive.arg = version;
+			} else if(name == "pragma") {
+				const size_t pragmaBegin = skipSpaces(s, nameEnd, lineEnd);
+				const size_t pragmaEnd = skipWord(s, pragmaBegin, lineEnd);
+				if(s.compare(pragmaBegin, pragmaEnd - pragmaBegin, "include") == 0) {
+					const size_t fileBegin = skipSpaces(s, pragmaEnd, lineEnd);
+					const size_t fileEnd = skipWord(s, fileBegin, lineEnd);
+					if(fileEnd - fileBegin < 3 || (s[fileBegin] != '"' && s[fileBegin] != '<') ||
+							(s[fileEnd - 1] != '"' && s[fileEnd - 1] != '>')) {
+						throw std::runtime_error("Error: malformed #pragma include in " + path +
+								" line " + std::to_string(lineNumber));
+					}
+					directive.type = ShaderSource::INCLUDE;
+					directive.arg = s.substr(fileBegin + 1, fileEnd - fileBegin - 2);
+				} else if(s.compare(pragmaBegin, pragmaEnd - pragmaBegin, "once") == 0) {
+					// Every file is only included once anyway, drop the line
+					directive.type = ShaderSource::INCLUDE;
+				}
+			}
+		}
+
+		if(directive.type != ShaderSource::TEXT) {
+			if(!directive.arg.empty()) {
+				ret->chunks.push_back(std::move(directive));
+			}
+		} else if(!ret->chunks.empty() && ret->chunks.back().type == ShaderSource::TEXT &&
+				ret->chunks.back().end == lineStart) {
+			// Extend the current run of text
+			ret->chunks.back().end = next;
+		} else {
+			ret->chunks.push_back({ ShaderSource::TEXT, lineStart, next, lineNumber, std::string() });
+		}
+
+		lineStart = next;
+		lineNumber += 1;
+	}
+	return ret;
+}
+
+void ShaderPreprocessor::addIncludeDir(const std::string& dir) {
+	m_includeDirs.push_back(dir);
+	m_resolved.clear();
+}
+
+std::shared_ptr<const ShaderSource> ShaderPreprocessor::load(const std::string& path) {
+	auto it = m_files.find(path);
+	if(it == m_files.end()) {
+		it = m_files.emplace(path, parse(path, readFile(path))).first;
+		m_numParsed += 1;
+	}
+	return it->second;
+}
+
+std::string ShaderPreprocessor::resolve(const std::string& name, const std::string& includer) {
+	const std::string includerDir = directoryOf(includer);
+	const std::string key = includerDir + '\n' + name;
+	auto it = m_resolved.find(key);
+	if(it != m_resolved.end()) {
+		return it->second;
+	}
+
+	std::vector<std::string> candidates { name };
+	if(!includerDir.empty()) {
+		candidates.push_back(includerDir + "/" + name);
+	}
+	for(const std::string& dir : m_includeDirs) {
+		candidates.push_back(dir + "/" + name);
+	}
+
+	for(const std::string& candidate : candidates) {
+		if(fileExists(candidate)) {
+			m_resolved.emplace(key, candidate);
+			return candidate;
+		}
+	}
+	throw std::runtime_error("Error: Could not find included file " + name +
+			(includer.empty() ? std::string() : " included from " + includer));
+}
+
+void ShaderPreprocessor::expand(const ShaderSource& file, size_t fileIndex, Expansion& state) {
+	state.stack.push_back(&file);
+	for(const ShaderSource::Chunk& chunk : file.chunks) {
+		switch(chunk.type) {
+		case ShaderSource::TEXT:
+			state.body.append("#line ").append(std::to_string(chunk.line)).append(" ")
+					.append(std::to_string(fileIndex)).append("\n");
+			state.body.append(file.text, chunk.begin, chunk.end - chunk.begin);
+			break;
+		case ShaderSource::VERSION:
+			state.version = chunk.arg;
+			break;
+		case ShaderSource::INCLUDE: {
+			const std::shared_ptr<const ShaderSource> included = load(resolve(chunk.arg, file.path));
+			if(std::find(state.stack.begin(), state.stack.end(), included.get()) != state.stack.end()) {
+				std::string cycle;
+				for(const ShaderSource* f : state.stack) {
+					cycle.append(f->path.empty() ? "<source>" : f->path).append(" -> ");
+				}
+				throw std::runtime_error("Error: include cycle " + cycle + included->path);
+			}
+			if(!state.included.insert(included.get()).second) {
+				break;
+			}
+			state.files.push_back(included->path);
+			expand(*included, state.files.size() - 1, state);
+			break;
+		}
+		}
+	}
+	state.stack.pop_back();
+}
+
+PreprocessedShader ShaderPreprocessor::preprocess(const std::string& source, const ShaderDefines& defines) {
+	std::shared_ptr<ShaderSource> parsed = parse(std::string(), source);
+
+	Expansion state;
+	state.files.push_back(std::string());
+	state.body.reserve(source.size() * 2);
+	expand(*parsed, 0, state);
+
+	return finish(state, defines);
+}
+
+PreprocessedShader ShaderPreprocessor::preprocessFile(const std::string& path, const ShaderDefines& defines) {
+	const std::shared_ptr<const ShaderSource> file = load(path);
+
+	Expansion state;
+	state.files.push_back(path);
+	state.included.insert(file.get());
+	state.body.reserve(file->text.size() * 2);
+	expand(*file, 0, state);
+
+	return finish(state, defines);
+}
+
+void ShaderPreprocessor::invalidate(const std::string& path) {
+	m_files.erase(path);
+}
+
+void ShaderPreprocessor::clear() {
+	m_files.clear();
+	m_resolved.clear();
+}
+
+}
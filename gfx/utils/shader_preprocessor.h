@@ -0,0 +1,113 @@
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifndef SHADER_PREPROCESSOR_H_
+#define SHADER_PREPROCESSOR_H_
+
+namespace utils {
+
+typedef std::vector<std::pair<std::string, std::string>> ShaderDefines;
+
+/*
+ * A shader source file parsed into runs of plain text lines and the
+ * directives the preprocessor handles: #version and #pragma include.
+ */
+struct ShaderSource {
+	enum ChunkType { TEXT, INCLUDE, VERSION };
+
+	struct Chunk {
+		ChunkType type;
+
+		// TEXT: byte range in text and the line it starts on, from 1
+		size_t begin;
+		size_t end;
+		size_t line;
+
+		// INCLUDE: file name, VERSION: the version and profile
+		std::string arg;
+	};
+
+	std::string path;
+	std::string text;
+	std::vector<Chunk> chunks;
+};
+
+/*
+ * Output of ShaderPreprocessor::preprocess(). files are the paths of the
+ * main source and of every file included, indexed by the source string
+ * numbers of the #line directives, so compile errors reported as
+ * "<number>(<line>)" can be traced back to a file.
+ */
+struct PreprocessedShader {
+	std::string source;
+	std::vector<std::string> files;
+};
+
+/*
+ * Expands #pragma include "file" directives to any depth. Each file is
+ * included at most once per shader, as if it had an include guard, and an
+ * include cycle is an error. The output starts with the shader's #version
+ * (330 if it has none) followed by the external defines, and every run of
+ * text is preceded by a #line directive mapping it back to its file.
+ *
+ * Files are read (through mmap) and parsed once, then reused by every
+ * shader including them until invalidate() or clear(). Include names are
+ * resolved once per including directory: as given, relative to the
+ * including file, then in each include directory.
+ */
+class ShaderPreprocessor {
+	std::vector<std::string> m_includeDirs;
+
+	std::unordered_map<std::string, std::shared_ptr<const ShaderSource>> m_files;
+	std::unordered_map<std::string, std::string> m_resolved;
+	size_t m_numParsed = 0;
+
+	struct Expansion;
+
+	std::shared_ptr<const ShaderSource> load(const std::string& path);
+	std::string resolve(const std::string& name, const std::string& includer);
+	void expand(const ShaderSource& file, size_t fileIndex, Expansion& state);
+	static PreprocessedShader finish(Expansion& state, const ShaderDefines& defines);
+
+public:
+	static std::shared_ptr<ShaderSource> parse(const std::string& path, std::string text);
+
+	/*
+	 * The #define lines preprocess() puts after the #version line
+	 */
+	static std::string defineDirectives(const ShaderDefines& defines);
+
+	void addIncludeDir(const std::string& dir);
+
+	const std::vector<std::string>& includeDirs() const {
+		return m_includeDirs;
+	}
+
+	PreprocessedShader preprocess(const std::string& source,
+			const ShaderDefines& defines = ShaderDefines());
+
+	PreprocessedShader preprocessFile(const std::string& path,
+			const ShaderDefines& defines = ShaderDefines());
+
+	/*
+	 * Forgets a file, so it is read again the next time it is used
+	 */
+	void invalidate(const std::string& path);
+
+	void clear();
+
+	/*
+	 * Number of files read and parsed so far
+	 */
+	size_t numParsedFiles() const {
+		return m_numParsed;
+	}
+};
+
+}
+
+#endif /* SHADER_PREPROCESSOR_H_ */
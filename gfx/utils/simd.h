@@ -0,0 +1,44 @@
+#ifndef GFX_UTILS_SIMD_H_
+#define GFX_UTILS_SIMD_H_
+
+#if defined(__x86_64__) || defined(__i386__)
+#define GFX_SIMD_X86 1
+#endif
+
+namespace gfx {
+
+/*
+ * Instruction sets the CPU kernels (culling, batch matrix math) can use.
+ * Kernels are compiled for every level with target attributes and the
+ * level is picked at run time, scalar code is used on other architectures.
+ */
+enum class SimdLevel { SCALAR, SSE, AVX };
+
+inline bool isSimdLevelSupported(SimdLevel level) {
+	switch(level) {
+	case SimdLevel::SCALAR:
+		return true;
+#ifdef GFX_SIMD_X86
+	case SimdLevel::SSE:
+		return __builtin_cpu_supports("sse2");
+	case SimdLevel::AVX:
+		return __builtin_cpu_supports("avx");
+#endif
+	default:
+		return false;
+	}
+}
+
+/*
+ * The fastest level supported by this build and CPU
+ */
+inline SimdLevel bestSimdLevel() {
+	static const SimdLevel best =
+			isSimdLevelSupported(SimdLevel::AVX) ? SimdLevel::AVX :
+			isSimdLevelSupported(SimdLevel::SSE) ? SimdLevel::SSE : SimdLevel::SCALAR;
+	return best;
+}
+
+}
+
+#endif /* GFX_UTILS_SIMD_H_ */
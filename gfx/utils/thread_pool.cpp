@@ -0,0 +1,92 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+#include <boost/assert.hpp>
+
+namespace gfx {
+
+ThreadPool::ThreadPool(size_t numThreads) : m_nextIndex(0) {
+	if(numThreads == 0) {
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	for(size_t i = 1; i < numThreads; i++) {
+		m_workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wakeCondition.notify_all();
+
+	for(std::thread& worker : m_workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::runJobItems() {
+	for(size_t i = m_nextIndex++; i < m_jobSize; i = m_nextIndex++) {
+		(*m_job)(i);
+	}
+}
+
+void ThreadPool::workerLoop() {
+	size_t lastGeneration = 0;
+
+	for(;;) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wakeCondition.wait(lock, [&]() { return m_stop || m_generation != lastGeneration; });
+			if(m_stop) {
+				return;
+			}
+			lastGeneration = m_generation;
+			m_numBusy += 1;
+		}
+
+		runJobItems();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_numBusy -= 1;
+		}
+		m_doneCondition.notify_one();
+	}
+}
+
+void ThreadPool::parallelFor(size_t n, const std::function<void(size_t)>& fn) {
+	if(n == 0) {
+		return;
+	}
+
+	if(m_workers.empty() || n == 1) {
+		for(size_t i = 0; i < n; i++) {
+			fn(i);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		BOOST_ASSERT_MSG(m_job == nullptr, "Error: ThreadPool::parallelFor is not reentrant");
+		m_job = &fn;
+		m_jobSize = n;
+		m_nextIndex = 0;
+		m_generation += 1;
+	}
+	m_wakeCondition.notify_all();
+
+	runJobItems();
+
+	// Workers which woke up late find no items left and leave straight away,
+	// but they still read m_job so wait for all of them before clearing it
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_doneCondition.wait(lock, [&]() { return m_numBusy == 0 && m_nextIndex >= m_jobSize; });
+	m_job = nullptr;
+}
+
+}
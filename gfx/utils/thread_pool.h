@@ -0,0 +1,70 @@
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef GFX_UTILS_THREAD_POOL_H_
+#define GFX_UTILS_THREAD_POOL_H_
+
+namespace gfx {
+
+/*
+ * A fixed set of worker threads for data parallel CPU work (sorting, culling,
+ * recording). The calling thread takes part in every job, so a pool with zero
+ * workers runs everything inline.
+ *
+ * Jobs must not make GL calls: only the thread owning the context may do that.
+ */
+class ThreadPool {
+	std::vector<std::thread> m_workers;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wakeCondition;
+	std::condition_variable m_doneCondition;
+
+	// The job currently being run. m_generation is bumped for every new job so
+	// sleeping workers can tell it apart from the previous one.
+	const std::function<void(size_t)>* m_job = nullptr;
+	size_t m_jobSize = 0;
+	size_t m_generation = 0;
+	size_t m_numBusy = 0;
+	bool m_stop = false;
+
+	std::atomic<size_t> m_nextIndex;
+
+	void workerLoop();
+	void runJobItems();
+
+public:
+	/*
+	 * Creates numThreads - 1 workers; together with the caller numThreads
+	 * threads run each job. 0 means one per hardware thread.
+	 */
+	explicit ThreadPool(size_t numThreads = 0);
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	~ThreadPool();
+
+	/*
+	 * Number of threads running a job, including the caller
+	 */
+	size_t numThreads() const {
+		return m_workers.size() + 1;
+	}
+
+	/*
+	 * Calls fn(i) for every i in [0, n) and returns once all calls have
+	 * finished. Items are handed out one at a time, so give each item a
+	 * reasonable amount of work. Not reentrant.
+	 */
+	void parallelFor(size_t n, const std::function<void(size_t)>& fn);
+};
+
+}
+
+#endif /* GFX_UTILS_THREAD_POOL_H_ */
@@ -0,0 +1,95 @@
+#include "transform_hierarchy.h"
+
+#include <algorithm>
+
+#include <boost/assert.hpp>
+
+namespace gfx {
+
+const uint32_t TransformHierarchy::INVALID_INDEX;
+
+namespace {
+
+glm::mat4 composeTRS(const glm::vec3& t, const glm::quat& r, const glm::vec3& s) {
+	const glm::mat3 rot = glm::mat3_cast(r);
+	glm::mat4 m(1.0f);
+	for(int c = 0; c < 3; c++) {
+		for(int row = 0; row < 3; row++) {
+			m[c][row] = rot[c][row] * s[c];
+		}
+	}
+	m[3] = glm::vec4(t, 1.0f);
+	return m;
+}
+
+}
+
+void TransformHierarchy::reserve(size_t n) {
+	m_parents.reserve(n);
+	m_translations.reserve(n);
+	m_rotations.reserve(n);
+	m_scales.reserve(n);
+	m_world.reserve(n);
+	m_dirty.reserve(n);
+}
+
+void TransformHierarchy::clear() {
+	m_parents.clear();
+	m_translations.clear();
+	m_rotations.clear();
+	m_scales.clear();
+	m_world.clear();
+	m_dirty.clear();
+	m_firstDirty = 0;
+}
+
+uint32_t TransformHierarchy::add(uint32_t parent, const glm::vec3& translation, const glm::quat& rotation,
+		const glm::vec3& scale) {
+	BOOST_ASSERT_MSG(parent == INVALID_INDEX || parent < m_parents.size(),
+			"Error: TransformHierarchy parents must be added before their children");
+
+	const uint32_t node = static_cast<uint32_t>(m_parents.size());
+	m_parents.push_back(parent);
+	m_translations.push_back(translation);
+	m_rotations.push_back(rotation);
+	m_scales.push_back(scale);
+	m_world.push_back(glm::mat4(1.0f));
+	m_dirty.push_back(0);
+	markDirty(node);
+	return node;
+}
+
+size_t TransformHierarchy::update() {
+	const size_t n = m_parents.size();
+	size_t numUpdated = 0;
+	for(size_t i = m_firstDirty; i < n; i++) {
+		const uint32_t p = m_parents[i];
+		if(!m_dirty[i]) {
+			// Parents come first, so a dirty parent has already been updated
+			if(p == INVALID_INDEX || !m_dirty[p]) {
+				continue;
+			}
+			m_dirty[i] = 1;
+		}
+
+		const glm::mat4 local = composeTRS(m_translations[i], m_rotations[i], m_scales[i]);
+		m_world[i] = p == INVALID_INDEX ? local : m_world[p] * local;
+		numUpdated += 1;
+	}
+
+	if(m_firstDirty < n) {
+		std::fill(m_dirty.begin() + m_firstDirty, m_dirty.end(), 0);
+	}
+	m_firstDirty = n;
+	return numUpdated;
+}
+
+void TransformHierarchy::computeViewMatrices(const glm::mat4& view, const glm::mat4& projection, const uint32_t* nodes,
+		size_t numNodes, void* dst, size_t stride) const {
+	for(size_t i = 0; i < numNodes; i++) {
+		BOOST_ASSERT_MSG(nodes[i] < m_world.size(), "Error: TransformHierarchy node out of range");
+	}
+	computeObjectMatrices(view, projection, m_world.data(), nodes, numNodes, dst, stride);
+}
+
+}
@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "matrix_batch.h"
+
+#ifndef GFX_UTILS_TRANSFORM_HIERARCHY_H_
+#define GFX_UTILS_TRANSFORM_HIERARCHY_H_
+
+namespace gfx {
+
+/*
+ * Scene graph transforms: every node has a local translation, rotation and
+ * scale relative to its parent and a world matrix.
+ *
+ * Nodes are stored as separate arrays, in topological order: a parent is
+ * always added before its children, so one forward pass over the arrays
+ * sees every parent before its children. Setting a node's local transform
+ * marks it dirty, and update() only recomputes the world matrices of dirty
+ * nodes and their descendants, starting at the first dirty node.
+ *
+ * computeViewMatrices() then produces the modelview, modelview projection
+ * and normal matrices of the nodes being drawn in one batch, instead of per
+ * draw.
+ */
+class TransformHierarchy {
+public:
+	static const uint32_t INVALID_INDEX = ~0u;
+
+private:
+	std::vector<uint32_t> m_parents;
+	std::vector<glm::vec3> m_translations;
+	std::vector<glm::quat> m_rotations;
+	std::vector<glm::vec3> m_scales;
+	std::vector<glm::mat4> m_world;
+	std::vector<uint8_t> m_dirty;
+
+	// Nothing before this index is dirty
+	size_t m_firstDirty = 0;
+
+	void markDirty(uint32_t node) {
+		m_dirty[node] = 1;
+		m_firstDirty = std::min(m_firstDirty, static_cast<size_t>(node));
+	}
+
+public:
+	size_t size() const {
+		return m_parents.size();
+	}
+
+	void reserve(size_t n);
+
+	void clear();
+
+	/*
+	 * Adds a node and returns its index. parent must already exist.
+	 */
+	uint32_t add(uint32_t parent = INVALID_INDEX, const glm::vec3& translation = glm::vec3(0.0f),
+			const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f), const glm::vec3& scale = glm::vec3(1.0f));
+
+	uint32_t parent(uint32_t node) const {
+		return m_parents[node];
+	}
+
+	const glm::vec3& translation(uint32_t node) const {
+		return m_translations[node];
+	}
+
+	const glm::quat& rotation(uint32_t node) const {
+		return m_rotations[node];
+	}
+
+	const glm::vec3& scale(uint32_t node) const {
+		return m_scales[node];
+	}
+
+	void setTranslation(uint32_t node, const glm::vec3& translation) {
+		m_translations[node] = translation;
+		markDirty(node);
+	}
+
+	void setRotation(uint32_t node, const glm::quat& rotation) {
+		m_rotations[node] = rotation;
+		markDirty(node);
+	}
+
+	void setScale(uint32_t node, const glm::vec3& scale) {
+		m_scales[node] = scale;
+		markDirty(node);
+	}
+
+	void setLocal(uint32_t node, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale) {
+		m_translations[node] = translation;
+		m_rotations[node] = rotation;
+		m_scales[node] = scale;
+		markDirty(node);
+	}
+
+	bool isDirty(uint32_t node) const {
+		return m_dirty[node] != 0;
+	}
+
+	/*
+	 * World matrix of a node as of the last update()
+	 */
+	const glm::mat4& world(uint32_t node) const {
+		return m_world[node];
+	}
+
+	const std::vector<glm::mat4>& worldMatrices() const {
+		return m_world;
+	}
+
+	/*
+	 * Brings the world matrices of dirty nodes and their descendants up to
+	 * date and returns how many were recomputed
+	 */
+	size_t update();
+
+	/*
+	 * Writes the ObjectMatrices of numNodes nodes to dst, one every stride
+	 * bytes, see computeObjectMatrices()
+	 */
+	void computeViewMatrices(const glm::mat4& view, const glm::mat4& projection, const uint32_t* nodes,
+			size_t numNodes, void* dst, size_t stride = sizeof(ObjectMatrices)) const;
+};
+
+}
+
+#endif /* GFX_UTILS_TRANSFORM_HIERARCHY_H_ */
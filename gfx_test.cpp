@@ -1,5 +1,7 @@
+#include <array>
 #include <string>
 #include <iostream>
+#include <stdexcept>
 
 #include <glm/glm.hpp>
 #include <boost/assert.hpp>
@@ -8,6 +10,7 @@
 #include "gfx/graphicscontext.h"
 #include "gfx/utils/3dshapes.h"
 #include "gfx/utils/camera.h"
+#include "gfx/utils/transform_hierarchy.h"
 #include "gfx/utils/vertex.h"
 
 using namespace glm;
@@ -18,28 +21,36 @@ typedef Vertex4P3N2T Vertex;
 typedef gfx::GBufHandle<Vertex> GBufHdl;
 typedef gfx::ShaderProgramHandle ProgHdl;
 
-struct Material {
-	vec4 diffuse;
-	vec4 specular;
-	float shininess;
-	float reflectance;
+// Laid out like the Material and Light structs in gfx/shaders/glsl330/stddefs.glsl
+struct Material : Std140Tuple<vec4, vec4, float, float> {
+	vec4& diffuse() { return get<0>(); }
+	vec4& specular() { return get<1>(); }
+	float& shininess() { return get<2>(); }
+	float& reflectance() { return get<3>(); }
 };
 
-struct Light {
-	vec4 position;
-	vec4 intensity;
-	float attenuation;
-	float enabled;
+struct Light : Std140Tuple<vec4, vec4, float, float> {
+	vec4& position() { return get<0>(); }
+	vec4& intensity() { return get<1>(); }
+	float& attenuation() { return get<2>(); }
+	float& enabled() { return get<3>(); }
+};
+
+// PerFrameLightingBlock
+template <size_t NumLights>
+struct LightingBlock : Std140Tuple<vec4, std::array<Light, NumLights>> {
+	vec4& globalAmbient() { return this->template get<0>(); }
+	std::array<Light, NumLights>& lights() { return this->template get<1>(); }
 };
 
 
 struct App : public SDLGLWindow {
 	static const size_t NUM_LIGHTS = 10;
 
-	Light lights[NUM_LIGHTS];
-	vec4 globalAmbient;
-
-	Material cubeMaterial;
+	// Uniform blocks, uploaded once each when they change instead of
+	// setting every member on every draw
+	UniformBufHandle<LightingBlock<NUM_LIGHTS>> lighting;
+	UniformBufHandle<Material> cubeMaterial;
 
 	FirstPersonCamera camera;
 
@@ -47,8 +58,27 @@ struct App : public SDLGLWindow {
 	GBufHdl sphereGeometry;
 	GBufHdl planeGeometry;
 
+	// Lit with every light, through the physically based BRDF
+	ShaderVariantsHandle litVariants;
 	ProgHdl program;
 
+	// Uniforms set once per frame, looked up once after the program is built
+	struct {
+		UniformHandle<mat4> view;
+	} uniforms;
+
+	// Object transforms, with modelview and normal matrices computed for
+	// every drawn node once per frame straight into the uniform ring, and
+	// bound per draw as ranges of it
+	TransformHierarchy transforms;
+	uint32_t cubeNode, sphereNode, planeNode;
+	std::vector<uint32_t> drawnNodes;
+	UniformRingHandle drawUniforms;
+	std::vector<UniformRange> drawRanges;
+
+	// The sphere is the most expensive object, skip it when it is hidden
+	OcclusionQueriesHandle sphereQueries;
+
 	gfx::GraphicsContext* ctx = nullptr;
 
 	App(size_t w, size_t h) :
@@ -57,47 +87,49 @@ struct App : public SDLGLWindow {
 	}
 
 	void setupLights() {
-	    globalAmbient = vec4(0.0001f);
+	    std::array<Light, NUM_LIGHTS>& lights = lighting->data().lights();
+	    lighting->data().globalAmbient() = vec4(0.0001f);
 	    const vec4 center(0.0, 15.0, -5.0, 1.0);
 	    const vec2 squareSize(42.5);
 	    for(int i = 0; i < 3; i++) {
 	      for(int j = 0; j < 3; j++) {
 	        const size_t light_index = 3 * i + j;
 	        const vec4 offset((i-1)*squareSize.x/2.0, 0.0, (j-1)*squareSize.y/2.0, 0.0);
-	        lights[light_index].intensity = vec4(0.5, 0.5, 0.5, 1.0);
-	        lights[light_index].position = center + offset;
-	        lights[light_index].attenuation = 1.0 / pow(25.0, 2.0);
+	        lights[light_index].intensity() = vec4(0.5, 0.5, 0.5, 1.0);
+	        lights[light_index].position() = center + offset;
+	        lights[light_index].attenuation() = 1.0 / pow(25.0, 2.0);
 	      }
 	    }
 
-	    lights[9].position = vec4(0.0, 2.0, -5.0, 1.0);
-	    lights[9].intensity = vec4(0.3525, 0.3525, 0.3525, 1.0);
-	    lights[9].attenuation = 1.0 / pow(20.0, 2.0);
+	    lights[9].position() = vec4(0.0, 2.0, -5.0, 1.0);
+	    lights[9].intensity() = vec4(0.3525, 0.3525, 0.3525, 1.0);
+	    lights[9].attenuation() = 1.0 / pow(20.0, 2.0);
+	    lighting->upload();
 	}
 
-	void setupStdUniforms(ProgHdl hdl, const mat4& model = mat4(1.0)) {
-		if(hdl->hasUniform("std_Modelview"))
-			hdl->setUniform("std_Modelview", camera.getViewMatrix() * model);
-		if(hdl->hasUniform("std_Projection"))
-			hdl->setUniform("std_Projection", camera.getProjectionMatrix());
-		if(hdl->hasUniform("std_Normal"))
-			hdl->setUniform("std_Normal", mat4(transpose(inverse(mat3(camera.getViewMatrix() * model)))));
-		if(hdl->hasUniform("std_View"))
-			hdl->setUniform("std_View", camera.getViewMatrix());
-		if(hdl->hasUniform("std_GlobalAmbient"))
-			hdl->setUniform("std_GlobalAmbient", globalAmbient);
+	void lookupUniforms(ProgHdl hdl) {
+		uniforms.view = hdl->uniformHandle<mat4>("std_View");
+	}
 
-		#define __APP_LIGHT_UNAME(i, name) (string("std_Lights[") + to_string(i) + string("].") + string(name))
-	    for(size_t i = 0; i < NUM_LIGHTS; i++) {
-	    	if(hdl->hasUniform(__APP_LIGHT_UNAME(i, "position")))
-	    		hdl->setUniform(__APP_LIGHT_UNAME(i, "position"), lights[i].position);
-	    	if(hdl->hasUniform(__APP_LIGHT_UNAME(i, "color")))
-	    		hdl->setUniform(__APP_LIGHT_UNAME(i, "color"), lights[i].intensity);
-	    	if(hdl->hasUniform(__APP_LIGHT_UNAME(i, "attenuation")))
-	    		hdl->setUniform(__APP_LIGHT_UNAME(i, "attenuation"), lights[i].attenuation);
+	void bindUniformBlocks(ProgHdl hdl) {
+		checkBlockSize(hdl, "PerFrameLightingBlock", sizeof(LightingBlock<NUM_LIGHTS>));
+		checkBlockSize(hdl, "MaterialBlock", sizeof(Material));
+		checkBlockSize(hdl, "PerDrawMatrixBlock", sizeof(ObjectMatrices));
+		hdl->setUniformBlockBinding("PerFrameLightingBlock", PER_FRAME_LIGHT_BLOCK_BINDING);
+		hdl->setUniformBlockBinding("MaterialBlock", MATERIAL_BLOCK_BINDING);
+		hdl->setUniformBlockBinding("PerDrawMatrixBlock", PER_DRAW_MATRIX_BLOCK_BINDING);
+	}
 
-	    }
-		#undef __APP_LIGHT_UNAME
+	void checkBlockSize(ProgHdl hdl, const string& name, size_t size) {
+		const ProgramBlock* block = hdl->reflection().uniformBlock(name);
+		if(block && static_cast<size_t>(block->dataSize) != size) {
+			throw runtime_error("Error: uniform block " + name + " is " + to_string(block->dataSize) +
+					" bytes but its tuple is " + to_string(size));
+		}
+	}
+
+	void setupStdUniforms(ProgHdl hdl) {
+		hdl->setUniform(uniforms.view, camera.getViewMatrix());
 	}
 
 	void printStdUniforms(ProgHdl hdl) {
@@ -109,44 +141,64 @@ struct App : public SDLGLWindow {
 			cout << "std_Normal: " << to_string(hdl->getUniform<mat4>("std_Normal")) << endl;
 		if(hdl->hasUniform("std_View"))
 			cout << "std_View: " << to_string(hdl->getUniform<mat4>("std_View")) << endl;
-		if(hdl->hasUniform("std_GlobalAmbient"))
-			cout << "std_GlobalAmbient: " << to_string(hdl->getUniform<vec4>("std_GlobalAmbient")) << endl;
 
-		#define __APP_LIGHT_UNAME(i, name) (string("std_Lights[") + to_string(i) + string("].") + string(name))
-	    for(size_t i = 0; i < NUM_LIGHTS; i++) {
-	    	if(hdl->hasUniform(__APP_LIGHT_UNAME(i, "position")))
-	    		cout << __APP_LIGHT_UNAME(i, "position") << ": " << to_string(hdl->getUniform<vec4>(__APP_LIGHT_UNAME(i, "position"))) << endl;
-	    	if(hdl->hasUniform(__APP_LIGHT_UNAME(i, "color")))
-	    		cout << __APP_LIGHT_UNAME(i, "color") << ": " << to_string(hdl->getUniform<vec4>(__APP_LIGHT_UNAME(i, "color"))) << endl;
-	    	if(hdl->hasUniform(__APP_LIGHT_UNAME(i, "attenuation")))
-	    		cout << __APP_LIGHT_UNAME(i, "attenuation") << ": " << to_string(hdl->getUniform<float>(__APP_LIGHT_UNAME(i, "attenuation"))) << endl;
+		cout << "uniform sets: " << hdl->uniformStats().issued << " issued, "
+				<< hdl->uniformStats().elided << " elided" << endl;
 
+		// Block members are printed from the copies the blocks were uploaded from
+		cout << "std_GlobalAmbient: " << to_string(lighting->data().globalAmbient()) << endl;
+	    for(size_t i = 0; i < NUM_LIGHTS; i++) {
+	    	Light& light = lighting->data().lights()[i];
+	    	cout << "std_Lights[" << i << "].position: " << to_string(light.position()) << endl;
+	    	cout << "std_Lights[" << i << "].color: " << to_string(light.intensity()) << endl;
+	    	cout << "std_Lights[" << i << "].attenuation: " << to_string(light.attenuation()) << endl;
 	    }
-		#undef __APP_LIGHT_UNAME
 	}
 
 	void printShaderUtniforms(ProgHdl hdl) {
-	    if(hdl->hasUniform("mat.diffuse"))
-	    	cout << "mat.diffuse: " << to_string(program->getUniform<vec4>("mat.diffuse")) << endl;
-	    if(hdl->hasUniform("mat.specular"))
-	    	cout << "mat.specular: " << to_string(program->getUniform<vec4>("mat.specular")) << endl;
-	    if(hdl->hasUniform("mat.roughness"))
-	    	cout << "mat.roughness: " << to_string(program->getUniform<float>("mat.roughness")) << endl;
-	    if(hdl->hasUniform("mat.reflectance"))
-	    	cout << "mat.reflectance: " << to_string(program->getUniform<float>("mat.reflectance")) << endl;
+	    cout << "mat.diffuse: " << to_string(cubeMaterial->data().diffuse()) << endl;
+	    cout << "mat.specular: " << to_string(cubeMaterial->data().specular()) << endl;
+	    cout << "mat.roughness: " << to_string(cubeMaterial->data().shininess()) << endl;
+	    cout << "mat.reflectance: " << to_string(cubeMaterial->data().reflectance()) << endl;
 	}
 
 	void setup(SDLGLWindow& w) {
 		ctx->enableDepthBuffer();
 		ctx->enableFaceCulling();
 
+		ctx->addShaderProgramIncludeDir("gfx/shaders/glsl330");
+		ctx->enableProgramBinaryCache("shader_cache");
+		litVariants = ctx->makeShaderVariants("gfx/shaders/phong_per_draw_vert.glsl", "gfx/shaders/lit_frag.glsl",
+				{ { "PHYSICAL_BRDF", 1 }, { "NUM_LIGHTS", 4, NUM_LIGHTS } });
+		const ShaderVariantKey physical = litVariants->key({ { "PHYSICAL_BRDF", 1 } });
+		ctx->prewarmShaderVariants(litVariants, { physical });
+		program = ctx->shaderVariant(litVariants, physical);
+
 		cubeGeometry = makeCube<0, 1, 2, Vertex>(*ctx, vec3(3.0));
 		sphereGeometry = makeSphere<0, 1, 2, Vertex>(*ctx, 100, 100, 1.5);
 		planeGeometry = makePlane<0, 1, 2, Vertex>(*ctx, 1, 1, vec2(1000.0));
-
-		ctx->addShaderProgramIncludeDir("gfx/shaders/glsl330");
-		program = ctx->makeShaderProgramFromFiles("gfx/shaders/phong_vertex.glsl",
-				                                  "gfx/shaders/physical_frag.glsl");
+		sphereQueries = ctx->makeOcclusionQueries(1);
+
+		cubeNode = transforms.add();
+		sphereNode = transforms.add(TransformHierarchy::INVALID_INDEX, vec3(10.0, 0.0, 1.0));
+		planeNode = transforms.add(TransformHierarchy::INVALID_INDEX, vec3(0.0, -1.5, 0.0),
+				angleAxis(glm::half_pi<float>(), vec3(1.0, 0.0, 0.0)));
+		drawnNodes = { cubeNode, planeNode, sphereNode };
+		drawRanges.resize(drawnNodes.size());
+
+		// Offset alignments are at most 256 bytes
+		drawUniforms = ctx->makeUniformRing(drawnNodes.size() * 256);
+
+		// The program has compiled alongside the setup above
+		ctx->finishShaderPrograms();
+		ctx->enableShaderHotReload();
+		lookupUniforms(program);
+		bindUniformBlocks(program);
+
+		string vertexError;
+		if(!program->acceptsVertex<Vertex>(&vertexError)) {
+			throw runtime_error(vertexError);
+		}
 
 
 		// Setup a first person camera
@@ -156,14 +208,17 @@ struct App : public SDLGLWindow {
 
 
 		// Create a grid of lights and one light close to the object
+	    lighting = ctx->makeUniformBuffer<LightingBlock<NUM_LIGHTS>>();
 	    setupLights();
 
 	    // Create a material for the cube
 	    vec4 goldColor(1.0, 0.71, 0.29, 0.0);
-	    cubeMaterial.diffuse = goldColor;
-	    cubeMaterial.specular = goldColor * 0.5f;
-	    cubeMaterial.shininess = 2.0 + (2.0 / pow(0.2, 2.0));
-	    cubeMaterial.reflectance = 0.8f;
+	    cubeMaterial = ctx->makeUniformBuffer<Material>();
+	    cubeMaterial->data().diffuse() = goldColor;
+	    cubeMaterial->data().specular() = goldColor * 0.5f;
+	    cubeMaterial->data().shininess() = 2.0 + (2.0 / pow(0.2, 2.0));
+	    cubeMaterial->data().reflectance() = 0.8f;
+	    cubeMaterial->upload();
 
 
 		// Move mouse cursor to the middle of the screen and hide it
@@ -219,31 +274,42 @@ struct App : public SDLGLWindow {
 	}
 
 	void draw(SDLGLWindow& w) {
+		ctx->beginFrame();
+		ctx->reloadShaderPrograms();
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		transforms.update();
+		void* matrices = drawUniforms->allocate(sizeof(ObjectMatrices), drawnNodes.size(), drawRanges.data());
+		transforms.computeViewMatrices(camera.getViewMatrix(), camera.getProjectionMatrix(),
+				drawnNodes.data(), drawnNodes.size(), matrices, drawUniforms->stride(sizeof(ObjectMatrices)));
+
 	    setupStdUniforms(program);
-	    if(program->hasUniform("mat.diffuse"))
-	    	program->setUniform("mat.diffuse", cubeMaterial.diffuse);
-	    if(program->hasUniform("mat.specular"))
-	    	program->setUniform("mat.specular", cubeMaterial.diffuse);
-	    if(program->hasUniform("mat.roughness"))
-	    	program->setUniform("mat.roughness", cubeMaterial.shininess);
-	    if(program->hasUniform("mat.reflectance"))
-	    	program->setUniform("mat.reflectance", cubeMaterial.reflectance);
+	    ctx->bindUniformBuffer(lighting, PER_FRAME_LIGHT_BLOCK_BINDING);
+	    ctx->bindUniformBuffer(cubeMaterial, MATERIAL_BLOCK_BINDING);
 
 		ctx->setShaderProgram(program);
 
 		ctx->setGeometryBuffer(cubeGeometry);
+		ctx->bindUniformRange(drawRanges[0]);
 		ctx->draw();
 
-		setupStdUniforms(program, translate(mat4(1.0), vec3(10.0, 0.0, 1.0)));
-
-		ctx->setGeometryBuffer(sphereGeometry);
+		ctx->setGeometryBuffer(planeGeometry);
+		ctx->bindUniformRange(drawRanges[1]);
 		ctx->draw();
 
-		setupStdUniforms(program, translate(mat4(1.0), vec3(0.0, -1.5, 0.0)) * rotate(mat4(1.0), glm::half_pi<float>(), vec3(1.0, 0.0, 0.0)));
+		// Draw the sphere last so the cube and plane can hide it
+		ctx->beginOcclusionQueries(sphereQueries, camera.getProjectionMatrix() * camera.getViewMatrix());
+		ctx->queryOcclusion(sphereQueries, 0, sphereGeometry->bounds().transformed(transforms.world(sphereNode)));
+		ctx->endOcclusionQueries();
 
-		ctx->setGeometryBuffer(planeGeometry);
+		ctx->setShaderProgram(program);
+		ctx->setGeometryBuffer(sphereGeometry);
+		ctx->bindUniformRange(drawRanges[2]);
+		ctx->beginConditionalDraw(sphereQueries, 0);
 		ctx->draw();
+		ctx->endConditionalDraw();
+
+		drawUniforms->advance();
 	}
 
 	void teardown(SDLGLWindow& w) {
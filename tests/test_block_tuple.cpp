@@ -0,0 +1,90 @@
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <array>
+
+#include <glm/glm.hpp>
+
+#include "gfx/utils/block_tuple.h"
+
+using namespace glm;
+using namespace gfx;
+
+/*
+ * Expected offsets are the ones glGetProgramResourceiv(GL_OFFSET) reports
+ * for the same members declared in a GLSL block
+ */
+
+BOOST_AUTO_TEST_CASE(test_std140_offsets) {
+	typedef Std140Tuple<vec3, float, vec2, mat4, vec2, float, std::array<vec4, 2>, int> Block;
+
+	BOOST_CHECK_EQUAL(Block::offset<0>(), 0);
+	BOOST_CHECK_EQUAL(Block::offset<1>(), 12);
+	BOOST_CHECK_EQUAL(Block::offset<2>(), 16);
+	BOOST_CHECK_EQUAL(Block::offset<3>(), 32);
+	BOOST_CHECK_EQUAL(Block::offset<4>(), 96);
+	BOOST_CHECK_EQUAL(Block::offset<5>(), 104);
+	BOOST_CHECK_EQUAL(Block::offset<6>(), 112);
+	BOOST_CHECK_EQUAL(Block::offset<7>(), 144);
+	BOOST_CHECK_EQUAL(sizeof(Block), 160);
+}
+
+BOOST_AUTO_TEST_CASE(test_std430_offsets) {
+	typedef Std430Tuple<float, vec2, float, vec3, float, std::array<vec2, 3>, float> Block;
+
+	BOOST_CHECK_EQUAL(Block::offset<0>(), 0);
+	BOOST_CHECK_EQUAL(Block::offset<1>(), 8);
+	BOOST_CHECK_EQUAL(Block::offset<2>(), 16);
+	BOOST_CHECK_EQUAL(Block::offset<3>(), 32);
+	BOOST_CHECK_EQUAL(Block::offset<4>(), 44);
+	BOOST_CHECK_EQUAL(Block::offset<5>(), 48);
+	BOOST_CHECK_EQUAL(Block::offset<6>(), 72);
+	BOOST_CHECK_EQUAL(sizeof(Block), 80);
+}
+
+BOOST_AUTO_TEST_CASE(test_nested_structs) {
+	// struct Light { vec4 position; vec4 color; float attenuation; float enabled; };
+	typedef Std140Tuple<vec4, vec4, float, float> Light;
+	typedef Std140Tuple<vec4, std::array<Light, 10>, float> Block;
+
+	// std140 rounds struct sizes up to a multiple of a vec4
+	BOOST_CHECK_EQUAL(sizeof(Light), 48);
+	BOOST_CHECK_EQUAL(Block::offset<1>(), 16);
+	BOOST_CHECK_EQUAL(Block::offset<2>(), 496);
+	BOOST_CHECK_EQUAL(sizeof(Block), 512);
+
+	// std430 doesn't
+	typedef Std430Tuple<vec2, float> Small;
+	typedef Std430Tuple<float, std::array<Small, 2>, float> Block430;
+	BOOST_CHECK_EQUAL(sizeof(Small), 16);
+	BOOST_CHECK_EQUAL(Block430::offset<1>(), 8);
+	BOOST_CHECK_EQUAL(Block430::offset<2>(), 40);
+}
+
+BOOST_AUTO_TEST_CASE(test_values) {
+	typedef Std140Tuple<float, vec3, float> Block;
+
+	Block b(1.0f, vec3(2.0f, 3.0f, 4.0f), 5.0f);
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&b);
+	BOOST_CHECK_EQUAL(*reinterpret_cast<const float*>(bytes + Block::offset<0>()), 1.0f);
+	BOOST_CHECK_EQUAL(reinterpret_cast<const float*>(bytes + Block::offset<1>())[2], 4.0f);
+	BOOST_CHECK_EQUAL(*reinterpret_cast<const float*>(bytes + Block::offset<2>()), 5.0f);
+
+	b.get<2>() = 6.0f;
+	BOOST_CHECK_EQUAL(*reinterpret_cast<const float*>(bytes + 28), 6.0f);
+}
+
+BOOST_AUTO_TEST_CASE(test_block_traits) {
+	struct Derived : Std140Tuple<vec4, float> {};
+
+	BOOST_CHECK((IsStd140Block<Std140Tuple<vec4, float>>::value));
+	BOOST_CHECK((IsStd140Block<Derived>::value));
+	BOOST_CHECK(!(IsStd140Block<Std430Tuple<vec4, float>>::value));
+	BOOST_CHECK(!(IsStd140Block<std::array<vec4, 2>>::value));
+	BOOST_CHECK(!(IsStd140Block<vec4>::value));
+
+	// Tightly packed arrays of scalars don't have std140 strides
+	BOOST_CHECK(!(detail::BlockAlign<detail::Std140Layout, std::array<float, 4>>::VALID));
+	BOOST_CHECK((detail::BlockAlign<detail::Std430Layout, std::array<float, 4>>::VALID));
+	BOOST_CHECK(!(detail::BlockAlign<detail::Std140Layout, mat3>::VALID));
+}
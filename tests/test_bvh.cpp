@@ -0,0 +1,134 @@
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "gfx/utils/bvh.h"
+
+using namespace glm;
+using namespace gfx;
+
+struct BvhFixture {
+	std::mt19937 rng;
+	std::vector<BoundingBox> boxes;
+	Frustum frustum;
+
+	BvhFixture() : rng(11) {
+		for(size_t i = 0; i < 20000; i++) {
+			boxes.push_back(randomBox());
+		}
+
+		const mat4 proj = perspective(radians(60.0f), 1.0f, 0.5f, 80.0f);
+		const mat4 view = lookAt(vec3(0.0f, 0.0f, 0.0f), vec3(1.0f, 0.2f, -1.0f), vec3(0.0f, 1.0f, 0.0f));
+		frustum = Frustum::fromMatrix(proj * view);
+	}
+
+	BoundingBox randomBox() {
+		std::uniform_real_distribution<float> pos(-100.0f, 100.0f);
+		std::uniform_real_distribution<float> size(0.05f, 3.0f);
+		const vec3 c(pos(rng), pos(rng), pos(rng));
+		const vec3 e(size(rng), size(rng), size(rng));
+		return BoundingBox(c - e, c + e);
+	}
+
+	template <class Pred>
+	std::vector<uint32_t> bruteForce(Pred pred) const {
+		std::vector<uint32_t> ret;
+		for(uint32_t i = 0; i < boxes.size(); i++) {
+			if(pred(boxes[i])) {
+				ret.push_back(i);
+			}
+		}
+		return ret;
+	}
+
+	static std::vector<uint32_t> sorted(std::vector<uint32_t> v) {
+		std::sort(v.begin(), v.end());
+		return v;
+	}
+
+	void checkQueries(const Bvh& bvh) const {
+		std::vector<uint32_t> result;
+		bvh.queryFrustum(frustum, result);
+		const std::vector<uint32_t> expectedFrustum =
+				bruteForce([&](const BoundingBox& b) { return frustum.intersects(b); });
+		BOOST_REQUIRE(!expectedFrustum.empty());
+		result = sorted(result);
+		BOOST_CHECK_EQUAL_COLLECTIONS(result.begin(), result.end(), expectedFrustum.begin(), expectedFrustum.end());
+
+		const BoundingBox range(vec3(-20.0f, -10.0f, -30.0f), vec3(15.0f, 25.0f, 5.0f));
+		result.clear();
+		bvh.queryBox(range, result);
+		const std::vector<uint32_t> expectedBox =
+				bruteForce([&](const BoundingBox& b) { return b.overlaps(range); });
+		result = sorted(result);
+		BOOST_CHECK_EQUAL_COLLECTIONS(result.begin(), result.end(), expectedBox.begin(), expectedBox.end());
+
+		const vec3 center(10.0f, -5.0f, 3.0f);
+		result.clear();
+		bvh.querySphere(center, 12.0f, result);
+		const std::vector<uint32_t> expectedSphere =
+				bruteForce([&](const BoundingBox& b) { return b.distanceSquared(center) <= 144.0f; });
+		result = sorted(result);
+		BOOST_CHECK_EQUAL_COLLECTIONS(result.begin(), result.end(), expectedSphere.begin(), expectedSphere.end());
+
+		const vec3 point(150.0f, 20.0f, -40.0f);
+		float bestDist2 = 1e30f;
+		for(const BoundingBox& b : boxes) {
+			bestDist2 = std::min(bestDist2, b.distanceSquared(point));
+		}
+		float dist = 0.0f;
+		const uint32_t nearest = bvh.nearest(point, &dist);
+		BOOST_REQUIRE(nearest != Bvh::INVALID_INDEX);
+		BOOST_CHECK_CLOSE(boxes[nearest].distanceSquared(point), bestDist2, 1e-4);
+		BOOST_CHECK_CLOSE(dist * dist, bestDist2, 1e-3);
+	}
+};
+
+BOOST_FIXTURE_TEST_SUITE(BvhTests, BvhFixture)
+
+BOOST_AUTO_TEST_CASE(QueriesMatchBruteForce) {
+	Bvh bvh;
+	bvh.build(boxes);
+	BOOST_CHECK_EQUAL(bvh.numObjects(), boxes.size());
+	checkQueries(bvh);
+}
+
+BOOST_AUTO_TEST_CASE(ParallelBuildMatchesBruteForce) {
+	ThreadPool pool(4);
+	Bvh bvh;
+	bvh.build(boxes, &pool);
+	checkQueries(bvh);
+}
+
+BOOST_AUTO_TEST_CASE(RefitAfterUpdates) {
+	Bvh bvh;
+	bvh.build(boxes);
+
+	for(uint32_t i = 0; i < boxes.size(); i += 200) {
+		boxes[i] = randomBox();
+		bvh.update(i, boxes[i]);
+	}
+	bvh.refit();
+
+	BOOST_CHECK(bvh.numRefitNodes() > 0);
+	BOOST_CHECK(bvh.numRefitNodes() < bvh.numNodes());
+	checkQueries(bvh);
+}
+
+BOOST_AUTO_TEST_CASE(EmptyTree) {
+	Bvh bvh;
+	bvh.build(std::vector<BoundingBox>());
+	std::vector<uint32_t> result;
+	bvh.queryFrustum(frustum, result);
+	BOOST_CHECK(result.empty());
+	BOOST_CHECK_EQUAL(bvh.nearest(vec3(0.0f)), Bvh::INVALID_INDEX);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,101 @@
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gfx/utils/file_watcher.h"
+
+using namespace utils;
+
+static void writeFile(const std::string& path, const std::string& text) {
+	std::ofstream(path.c_str(), std::ios::out | std::ios::trunc) << text;
+}
+
+/*
+ * Waits up to two seconds for the watcher to report at least one file
+ */
+static std::vector<std::string> waitForChanges(FileWatcher& watcher) {
+	std::vector<std::string> ret;
+	for(int i = 0; i < 200 && ret.empty(); i++) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		ret = watcher.takeChanged();
+	}
+	return ret;
+}
+
+struct WatchedDir {
+	std::string path;
+
+	WatchedDir() {
+		char name[] = "/tmp/test_file_watcher.XXXXXX";
+		BOOST_REQUIRE(mkdtemp(name) != nullptr);
+		path = name;
+	}
+
+	~WatchedDir() {
+		for(const char* f : { "/a.glsl", "/b.glsl", "/c.glsl", "/a.glsl.tmp" }) {
+			std::remove((path + f).c_str());
+		}
+		std::remove(path.c_str());
+	}
+};
+
+BOOST_AUTO_TEST_SUITE(FileWatcherTests)
+
+BOOST_FIXTURE_TEST_CASE(ReportsWatchedFilesOnly, WatchedDir) {
+	writeFile(path + "/a.glsl", "a");
+	writeFile(path + "/b.glsl", "b");
+
+	FileWatcher watcher;
+	BOOST_REQUIRE(watcher.isSupported());
+	watcher.watch(path + "/a.glsl");
+
+	writeFile(path + "/b.glsl", "b2");
+	writeFile(path + "/a.glsl", "a2");
+	writeFile(path + "/a.glsl", "a3");
+
+	std::vector<std::string> changed = waitForChanges(watcher);
+	BOOST_REQUIRE_EQUAL(changed.size(), 1);
+	BOOST_CHECK_EQUAL(changed[0], path + "/a.glsl");
+	BOOST_CHECK(watcher.takeChanged().empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(ReportsFilesReplacedByRename, WatchedDir) {
+	writeFile(path + "/a.glsl", "a");
+
+	FileWatcher watcher;
+	BOOST_REQUIRE(watcher.isSupported());
+	watcher.watch(path + "/a.glsl");
+
+	// Saved the way many editors do
+	writeFile(path + "/a.glsl.tmp", "a2");
+	BOOST_REQUIRE_EQUAL(std::rename((path + "/a.glsl.tmp").c_str(), (path + "/a.glsl").c_str()), 0);
+
+	std::vector<std::string> changed = waitForChanges(watcher);
+	BOOST_REQUIRE_EQUAL(changed.size(), 1);
+	BOOST_CHECK_EQUAL(changed[0], path + "/a.glsl");
+
+	// Still watched after the rename
+	writeFile(path + "/a.glsl", "a3");
+	BOOST_CHECK_EQUAL(waitForChanges(watcher).size(), 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(ReportsEverySpellingOfAFile, WatchedDir) {
+	writeFile(path + "/c.glsl", "c");
+
+	FileWatcher watcher;
+	BOOST_REQUIRE(watcher.isSupported());
+	watcher.watch(path + "/c.glsl");
+	watcher.watch(path + "/./c.glsl");
+
+	writeFile(path + "/c.glsl", "c2");
+	BOOST_CHECK_EQUAL(waitForChanges(watcher).size(), 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,79 @@
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "gfx/utils/frustum_culler.h"
+
+using namespace glm;
+using namespace gfx;
+
+struct CullingFixture {
+	Frustum frustum;
+
+	CullingFixture() {
+		const mat4 proj = perspective(radians(60.0f), 1.5f, 0.1f, 100.0f);
+		const mat4 view = lookAt(vec3(0.0f, 0.0f, 5.0f), vec3(0.0f), vec3(0.0f, 1.0f, 0.0f));
+		frustum = Frustum::fromMatrix(proj * view);
+	}
+
+	static BoundingBox box(const vec3& center, float halfSize) {
+		return BoundingBox(center - vec3(halfSize), center + vec3(halfSize));
+	}
+};
+
+BOOST_FIXTURE_TEST_SUITE(FrustumCullingTests, CullingFixture)
+
+BOOST_AUTO_TEST_CASE(ClassifiesSimpleBoxes) {
+	BOOST_CHECK(frustum.intersects(box(vec3(0.0f), 1.0f)));
+	BOOST_CHECK(!frustum.intersects(box(vec3(0.0f, 0.0f, 10.0f), 1.0f)));
+	BOOST_CHECK(!frustum.intersects(box(vec3(0.0f, 0.0f, -200.0f), 1.0f)));
+	BOOST_CHECK(!frustum.intersects(box(vec3(100.0f, 0.0f, 0.0f), 1.0f)));
+	BOOST_CHECK(frustum.intersects(BoundingSphere(vec3(0.0f, 0.0f, -50.0f), 1.0f)));
+	BOOST_CHECK(!frustum.intersects(BoundingSphere(vec3(0.0f, 0.0f, 10.0f), 1.0f)));
+}
+
+BOOST_AUTO_TEST_CASE(AllSimdLevelsAgree) {
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> pos(-120.0f, 120.0f);
+	std::uniform_real_distribution<float> size(0.01f, 4.0f);
+
+	// Odd count so the padding lanes are exercised
+	FrustumCuller culler;
+	std::vector<uint32_t> expected;
+	for(uint32_t i = 0; i < 10007; i++) {
+		const BoundingBox b = box(vec3(pos(rng), pos(rng), pos(rng)), size(rng));
+		culler.add(b);
+		if(frustum.intersects(b)) {
+			expected.push_back(i);
+		}
+	}
+	BOOST_REQUIRE(!expected.empty());
+
+	for(FrustumCuller::SimdLevel level : { FrustumCuller::SimdLevel::SCALAR,
+			FrustumCuller::SimdLevel::SSE, FrustumCuller::SimdLevel::AVX }) {
+		if(!FrustumCuller::isSupported(level)) {
+			continue;
+		}
+		std::vector<uint32_t> visible;
+		BOOST_CHECK_EQUAL(culler.cull(frustum, visible, level), expected.size());
+		BOOST_CHECK_EQUAL_COLLECTIONS(visible.begin(), visible.end(), expected.begin(), expected.end());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(BoundsOfTransformedBox) {
+	const BoundingBox b(vec3(-1.0f, -2.0f, -3.0f), vec3(1.0f, 2.0f, 3.0f));
+	const BoundingBox t = b.transformed(translate(mat4(1.0f), vec3(10.0f, 0.0f, 0.0f)) *
+			rotate(mat4(1.0f), radians(90.0f), vec3(0.0f, 0.0f, 1.0f)));
+	BOOST_CHECK_CLOSE(t.min.x, 8.0f, 1e-3);
+	BOOST_CHECK_CLOSE(t.max.x, 12.0f, 1e-3);
+	BOOST_CHECK_CLOSE(t.min.y, -1.0f, 1e-3);
+	BOOST_CHECK_CLOSE(t.max.z, 3.0f, 1e-3);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
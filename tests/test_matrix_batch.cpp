@@ -0,0 +1,77 @@
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "gfx/utils/matrix_batch.h"
+
+using namespace glm;
+using namespace gfx;
+
+static bool closeTo(const mat4& a, const mat4& b, float tolerance) {
+	for(int c = 0; c < 4; c++) {
+		for(int r = 0; r < 4; r++) {
+			if(std::abs(a[c][r] - b[c][r]) > tolerance * std::max(1.0f, std::abs(b[c][r]))) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+BOOST_AUTO_TEST_SUITE(MatrixBatchTests)
+
+BOOST_AUTO_TEST_CASE(AllSimdLevelsMatchGlm) {
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> pos(-50.0f, 50.0f);
+	std::uniform_real_distribution<float> angle(-3.0f, 3.0f);
+	std::uniform_real_distribution<float> size(0.1f, 4.0f);
+
+	std::vector<mat4> models;
+	for(int i = 0; i < 257; i++) {
+		mat4 m = translate(mat4(1.0f), vec3(pos(rng), pos(rng), pos(rng)));
+		m = rotate(m, angle(rng), normalize(vec3(pos(rng), pos(rng), 1.0f)));
+		models.push_back(scale(m, vec3(size(rng), size(rng), size(rng))));
+	}
+
+	// Every other model, in reverse
+	std::vector<uint32_t> indices;
+	for(int i = 256; i >= 0; i -= 2) {
+		indices.push_back(static_cast<uint32_t>(i));
+	}
+
+	const mat4 view = lookAt(vec3(3.0f, 4.0f, 30.0f), vec3(0.0f), vec3(0.0f, 1.0f, 0.0f));
+	const mat4 proj = perspective(radians(45.0f), 1.3f, 0.5f, 500.0f);
+
+	// Padded like per draw blocks at a 256 byte uniform buffer offset alignment
+	const size_t stride = 256;
+	for(SimdLevel level : { SimdLevel::SCALAR, SimdLevel::SSE, SimdLevel::AVX }) {
+		if(!isSimdLevelSupported(level)) {
+			continue;
+		}
+
+		std::vector<char> buffer(indices.size() * stride, 0);
+		computeObjectMatrices(view, proj, models.data(), indices.data(), indices.size(), buffer.data(), stride, level);
+		for(size_t i = 0; i < indices.size(); i++) {
+			const ObjectMatrices* out = reinterpret_cast<const ObjectMatrices*>(&buffer[i * stride]);
+			const mat4 mv = view * models[indices[i]];
+			BOOST_CHECK(closeTo(out->modelview, mv, 1e-5f));
+			BOOST_CHECK(closeTo(out->modelviewProjection, proj * view * models[indices[i]], 1e-4f));
+			BOOST_CHECK(closeTo(out->normal, mat4(transpose(inverse(mat3(mv)))), 1e-4f));
+
+			// Nothing is written between objects
+			BOOST_CHECK_EQUAL(buffer[i * stride + sizeof(ObjectMatrices)], 0);
+		}
+
+		std::vector<ObjectMatrices> packed(models.size());
+		computeObjectMatrices(view, proj, models.data(), nullptr, models.size(), packed.data(), sizeof(ObjectMatrices), level);
+		BOOST_CHECK(closeTo(packed[100].modelview, view * models[100], 1e-5f));
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,132 @@
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "gfx/utils/occlusion_culler.h"
+
+using namespace glm;
+using namespace gfx;
+
+struct OcclusionFixture {
+	mat4 viewProj;
+
+	OcclusionFixture() {
+		const mat4 proj = perspective(radians(60.0f), 2.0f, 0.1f, 100.0f);
+		const mat4 view = lookAt(vec3(0.0f), vec3(0.0f, 0.0f, -1.0f), vec3(0.0f, 1.0f, 0.0f));
+		viewProj = proj * view;
+	}
+
+	static BoundingBox box(const vec3& center, float halfSize) {
+		return BoundingBox(center - vec3(halfSize), center + vec3(halfSize));
+	}
+
+	// A quad with corners a, b, c, d, wound either way
+	static void addQuad(OcclusionCuller& culler, const vec3& a, const vec3& b, const vec3& c, const vec3& d,
+			bool flip = false) {
+		const std::vector<vec3> positions = { a, b, c, d };
+		const std::vector<uint32_t> indices = flip ?
+				std::vector<uint32_t>{ 0, 2, 1, 0, 3, 2 } : std::vector<uint32_t>{ 0, 1, 2, 0, 2, 3 };
+		culler.addOccluder(positions, indices);
+	}
+};
+
+BOOST_FIXTURE_TEST_SUITE(OcclusionCullingTests, OcclusionFixture)
+
+BOOST_AUTO_TEST_CASE(NothingIsOccludedWithoutOccluders) {
+	OcclusionCuller culler;
+	culler.render(viewProj);
+	BOOST_CHECK(culler.isVisible(box(vec3(0.0f, 0.0f, -10.0f), 1.0f)));
+	BOOST_CHECK(culler.isVisible(box(vec3(0.0f, 0.0f, -99.0f), 0.1f)));
+	BOOST_CHECK_EQUAL(culler.stats().numTriangles, 0);
+}
+
+BOOST_AUTO_TEST_CASE(WallHidesBoxesBehindIt) {
+	// Covers the left half of the screen at z = -10
+	OcclusionCuller culler(200, 100);
+	addQuad(culler, vec3(-50.0f, -50.0f, -10.0f), vec3(0.0f, -50.0f, -10.0f),
+			vec3(0.0f, 50.0f, -10.0f), vec3(-50.0f, 50.0f, -10.0f));
+	culler.render(viewProj);
+
+	BOOST_CHECK(!culler.isVisible(box(vec3(-8.0f, 0.0f, -30.0f), 1.0f)));
+	BOOST_CHECK(!culler.isVisible(box(vec3(-3.0f, 2.0f, -12.0f), 0.5f)));
+
+	// In front of the wall, straddling its edge, and beside it
+	BOOST_CHECK(culler.isVisible(box(vec3(-3.0f, 0.0f, -5.0f), 1.0f)));
+	BOOST_CHECK(culler.isVisible(box(vec3(0.0f, 0.0f, -30.0f), 2.0f)));
+	BOOST_CHECK(culler.isVisible(box(vec3(8.0f, 0.0f, -30.0f), 1.0f)));
+
+	// Crossing the near plane
+	BOOST_CHECK(culler.isVisible(box(vec3(-1.0f, 0.0f, 0.0f), 0.5f)));
+}
+
+BOOST_AUTO_TEST_CASE(WindingDoesNotMatter) {
+	OcclusionCuller culler(200, 100);
+	addQuad(culler, vec3(-50.0f, -50.0f, -10.0f), vec3(50.0f, -50.0f, -10.0f),
+			vec3(50.0f, 50.0f, -10.0f), vec3(-50.0f, 50.0f, -10.0f), true);
+	culler.render(viewProj);
+	BOOST_CHECK(!culler.isVisible(box(vec3(0.0f, 0.0f, -20.0f), 1.0f)));
+
+	// The depth buffer holds window space depth of the plane
+	const vec4 clip = viewProj * vec4(0.0f, 0.0f, -10.0f, 1.0f);
+	BOOST_CHECK_CLOSE(culler.depth(100, 50), 0.5f * clip.z / clip.w + 0.5f, 0.01f);
+}
+
+BOOST_AUTO_TEST_CASE(ClipsOccludersCrossingTheNearPlane) {
+	// A wall along the left side of the camera, starting behind it
+	OcclusionCuller culler(200, 100);
+	addQuad(culler, vec3(-2.0f, -50.0f, 10.0f), vec3(-2.0f, -50.0f, -90.0f),
+			vec3(-2.0f, 50.0f, -90.0f), vec3(-2.0f, 50.0f, 10.0f));
+	culler.render(viewProj);
+
+	BOOST_CHECK(culler.stats().numTriangles > 0);
+	BOOST_CHECK(!culler.isVisible(box(vec3(-10.0f, 0.0f, -20.0f), 1.0f)));
+	BOOST_CHECK(culler.isVisible(box(vec3(0.0f, 0.0f, -20.0f), 1.0f)));
+}
+
+BOOST_AUTO_TEST_CASE(CullMatchesIsVisible) {
+	OcclusionCuller culler(256, 128);
+	for(int i = 0; i < 8; i++) {
+		const float x = -40.0f + 10.0f * i, z = -15.0f - 3.0f * i;
+		addQuad(culler, vec3(x, -3.0f, z), vec3(x + 6.0f, -3.0f, z), vec3(x + 6.0f, 4.0f, z), vec3(x, 4.0f, z));
+	}
+
+	std::mt19937 rng(3);
+	std::uniform_real_distribution<float> pos(-60.0f, 60.0f);
+	std::uniform_real_distribution<float> size(0.05f, 2.0f);
+	std::vector<BoundingBox> boxes;
+	std::vector<uint32_t> candidates;
+	for(uint32_t i = 0; i < 5000; i++) {
+		boxes.push_back(box(vec3(pos(rng), pos(rng) * 0.1f, -0.5f * std::abs(pos(rng)) - 1.0f), size(rng)));
+		if(i % 3 != 0) {
+			candidates.push_back(i);
+		}
+	}
+
+	ThreadPool pool(4);
+	culler.render(viewProj, &pool);
+
+	std::vector<uint32_t> expected;
+	for(uint32_t i : candidates) {
+		if(culler.isVisible(boxes[i])) {
+			expected.push_back(i);
+		}
+	}
+	BOOST_CHECK(expected.size() < candidates.size());
+
+	std::vector<uint32_t> visible;
+	BOOST_CHECK_EQUAL(culler.cull(boxes, candidates, visible, &pool), expected.size());
+	BOOST_CHECK(visible == expected);
+
+	// Rendering on one thread gives the same result
+	culler.render(viewProj);
+	culler.cull(boxes, candidates, visible);
+	BOOST_CHECK(visible == expected);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,64 @@
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "gfx/utils/radix_sort.h"
+
+struct Item {
+	uint64_t key;
+	uint32_t index;
+};
+
+static std::vector<Item> makeItems(size_t n, uint64_t keyMask, unsigned seed) {
+	std::mt19937_64 rng(seed);
+	std::vector<Item> items(n);
+	for(size_t i = 0; i < n; i++) {
+		items[i].key = rng() & keyMask;
+		items[i].index = static_cast<uint32_t>(i);
+	}
+	return items;
+}
+
+static void checkSorted(std::vector<Item> items, gfx::ThreadPool* pool) {
+	std::vector<Item> expected = items;
+	std::stable_sort(expected.begin(), expected.end(),
+			[](const Item& a, const Item& b) { return a.key < b.key; });
+
+	std::vector<Item> scratch;
+	gfx::radixSort(items, scratch, [](const Item& it) { return it.key; }, pool);
+
+	BOOST_REQUIRE_EQUAL(items.size(), expected.size());
+	for(size_t i = 0; i < items.size(); i++) {
+		BOOST_REQUIRE_EQUAL(items[i].key, expected[i].key);
+		BOOST_REQUIRE_EQUAL(items[i].index, expected[i].index);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(RadixSortTests)
+
+BOOST_AUTO_TEST_CASE(SortsFullKeysSerial) {
+	checkSorted(makeItems(10000, ~uint64_t(0), 1), nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(StableWithFewDistinctKeys) {
+	// Lots of duplicates, only a couple of bytes differ
+	checkSorted(makeItems(10000, 0x00ff00000000000full, 2), nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(SortsInParallel) {
+	gfx::ThreadPool pool(4);
+	checkSorted(makeItems(100000, ~uint64_t(0), 3), &pool);
+	checkSorted(makeItems(100000, 0xffff000000000000ull, 4), &pool);
+}
+
+BOOST_AUTO_TEST_CASE(HandlesTinyInputs) {
+	checkSorted(std::vector<Item>(), nullptr);
+	checkSorted(makeItems(1, ~uint64_t(0), 5), nullptr);
+	checkSorted(std::vector<Item>(5, Item{ 7, 0 }), nullptr);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,169 @@
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "gfx/utils/shader_preprocessor.h"
+
+using namespace utils;
+
+/*
+ * Writes shader files into a fresh temporary directory
+ */
+struct ShaderDir {
+	std::string path;
+	std::vector<std::string> files;
+
+	ShaderDir() {
+		char name[] = "/tmp/test_shader_preprocessor.XXXXXX";
+		BOOST_REQUIRE(mkdtemp(name) != nullptr);
+		path = name;
+	}
+
+	~ShaderDir() {
+		for(const std::string& f : files) {
+			std::remove(f.c_str());
+		}
+		std::remove(path.c_str());
+	}
+
+	std::string write(const std::string& name, const std::string& text) {
+		const std::string filename = path + "/" + name;
+		std::ofstream(filename.c_str(), std::ios::out | std::ios::trunc) << text;
+		files.push_back(filename);
+		return filename;
+	}
+};
+
+static size_t count(const std::string& s, const std::string& what) {
+	size_t n = 0;
+	for(size_t i = s.find(what); i != std::string::npos; i = s.find(what, i + 1)) {
+		n++;
+	}
+	return n;
+}
+
+BOOST_AUTO_TEST_SUITE(ShaderPreprocessorTests)
+
+BOOST_FIXTURE_TEST_CASE(NestedIncludesAreExpandedOnce, ShaderDir) {
+	write("defs.glsl", "#define PI 3.14159\n");
+	write("lighting.glsl", "#pragma include \"defs.glsl\"\nfloat light() { return PI; }\n");
+	write("utils.glsl", "#pragma include \"defs.glsl\"\nfloat util() { return PI; }\n");
+	const std::string main = write("main.glsl",
+			"#version 330 core\n#pragma include \"lighting.glsl\"\n#pragma include <utils.glsl>\nvoid main() {}\n");
+
+	ShaderPreprocessor pp;
+	PreprocessedShader out = pp.preprocessFile(main);
+
+	BOOST_CHECK_EQUAL(out.source.compare(0, 18, "#version 330 core\n"), 0);
+	BOOST_CHECK_EQUAL(count(out.source, "#version"), 1);
+	BOOST_CHECK_EQUAL(count(out.source, "#define PI"), 1);
+	BOOST_CHECK_EQUAL(count(out.source, "#pragma include"), 0);
+	BOOST_CHECK(out.source.find("#define PI") < out.source.find("float light()"));
+	BOOST_CHECK(out.source.find("float light()") < out.source.find("float util()"));
+	BOOST_CHECK(out.source.find("float util()") < out.source.find("void main()"));
+
+	BOOST_REQUIRE_EQUAL(out.files.size(), 4);
+	BOOST_CHECK_EQUAL(out.files[0], main);
+	BOOST_CHECK_EQUAL(out.files[1], path + "/lighting.glsl");
+	BOOST_CHECK_EQUAL(out.files[2], path + "/defs.glsl");
+	BOOST_CHECK_EQUAL(out.files[3], path + "/utils.glsl");
+}
+
+BOOST_FIXTURE_TEST_CASE(LineDirectivesMapBackToFiles, ShaderDir) {
+	write("inc.glsl", "// one\n// two\n");
+	const std::string main = write("main.glsl", "// line 1\n#pragma include \"inc.glsl\"\nvoid main() {}");
+
+	ShaderPreprocessor pp;
+	const std::string source = pp.preprocessFile(main).source;
+
+	BOOST_CHECK_EQUAL(source,
+			"#version 330\n"
+			"#line 1 0\n// line 1\n"
+			"#line 1 1\n// one\n// two\n"
+			"#line 3 0\nvoid main() {}\n");
+}
+
+BOOST_FIXTURE_TEST_CASE(DefinesFollowTheVersion, ShaderDir) {
+	ShaderPreprocessor pp;
+	const std::string source = pp.preprocess("#version 430\nvoid main() {}\n",
+			{ { "USE_SHADOWS", "1" }, { "NUM_LIGHTS", "4" } }).source;
+
+	BOOST_CHECK_EQUAL(source,
+			"#version 430\n"
+			"#define USE_SHADOWS 1\n"
+			"#define NUM_LIGHTS 4\n"
+			"#line 2 0\nvoid main() {}\n");
+}
+
+BOOST_FIXTURE_TEST_CASE(IncludeCycleThrows, ShaderDir) {
+	write("a.glsl", "#pragma include \"b.glsl\"\n");
+	write("b.glsl", "#pragma include \"a.glsl\"\n");
+	const std::string main = write("main.glsl", "#pragma include \"a.glsl\"\n");
+
+	ShaderPreprocessor pp;
+	BOOST_CHECK_THROW(pp.preprocessFile(main), std::runtime_error);
+
+	// Including a file from itself is a cycle too
+	const std::string self = write("self.glsl", "#pragma include \"self.glsl\"\n");
+	BOOST_CHECK_THROW(pp.preprocessFile(self), std::runtime_error);
+}
+
+BOOST_FIXTURE_TEST_CASE(MissingIncludeThrows, ShaderDir) {
+	const std::string main = write("main.glsl", "#pragma include \"missing.glsl\"\n");
+
+	ShaderPreprocessor pp;
+	BOOST_CHECK_THROW(pp.preprocessFile(main), std::runtime_error);
+}
+
+BOOST_FIXTURE_TEST_CASE(UnreadableFileThrows, ShaderDir) {
+	// Opens fine, but can't be mapped
+	ShaderPreprocessor pp;
+	BOOST_CHECK_THROW(pp.preprocessFile(path), std::runtime_error);
+}
+
+BOOST_FIXTURE_TEST_CASE(FilesAreParsedOnce, ShaderDir) {
+	write("stddefs.glsl", "uniform mat4 std_Projection;\n");
+	write("stdutils.glsl", "#pragma include \"stddefs.glsl\"\nvec3 gamma(vec3 c) { return c; }\n");
+	std::vector<std::string> shaders;
+	for(int i = 0; i < 10; i++) {
+		shaders.push_back(write("shader" + std::to_string(i) + ".glsl",
+				"#pragma include \"stdutils.glsl\"\nvoid main() {}\n"));
+	}
+
+	ShaderPreprocessor pp;
+	for(const std::string& shader : shaders) {
+		pp.preprocessFile(shader);
+	}
+	BOOST_CHECK_EQUAL(pp.numParsedFiles(), shaders.size() + 2);
+
+	for(const std::string& shader : shaders) {
+		pp.preprocessFile(shader);
+	}
+	BOOST_CHECK_EQUAL(pp.numParsedFiles(), shaders.size() + 2);
+
+	// An edited file is read again once invalidated
+	write("stddefs.glsl", "uniform mat4 std_View;\n");
+	BOOST_CHECK(pp.preprocessFile(shaders[0]).source.find("std_Projection") != std::string::npos);
+	pp.invalidate(path + "/stddefs.glsl");
+	BOOST_CHECK(pp.preprocessFile(shaders[0]).source.find("std_View") != std::string::npos);
+	BOOST_CHECK_EQUAL(pp.numParsedFiles(), shaders.size() + 3);
+}
+
+BOOST_FIXTURE_TEST_CASE(IncludeDirsAreSearched, ShaderDir) {
+	const std::string main = write("main.glsl", "#pragma include \"lib.glsl\"\n");
+	ShaderDir libs;
+	libs.write("lib.glsl", "float lib();\n");
+
+	ShaderPreprocessor pp;
+	BOOST_CHECK_THROW(pp.preprocessFile(main), std::runtime_error);
+	pp.addIncludeDir(libs.path);
+	BOOST_CHECK(pp.preprocessFile(main).source.find("float lib();") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
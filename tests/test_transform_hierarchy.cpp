@@ -0,0 +1,135 @@
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "gfx/utils/transform_hierarchy.h"
+
+using namespace glm;
+using namespace gfx;
+
+static bool closeTo(const mat4& a, const mat4& b) {
+	for(int c = 0; c < 4; c++) {
+		for(int r = 0; r < 4; r++) {
+			if(std::abs(a[c][r] - b[c][r]) > 1e-4f) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static mat4 localMatrix(const TransformHierarchy& h, uint32_t node) {
+	return translate(mat4(1.0f), h.translation(node)) * mat4_cast(h.rotation(node)) * scale(mat4(1.0f), h.scale(node));
+}
+
+// World matrix computed from scratch by walking up to the root
+static mat4 expectedWorld(const TransformHierarchy& h, uint32_t node) {
+	mat4 world = localMatrix(h, node);
+	for(uint32_t p = h.parent(node); p != TransformHierarchy::INVALID_INDEX; p = h.parent(p)) {
+		world = localMatrix(h, p) * world;
+	}
+	return world;
+}
+
+BOOST_AUTO_TEST_SUITE(TransformHierarchyTests)
+
+BOOST_AUTO_TEST_CASE(ComposesParentTransforms) {
+	TransformHierarchy h;
+	const uint32_t root = h.add(TransformHierarchy::INVALID_INDEX, vec3(1.0f, 0.0f, 0.0f));
+	const uint32_t child = h.add(root, vec3(0.0f, 2.0f, 0.0f), angleAxis(radians(90.0f), vec3(0.0f, 0.0f, 1.0f)));
+	const uint32_t grandchild = h.add(child, vec3(3.0f, 0.0f, 0.0f), quat(1.0f, 0.0f, 0.0f, 0.0f), vec3(2.0f));
+
+	BOOST_CHECK_EQUAL(h.update(), 3);
+	BOOST_CHECK_EQUAL(h.update(), 0);
+
+	// The child's rotation turns the grandchild's +x offset into +y
+	const vec4 origin = h.world(grandchild) * vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	BOOST_CHECK_CLOSE(origin.x, 1.0f, 1e-3f);
+	BOOST_CHECK_CLOSE(origin.y, 5.0f, 1e-3f);
+	BOOST_CHECK_SMALL(origin.z, 1e-5f);
+	BOOST_CHECK(closeTo(h.world(grandchild), expectedWorld(h, grandchild)));
+}
+
+BOOST_AUTO_TEST_CASE(OnlyUpdatesDirtySubtrees) {
+	// root -> a -> a1, a2 and root -> b
+	TransformHierarchy h;
+	const uint32_t root = h.add();
+	const uint32_t a = h.add(root, vec3(1.0f));
+	const uint32_t b = h.add(root, vec3(2.0f));
+	const uint32_t a1 = h.add(a, vec3(3.0f));
+	const uint32_t a2 = h.add(a, vec3(4.0f));
+	h.update();
+
+	h.setTranslation(a, vec3(5.0f));
+	BOOST_CHECK(h.isDirty(a));
+	BOOST_CHECK_EQUAL(h.update(), 3);
+	BOOST_CHECK(!h.isDirty(a));
+	for(uint32_t node : { root, a, b, a1, a2 }) {
+		BOOST_CHECK(closeTo(h.world(node), expectedWorld(h, node)));
+	}
+
+	h.setScale(b, vec3(2.0f));
+	BOOST_CHECK_EQUAL(h.update(), 1);
+
+	h.setRotation(root, angleAxis(1.0f, vec3(0.0f, 1.0f, 0.0f)));
+	BOOST_CHECK_EQUAL(h.update(), 5);
+	for(uint32_t node : { root, a, b, a1, a2 }) {
+		BOOST_CHECK(closeTo(h.world(node), expectedWorld(h, node)));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(MatchesRecomputingEverything) {
+	std::mt19937 rng(11);
+	std::uniform_real_distribution<float> pos(-5.0f, 5.0f);
+	std::uniform_real_distribution<float> angle(-3.0f, 3.0f);
+	std::uniform_real_distribution<float> size(0.5f, 2.0f);
+
+	TransformHierarchy h;
+	for(uint32_t i = 0; i < 2000; i++) {
+		const uint32_t parent = i < 4 ? TransformHierarchy::INVALID_INDEX :
+				std::uniform_int_distribution<uint32_t>(0, i - 1)(rng);
+		h.add(parent, vec3(pos(rng), pos(rng), pos(rng)), angleAxis(angle(rng), normalize(vec3(pos(rng), pos(rng), 1.0f))),
+				vec3(size(rng)));
+	}
+	h.update();
+
+	for(int frame = 0; frame < 5; frame++) {
+		for(int i = 0; i < 20; i++) {
+			const uint32_t node = std::uniform_int_distribution<uint32_t>(0, 1999)(rng);
+			h.setTranslation(node, vec3(pos(rng), pos(rng), pos(rng)));
+		}
+		h.update();
+	}
+
+	// Keep the tree shallow enough for float error to stay small
+	std::vector<uint32_t> nodes;
+	for(uint32_t i = 0; i < h.size(); i += 7) {
+		int depth = 0;
+		for(uint32_t p = h.parent(i); p != TransformHierarchy::INVALID_INDEX; p = h.parent(p)) {
+			depth++;
+		}
+		if(depth <= 4) {
+			BOOST_CHECK(closeTo(h.world(i), expectedWorld(h, i)));
+			nodes.push_back(i);
+		}
+	}
+
+	const mat4 view = lookAt(vec3(1.0f, 2.0f, 10.0f), vec3(0.0f), vec3(0.0f, 1.0f, 0.0f));
+	const mat4 proj = perspective(radians(60.0f), 1.0f, 0.1f, 100.0f);
+	std::vector<ObjectMatrices> matrices(nodes.size());
+	h.computeViewMatrices(view, proj, nodes.data(), nodes.size(), matrices.data());
+	for(size_t i = 0; i < nodes.size(); i++) {
+		const mat4 mv = view * h.world(nodes[i]);
+		BOOST_CHECK(closeTo(matrices[i].modelview, mv));
+		BOOST_CHECK(closeTo(matrices[i].normal, mat4(transpose(inverse(mat3(mv))))));
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,81 @@
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include <glm/glm.hpp>
+
+#include "etc/sdl_gl_window.h"
+#include "gfx/graphicscontext.h"
+
+using namespace gfx;
+using glm::vec4;
+
+static const char* VERT_SHADER =
+		"in vec4 in_position;\n"
+		"void main() {\n"
+		"  gl_Position = in_position;\n"
+		"}\n";
+
+static const char* FRAG_SHADER =
+		"uniform vec4 u[2];\n"
+		"out vec4 fragcolor;\n"
+		"void main() {\n"
+		"  fragcolor = u[0] + u[1];\n"
+		"}\n";
+
+/*
+ * A program with a uniform array, reachable as "u", "u[0]" and "u[1]"
+ */
+struct ArrayProgram {
+	SDLGLWindow window;
+	GraphicsContext ctx;
+	ShaderProgramHandle program;
+
+	const vec4 a = vec4(1.0f, 2.0f, 3.0f, 4.0f);
+	const vec4 b = vec4(5.0f, 6.0f, 7.0f, 8.0f);
+
+	ArrayProgram() : window(64, 64) {
+		program = ctx.makeShaderProgramFromStrings(VERT_SHADER, FRAG_SHADER);
+		BOOST_REQUIRE(program->uniformLocation("u[1]") != -1);
+	}
+};
+
+BOOST_FIXTURE_TEST_CASE(AliasedNamesSeeEachOthersSets, ArrayProgram) {
+	program->setUniform("u[0]", a);
+	program->setUniform("u", b);
+	program->setUniform("u[0]", a);
+
+	BOOST_CHECK(program->getUniform<vec4>("u[0]") == a);
+	BOOST_CHECK_EQUAL(program->uniformStats().issued, 3u);
+	BOOST_CHECK_EQUAL(program->uniformStats().elided, 0u);
+
+	program->setUniform("u", a);
+	BOOST_CHECK_EQUAL(program->uniformStats().issued, 4u);
+	program->setUniform("u[0]", a);
+	program->setUniform("u[0]", a);
+	BOOST_CHECK_EQUAL(program->uniformStats().elided, 1u);
+}
+
+BOOST_FIXTURE_TEST_CASE(ArraySetCoversLaterElements, ArrayProgram) {
+	const vec4 values[2] = { b, b };
+	program->setUniform("u[1]", a);
+	program->setUniform("u", values[0], 2, false);
+	program->setUniform("u[1]", a);
+
+	BOOST_CHECK(program->getUniform<vec4>("u[1]") == a);
+	BOOST_CHECK_EQUAL(program->uniformStats().elided, 0u);
+}
+
+BOOST_FIXTURE_TEST_CASE(CommandBufferSetsForgetCopies, ArrayProgram) {
+	const vec4 values[2] = { b, b };
+	program->setUniform("u[1]", a);
+
+	CommandBufferHandle commands = ctx.makeCommandBuffer();
+	commands->setShaderProgram(program);
+	commands->setUniform(program->uniformLocation("u"), values, 2);
+	ctx.execute(commands);
+	BOOST_CHECK(program->getUniform<vec4>("u[1]") == b);
+
+	program->setUniform("u[1]", a);
+	BOOST_CHECK(program->getUniform<vec4>("u[1]") == a);
+}
@@ -0,0 +1,142 @@
+/*
+ * Preprocesses shaders with utils::ShaderPreprocessor and writes them as a
+ * C++ table of utils::EmbeddedShader, so the gfx library can build programs
+ * without reading shader files. Run from the source root, the paths given
+ * are the ones programs are asked for with.
+ *   embed_shaders output.cpp [-I includeDir]... shader...
+ */
+#include <stdio.h>
+
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "gfx/utils/shader_preprocessor.h"
+
+using namespace utils;
+
+// Same as utils::ProgramBinaryCache::hash(), which needs GL
+static uint64_t fnv1a(const std::string& s) {
+	uint64_t h = 14695981039346656037ull;
+	for(unsigned char c : s) {
+		h ^= c;
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+/*
+ * s as a sequence of string literals, one per line of s
+ */
+static std::string literal(const std::string& s, const char* indent) {
+	std::string ret = "\"";
+	for(size_t i = 0; i < s.size(); i++) {
+		const unsigned char c = s[i];
+		switch(c) {
+		case '\\':
+			ret += "\\\\";
+			break;
+		case '"':
+			ret += "\\\"";
+			break;
+		case '\n':
+			ret += "\\n\"";
+			if(i + 1 < s.size()) {
+				ret.append("\n").append(indent).append("\"");
+			}
+			continue;
+		case '\t':
+			ret += "\\t";
+			break;
+		default:
+			if(c < 0x20 || c >= 0x7f) {
+				char escaped[8];
+				snprintf(escaped, sizeof(escaped), "\\%03o", c);
+				ret += escaped;
+			} else {
+				ret += c;
+			}
+		}
+	}
+	if(s.empty() || s.back() != '\n') {
+		ret += "\"";
+	}
+	return ret;
+}
+
+int main(int argc, char** argv) {
+	if(argc < 2) {
+		fprintf(stderr, "Usage: %s output.cpp [-I includeDir]... shader...\n", argv[0]);
+		return 1;
+	}
+
+	ShaderPreprocessor preprocessor;
+	std::vector<std::string> shaders;
+	std::string includeDirs;
+	for(int i = 2; i < argc; i++) {
+		const std::string arg = argv[i];
+		if(arg == "-I" && i + 1 < argc) {
+			includeDirs.append(argv[++i]).append("\n");
+		} else if(arg.compare(0, 2, "-I") == 0) {
+			includeDirs.append(arg.substr(2)).append("\n");
+		} else {
+			shaders.push_back(arg);
+		}
+	}
+	std::istringstream dirs(includeDirs);
+	for(std::string dir; std::getline(dirs, dir);) {
+		preprocessor.addIncludeDir(dir);
+	}
+
+	std::ostringstream out;
+	out << "// Generated by tools/embed_shaders, do not edit\n"
+			"#include \"gfx/utils/embedded_shaders.h\"\n"
+			"\n"
+			"namespace utils {\n"
+			"\n"
+			"constexpr EmbeddedShader EMBEDDED_SHADERS[] = {\n";
+	for(const std::string& shader : shaders) {
+		PreprocessedShader flattened;
+		try {
+			flattened = preprocessor.preprocessFile(shader);
+		} catch(const std::runtime_error& e) {
+			fprintf(stderr, "%s: %s\n", shader.c_str(), e.what());
+			return 1;
+		}
+
+		std::string files;
+		for(const std::string& file : flattened.files) {
+			files.append(file).append("\n");
+		}
+
+		char hash[32];
+		snprintf(hash, sizeof(hash), "0x%016llxull", static_cast<unsigned long long>(fnv1a(flattened.source)));
+		out << "\t{\n"
+				"\t\t" << literal(shader, "\t\t") << ",\n"
+				"\t\t" << literal(flattened.source, "\t\t") << ",\n"
+				"\t\t" << flattened.source.size() << ", " << hash << ",\n"
+				"\t\t" << literal(files, "\t\t") << "\n"
+				"\t},\n";
+	}
+	out << "\t{ nullptr, nullptr, 0, 0, nullptr }\n"
+			"};\n"
+			"\n"
+			"const size_t NUM_EMBEDDED_SHADERS = " << shaders.size() << ";\n"
+			"\n"
+			"const char* const EMBEDDED_SHADER_INCLUDE_DIRS =\n"
+			"\t" << literal(includeDirs, "\t") << ";\n"
+			"\n"
+			"}\n";
+
+	const std::string output = argv[1];
+	std::ofstream file(output.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	file << out.str();
+	if(!file) {
+		fprintf(stderr, "Error writing %s\n", output.c_str());
+		return 1;
+	}
+	return 0;
+}